@@ -30,6 +30,10 @@
 #endif
 
 #define FILEXIO_IRX 0xb0b0b00
+/** Worker servers, started with FILEXIO_STARTWORKERS, are FILEXIO_WORKER_IRX + 0 to FILEXIO_MAX_WORKERS - 1.
+ * They only serve FILEXIO_READ, FILEXIO_WRITE and FILEXIO_LSEEK. */
+#define FILEXIO_WORKER_IRX 0xb0b0b10
+#define FILEXIO_MAX_WORKERS 4
 enum FILEXIO_CMDS {
     FILEXIO_DOPEN = 0x01,
     FILEXIO_DREAD,
@@ -62,7 +66,10 @@ enum FILEXIO_CMDS {
     FILEXIO_MKDIR,
     FILEXIO_REMOVE,
     FILEXIO_GETDEVICELIST,
-    FILEXIO_SETRWBUFFSIZE
+    FILEXIO_SETRWBUFFSIZE,
+    FILEXIO_SETRWBUFFCOUNT,
+    FILEXIO_GETRWSTATS,
+    FILEXIO_STARTWORKERS
 };
 
 /** Used for buffer alignment correction when reading data. */
@@ -294,4 +301,27 @@ struct fxio_rwbuff
     int size;
 };
 
+/** Read and write counters of the IOP side.
+ * Times are in microseconds and wrap around after about 71 minutes.
+ * Device time is spent reading from and writing to the device, SIF time waiting for
+ * transfers to and from the EE. When they overlap, their sum exceeds the total time.
+ */
+struct fileXioRWStats
+{
+    u32 reads;
+    u32 writes;
+    u32 read_bytes;
+    u32 write_bytes;
+    u32 read_device_usec;
+    u32 read_sif_usec;
+    u32 read_usec;
+    u32 write_device_usec;
+    u32 write_sif_usec;
+    u32 write_usec;
+    /** Size of each RW buffer */
+    u32 buffer_size;
+    /** Number of RW buffers */
+    u32 buffer_count;
+};
+
 #endif /* __FILEXIO_H__ */
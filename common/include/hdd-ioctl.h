@@ -218,7 +218,20 @@ typedef struct
 #define PDIOC_CLRFSCKSTAT 0x5005
 
 // Arbitrarily-named commands
-#define PDIOC_SHOWBITMAP 0xFF
+#define PDIOC_SHOWBITMAP   0xFF
+#define PDIOC_GETCACHESTAT 0xFE
+#define PDIOC_CLRCACHESTAT 0xFD
+
+/** Metadata cache counters, returned by PDIOC_GETCACHESTAT. */
+typedef struct
+{
+    u32 lookups;        /// cache lookups
+    u32 hits;           /// lookups served from the cache
+    u32 cleanEvictions; /// clean buffers reused
+    u32 dirtyEvictions; /// dirty buffers reused (forcing a flush)
+    u32 flushes;        /// journalled write-back batches
+    u32 blocksWritten;  /// dirty blocks written back
+} pfs_cache_stats_t;
 
 // I/O direction
 #define PFS_IO_MODE_READ  0x00
@@ -253,6 +266,8 @@ typedef struct
 #define PFS_DEVCTL_GET_STAT      PDIOC_GETFSCKSTAT
 #define PFS_DEVCTL_CLEAR_STAT    PDIOC_CLRFSCKSTAT
 
-#define PFS_DEVCTL_SHOW_BITMAP PDIOC_SHOWBITMAP
+#define PFS_DEVCTL_SHOW_BITMAP       PDIOC_SHOWBITMAP
+#define PFS_DEVCTL_GET_CACHE_STAT    PDIOC_GETCACHESTAT
+#define PFS_DEVCTL_CLEAR_CACHE_STAT  PDIOC_CLRCACHESTAT
 
 #endif /* __HDD_IOCTL_H__ */
@@ -12,6 +12,7 @@
 #define NETMAN_NETIF_NAME_MAX_LEN 4
 #define NETMAN_NETIF_FRAME_SIZE   1514
 #define NETMAN_FRAME_GROUP_SIZE   8 // The actual number of DMA transfer tags is twice this. The total number presented to sceSifSetDma must never exceed 32.
+#define NETMAN_FRAME_GROUP_MAX    16 // Largest Rx frame group the IOP can send to the EE at once (32 DMA transfer tags).
 
 struct NetManNetProtStack
 {
@@ -49,6 +50,37 @@ struct NetManEthStatus
     struct NetManEthRuntimeStats stats;
 };
 
+/** Grouping of received frames before they are sent from the IOP to the EE network stack.
+    Times are in IOP clock ticks (36864 per millisecond). */
+struct NetManRxCoalesceParams
+{
+    /** A group is sent once it has this many frames (1 - NETMAN_FRAME_GROUP_MAX). */
+    u16 MaxFrames;
+    /** If non-zero, the time to wait for further frames follows the measured arrival rate,
+        and frames that arrive far apart are sent right away. Otherwise MaxHold is always waited for. */
+    u16 Adaptive;
+    /** Shortest time to wait for a further frame. Used by the adaptive mode only. */
+    u32 MinHold;
+    /** Longest time to wait for a further frame. */
+    u32 MaxHold;
+};
+
+struct NetManRxCoalesceStats
+{
+    u32 Frames;
+    u32 Groups;
+    /** Groups sent because MaxFrames was reached. */
+    u32 FullGroups;
+    /** Groups sent because no further frame arrived in time. */
+    u32 TimedGroups;
+    /** Groups sent right away, because frames were arriving too far apart. */
+    u32 ImmediateGroups;
+    /** Current estimate of the time between two frames. */
+    u32 FrameInterval;
+    /** Current time to wait for a further frame. */
+    u32 HoldTime;
+};
+
 /** Flow-control */
 #define NETMAN_NETIF_ETH_LINK_DISABLE_PAUSE 0x40
 
@@ -99,6 +131,14 @@ enum NETMAN_NETIF_IOCTL_CODES {
     NETMAN_NETIF_IOCTL_GET_LINK_STATUS = 0x3000,
     NETMAN_NETIF_IOCTL_GET_TX_DROPPED_COUNT,
     NETMAN_NETIF_IOCTL_GET_RX_DROPPED_COUNT,
+
+    // NETMAN IOCTL codes, for the Rx path to the EE network stack. Do not require an I/F.
+    /** Input = struct NetManRxCoalesceParams. */
+    NETMAN_NETIF_IOCTL_SET_RX_COALESCE = 0x4000,
+    /** Output = struct NetManRxCoalesceParams. */
+    NETMAN_NETIF_IOCTL_GET_RX_COALESCE,
+    /** Output = struct NetManRxCoalesceStats. Input (optional) = int, non-zero to reset the statistics. */
+    NETMAN_NETIF_IOCTL_GET_RX_COALESCE_STATS,
 };
 
 //*** Higher-level services, for the running user program ***
@@ -0,0 +1,92 @@
+/*
+# _____     ___ ____     ___ ____
+#  ____|   |    ____|   |        | |____|
+# |     ___|   |____ ___|    ____| |    \    PS2DEV Open Source Project.
+#-----------------------------------------------------------------------
+# Copyright ps2dev - http://www.ps2dev.org
+# Licenced under Academic Free License version 2.0
+# Review ps2sdk README & LICENSE files for further details.
+*/
+
+/**
+ * @file
+ * Decompressor for the LZ4 block format, as produced by bin2c, bin2o and bin2s -z.
+ * Usable on both the EE and the IOP.
+ */
+
+#ifndef __UNLZ4_H__
+#define __UNLZ4_H__
+
+#include <tamtypes.h>
+
+/** Reads an LZ4 length extension: bytes of 255 followed by a final byte.
+ * Returns 0 if the input ends first.
+ */
+static inline int _unlz4_length(const u8 **ip, const u8 *iend, unsigned int *len)
+{
+    unsigned int b;
+
+    do {
+        if (*ip >= iend)
+            return 0;
+        b = *(*ip)++;
+        *len += b;
+    } while (b == 255);
+
+    return 1;
+}
+
+/** Decompresses an LZ4 block.
+ * @param src Compressed data.
+ * @param src_size Size of the compressed data, in bytes.
+ * @param dst Buffer for the decompressed data. It must not overlap src.
+ * @param dst_size Size of dst, in bytes.
+ * @return The size of the decompressed data, or -1 if the input is corrupt or does not fit into dst.
+ */
+static inline int unlz4(const void *src, unsigned int src_size, void *dst, unsigned int dst_size)
+{
+    const u8 *ip = (const u8 *)src, *iend = ip + src_size;
+    u8 *op = (u8 *)dst, *oend = op + dst_size;
+
+    while (ip < iend) {
+        unsigned int token = *ip++, len, offset;
+        const u8 *match;
+
+        // Literals
+        len = token >> 4;
+        if (len == 15 && !_unlz4_length(&ip, iend, &len))
+            return -1;
+        if (len > (unsigned int)(iend - ip) || len > (unsigned int)(oend - op))
+            return -1;
+        while (len-- > 0)
+            *op++ = *ip++;
+
+        // The last sequence has no match
+        if (ip >= iend)
+            break;
+
+        // Match
+        if (iend - ip < 2)
+            return -1;
+        offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > (unsigned int)(op - (u8 *)dst))
+            return -1;
+
+        len = token & 15;
+        if (len == 15 && !_unlz4_length(&ip, iend, &len))
+            return -1;
+        len += 4;
+        if (len > (unsigned int)(oend - op))
+            return -1;
+
+        // Byte by byte, as the match may overlap the output
+        match = op - offset;
+        while (len-- > 0)
+            *op++ = *match++;
+    }
+
+    return op - (u8 *)dst;
+}
+
+#endif /* __UNLZ4_H__ */
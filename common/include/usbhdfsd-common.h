@@ -22,6 +22,26 @@ typedef struct bd_fragment {
     u32 count;  /// number of sector in this fragment
 } __attribute__((packed)) bd_fragment_t;
 
+typedef struct bd_cache_stats {
+    u32 block_count;       /// number of cache blocks
+    u32 sectors_per_block; /// sectors per cache block
+    u32 hits;              /// block lookups served from the cache
+    u32 misses;            /// block lookups that had to read the device
+    u32 evictions;         /// blocks dropped from the cache
+    u32 promotions;        /// re-used blocks promoted to the protected queue
+    u32 direct_sectors;    /// sectors read around the cache (large reads)
+    u32 write_updates;     /// cached blocks updated by writes
+} bd_cache_stats_t;
+
+typedef struct fs_readahead_stats {
+    u32 size;         /// read-ahead buffer size in bytes, 0 if disabled
+    u32 reads;        /// read calls on read-ahead enabled files
+    u32 fills;        /// read-ahead buffer refills
+    u32 fill_bytes;   /// bytes prefetched into read-ahead buffers
+    u32 hit_bytes;    /// bytes served from read-ahead buffers
+    u32 direct_bytes; /// bytes read around the read-ahead buffers
+} fs_readahead_stats_t;
+
 // IOCTL function codes
 /** Rename opened file. Data input to ioctl() -> new, full filename of file. */
 #define USBMASS_IOCTL_RENAME         0x0000
@@ -41,6 +61,14 @@ typedef struct bd_fragment {
 #define USBMASS_DEVCTL_STOP_UNIT 0x0000
 /** Issues the SCSI STOP UNIT command too all devices. Use this to shut down devices properly. */
 #define USBMASS_DEVCTL_STOP_ALL  0x0001
+/** Returns the block cache counters (bd_cache_stats_t) of the device. */
+#define USBMASS_DEVCTL_GET_CACHE_STATS   0x0002
+/** Clears the block cache counters of the device. */
+#define USBMASS_DEVCTL_RESET_CACHE_STATS 0x0003
+/** Returns the read-ahead counters (fs_readahead_stats_t) of the filesystem driver. */
+#define USBMASS_DEVCTL_GET_READAHEAD_STATS   0x0004
+/** Clears the read-ahead counters of the filesystem driver. */
+#define USBMASS_DEVCTL_RESET_READAHEAD_STATS 0x0005
 
 // Device status bits.
 /** CONNected */
@@ -16,6 +16,7 @@
 #include <draw_primitives.h>
 #include <draw_sampling.h>
 #include <draw_tests.h>
+#include <draw_texcache.h>
 #include <draw_types.h>
 
 #include <draw2d.h>
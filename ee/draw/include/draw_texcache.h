@@ -0,0 +1,102 @@
+/**
+ * @file
+ * Draw library texture cache
+ *
+ * Keeps textures resident in vram between frames and only uploads the ones
+ * that aren't, evicting the least recently used ones when vram runs out.
+ * vram is allocated with graph_vram_allocate(), so link with libgraph.
+ *
+ * Every frame:
+ * - draw_texcache_use() for each texture drawn, before drawing with it
+ * - draw_texcache_upload() to build the dma chain of the uploads, to be sent
+ *   before the drawing of the frame
+ * - draw_texcache_next_frame() once the frame is built
+ *
+ * Textures used in the current frame are never evicted.
+ */
+
+#ifndef __DRAW_TEXCACHE_H__
+#define __DRAW_TEXCACHE_H__
+
+#include <tamtypes.h>
+
+#include <draw_buffers.h>
+
+typedef struct draw_texcache draw_texcache_t;
+
+typedef struct {
+	/** Current frame */
+	unsigned int frame;
+	/** Textures uploaded in the last frame */
+	unsigned int uploads;
+	/** Bytes uploaded in the last frame */
+	unsigned int bytes;
+	/** Textures used in the last frame that were already resident */
+	unsigned int hits;
+	/** Textures used in the last frame that had to be uploaded */
+	unsigned int misses;
+	/** Textures evicted in the last frame */
+	unsigned int evictions;
+	/** Uses that failed in the last frame, for lack of vram */
+	unsigned int failures;
+	/** Bytes uploaded since the cache was created */
+	unsigned int total_bytes;
+	/** Textures resident and the vram words they use */
+	unsigned int resident;
+	unsigned int resident_words;
+} draw_texcache_stats_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Creates a cache for up to max_textures textures
+ * The cache doesn't use more than max_words words of vram, 0 for no limit.
+ */
+draw_texcache_t *draw_texcache_init(int max_textures, int max_words);
+
+/** Frees the vram of the resident textures and the cache */
+void draw_texcache_free(draw_texcache_t *cache);
+
+/** Registers a texture and returns its handle, or -1
+ * The texture and CLUT data must stay valid and qword aligned while registered.
+ * The CLUT, NULL if none, is uploaded as is (8x2 or 16x16).
+ * Z buffer formats aren't supported.
+ */
+int draw_texcache_register(draw_texcache_t *cache, void *texture, int width, int height, int psm, void *clut, int clut_psm);
+
+/** Unregisters a texture and frees its vram */
+void draw_texcache_unregister(draw_texcache_t *cache, int handle);
+
+/** Uploads a texture again the next time it's used, after its data changed */
+void draw_texcache_invalidate(draw_texcache_t *cache, int handle);
+
+/** Forgets all resident textures and frees their vram */
+void draw_texcache_clear(draw_texcache_t *cache);
+
+/** Makes a texture resident for the current frame
+ * Fills in the address, width and psm of texbuf and the texture size in its info,
+ * and the address and psm of clut if the texture has a CLUT (clut can be NULL otherwise).
+ * Returns -1 if the texture doesn't fit in vram with the ones used in this frame.
+ */
+int draw_texcache_use(draw_texcache_t *cache, int handle, texbuffer_t *texbuf, clutbuffer_t *clut);
+
+/** Returns the number of qwords draw_texcache_upload() needs */
+int draw_texcache_upload_size(draw_texcache_t *cache);
+
+/** Builds a single dma chain with the pending uploads, followed by a texture flush
+ * Returns q unchanged if there is nothing to upload.
+ */
+qword_t *draw_texcache_upload(draw_texcache_t *cache, qword_t *q);
+
+/** Ends the current frame */
+void draw_texcache_next_frame(draw_texcache_t *cache);
+
+/** Fills in the counters of the last frame */
+void draw_texcache_get_stats(draw_texcache_t *cache, draw_texcache_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __DRAW_TEXCACHE_H__ */
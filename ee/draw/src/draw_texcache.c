@@ -0,0 +1,683 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include <gif_tags.h>
+#include <gs_psm.h>
+
+#include <graph_vram.h>
+
+#include <draw.h>
+#include <draw_texcache.h>
+
+struct draw_texcache_entry
+{
+	void *texture;
+	void *clut;
+	short width;
+	short height;
+	/** Buffer width in pixels */
+	short buffer_width;
+	unsigned char psm;
+	unsigned char clut_psm;
+	/** vram words of the texture and of its CLUT */
+	int words;
+	int clut_words;
+	/** vram addresses, -1 when not resident */
+	int address;
+	int clut_address;
+	unsigned int last_frame;
+	unsigned char registered;
+	unsigned char queued;
+	unsigned char dirty;
+	/** Resident textures, most recently used first */
+	short prev;
+	short next;
+};
+
+struct draw_texcache
+{
+	struct draw_texcache_entry *entries;
+	short *queue;
+	int max_textures;
+	int max_words;
+	int queued;
+	short lru_head;
+	short lru_tail;
+	unsigned int frame;
+	draw_texcache_stats_t current;
+	draw_texcache_stats_t last;
+};
+
+// Block arrangement in a page, in row order
+static const unsigned char block_32[32] =
+{
+	 0,  1,  4,  5, 16, 17, 20, 21,
+	 2,  3,  6,  7, 18, 19, 22, 23,
+	 8,  9, 12, 13, 24, 25, 28, 29,
+	10, 11, 14, 15, 26, 27, 30, 31
+};
+
+static const unsigned char block_16[32] =
+{
+	 0,  2,  8, 10,
+	 1,  3,  9, 11,
+	 4,  6, 12, 14,
+	 5,  7, 13, 15,
+	16, 18, 24, 26,
+	17, 19, 25, 27,
+	20, 22, 28, 30,
+	21, 23, 29, 31
+};
+
+static const unsigned char block_16s[32] =
+{
+	 0,  2, 16, 18,
+	 1,  3, 17, 19,
+	 8, 10, 24, 26,
+	 9, 11, 25, 27,
+	 4,  6, 20, 22,
+	 5,  7, 21, 23,
+	12, 14, 28, 30,
+	13, 15, 29, 31
+};
+
+// Words of vram a texture spans from its base pointer. Smaller than a page,
+// its blocks aren't contiguous, e.g. a 64x8 32-bit texture spans 22 blocks.
+static int texcache_footprint(int width, int height, int psm, int buffer_width)
+{
+
+	const unsigned char *table;
+
+	int page_width, page_height;
+	int block_width, block_height;
+	int columns;
+	int x, y;
+	int max = 0;
+
+	switch (psm)
+	{
+
+		case GS_PSM_32:
+		case GS_PSM_24:
+		case GS_PSM_8H:
+		case GS_PSM_4HL:
+		case GS_PSM_4HH:	table = block_32; page_width = 64; page_height = 32; block_width = 8; block_height = 8; columns = 8; break;
+		case GS_PSM_16:		table = block_16; page_width = 64; page_height = 64; block_width = 16; block_height = 8; columns = 4; break;
+		case GS_PSM_16S:	table = block_16s; page_width = 64; page_height = 64; block_width = 16; block_height = 8; columns = 4; break;
+		case GS_PSM_8:		table = block_32; page_width = 128; page_height = 64; block_width = 16; block_height = 16; columns = 8; break;
+		case GS_PSM_4:		table = block_16; page_width = 128; page_height = 128; block_width = 32; block_height = 16; columns = 4; break;
+		default: return 0;
+
+	}
+
+	for (y = 0; y < height; y += block_height)
+	{
+
+		for (x = 0; x < width; x += block_width)
+		{
+
+			int page = ((y / page_height) * (buffer_width / page_width)) + (x / page_width);
+			int block = (page * 32) + table[(((y % page_height) / block_height) * columns) + ((x % page_width) / block_width)];
+
+			if (block > max)
+			{
+				max = block;
+			}
+
+		}
+
+	}
+
+	return (max + 1) * GRAPH_ALIGN_BLOCK;
+
+}
+
+// Same sizes as draw_texture_transfer()
+static int texcache_qwords(int width, int height, int psm)
+{
+
+	switch (psm)
+	{
+
+		case GS_PSM_32:
+		case GS_PSM_24:		return (width*height)>>2;
+		case GS_PSM_16:
+		case GS_PSM_16S:	return (width*height)>>3;
+		case GS_PSM_8:
+		case GS_PSM_8H:		return (width*height)>>4;
+		case GS_PSM_4:
+		case GS_PSM_4HL:
+		case GS_PSM_4HH:	return (width*height)>>5;
+		default: return 0;
+
+	}
+
+}
+
+// Size of the dma chain draw_texture_transfer() builds
+static int texcache_transfer_size(int qwords)
+{
+
+	return 6 + (3 * ((qwords + GIF_BLOCK_SIZE - 1) / GIF_BLOCK_SIZE));
+
+}
+
+static int texcache_clut_width(struct draw_texcache_entry *entry)
+{
+
+	return (entry->psm == GS_PSM_8 || entry->psm == GS_PSM_8H) ? 16 : 8;
+
+}
+
+static int texcache_clut_height(struct draw_texcache_entry *entry)
+{
+
+	return (entry->psm == GS_PSM_8 || entry->psm == GS_PSM_8H) ? 16 : 2;
+
+}
+
+static void texcache_unlink(draw_texcache_t *cache, int handle)
+{
+
+	struct draw_texcache_entry *entry = &cache->entries[handle];
+
+	if (entry->prev >= 0)
+		cache->entries[entry->prev].next = entry->next;
+	else
+		cache->lru_head = entry->next;
+
+	if (entry->next >= 0)
+		cache->entries[entry->next].prev = entry->prev;
+	else
+		cache->lru_tail = entry->prev;
+
+}
+
+static void texcache_link(draw_texcache_t *cache, int handle)
+{
+
+	struct draw_texcache_entry *entry = &cache->entries[handle];
+
+	entry->prev = -1;
+	entry->next = cache->lru_head;
+
+	if (cache->lru_head >= 0)
+		cache->entries[cache->lru_head].prev = handle;
+	else
+		cache->lru_tail = handle;
+
+	cache->lru_head = handle;
+
+}
+
+static void texcache_dequeue(draw_texcache_t *cache, int handle)
+{
+
+	int i;
+
+	for (i = 0; i < cache->queued; i++)
+	{
+
+		if (cache->queue[i] == handle)
+		{
+
+			cache->queued--;
+			memmove(&cache->queue[i], &cache->queue[i + 1], (cache->queued - i) * sizeof(short));
+			break;
+
+		}
+
+	}
+
+	cache->entries[handle].queued = 0;
+
+}
+
+static void texcache_evict(draw_texcache_t *cache, int handle)
+{
+
+	struct draw_texcache_entry *entry = &cache->entries[handle];
+
+	if (entry->address < 0)
+	{
+		return;
+	}
+
+	if (entry->queued)
+	{
+		texcache_dequeue(cache, handle);
+	}
+
+	texcache_unlink(cache, handle);
+
+	graph_vram_free(entry->address);
+
+	if (entry->clut_address >= 0)
+	{
+		graph_vram_free(entry->clut_address);
+	}
+
+	entry->address = -1;
+	entry->clut_address = -1;
+
+	cache->current.resident--;
+	cache->current.resident_words -= entry->words + entry->clut_words;
+
+}
+
+// Evicts the least recently used texture, if it wasn't used in this frame
+static int texcache_evict_lru(draw_texcache_t *cache)
+{
+
+	int handle = cache->lru_tail;
+
+	if (handle < 0 || cache->entries[handle].last_frame == cache->frame)
+	{
+		return -1;
+	}
+
+	texcache_evict(cache, handle);
+	cache->current.evictions++;
+
+	return 0;
+
+}
+
+// vram is allocated by size only: the footprint isn't width*height
+static int texcache_allocate(int words)
+{
+
+	return graph_vram_allocate(words, 1, GS_PSM_32, GRAPH_ALIGN_BLOCK);
+
+}
+
+static int texcache_make_resident(draw_texcache_t *cache, int handle)
+{
+
+	struct draw_texcache_entry *entry = &cache->entries[handle];
+
+	int words = entry->words + entry->clut_words;
+
+	if (cache->max_words > 0)
+	{
+
+		while (cache->current.resident_words + words > (unsigned int)cache->max_words)
+		{
+
+			if (texcache_evict_lru(cache) < 0)
+			{
+				return -1;
+			}
+
+		}
+
+	}
+
+	while ((entry->address = texcache_allocate(entry->words)) < 0)
+	{
+
+		if (texcache_evict_lru(cache) < 0)
+		{
+			return -1;
+		}
+
+	}
+
+	if (entry->clut != NULL)
+	{
+
+		while ((entry->clut_address = texcache_allocate(entry->clut_words)) < 0)
+		{
+
+			if (texcache_evict_lru(cache) < 0)
+			{
+
+				graph_vram_free(entry->address);
+				entry->address = -1;
+
+				return -1;
+
+			}
+
+		}
+
+	}
+
+	texcache_link(cache, handle);
+
+	cache->current.resident++;
+	cache->current.resident_words += words;
+
+	return 0;
+
+}
+
+draw_texcache_t *draw_texcache_init(int max_textures, int max_words)
+{
+
+	draw_texcache_t *cache;
+
+	if (max_textures <= 0 || max_textures > 0x7fff)
+	{
+		return NULL;
+	}
+
+	cache = (draw_texcache_t*)malloc(sizeof(draw_texcache_t));
+
+	if (cache == NULL)
+	{
+		return NULL;
+	}
+
+	memset(cache, 0, sizeof(draw_texcache_t));
+
+	cache->entries = (struct draw_texcache_entry*)malloc(max_textures * sizeof(struct draw_texcache_entry));
+	cache->queue = (short*)malloc(max_textures * sizeof(short));
+
+	if (cache->entries == NULL || cache->queue == NULL)
+	{
+
+		free(cache->entries);
+		free(cache->queue);
+		free(cache);
+
+		return NULL;
+
+	}
+
+	memset(cache->entries, 0, max_textures * sizeof(struct draw_texcache_entry));
+
+	cache->max_textures = max_textures;
+	cache->max_words = max_words;
+	cache->lru_head = -1;
+	cache->lru_tail = -1;
+	cache->frame = 1;
+
+	return cache;
+
+}
+
+void draw_texcache_free(draw_texcache_t *cache)
+{
+
+	if (cache == NULL)
+	{
+		return;
+	}
+
+	draw_texcache_clear(cache);
+
+	free(cache->entries);
+	free(cache->queue);
+	free(cache);
+
+}
+
+int draw_texcache_register(draw_texcache_t *cache, void *texture, int width, int height, int psm, void *clut, int clut_psm)
+{
+
+	struct draw_texcache_entry *entry;
+
+	int buffer_width;
+	int handle;
+
+	if (texture == NULL || width <= 0 || height <= 0 || width > 1024 || height > 1024 || texcache_qwords(width, height, psm) == 0)
+	{
+		return -1;
+	}
+
+	for (handle = 0; handle < cache->max_textures; handle++)
+	{
+
+		if (!cache->entries[handle].registered)
+		{
+			break;
+		}
+
+	}
+
+	if (handle == cache->max_textures)
+	{
+		return -1;
+	}
+
+	// 4-bit and 8-bit buffer widths have to be even
+	if (psm == GS_PSM_4 || psm == GS_PSM_8)
+	{
+		buffer_width = -128 & (width + 127);
+	}
+	else
+	{
+		buffer_width = -64 & (width + 63);
+	}
+
+	entry = &cache->entries[handle];
+
+	memset(entry, 0, sizeof(struct draw_texcache_entry));
+
+	entry->texture = texture;
+	entry->width = width;
+	entry->height = height;
+	entry->buffer_width = buffer_width;
+	entry->psm = psm;
+	entry->words = texcache_footprint(width, height, psm, buffer_width);
+	entry->address = -1;
+	entry->clut_address = -1;
+	entry->prev = -1;
+	entry->next = -1;
+
+	if (clut != NULL)
+	{
+
+		entry->clut = clut;
+		entry->clut_psm = clut_psm;
+		entry->clut_words = texcache_footprint(texcache_clut_width(entry), texcache_clut_height(entry), clut_psm, 64);
+
+	}
+
+	entry->registered = 1;
+
+	return handle;
+
+}
+
+void draw_texcache_unregister(draw_texcache_t *cache, int handle)
+{
+
+	if (handle < 0 || handle >= cache->max_textures || !cache->entries[handle].registered)
+	{
+		return;
+	}
+
+	texcache_evict(cache, handle);
+
+	cache->entries[handle].registered = 0;
+
+}
+
+void draw_texcache_invalidate(draw_texcache_t *cache, int handle)
+{
+
+	if (handle < 0 || handle >= cache->max_textures || !cache->entries[handle].registered)
+	{
+		return;
+	}
+
+	cache->entries[handle].dirty = 1;
+
+}
+
+void draw_texcache_clear(draw_texcache_t *cache)
+{
+
+	while (cache->lru_head >= 0)
+	{
+		texcache_evict(cache, cache->lru_head);
+	}
+
+	cache->queued = 0;
+
+}
+
+int draw_texcache_use(draw_texcache_t *cache, int handle, texbuffer_t *texbuf, clutbuffer_t *clut)
+{
+
+	struct draw_texcache_entry *entry;
+
+	if (handle < 0 || handle >= cache->max_textures || !cache->entries[handle].registered)
+	{
+		return -1;
+	}
+
+	entry = &cache->entries[handle];
+
+	if (entry->address >= 0)
+	{
+
+		texcache_unlink(cache, handle);
+		texcache_link(cache, handle);
+
+		if (entry->last_frame != cache->frame)
+		{
+			cache->current.hits++;
+		}
+
+	}
+	else
+	{
+
+		if (texcache_make_resident(cache, handle) < 0)
+		{
+
+			cache->current.failures++;
+			return -1;
+
+		}
+
+		entry->dirty = 1;
+		cache->current.misses++;
+
+	}
+
+	if (entry->dirty && !entry->queued)
+	{
+
+		cache->queue[cache->queued++] = handle;
+		entry->queued = 1;
+
+	}
+
+	entry->dirty = 0;
+	entry->last_frame = cache->frame;
+
+	texbuf->address = entry->address;
+	texbuf->width = entry->buffer_width;
+	texbuf->psm = entry->psm;
+	texbuf->info.width = draw_log2(entry->width);
+	texbuf->info.height = draw_log2(entry->height);
+
+	if (clut != NULL && entry->clut != NULL)
+	{
+
+		clut->address = entry->clut_address;
+		clut->psm = entry->clut_psm;
+
+	}
+
+	return 0;
+
+}
+
+int draw_texcache_upload_size(draw_texcache_t *cache)
+{
+
+	int i;
+	int size = 0;
+
+	for (i = 0; i < cache->queued; i++)
+	{
+
+		struct draw_texcache_entry *entry = &cache->entries[cache->queue[i]];
+
+		size += texcache_transfer_size(texcache_qwords(entry->width, entry->height, entry->psm));
+
+		if (entry->clut != NULL)
+		{
+			size += texcache_transfer_size(texcache_qwords(texcache_clut_width(entry), texcache_clut_height(entry), entry->clut_psm));
+		}
+
+	}
+
+	// The texture flush ends the chain
+	return size ? size + 3 : 0;
+
+}
+
+qword_t *draw_texcache_upload(draw_texcache_t *cache, qword_t *q)
+{
+
+	int i;
+
+	if (cache->queued == 0)
+	{
+		return q;
+	}
+
+	for (i = 0; i < cache->queued; i++)
+	{
+
+		struct draw_texcache_entry *entry = &cache->entries[cache->queue[i]];
+
+		q = draw_texture_transfer(q, entry->texture, entry->width, entry->height, entry->psm, entry->address, entry->buffer_width);
+		cache->current.bytes += texcache_qwords(entry->width, entry->height, entry->psm) * 16;
+
+		if (entry->clut != NULL)
+		{
+
+			q = draw_texture_transfer(q, entry->clut, texcache_clut_width(entry), texcache_clut_height(entry), entry->clut_psm, entry->clut_address, 64);
+			cache->current.bytes += texcache_qwords(texcache_clut_width(entry), texcache_clut_height(entry), entry->clut_psm) * 16;
+
+		}
+
+		entry->queued = 0;
+		cache->current.uploads++;
+
+	}
+
+	cache->queued = 0;
+
+	q = draw_texture_flush(q);
+
+	return q;
+
+}
+
+void draw_texcache_next_frame(draw_texcache_t *cache)
+{
+
+	cache->current.total_bytes += cache->current.bytes;
+
+	cache->last = cache->current;
+
+	cache->current.uploads = 0;
+	cache->current.bytes = 0;
+	cache->current.hits = 0;
+	cache->current.misses = 0;
+	cache->current.evictions = 0;
+	cache->current.failures = 0;
+
+	cache->frame++;
+
+}
+
+void draw_texcache_get_stats(draw_texcache_t *cache, draw_texcache_stats_t *stats)
+{
+
+	*stats = cache->last;
+
+	stats->frame = cache->frame;
+	stats->total_bytes = cache->current.total_bytes;
+	stats->resident = cache->current.resident;
+	stats->resident_words = cache->current.resident_words;
+
+}
@@ -16,5 +16,6 @@ char * erl_id = "libdraw";
 char * erl_dependancies[] = {
 	"libc",
 	"libmf",
+	"libgraph",
     0
 };
@@ -44,6 +44,30 @@ struct symbol_t {
     u32 address;
 };
 
+/** Load statistics, accumulated over all the erl files loaded.
+ * Times are in cpu_ticks() units.
+ */
+struct erl_load_stats_t {
+    /** erl files loaded */
+    u32 loads;
+    /** erl files loaded thru their prelink index */
+    u32 prelinked;
+    /** Relocations applied */
+    u32 relocs;
+    /** Relocations left pending on a symbol that isn't loaded yet */
+    u32 loosy;
+    /** Reading the headers and the symbol/relocation tables */
+    u64 parse_time;
+    /** Reading the code and data sections */
+    u64 read_time;
+    /** Resolving symbols and applying relocations */
+    u64 reloc_time;
+    /** Exporting symbols */
+    u64 export_time;
+    /** Loading the dependancies and running _init and _start */
+    u64 init_time;
+};
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -81,6 +105,8 @@ struct symbol_t * erl_find_symbol(const char * symbol);
 
 void erl_flush_symbols(struct erl_record_t * erl);
 
+void erl_get_load_stats(struct erl_load_stats_t * stats, int reset);
+
 #ifdef __cplusplus
 }
 #endif
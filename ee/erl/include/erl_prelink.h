@@ -0,0 +1,99 @@
+/*
+# _____     ___ ____     ___ ____
+#  ____|   |    ____|   |        | |____|
+# |     ___|   |____ ___|    ____| |    \    PS2DEV Open Source Project.
+#-----------------------------------------------------------------------
+# Copyright 2001-2004, ps2dev - http://www.ps2dev.org
+# Licenced under Academic Free License version 2.0
+# Review ps2sdk README & LICENSE files for further details.
+*/
+
+/**
+ * @file
+ * Layout of the prelink index, written into ERL files by the erl-prelink tool.
+ *
+ * The index is stored as the last section of the ERL. It lists the symbols
+ * the ERL imports and exports, with their name hashes precomputed, and all of
+ * its relocations in section/offset order, so that the loader doesn't have to
+ * read the symbol and relocation tables nor look names up for every
+ * relocation. All fields are little endian.
+ *
+ * The section is laid out as: header, imports, exports, relocations, strings.
+ */
+
+#ifndef __ERL_PRELINK_H__
+#define __ERL_PRELINK_H__
+
+#include <stdint.h>
+
+/** Section type of the prelink index (in the SHT_LOUSER range) */
+#define ERL_PRELINK_SHT     0x8045524c
+/** Section name of the prelink index */
+#define ERL_PRELINK_NAME    ".erl.prelink"
+/** "ERLP" */
+#define ERL_PRELINK_MAGIC   0x504c5245
+#define ERL_PRELINK_VERSION 1
+
+struct erl_prelink_header_t {
+    uint32_t magic;
+    uint16_t version;
+    /** e_shnum of the ERL the index was built for, the index included */
+    uint16_t shnum;
+    uint32_t nimports;
+    uint32_t nexports;
+    uint32_t nrelocs;
+    /** Size of the string pool, which ends with a NUL */
+    uint32_t strsize;
+};
+
+/** Symbol is absolute: value isn't relative to a section */
+#define ERL_PRELINK_ABS 1
+
+struct erl_prelink_symbol_t {
+    /** Offset of the name in the string pool */
+    uint32_t name;
+    /** erl_hash() of the name */
+    uint32_t hash;
+    /** Offset in the section for defined symbols, 0 otherwise */
+    uint32_t value;
+    /** Section of defined symbols, 0 otherwise */
+    uint16_t section;
+    uint16_t flags;
+};
+
+/** Relocation against section + value */
+#define ERL_PRELINK_SECTION 0
+/** Relocation against an undefined symbol: imports[target] */
+#define ERL_PRELINK_IMPORT  1
+/** Relocation against a symbol this ERL defines, unless some other ERL already exports it */
+#define ERL_PRELINK_SYMBOL  2
+
+struct erl_prelink_reloc_t {
+    /** Offset of the relocated word in its section */
+    uint32_t offset;
+    /** ERL_PRELINK_SECTION: offset in the target section */
+    uint32_t value;
+    /** Section of the relocated word */
+    uint16_t section;
+    /** Target section or import index, depending on kind */
+    uint16_t target;
+    /** R_MIPS_* */
+    uint8_t type;
+    uint8_t kind;
+    uint16_t reserved;
+};
+
+/** Hash of a symbol name (32-bit FNV-1a), used by both the loader and the prelinker. */
+static inline uint32_t erl_hash(const char *name)
+{
+    uint32_t hash = 0x811c9dc5;
+
+    while (*name) {
+        hash ^= (uint8_t)*name++;
+        hash *= 0x01000193;
+    }
+
+    return hash;
+}
+
+#endif /* __ERL_PRELINK_H__ */
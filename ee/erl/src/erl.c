@@ -50,6 +50,7 @@
 #endif
 
 #include <erl.h>
+#include <erl_prelink.h>
 
 #include <hashtab.h>
 #include <recycle.h>
@@ -59,13 +60,17 @@
 #ifdef _EE
 #include <tamtypes.h>
 #include <kernel.h>
+#include <timer.h>
+#define erl_ticks() cpu_ticks()
 #else
+#include <time.h>
 typedef unsigned char u8;
 typedef unsigned short u16;
 typedef unsigned int u32;
 typedef signed char s8;
 typedef signed short s16;
 typedef signed int s32;
+#define erl_ticks() ((u32) clock())
 #endif
 
 #ifdef DEBUG
@@ -188,6 +193,7 @@ static char * reloc_types[] = {
 #define PROGBITS 1
 #define NOBITS 8
 #define REL 9
+#define LOCAL 0
 #define GLOBAL 1
 #define WEAK 2
 #define NOTYPE 0
@@ -271,6 +277,15 @@ struct dependancy_t {
     struct dependancy_t * next, * prev;
 };
 
+/* Exported symbols are also linked into a single hash index, keyed by name,
+   so that a lookup doesn't have to go thru the table of every loaded erl. */
+struct symbol_entry_t {
+    struct symbol_t symbol;
+    struct symbol_entry_t * next;
+    char * name;
+    u32 hash;
+};
+
 
 /* And our global variables. */
 static struct erl_record_t * erl_record_root = 0;
@@ -282,6 +297,11 @@ char _init_erl_prefix[256] = "";
 
 static struct dependancy_t * dependancy_root = 0;
 
+static struct symbol_entry_t ** symbol_index = 0;
+static u32 symbol_index_size = 0, symbol_index_count = 0;
+
+static struct erl_load_stats_t load_stats;
+
 
 static u32 align(u32 x, int align) {
 #ifdef FORCE_ALIGN
@@ -329,23 +349,93 @@ static void r_destroy_loosy(struct loosy_t * l) {
 static reroot * symbol_recycle = 0;
 
 static struct symbol_t * create_symbol(struct erl_record_t * provider, u32 address) {
-    struct symbol_t * r;
+    struct symbol_entry_t * r;
 
     if (!symbol_recycle)
-	symbol_recycle = remkroot(sizeof(struct symbol_t));
+	symbol_recycle = remkroot(sizeof(struct symbol_entry_t));
 
-    r = (struct symbol_t *) renew(symbol_recycle);
+    r = (struct symbol_entry_t *) renew(symbol_recycle);
 
-    r->provider = provider;
-    r->address = address;
+    r->symbol.provider = provider;
+    r->symbol.address = address;
+    r->next = 0;
+    r->name = 0;
+    r->hash = 0;
 
-    return r;
+    return &r->symbol;
 }
 
 static void destroy_symbol(struct symbol_t * s) {
     redel(symbol_recycle, s);
 }
 
+static int grow_symbol_index(void) {
+    struct symbol_entry_t ** new_index, * e, * next;
+    u32 new_size, i;
+
+    new_size = symbol_index_size ? symbol_index_size * 2 : 256;
+    if (!(new_index = (struct symbol_entry_t **) calloc(new_size, sizeof(struct symbol_entry_t *))))
+	return -1;
+
+    for (i = 0; i < symbol_index_size; i++) {
+	for (e = symbol_index[i]; e; e = next) {
+	    next = e->next;
+	    e->next = new_index[e->hash & (new_size - 1)];
+	    new_index[e->hash & (new_size - 1)] = e;
+	}
+    }
+
+    free(symbol_index);
+    symbol_index = new_index;
+    symbol_index_size = new_size;
+
+    return 0;
+}
+
+static void index_symbol(struct symbol_t * s, char * name, u32 hash) {
+    struct symbol_entry_t * e = (struct symbol_entry_t *) s;
+
+    if ((symbol_index_count >= symbol_index_size) && (grow_symbol_index() < 0) && !symbol_index)
+	return;
+
+    e->name = name;
+    e->hash = hash;
+    e->next = symbol_index[hash & (symbol_index_size - 1)];
+    symbol_index[hash & (symbol_index_size - 1)] = e;
+    symbol_index_count++;
+}
+
+static void unindex_symbol(struct symbol_t * s) {
+    struct symbol_entry_t * e = (struct symbol_entry_t *) s, ** p;
+
+    if (!e->name)
+	return;
+
+    for (p = &symbol_index[e->hash & (symbol_index_size - 1)]; *p; p = &(*p)->next) {
+	if (*p == e) {
+	    *p = e->next;
+	    symbol_index_count--;
+	    break;
+	}
+    }
+
+    e->name = 0;
+}
+
+static struct symbol_t * find_symbol_hashed(const char * symbol, u32 hash) {
+    struct symbol_entry_t * e;
+
+    if (!symbol_index)
+	return 0;
+
+    for (e = symbol_index[hash & (symbol_index_size - 1)]; e; e = e->next) {
+	if ((e->hash == hash) && !strcmp(e->name, symbol))
+	    return &e->symbol;
+    }
+
+    return 0;
+}
+
 static struct erl_record_t * allocate_erl_record() {
     struct erl_record_t * r;
 
@@ -420,6 +510,8 @@ static int apply_reloc(u8 * reloc, int type, u32 addr) {
 
 	memcpy(reloc, &newstate, 4);
 
+    load_stats.relocs++;
+
     dprintf("Changed data at %08X from %08X to %08X.\n", reloc, u_current_data, newstate);
     return 0;
 }
@@ -432,19 +524,8 @@ struct symbol_t * erl_find_local_symbol(const char * symbol, struct erl_record_t
     return 0;
 }
 
-static struct symbol_t * r_find_symbol(const char * symbol, struct erl_record_t * erl) {
-    if (!erl)
-	return 0;
-    if (hfind(erl->symbols, symbol, strlen(symbol)))
-	return hstuff(erl->symbols);
-    return r_find_symbol(symbol, erl->next);
-}
-
 struct symbol_t * erl_find_symbol(const char * symbol) {
-    if (global_symbols)
-	if (hfind(global_symbols, symbol, strlen(symbol)))
-	    return hstuff(global_symbols);
-    return r_find_symbol(symbol, erl_record_root);
+    return find_symbol_hashed(symbol, erl_hash(symbol));
 }
 
 static struct dependancy_t * add_dependancy(struct erl_record_t * depender, struct erl_record_t * provider) {
@@ -499,6 +580,8 @@ static void destroy_dependancy_r(struct erl_record_t * erl) {
 static void add_loosy(struct erl_record_t * erl, u8 * reloc, int type, const char * symbol) {
     struct loosy_t * l;
 
+    load_stats.loosy++;
+
     l = create_loosy(erl, reloc, type);
 
     if (!loosy_relocs)
@@ -516,7 +599,7 @@ static int fix_loosy(struct erl_record_t * provider, const char * symbol, u32 ad
     struct loosy_t * l;
     int count = 0;
 
-    if (!loosy_relocs)
+    if (!loosy_relocs || !hcount(loosy_relocs))
 	return count;
 
     if (hfind(loosy_relocs, symbol, strlen(symbol))) {
@@ -543,8 +626,11 @@ static int is_local(const char * symbol) {
     return 0;
 }
 
-static int add_symbol(struct erl_record_t * erl, const char * symbol, u32 address) {
+static int add_symbol_hashed(struct erl_record_t * erl, const char * symbol, u32 hash, u32 address) {
     htab * symbols;
+    struct symbol_t * s;
+    char * name;
+    int local = is_local(symbol);
 
     if (erl) {
 	symbols = erl->symbols;
@@ -554,7 +640,7 @@ static int add_symbol(struct erl_record_t * erl, const char * symbol, u32 addres
 	symbols = global_symbols;
     }
 
-    if (!is_local(symbol) && erl_find_symbol(symbol))
+    if (!local && find_symbol_hashed(symbol, hash))
 	return -1;
 
     dprintf("Adding symbol %s at address %08X\n", symbol, address);
@@ -566,15 +652,262 @@ static int add_symbol(struct erl_record_t * erl, const char * symbol, u32 addres
 #endif
     }
 
-    hadd(symbols, strdup(symbol), strlen(symbol), create_symbol(erl, address));
+    name = strdup(symbol);
+    s = create_symbol(erl, address);
+    if (!hadd(symbols, name, strlen(name), s)) {
+	destroy_symbol(s);
+	free(name);
+	return -1;
+    }
+
+   // Names such as _init are not exported, there is one per erl.
+    if (!local)
+	index_symbol(s, name, hash);
 
     return 0;
 }
 
+static int add_symbol(struct erl_record_t * erl, const char * symbol, u32 address) {
+    return add_symbol_hashed(erl, symbol, erl_hash(symbol), address);
+}
+
 int erl_add_global_symbol(const char * symbol, u32 address) {
     return add_symbol(0, symbol, address);
 }
 
+static u32 phase_done(u64 * counter, u32 start) {
+    u32 now = erl_ticks();
+
+    *counter += now - start;
+
+    return now;
+}
+
+static int load_sections(int elf_handle, u8 * elf_mem, struct elf_section_t * sec, int shnum, u32 addr, struct erl_record_t * erl_record) {
+    u32 fullsize = 0;
+    int i;
+
+    for (i = 1; i < shnum; i++) {
+	if ((sec[i].sh_type == PROGBITS) || (sec[i].sh_type == NOBITS)) {
+	   // Let's use this, it's not filled for relocatable objects.
+	    fullsize = align(fullsize, sec[i].sh_addralign);
+	    sec[i].sh_addr = fullsize;
+	    fullsize += sec[i].sh_size;
+	    dprintf("Section %i to load at %08X.\n", i, sec[i].sh_addr);
+	}
+    }
+
+    dprintf("Computed needed size to load the erl file: %i\n", fullsize);
+
+   // Loading progbits sections.
+    if (addr == ERL_DYN_ADDR) {
+        erl_record->bytes = (u8 *) malloc(fullsize);
+        if (!erl_record->bytes) {
+            dprintf("Cannot allocate ERL bytes.\n");
+            return -1;
+        }
+    } else {
+        erl_record->bytes = (u8 *) addr;
+        erl_record->flags |= ERL_FLAG_STATIC;
+    }
+
+    erl_record->fullsize = fullsize;
+    dprintf("Base address: %08X\n", erl_record->bytes);
+    for (i = 1; i < shnum; i++) {
+	switch (sec[i].sh_type) {
+	case PROGBITS:
+            // **TODO** handle compession
+	    dprintf("Reading section %i at %08X.\n", i, erl_record->bytes + sec[i].sh_addr);
+	    if (elf_mem) {
+		memcpy(erl_record->bytes + sec[i].sh_addr, elf_mem + sec[i].sh_offset, sec[i].sh_size);
+	    } else {
+		lseek(elf_handle, sec[i].sh_offset, SEEK_SET);
+		read(elf_handle, erl_record->bytes + sec[i].sh_addr, sec[i].sh_size);
+	    }
+	    break;
+	case NOBITS:
+	    dprintf("Zeroing section %i at %08X.\n", i, erl_record->bytes + sec[i].sh_addr);
+	    memset(erl_record->bytes + sec[i].sh_addr, 0, sec[i].sh_size);
+	    break;
+	}
+    }
+
+    return 0;
+}
+
+static int is_reloc_type(int type) {
+    return (type == R_MIPS_32) || (type == R_MIPS_26) || (type == R_MIPS_HI16) || (type == R_MIPS_LO16);
+}
+
+/* Checks the whole prelink index before anything is done with it, so that a
+   bad or stale one only makes us fall back to the normal path. */
+static int prelink_index_valid(const u8 * index, u32 size, const struct elf_header_t * head, const struct elf_section_t * sec) {
+    const struct erl_prelink_header_t * h = (const struct erl_prelink_header_t *) index;
+    const struct erl_prelink_symbol_t * syms;
+    const struct erl_prelink_reloc_t * r;
+    u32 i, nsyms;
+
+    if ((size < sizeof(*h)) || (h->magic != ERL_PRELINK_MAGIC) || (h->version != ERL_PRELINK_VERSION) || (h->shnum != head->e_shnum))
+	return 0;
+
+    if ((h->nimports > size / sizeof(*syms)) || (h->nexports > size / sizeof(*syms)) || (h->nrelocs > size / sizeof(*r)) || (h->strsize > size))
+	return 0;
+
+    nsyms = h->nimports + h->nexports;
+    if ((sizeof(*h) + nsyms * sizeof(*syms) + h->nrelocs * sizeof(*r) + h->strsize > size) || !h->strsize)
+	return 0;
+
+    syms = (const struct erl_prelink_symbol_t *) (h + 1);
+    for (i = 0; i < nsyms; i++) {
+	if ((syms[i].name >= h->strsize) || (syms[i].section >= head->e_shnum))
+	    return 0;
+    }
+
+    r = (const struct erl_prelink_reloc_t *) (syms + nsyms);
+    if (((const char *) (r + h->nrelocs))[h->strsize - 1])
+	return 0;
+
+    for (i = 0; i < h->nrelocs; i++, r++) {
+	if ((r->section >= head->e_shnum) || (sec[r->section].sh_type != PROGBITS))
+	    return 0;
+	if ((sec[r->section].sh_size < 4) || (r->offset > sec[r->section].sh_size - 4) || !is_reloc_type(r->type))
+	    return 0;
+	switch (r->kind) {
+	case ERL_PRELINK_SECTION:
+	    if (r->target >= head->e_shnum)
+		return 0;
+	    break;
+	case ERL_PRELINK_IMPORT:
+	case ERL_PRELINK_SYMBOL:
+	    if (r->target >= h->nimports)
+		return 0;
+	    break;
+	default:
+	    return 0;
+	}
+    }
+
+    return 1;
+}
+
+static u32 prelink_symbol_address(struct erl_record_t * erl_record, const struct elf_section_t * sec, const struct erl_prelink_symbol_t * s) {
+    if (s->flags & ERL_PRELINK_ABS)
+	return s->value;
+    return (u32) (erl_record->bytes + sec[s->section].sh_addr + s->value);
+}
+
+/* Loads an erl thru its prelink index. Returns 1 if the index can't be used. */
+static int read_erl_prelinked(int elf_handle, u8 * elf_mem, u32 addr, struct elf_header_t * head, struct elf_section_t * sec, struct erl_record_t * erl_record) {
+    struct elf_section_t * isec = sec + head->e_shnum - 1;
+    const struct erl_prelink_header_t * h;
+    const struct erl_prelink_symbol_t * imports, * exports;
+    const struct erl_prelink_reloc_t * r, * relocs_end;
+    const char * strings;
+    struct symbol_t ** resolved = 0;
+    u8 * index;
+    u32 i, t = erl_ticks();
+    int ret = -1;
+
+    if (elf_mem) {
+	index = elf_mem + isec->sh_offset;
+    } else {
+	if (!(index = (u8 *) malloc(isec->sh_size))) {
+	    dprintf("Not enough memory.\n");
+	    return -1;
+	}
+	lseek(elf_handle, isec->sh_offset, SEEK_SET);
+	read(elf_handle, index, isec->sh_size);
+    }
+
+    if (!prelink_index_valid(index, isec->sh_size, head, sec)) {
+	dprintf("Invalid prelink index.\n");
+	ret = 1;
+	goto out;
+    }
+
+    h = (const struct erl_prelink_header_t *) index;
+    imports = (const struct erl_prelink_symbol_t *) (h + 1);
+    exports = imports + h->nimports;
+    r = (const struct erl_prelink_reloc_t *) (exports + h->nexports);
+    relocs_end = r + h->nrelocs;
+    strings = (const char *) relocs_end;
+
+    dprintf("Prelinked: %i imports, %i exports, %i relocations.\n", h->nimports, h->nexports, h->nrelocs);
+
+    if (h->nimports && !(resolved = (struct symbol_t **) malloc(h->nimports * sizeof(struct symbol_t *)))) {
+	dprintf("Not enough memory.\n");
+	goto out;
+    }
+
+    t = phase_done(&load_stats.parse_time, t);
+
+    if (load_sections(elf_handle, elf_mem, sec, head->e_shnum, addr, erl_record) < 0)
+	goto out;
+
+    t = phase_done(&load_stats.read_time, t);
+
+   // Resolving every imported symbol once.
+    for (i = 0; i < h->nimports; i++) {
+	if ((resolved[i] = find_symbol_hashed(strings + imports[i].name, imports[i].hash)))
+	    add_dependancy(erl_record, resolved[i]->provider);
+	else if (!imports[i].section)
+	    printf("%s: Symbol not found, adding as loosy relocation.\n", strings + imports[i].name);
+    }
+
+   // The relocations are sorted by address, apply them in one go.
+    for (; r < relocs_end; r++) {
+	u8 * where = erl_record->bytes + sec[r->section].sh_addr + r->offset;
+	u32 target;
+
+	switch (r->kind) {
+	case ERL_PRELINK_SECTION:
+	    target = (u32) (erl_record->bytes + sec[r->target].sh_addr + r->value);
+	    break;
+	case ERL_PRELINK_IMPORT:
+	    if (!resolved[r->target]) {
+		add_loosy(erl_record, where, r->type, strings + imports[r->target].name);
+		continue;
+	    }
+	    target = resolved[r->target]->address;
+	    break;
+	default:
+	    if (resolved[r->target])
+		target = resolved[r->target]->address;
+	    else
+		target = prelink_symbol_address(erl_record, sec, imports + r->target);
+	    break;
+	}
+
+	apply_reloc(where, r->type, target);
+    }
+
+    t = phase_done(&load_stats.reloc_time, t);
+
+    for (i = 0; i < h->nexports; i++) {
+	if (add_symbol_hashed(erl_record, strings + exports[i].name, exports[i].hash, prelink_symbol_address(erl_record, sec, exports + i)) < 0) {
+	    dprintf("Symbol %s probably already exists, let's ignore that.\n", strings + exports[i].name);
+	}
+    }
+
+#ifdef _EE
+    FlushCache(2);
+    FlushCache(0);
+#endif
+
+    phase_done(&load_stats.export_time, t);
+
+    load_stats.prelinked++;
+    ret = 0;
+
+out:
+    if (resolved)
+	free(resolved);
+    if (!elf_mem)
+	free(index);
+
+    return ret;
+}
+
 static int read_erl(int elf_handle, u8 * elf_mem, u32 addr, struct erl_record_t ** p_erl_record) {
     struct elf_header_t head;
     struct elf_section_t * sec = 0;
@@ -585,9 +918,9 @@ static int read_erl(int elf_handle, u8 * elf_mem, u32 addr, struct erl_record_t
     char * names = 0, * strtab_names = 0, * reloc_section = 0;
     int symtab = 0, strtab = 0, linked_strtab = 0;
     u8 * magic;
-    u32 fullsize = 0;
     struct erl_record_t * erl_record = 0;
     struct symbol_t * s;
+    u32 t = erl_ticks();
 
     *p_erl_record = 0;
 
@@ -668,6 +1001,20 @@ return code
         read(elf_handle, sec, sizeof(struct elf_section_t) * head.e_shnum);
     }
 
+   // Prelinked erl files carry an index as their last section.
+    if ((head.e_shnum > 1) && (sec[head.e_shnum - 1].sh_type == ERL_PRELINK_SHT)) {
+	switch (read_erl_prelinked(elf_handle, elf_mem, addr, &head, sec, erl_record)) {
+	case 0:
+	    *p_erl_record = erl_record;
+	    free_and_return(0);
+	case 1:
+	    dprintf("Prelink index not usable, loading the normal way.\n");
+	    break;
+	default:
+	    free_and_return(-1);
+	}
+    }
+
    // Reading the section names's table.
     // **TODO** handle compession
     if (elf_mem) {
@@ -692,14 +1039,6 @@ return code
 	    strtab = i;
 	}
 
-	if ((sec[i].sh_type == PROGBITS) || (sec[i].sh_type == NOBITS)) {
-	   // Let's use this, it's not filled for relocatable objects.
-	    fullsize = align(fullsize, sec[i].sh_addralign);
-	    sec[i].sh_addr = fullsize;
-	    fullsize += sec[i].sh_size;
-	    dprintf("Section to load at %08X:\n", sec[i].sh_addr);
-	}
-
 	dprintf("%2i: ", i);
 	if (sec[i].sh_type <= 0xff) {
 	    rprintf("%-8s ", section_types[sec[i].sh_type]);
@@ -743,41 +1082,13 @@ return code
 	free_and_return(-1);
     }
 
-    dprintf("Computed needed size to load the erl file: %i\n", fullsize);
-
-   // Loading progbits sections.
-    if (addr == ERL_DYN_ADDR) {
-        erl_record->bytes = (u8 *) malloc(fullsize);
-        if (!erl_record->bytes) {
-            dprintf("Cannot allocate ERL bytes.\n");
-            free_and_return(-1);
-        }
-    } else {
-        erl_record->bytes = (u8 *) addr;
-        erl_record->flags |= ERL_FLAG_STATIC;
-    }
+    t = phase_done(&load_stats.parse_time, t);
 
-    erl_record->fullsize = fullsize;
-    dprintf("Base address: %08X\n", erl_record->bytes);
-    for (i = 1; i < head.e_shnum; i++) {
-	switch (sec[i].sh_type) {
-	case PROGBITS:
-            // **TODO** handle compession
-	    dprintf("Reading section %s at %08X.\n", names + sec[i].sh_name, erl_record->bytes + sec[i].sh_addr);
-	    if (elf_mem) {
-		memcpy(erl_record->bytes + sec[i].sh_addr, elf_mem + sec[i].sh_offset, sec[i].sh_size);
-	    } else {
-		lseek(elf_handle, sec[i].sh_offset, SEEK_SET);
-		read(elf_handle, erl_record->bytes + sec[i].sh_addr, sec[i].sh_size);
-	    }
-	    break;
-	case NOBITS:
-	    dprintf("Zeroing section %s at %08X.\n", names + sec[i].sh_name, erl_record->bytes + sec[i].sh_addr);
-	    memset(erl_record->bytes + sec[i].sh_addr, 0, sec[i].sh_size);
-	    break;
-	}
+    if (load_sections(elf_handle, elf_mem, sec, head.e_shnum, addr, erl_record) < 0) {
+	free_and_return(-1);
     }
 
+    t = phase_done(&load_stats.read_time, t);
 
    // Loading strtab.
     // **TODO** handle compession
@@ -806,6 +1117,8 @@ return code
 	read(elf_handle, sym, sec[symtab].sh_size);
     }
 
+    t = phase_done(&load_stats.parse_time, t);
+
    // Parsing sections to find relocation sections.
     for (i = 0; i < head.e_shnum; i++) {
 	if (sec[i].sh_type != REL)
@@ -868,7 +1181,7 @@ return code
 	    case OBJECT:
 	    case FUNC:
 		rprintf("internal relocation to symbol %s\n", strtab_names + sym[sym_n].st_name);
-		if ((s = erl_find_symbol(strtab_names + sym[sym_n].st_name))) {
+		if (((sym[sym_n].st_info >> 4) != LOCAL) && (s = erl_find_symbol(strtab_names + sym[sym_n].st_name))) {
 		    dprintf("Symbol already exists at %08X. Let's use it instead.\n", s->address);
 		    if (apply_reloc(erl_record->bytes + sec[sec[i].sh_info].sh_addr + reloc.r_offset, reloc.r_info & 255, s->address) < 0) {
 			dprintf("Something went wrong in relocation.");
@@ -892,6 +1205,8 @@ return code
 	    free(reloc_section);
     }
 
+    t = phase_done(&load_stats.reloc_time, t);
+
     dprintf("   Num: Value    Size     Type    Bind      Ndx Name\n");
     for (i = 0; (u32)i < sec[symtab].sh_size / sec[symtab].sh_entsize; i++) {
 	if (((sym[i].st_info >> 4) == GLOBAL) || ((sym[i].st_info >> 4) == WEAK)) {
@@ -916,6 +1231,8 @@ return code
     FlushCache(0);
 #endif
 
+    phase_done(&load_stats.export_time, t);
+
     *p_erl_record = erl_record;
 
     free_and_return(0);
@@ -941,6 +1258,7 @@ static struct erl_record_t * load_erl(const char * fname, u8 * elf_mem, u32 addr
     struct erl_record_t * r;
     struct symbol_t * s;
     int elf_handle = 0;
+    u32 t;
 
     dprintf("Reading ERL file.\n");
 
@@ -963,6 +1281,9 @@ static struct erl_record_t * load_erl(const char * fname, u8 * elf_mem, u32 addr
 	close(elf_handle);
     }
 
+    load_stats.loads++;
+    t = erl_ticks();
+
 	if ((s = erl_find_local_symbol("erl_id", r))) {
 		r->name = *(char **) s->address;
 	} else {
@@ -1000,12 +1321,16 @@ static struct erl_record_t * load_erl(const char * fname, u8 * elf_mem, u32 addr
         int _start_ret;
         if ((_start_ret = ((start_t)s->address)(argc, argv))) {
 	    dprintf("Module's _start returned %i, unloading module.\n", _start_ret);
-	    if (unload_erl(r))
+	    if (unload_erl(r)) {
+		phase_done(&load_stats.init_time, t);
 		return 0;
+	    }
 	}
 #endif
     }
 
+    phase_done(&load_stats.init_time, t);
+
     return r;
 }
 
@@ -1149,6 +1474,7 @@ void erl_flush_symbols(struct erl_record_t * erl) {
 	return;
 
     if (hfirst(erl->symbols)) do {
+	unindex_symbol((struct symbol_t *) hstuff(erl->symbols));
 	destroy_symbol((struct symbol_t *) hstuff(erl->symbols));
 	free(hkey(erl->symbols));
 	hdel(erl->symbols);
@@ -1159,6 +1485,13 @@ void erl_flush_symbols(struct erl_record_t * erl) {
     erl->symbols = 0;
 }
 
+void erl_get_load_stats(struct erl_load_stats_t * stats, int reset) {
+    if (stats)
+	*stats = load_stats;
+    if (reset)
+	memset(&load_stats, 0, sizeof(load_stats));
+}
+
 #ifdef STANDALONE
 
 int main(int argc, char *argv[]) {
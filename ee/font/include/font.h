@@ -13,6 +13,40 @@
 #define SINGLE_BYTE 0
 #define DOUBLE_BYTE 1
 
+struct fontx_slot;
+
+/** Glyph atlas for FontX2 fonts
+ * Glyphs are rasterized on demand into a 4-bit texture in VRAM, which is split
+ * into slots of the same size. Text is then drawn with one textured sprite per
+ * glyph. When the atlas is full, the least recently used glyphs are replaced.
+ */
+typedef struct {
+	/** VRAM address of the texture (GS_PSM_4) */
+	int texture_address;
+	/** VRAM address of its CLUT (8x2, GS_PSM_32) */
+	int clut_address;
+	/** Texture size, powers of 2 */
+	int width;
+	int height;
+	/** Slot size, rounded up to multiples of 8x4 */
+	int slot_width;
+	int slot_height;
+	/** Number of slots */
+	int slot_count;
+	/** Slot cache, managed by fontx */
+	struct fontx_slot *slots;
+	short *buckets;
+	int bucket_mask;
+	short lru_head;
+	short lru_tail;
+	unsigned int batch;
+	int clut_loaded;
+	/** Glyph lookups that found the glyph in the atlas */
+	unsigned int hits;
+	/** Glyph lookups that needed an upload */
+	unsigned int misses;
+} fontx_atlas_t;
+
 typedef struct {
 	/** Name of font */
 	char name[9];
@@ -30,6 +64,10 @@ typedef struct {
 	int offset;
 	/** The font data */
 	char *font;
+	/** Glyph atlas the font is drawn with, NULL to draw with points */
+	fontx_atlas_t *atlas;
+	/** Index of the first glyph of each table, NULL if the tables aren't sorted */
+	int *table_index;
 } fontx_t;
 
 /** FontStudio type fonts */
@@ -54,6 +92,8 @@ typedef struct {
 	int totalchars;
 	int spacewidth;
 	inidata_t *chardata;
+	/** Pages of 256 indices by high byte of the codepoint, built by fontstudio_parse_ini */
+	unsigned short **lookup;
 } fsfont_t;
 
 /** Alignments */
@@ -70,6 +110,7 @@ extern "C" {
 // README: dma heavy
 // A 16x16 pt font with a character that consists of nothing but points
 // would take roughly 2 kilobytes to draw (16x16)*8 bytes
+// Use a glyph atlas to draw each character with a single textured sprite.
 
 /** Loads a FontX2 type font with set characteristics
  * Use "rom0:KROM" as the path to load the PS2's internal FontX2 font
@@ -82,9 +123,33 @@ void fontx_unload(fontx_t *fontx);
 /** Prints an ascii/JISX201 formatted string */
 qword_t *fontx_print_ascii(qword_t *q, int context, const unsigned char *str, int alignment, const vertex_t *v0, color_t *c0, fontx_t *fontx);
 
-/** Prints a SJIS formatted string */
+/** Prints a SJIS formatted string
+ * The atlas is only used if both fonts use the same one.
+ */
 qword_t *fontx_print_sjis(qword_t *q, int context, const unsigned char *str, int alignment, const vertex_t *v0, color_t *c0, fontx_t *ascii, fontx_t *kanji);
 
+/** Creates a glyph atlas
+ * The texture and its CLUT have to be allocated by the caller, e.g. with
+ * graph_vram_allocate(width,height,GS_PSM_4,GRAPH_ALIGN_BLOCK) and
+ * graph_vram_allocate(8,2,GS_PSM_32,GRAPH_ALIGN_BLOCK).
+ * The width has to be between 128 and 1024, the height at most 1024.
+ * Glyphs are uploaded thru the packets of the print functions, so these packets
+ * have to be sent to the GS in the order they were built.
+ * Drawing with the atlas sets TEX0 and TEX1 of the context.
+ */
+fontx_atlas_t *fontx_atlas_init(int texture_address, int clut_address, int width, int height, int slot_width, int slot_height);
+
+/** Frees an atlas, the fonts using it must not be printed anymore */
+void fontx_atlas_free(fontx_atlas_t *atlas);
+
+/** Forgets all the glyphs of an atlas, for when VRAM has been overwritten */
+void fontx_atlas_reset(fontx_atlas_t *atlas);
+
+/** Draws a font with an atlas, or with points if atlas is NULL
+ * Returns -1 if the glyphs of the font don't fit in the slots of the atlas.
+ */
+int fontx_set_atlas(fontx_t *fontx, fontx_atlas_t *atlas);
+
 // FontStudio type fonts
 
 // README:
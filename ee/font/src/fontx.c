@@ -3,6 +3,7 @@
 
 #include <gif_tags.h>
 #include <gs_gp.h>
+#include <gs_psm.h>
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -44,6 +45,48 @@ static prim_t charprim =
 	PRIM_MAP_ST, PRIM_UNFIXED
 };
 
+static prim_t atlasprim =
+{
+	PRIM_SPRITE, PRIM_SHADE_FLAT, DRAW_ENABLE,
+	DRAW_DISABLE, DRAW_ENABLE, DRAW_DISABLE,
+	PRIM_MAP_UV, PRIM_UNFIXED
+};
+
+struct fontx_slot
+{
+	/** Glyph data held by the slot, NULL if free */
+	const char *glyph;
+	/** Least recently used list */
+	short prev;
+	short next;
+	/** Hash chain */
+	short hash_next;
+	unsigned char bold;
+	/** Batch the slot is used by, it can't be replaced before the batch is drawn */
+	unsigned int batch;
+};
+
+// Glyphs are drawn in batches: uploads for the missing ones first, then the sprites
+#define FONTX_BATCH_SIZE 64
+
+typedef struct {
+	fontx_atlas_t *atlas;
+	int context;
+	color_t *color;
+	int count;
+	struct {
+		int x;
+		int y;
+		int z;
+		short slot;
+		short width;
+		short height;
+		/** Glyph to upload into the slot first, or NULL */
+		const char *upload;
+		const fontx_t *fontx;
+	} glyph[FONTX_BATCH_SIZE];
+} fontx_batch_t;
+
 // These are the SJIS table ranges for character lookup
 unsigned short sjis_table[] = {
 0x8140,0x817e,
@@ -259,6 +302,45 @@ int fontx_load_double_krom(fontx_t *fontx)
 
 }
 
+// Computes the first glyph of each table for fontx_find_char
+static void fontx_index_tables(fontx_t *fontx)
+{
+
+	fontx_hdr *fontx_header = (fontx_hdr*)fontx->font;
+
+	int i;
+	int index = 0;
+
+	fontx->table_index = NULL;
+
+	// Tables out of order are still looked up one by one
+	for (i = 1; i < fontx_header->table_num; i++)
+	{
+
+		if (fontx_header->block[i].start <= fontx_header->block[i-1].end)
+		{
+			return;
+		}
+
+	}
+
+	fontx->table_index = (int*)malloc(sizeof(int) * (fontx_header->table_num + 1));
+
+	if (fontx->table_index == NULL)
+	{
+		return;
+	}
+
+	for (i = 0; i < fontx_header->table_num; i++)
+	{
+
+		fontx->table_index[i] = index;
+		index += fontx_header->block[i].end - fontx_header->block[i].start + 1;
+
+	}
+
+}
+
 int fontx_load(const char *path, fontx_t* fontx, int type, int wmargin, int hmargin, int bold)
 {
 
@@ -266,6 +348,9 @@ int fontx_load(const char *path, fontx_t* fontx, int type, int wmargin, int hmar
 
 	fontx_hdr *fontx_header = NULL;
 
+	fontx->atlas = NULL;
+	fontx->table_index = NULL;
+
 	if (!strcmp("rom0:KROM",path) || !strcmp("rom0:/KROM",path))
 	{
 		int ret = -1;
@@ -373,6 +458,8 @@ int fontx_load(const char *path, fontx_t* fontx, int type, int wmargin, int hmar
 		// 17 + 1 + (number of tables * 4) bytes
 		fontx->offset = 18 + (fontx_header->table_num * 4);
 
+		fontx_index_tables(fontx);
+
 	}
 
 	return 0;
@@ -389,6 +476,47 @@ void fontx_unload(fontx_t *fontx)
 
 	}
 
+	if (fontx->table_index != NULL)
+	{
+
+		free(fontx->table_index);
+		fontx->table_index = NULL;
+
+	}
+
+}
+
+// Tables are sorted and don't overlap, the first glyph of each one is known
+static char *fontx_find_char(fontx_t *fontx, unsigned short c)
+{
+
+	fontx_hdr *fontx_header = (fontx_hdr*)fontx->font;
+
+	int low = 0;
+	int high = fontx_header->table_num - 1;
+
+	while (low <= high)
+	{
+
+		int mid = (low + high) >> 1;
+
+		if (c < fontx_header->block[mid].start)
+		{
+			high = mid - 1;
+		}
+		else if (c > fontx_header->block[mid].end)
+		{
+			low = mid + 1;
+		}
+		else
+		{
+			return (fontx->font + (fontx->offset + (fontx->table_index[mid] + (c - fontx_header->block[mid].start)) * fontx->charsize));
+		}
+
+	}
+
+	return NULL;
+
 }
 
 char *fontx_get_char(fontx_t* fontx, unsigned short c)
@@ -418,6 +546,13 @@ char *fontx_get_char(fontx_t* fontx, unsigned short c)
 
 	}
 
+	if (fontx->table_index != NULL)
+	{
+
+		return fontx_find_char(fontx, c);
+
+	}
+
 	for (i = 0; i < fontx_header->table_num; i++)
 	{
 
@@ -556,11 +691,539 @@ qword_t *draw_fontx_char(qword_t *q, unsigned short c, vertex_t *v0, fontx_t *fo
 
 }
 
+static int fontx_log2(int x)
+{
+
+	int res = 0;
+
+	while ((1 << res) < x)
+	{
+		res++;
+	}
+
+	return res;
+
+}
+
+void fontx_atlas_reset(fontx_atlas_t *atlas)
+{
+
+	int i;
+
+	for (i = 0; i < atlas->slot_count; i++)
+	{
+
+		atlas->slots[i].glyph = NULL;
+		atlas->slots[i].prev = i - 1;
+		atlas->slots[i].next = (i + 1 < atlas->slot_count) ? i + 1 : -1;
+		atlas->slots[i].hash_next = -1;
+		atlas->slots[i].batch = 0;
+
+	}
+
+	for (i = 0; i <= atlas->bucket_mask; i++)
+	{
+		atlas->buckets[i] = -1;
+	}
+
+	atlas->lru_head = 0;
+	atlas->lru_tail = atlas->slot_count - 1;
+	atlas->batch = 1;
+	atlas->clut_loaded = 0;
+
+}
+
+fontx_atlas_t *fontx_atlas_init(int texture_address, int clut_address, int width, int height, int slot_width, int slot_height)
+{
+
+	fontx_atlas_t *atlas;
+	int buckets;
+
+	// The GS needs a buffer width multiple of 128 for 4-bit textures
+	if (width < 128 || width > 1024 || (width & (width - 1)) || height <= 0 || height > 1024 || (height & (height - 1)))
+	{
+
+		printf("Invalid atlas size %dx%d.\n", width, height);
+		return NULL;
+
+	}
+
+	// Transfers of 4-bit texels are done 8 texels wide, and in whole qwords
+	slot_width = (slot_width + 7) & ~7;
+	slot_height = (slot_height + 3) & ~3;
+
+	if (slot_width <= 0 || slot_height <= 0 || slot_width > width || slot_height > height || (width / slot_width) * (height / slot_height) > 0x7fff)
+	{
+
+		printf("Invalid atlas slot size %dx%d.\n", slot_width, slot_height);
+		return NULL;
+
+	}
+
+	atlas = (fontx_atlas_t*)malloc(sizeof(fontx_atlas_t));
+
+	if (atlas == NULL)
+	{
+
+		printf("Error allocating atlas.\n");
+		return NULL;
+
+	}
+
+	atlas->texture_address = texture_address;
+	atlas->clut_address = clut_address;
+	atlas->width = width;
+	atlas->height = height;
+	atlas->slot_width = slot_width;
+	atlas->slot_height = slot_height;
+	atlas->slot_count = (width / slot_width) * (height / slot_height);
+	atlas->hits = 0;
+	atlas->misses = 0;
+
+	for (buckets = 16; buckets < atlas->slot_count * 2; buckets <<= 1);
+
+	atlas->bucket_mask = buckets - 1;
+	atlas->slots = (struct fontx_slot*)malloc(atlas->slot_count * sizeof(struct fontx_slot));
+	atlas->buckets = (short*)malloc(buckets * sizeof(short));
+
+	if (atlas->slots == NULL || atlas->buckets == NULL)
+	{
+
+		printf("Error allocating atlas.\n");
+		fontx_atlas_free(atlas);
+		return NULL;
+
+	}
+
+	fontx_atlas_reset(atlas);
+
+	return atlas;
+
+}
+
+void fontx_atlas_free(fontx_atlas_t *atlas)
+{
+
+	if (atlas == NULL)
+	{
+		return;
+	}
+
+	free(atlas->slots);
+	free(atlas->buckets);
+	free(atlas);
+
+}
+
+int fontx_set_atlas(fontx_t *fontx, fontx_atlas_t *atlas)
+{
+
+	fontx_hdr *fontx_header = (fontx_hdr*)fontx->font;
+
+	// A bold glyph is one pixel wider
+	if (atlas != NULL && ((fontx->rowsize * 8) + (fontx->bold ? 1 : 0) > atlas->slot_width || fontx_header->height > atlas->slot_height))
+	{
+
+		printf("Font %s doesn't fit in the atlas slots.\n", fontx->name);
+		return -1;
+
+	}
+
+	fontx->atlas = atlas;
+
+	return 0;
+
+}
+
+static unsigned int fontx_atlas_hash(fontx_atlas_t *atlas, const char *glyph, int bold)
+{
+
+	unsigned int key = (unsigned int)(unsigned long)glyph ^ bold;
+
+	return ((key * 2654435761U) >> 16) & atlas->bucket_mask;
+
+}
+
+static void fontx_atlas_unlink(fontx_atlas_t *atlas, int slot)
+{
+
+	struct fontx_slot *s = &atlas->slots[slot];
+
+	if (s->prev >= 0)
+		atlas->slots[s->prev].next = s->next;
+	else
+		atlas->lru_head = s->next;
+
+	if (s->next >= 0)
+		atlas->slots[s->next].prev = s->prev;
+	else
+		atlas->lru_tail = s->prev;
+
+}
+
+static void fontx_atlas_touch(fontx_atlas_t *atlas, int slot)
+{
+
+	struct fontx_slot *s = &atlas->slots[slot];
+
+	if (atlas->lru_head == slot)
+	{
+		return;
+	}
+
+	fontx_atlas_unlink(atlas, slot);
+
+	s->prev = -1;
+	s->next = atlas->lru_head;
+	atlas->slots[atlas->lru_head].prev = slot;
+	atlas->lru_head = slot;
+
+}
+
+static int fontx_atlas_find(fontx_atlas_t *atlas, const char *glyph, int bold)
+{
+
+	int slot;
+
+	for (slot = atlas->buckets[fontx_atlas_hash(atlas, glyph, bold)]; slot >= 0; slot = atlas->slots[slot].hash_next)
+	{
+
+		if (atlas->slots[slot].glyph == glyph && atlas->slots[slot].bold == bold)
+		{
+			return slot;
+		}
+
+	}
+
+	return -1;
+
+}
+
+// Takes the least recently used slot over for glyph
+static int fontx_atlas_replace(fontx_atlas_t *atlas, const char *glyph, int bold)
+{
+
+	int slot = atlas->lru_tail;
+	struct fontx_slot *s = &atlas->slots[slot];
+	short *p;
+
+	if (s->glyph != NULL)
+	{
+
+		for (p = &atlas->buckets[fontx_atlas_hash(atlas, s->glyph, s->bold)]; *p >= 0; p = &atlas->slots[*p].hash_next)
+		{
+
+			if (*p == slot)
+			{
+				*p = s->hash_next;
+				break;
+			}
+
+		}
+
+	}
+
+	s->glyph = glyph;
+	s->bold = bold;
+	s->hash_next = atlas->buckets[fontx_atlas_hash(atlas, glyph, bold)];
+	atlas->buckets[fontx_atlas_hash(atlas, glyph, bold)] = slot;
+
+	return slot;
+
+}
+
+static qword_t *fontx_atlas_upload_clut(qword_t *q, fontx_atlas_t *atlas)
+{
+
+	u32 *clut;
+
+	PACK_GIFTAG(q, GIF_SET_TAG(4,0,0,0,GIF_FLG_PACKED,1), GIF_REG_AD);
+	q++;
+	PACK_GIFTAG(q, GS_SET_BITBLTBUF(0,0,0,atlas->clut_address>>6,1,GS_PSM_32), GS_REG_BITBLTBUF);
+	q++;
+	PACK_GIFTAG(q, GS_SET_TRXPOS(0,0,0,0,0), GS_REG_TRXPOS);
+	q++;
+	PACK_GIFTAG(q, GS_SET_TRXREG(8,2), GS_REG_TRXREG);
+	q++;
+	PACK_GIFTAG(q, GS_SET_TRXDIR(0), GS_REG_TRXDIR);
+	q++;
+	PACK_GIFTAG(q, GIF_SET_TAG(4,0,0,0,GIF_FLG_IMAGE,0), 0);
+	q++;
+
+	// Index 0 is transparent, index 1 is white and opaque: the texture modulates the text color
+	clut = (u32*)q;
+	memset(clut, 0, 64);
+	clut[1] = 0x80808080;
+	q += 4;
+
+	atlas->clut_loaded = 1;
+
+	return q;
+
+}
+
+// Rasterizes a glyph into its slot, bold the same way as draw_fontx_row
+static qword_t *fontx_atlas_upload(qword_t *q, fontx_atlas_t *atlas, int slot, const char *glyph, const fontx_t *fontx)
+{
+
+	fontx_hdr *fontx_header = (fontx_hdr*)fontx->font;
+
+	int cols = atlas->width / atlas->slot_width;
+	int height = (fontx_header->height + 3) & ~3;
+	int pitch = atlas->slot_width >> 1;
+	int qwords = (pitch * height) >> 4;
+	int width = fontx->rowsize * 8;
+	int i, x;
+
+	unsigned char *texels;
+
+	PACK_GIFTAG(q, GIF_SET_TAG(4,0,0,0,GIF_FLG_PACKED,1), GIF_REG_AD);
+	q++;
+	PACK_GIFTAG(q, GS_SET_BITBLTBUF(0,0,0,atlas->texture_address>>6,atlas->width>>6,GS_PSM_4), GS_REG_BITBLTBUF);
+	q++;
+	PACK_GIFTAG(q, GS_SET_TRXPOS(0,0,(slot % cols) * atlas->slot_width,(slot / cols) * atlas->slot_height,0), GS_REG_TRXPOS);
+	q++;
+	PACK_GIFTAG(q, GS_SET_TRXREG(atlas->slot_width,height), GS_REG_TRXREG);
+	q++;
+	PACK_GIFTAG(q, GS_SET_TRXDIR(0), GS_REG_TRXDIR);
+	q++;
+	PACK_GIFTAG(q, GIF_SET_TAG(qwords,0,0,0,GIF_FLG_IMAGE,0), 0);
+	q++;
+
+	texels = (unsigned char*)q;
+	memset(texels, 0, qwords * 16);
+
+	for (i = 0; i < fontx_header->height; i++)
+	{
+
+		const unsigned char *row = (const unsigned char*)glyph + (i * fontx->rowsize);
+		unsigned char *dst = texels + (i * pitch);
+		int px = 0;
+
+		for (x = 0; x < width; x++)
+		{
+
+			int bit = (row[x >> 3] >> (7 - (x & 7))) & 1;
+
+			if (bit || (fontx->bold && px))
+			{
+				dst[x >> 1] |= (x & 1) ? 0x10 : 0x01;
+			}
+
+			px = bit;
+
+		}
+
+		if (fontx->bold && px)
+		{
+			dst[x >> 1] |= (x & 1) ? 0x10 : 0x01;
+		}
+
+	}
+
+	q += qwords;
+
+	return q;
+
+}
+
+static qword_t *fontx_batch_flush(qword_t *q, fontx_batch_t *batch)
+{
+
+	fontx_atlas_t *atlas = batch->atlas;
+
+	int cols = atlas->width / atlas->slot_width;
+	int uploads = 0;
+	int i;
+
+	if (batch->count == 0)
+	{
+		return q;
+	}
+
+	if (!atlas->clut_loaded)
+	{
+
+		q = fontx_atlas_upload_clut(q, atlas);
+		uploads++;
+
+	}
+
+	for (i = 0; i < batch->count; i++)
+	{
+
+		if (batch->glyph[i].upload != NULL)
+		{
+
+			q = fontx_atlas_upload(q, atlas, batch->glyph[i].slot, batch->glyph[i].upload, batch->glyph[i].fontx);
+			uploads++;
+
+		}
+
+	}
+
+	// The texture is set again for each batch, which reloads the CLUT
+	PACK_GIFTAG(q, GIF_SET_TAG(uploads ? 3 : 2,0,0,0,GIF_FLG_PACKED,1), GIF_REG_AD);
+	q++;
+
+	if (uploads)
+	{
+
+		PACK_GIFTAG(q, 1, GS_REG_TEXFLUSH);
+		q++;
+
+	}
+
+	PACK_GIFTAG(q, GS_SET_TEX0(atlas->texture_address>>6,atlas->width>>6,GS_PSM_4,
+							   fontx_log2(atlas->width),fontx_log2(atlas->height),TEXTURE_COMPONENTS_RGBA,TEXTURE_FUNCTION_MODULATE,
+							   atlas->clut_address>>6,GS_PSM_32,CLUT_STORAGE_MODE1,0,CLUT_LOAD), GS_REG_TEX0 + batch->context);
+	q++;
+	PACK_GIFTAG(q, GS_SET_TEX1(0,0,0,0,0,0,0), GS_REG_TEX1 + batch->context);
+	q++;
+
+	q = draw_prim_start(q,batch->context,&atlasprim,batch->color);
+
+	for (i = 0; i < batch->count; i++)
+	{
+
+		int u = (batch->glyph[i].slot % cols) * atlas->slot_width;
+		int v = (batch->glyph[i].slot / cols) * atlas->slot_height;
+		int x = batch->glyph[i].x + 32768;
+		int y = batch->glyph[i].y + 32768;
+
+		q->dw[0] = GS_SET_UV(u << 4, v << 4);
+		q->dw[1] = GS_SET_XYZ(x, y, batch->glyph[i].z);
+		q++;
+		q->dw[0] = GS_SET_UV((u + batch->glyph[i].width) << 4, (v + batch->glyph[i].height) << 4);
+		q->dw[1] = GS_SET_XYZ(x + (batch->glyph[i].width << 4), y + (batch->glyph[i].height << 4), batch->glyph[i].z);
+		q++;
+
+	}
+
+	q = draw_prim_end(q,2,DRAW_UV_REGLIST);
+
+	batch->count = 0;
+	atlas->batch++;
+
+	return q;
+
+}
+
+static qword_t *fontx_atlas_char(qword_t *q, fontx_batch_t *batch, unsigned short c, vertex_t *v0, const fontx_t *fontx)
+{
+
+	fontx_atlas_t *atlas = batch->atlas;
+	fontx_hdr *fontx_header = (fontx_hdr*)fontx->font;
+
+	const char *glyph;
+	int bold = fontx->bold ? 1 : 0;
+	int slot, n;
+
+	glyph = fontx_get_char((fontx_t*)fontx,c);
+
+	if (!glyph)
+	{
+		return q;
+	}
+
+	if (batch->count == FONTX_BATCH_SIZE)
+	{
+		q = fontx_batch_flush(q, batch);
+	}
+
+	n = batch->count;
+	batch->glyph[n].upload = NULL;
+
+	if ((slot = fontx_atlas_find(atlas, glyph, bold)) >= 0)
+	{
+
+		atlas->hits++;
+
+	}
+	else
+	{
+
+		// Every slot is used by this batch: draw it before replacing any
+		if (atlas->slots[atlas->lru_tail].batch == atlas->batch)
+		{
+
+			q = fontx_batch_flush(q, batch);
+			n = 0;
+			batch->glyph[n].upload = NULL;
+
+		}
+
+		slot = fontx_atlas_replace(atlas, glyph, bold);
+		batch->glyph[n].upload = glyph;
+		atlas->misses++;
+
+	}
+
+	fontx_atlas_touch(atlas, slot);
+	atlas->slots[slot].batch = atlas->batch;
+
+	batch->glyph[n].x = ftoi4(v0->x);
+	batch->glyph[n].y = ftoi4(v0->y);
+	batch->glyph[n].z = v0->z;
+	batch->glyph[n].slot = slot;
+	batch->glyph[n].width = (fontx->rowsize * 8) + bold;
+	batch->glyph[n].height = fontx_header->height;
+	batch->glyph[n].fontx = fontx;
+	batch->count = n + 1;
+
+	return q;
+
+}
+
+// Starts drawing a string, with the atlas or with points
+static qword_t *fontx_draw_start(qword_t *q, fontx_batch_t *batch, fontx_atlas_t *atlas, int context, color_t *c0)
+{
+
+	batch->atlas = atlas;
+	batch->context = context;
+	batch->color = c0;
+	batch->count = 0;
+
+	if (atlas == NULL)
+	{
+		q = draw_prim_start(q,context,&charprim,c0);
+	}
+
+	return q;
+
+}
+
+static qword_t *fontx_draw_char(qword_t *q, fontx_batch_t *batch, unsigned short c, vertex_t *v0, fontx_t *fontx)
+{
+
+	if (batch->atlas == NULL)
+	{
+		return draw_fontx_char(q,c,v0,fontx);
+	}
+
+	return fontx_atlas_char(q,batch,c,v0,fontx);
+
+}
+
+static qword_t *fontx_draw_end(qword_t *q, fontx_batch_t *batch)
+{
+
+	if (batch->atlas == NULL)
+	{
+		return draw_prim_end(q,2,DRAW_XYZ_REGLIST);
+	}
+
+	return fontx_batch_flush(q, batch);
+
+}
+
 qword_t *fontx_print_ascii(qword_t *q, int context, const unsigned char *str, int alignment, const vertex_t *v0, color_t *c0, fontx_t *fontx)
 {
 
 	int i,j;
 
+	fontx_batch_t batch;
+
 	fontx_hdr *fontx_header = (fontx_hdr*)fontx->font;
 
 	vertex_t v_pos = *v0;
@@ -693,7 +1356,7 @@ qword_t *fontx_print_ascii(qword_t *q, int context, const unsigned char *str, in
 	line = 0;
 	v_pos.x = x_orig[0];
 
-	q = draw_prim_start(q,context,&charprim,c0);
+	q = fontx_draw_start(q,&batch,fontx->atlas,context,c0);
 
 	for (j = 0; j < length; j++)
 	{
@@ -715,18 +1378,18 @@ qword_t *fontx_print_ascii(qword_t *q, int context, const unsigned char *str, in
 
 		if (str[j] < 0x80)
 		{
-			q = draw_fontx_char(q,str[j],&v_pos,fontx);
+			q = fontx_draw_char(q,&batch,str[j],&v_pos,fontx);
 		}
 		else if (str[j] >= 0xA1 && str[j] <= 0xDF)
 		{
-			q = draw_fontx_char(q,str[j],&v_pos,fontx);
+			q = fontx_draw_char(q,&batch,str[j],&v_pos,fontx);
 		}
 
 		v_pos.x += w + wm;
 
 	}
 
-	q = draw_prim_end(q,2,DRAW_XYZ_REGLIST);
+	q = fontx_draw_end(q,&batch);
 
 	return q;
 
@@ -737,6 +1400,8 @@ qword_t *fontx_print_sjis(qword_t *q, int context, const unsigned char *str, int
 
 	int i,j;
 
+	fontx_batch_t batch;
+
 	fontx_hdr *ascii_header = (fontx_hdr*)ascii->font;
 	fontx_hdr *kanji_header = (fontx_hdr*)kanji->font;
 
@@ -901,7 +1566,7 @@ qword_t *fontx_print_sjis(qword_t *q, int context, const unsigned char *str, int
 	line = 0;
 	v_pos.x = x_orig[0];
 
-	q = draw_prim_start(q,context,&charprim,c0);
+	q = fontx_draw_start(q,&batch,(ascii->atlas == kanji->atlas) ? kanji->atlas : NULL,context,c0);
 
 	for (j = 0; j < length; j++)
 	{
@@ -924,26 +1589,26 @@ qword_t *fontx_print_sjis(qword_t *q, int context, const unsigned char *str, int
 
 		if (str[j] < 0x80)
 		{
-			q = draw_fontx_char(q,str[j],&v_pos,ascii);
+			q = fontx_draw_char(q,&batch,str[j],&v_pos,ascii);
 			v_pos.x += hw + wm;
 		}
 		else if (str[j] >= 0xA1 && str[j] <= 0xDF)
 		{
-			q = draw_fontx_char(q,str[j],&v_pos,ascii);
+			q = fontx_draw_char(q,&batch,str[j],&v_pos,ascii);
 			v_pos.x += hw + wm;
 		}
 		else if (str[j] >= 0x81 && str[j] <= 0x9F)
 		{
 			wide = str[j++]<<8;
 			wide += str[j];
-			q = draw_fontx_char(q,wide,&v_pos,kanji);
+			q = fontx_draw_char(q,&batch,wide,&v_pos,kanji);
 			v_pos.x += fw + wm;
 		}
 		else if (str[j] >= 0xE0 && str[j] <= 0xEF)
 		{
 			wide = str[j++]<<8;
 			wide += str[j];
-			q = draw_fontx_char(q,wide,&v_pos,kanji);
+			q = fontx_draw_char(q,&batch,wide,&v_pos,kanji);
 			v_pos.x += fw + wm;
 		}
 		else
@@ -953,7 +1618,7 @@ qword_t *fontx_print_sjis(qword_t *q, int context, const unsigned char *str, int
 
 	}
 
-	q = draw_prim_end(q,2,DRAW_XYZ_REGLIST);
+	q = fontx_draw_end(q,&batch);
 
 	return q;
 
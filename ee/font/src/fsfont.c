@@ -19,6 +19,82 @@ static prim_t charprim =
 #define NEWLINE '\n'
 #define SPACE ' '
 
+// Index returned for characters that aren't in the character map
+#define UNKNOWN_CHAR 0xFFFD
+
+static void free_lookup(fsfont_t *font)
+{
+
+	int i;
+
+	if (font->lookup == NULL)
+	{
+		return;
+	}
+
+	for (i = 0; i < 256; i++)
+	{
+
+		if (font->lookup[i] != NULL)
+		{
+			free(font->lookup[i]);
+		}
+
+	}
+
+	free(font->lookup);
+	font->lookup = NULL;
+
+}
+
+// Builds the pages used by get_char, get_char scans the character map if this fails
+static void build_lookup(fsfont_t *font)
+{
+
+	int i, j;
+
+	font->lookup = (unsigned short**)malloc(sizeof(unsigned short*) * 256);
+
+	if (font->lookup == NULL)
+	{
+		return;
+	}
+
+	memset(font->lookup, 0, sizeof(unsigned short*) * 256);
+
+	// Backwards, so that the first of duplicate characters is kept like with a scan
+	for (i = font->totalchars - 1; i >= 0; i--)
+	{
+
+		unsigned short **page = &font->lookup[font->charmap[i] >> 8];
+
+		if (*page == NULL)
+		{
+
+			*page = (unsigned short*)malloc(sizeof(unsigned short) * 256);
+
+			if (*page == NULL)
+			{
+
+				printf("Error allocating character lookup.\n");
+				free_lookup(font);
+				return;
+
+			}
+
+			for (j = 0; j < 256; j++)
+			{
+				(*page)[j] = UNKNOWN_CHAR;
+			}
+
+		}
+
+		(*page)[font->charmap[i] & 0xFF] = i;
+
+	}
+
+}
+
 fsfont_t *fontstudio_init( int char_height)
 {
 
@@ -28,6 +104,9 @@ fsfont_t *fontstudio_init( int char_height)
 
 	font->height = char_height;
 	font->scale = 1.0f;
+	font->charmap = NULL;
+	font->chardata = NULL;
+	font->lookup = NULL;
 
 	return font;
 
@@ -46,6 +125,8 @@ void fontstudio_free(fsfont_t *font)
 		free(font->chardata);
 	}
 
+	free_lookup(font);
+
 	free(font);
 
 }
@@ -306,6 +387,9 @@ int fontstudio_parse_ini(fsfont_t *font, char *ini, float tex_width, float tex_h
 		font->chardata[i].v2 = ftoi4(((float)(strtod(temp0,NULL) * tex_height)));
 	}
 
+	free_lookup(font);
+	build_lookup(font);
+
 	return 0;
 
 }
@@ -322,6 +406,7 @@ void fontstudio_unload_ini(fsfont_t *font)
 		free(font->chardata);
 		font->chardata = NULL;
 	}
+	free_lookup(font);
 }
 
 // Decode unicode byte sequences into unicode a single numerical character U+XXXX
@@ -381,6 +466,15 @@ unsigned short get_char(unsigned short c, fsfont_t *font)
 
 	unsigned short i;
 
+	if (font->lookup != NULL)
+	{
+
+		unsigned short *page = font->lookup[c >> 8];
+
+		return (page != NULL) ? page[c & 0xFF] : UNKNOWN_CHAR;
+
+	}
+
 	for (i = 0; i < font->totalchars; i++)
 	{
 
@@ -393,7 +487,7 @@ unsigned short get_char(unsigned short c, fsfont_t *font)
 	}
 
 	// Use unknown <?> character if character isn't in character map
-	return 0xFFFD;
+	return UNKNOWN_CHAR;
 
 }
 
@@ -402,6 +496,10 @@ void convert_to_index(unsigned short *in, int num, fsfont_t *font)
 
 	int i;
 
+	unsigned short **lookup = font->lookup;
+	unsigned short *page = NULL;
+	int page_num = -1;
+
 	for (i = 0; i < num; i++)
 	{
 		// These characters aren't included in the FontStudio index, I think
@@ -424,7 +522,20 @@ void convert_to_index(unsigned short *in, int num, fsfont_t *font)
 			i++;
 		}
 
-		in[i] = get_char(in[i],font);
+		if (lookup == NULL)
+		{
+			in[i] = get_char(in[i],font);
+			continue;
+		}
+
+		// Text is mostly from one or two scripts, keep the last page at hand
+		if ((in[i] >> 8) != page_num)
+		{
+			page_num = in[i] >> 8;
+			page = lookup[page_num];
+		}
+
+		in[i] = (page != NULL) ? page[in[i] & 0xFF] : UNKNOWN_CHAR;
 	}
 
 }
@@ -15,19 +15,50 @@
 /** Texture Buffer and CLUT Buffer */
 #define GRAPH_ALIGN_BLOCK    64
 
+/** Maximum number of used and free regions vram can be split into */
+#define GRAPH_VRAM_MAX_REGIONS 1024
+
+/** Sizes and addresses are in words */
+typedef struct {
+	/** Words in use */
+	int used;
+	/** Words not in use, alignment padding included */
+	int free;
+	/** Largest free region */
+	int largest_free;
+	/** Percentage of the free words outside of the largest free region */
+	int fragmentation;
+	/** Number of free regions */
+	int free_regions;
+	/** Number of allocations */
+	int allocations;
+	/** Most words ever in use */
+	int peak_used;
+	/** Highest end address ever allocated */
+	int high_water;
+	/** Number of allocations that failed */
+	int failures;
+} graph_vram_stats_t;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-/** Allocates vram and returns vram base pointer */
+/** Allocates vram and returns vram base pointer, or -1 if there's no room
+ * The alignment is at least GRAPH_ALIGN_BLOCK. The smallest free region that fits is used.
+ * A size of 0 returns the start of the free space at the end of vram, without allocating it.
+ */
 int graph_vram_allocate(int width, int height, int psm, int alignment);
 
-/** Frees in FIFO order... */
+/** Frees an allocation, in any order, by its base pointer */
 void graph_vram_free(int address);
 
 /** Clears the vram status */
 void graph_vram_clear(void);
 
+/** Fills in the usage, fragmentation and high-water marks of vram */
+void graph_vram_get_stats(graph_vram_stats_t *stats);
+
 /** Calculate the size in vram of a texture or buffer */
 int graph_vram_size(int width, int height, int psm, int alignment);
 
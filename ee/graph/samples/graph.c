@@ -165,9 +165,14 @@ int main(void)
 	// Render the sample.
 	render(packet,&frame);
 
-	// Free the vram.
+	// Free the vram, every buffer on its own.
 	graph_vram_free(frame.address);
 
+	if (z.enable)
+	{
+		graph_vram_free(z.address);
+	}
+
 	// Free the packet.
 	packet_free(packet);
 
@@ -1,43 +1,273 @@
+#include <string.h>
+
 #include <gs_psm.h>
 
 #include <graph_vram.h>
 
-static int graph_vram_pointer = 0;
+// VRAM is kept as a list of regions sorted by address, used or free, that
+// covers all of it. Neighbouring free regions are always merged.
+typedef struct {
+	int address;
+	int size;
+	int used;
+} graph_vram_region_t;
+
+static graph_vram_region_t graph_vram_regions[GRAPH_VRAM_MAX_REGIONS] = { { 0, GRAPH_VRAM_MAX_WORDS, 0 } };
+static int graph_vram_count = 1;
+
+static int graph_vram_used = 0;
+static int graph_vram_peak = 0;
+static int graph_vram_high = 0;
+static int graph_vram_failures = 0;
+
+static void graph_vram_insert(int index, int address, int size, int used)
+{
+
+	memmove(&graph_vram_regions[index + 1], &graph_vram_regions[index], (graph_vram_count - index) * sizeof(graph_vram_region_t));
+
+	graph_vram_regions[index].address = address;
+	graph_vram_regions[index].size = size;
+	graph_vram_regions[index].used = used;
+
+	graph_vram_count++;
+
+}
+
+static void graph_vram_remove(int index)
+{
+
+	graph_vram_count--;
+
+	memmove(&graph_vram_regions[index], &graph_vram_regions[index + 1], (graph_vram_count - index) * sizeof(graph_vram_region_t));
+
+}
+
+// Returns the region starting at address, or -1
+static int graph_vram_find(int address)
+{
+
+	int low = 0;
+	int high = graph_vram_count - 1;
+
+	while (low <= high)
+	{
+
+		int mid = (low + high) >> 1;
+
+		if (graph_vram_regions[mid].address < address)
+		{
+			low = mid + 1;
+		}
+		else if (graph_vram_regions[mid].address > address)
+		{
+			high = mid - 1;
+		}
+		else
+		{
+			return mid;
+		}
+
+	}
+
+	return -1;
+
+}
 
 int graph_vram_allocate(int width, int height, int psm, int alignment)
 {
 
 	int size;
+	int i, best = -1;
+	int start = 0, best_start = 0;
+	int end;
+
+	// Buffer base pointers are in units of blocks
+	if (alignment < GRAPH_ALIGN_BLOCK)
+	{
+		alignment = GRAPH_ALIGN_BLOCK;
+	}
 
-	// Calculate the size and increment the pointer
 	size = graph_vram_size(width,height,psm,alignment);
 
-	graph_vram_pointer += size;
+	// Nothing to reserve: returns where the free space at the end of vram starts
+	if (size == 0)
+	{
+
+		i = graph_vram_count - 1;
+
+		if (graph_vram_regions[i].used)
+		{
+			return -1;
+		}
+
+		start = -alignment & (graph_vram_regions[i].address + (alignment-1));
+
+		return (start < GRAPH_VRAM_MAX_WORDS) ? start : -1;
+
+	}
 
-	// If the pointer overflows the vram size
-	if (graph_vram_pointer > GRAPH_VRAM_MAX_WORDS)
+	// Best fit, the lowest address among equals
+	for (i = 0; i < graph_vram_count; i++)
 	{
 
-		graph_vram_pointer -= size;
+		if (graph_vram_regions[i].used)
+		{
+			continue;
+		}
+
+		start = -alignment & (graph_vram_regions[i].address + (alignment-1));
+
+		if (start + size > graph_vram_regions[i].address + graph_vram_regions[i].size)
+		{
+			continue;
+		}
+
+		if (best < 0 || graph_vram_regions[i].size < graph_vram_regions[best].size)
+		{
+
+			best = i;
+			best_start = start;
+
+		}
+
+	}
+
+	// Splitting the region can add two more
+	if (best < 0 || graph_vram_count + 2 > GRAPH_VRAM_MAX_REGIONS)
+	{
+
+		graph_vram_failures++;
 		return -1;
 
 	}
 
-	return graph_vram_pointer - size;
+	end = graph_vram_regions[best].address + graph_vram_regions[best].size;
+
+	// The alignment padding stays free
+	if (best_start > graph_vram_regions[best].address)
+	{
+
+		graph_vram_regions[best].size = best_start - graph_vram_regions[best].address;
+		best++;
+		graph_vram_insert(best, best_start, size, 1);
+
+	}
+	else
+	{
+
+		graph_vram_regions[best].size = size;
+		graph_vram_regions[best].used = 1;
+
+	}
+
+	if (best_start + size < end)
+	{
+
+		graph_vram_insert(best + 1, best_start + size, end - (best_start + size), 0);
+
+	}
+
+	graph_vram_used += size;
+
+	if (graph_vram_used > graph_vram_peak)
+	{
+		graph_vram_peak = graph_vram_used;
+	}
+
+	if (best_start + size > graph_vram_high)
+	{
+		graph_vram_high = best_start + size;
+	}
+
+	return best_start;
 
 }
 
 void graph_vram_free(int address)
 {
 
-	graph_vram_pointer = address;
+	int i = graph_vram_find(address);
+
+	if (i < 0 || !graph_vram_regions[i].used)
+	{
+		return;
+	}
+
+	graph_vram_regions[i].used = 0;
+	graph_vram_used -= graph_vram_regions[i].size;
+
+	// Merge with the next and previous regions
+	if (i + 1 < graph_vram_count && !graph_vram_regions[i + 1].used)
+	{
+
+		graph_vram_regions[i].size += graph_vram_regions[i + 1].size;
+		graph_vram_remove(i + 1);
+
+	}
+
+	if (i > 0 && !graph_vram_regions[i - 1].used)
+	{
+
+		graph_vram_regions[i - 1].size += graph_vram_regions[i].size;
+		graph_vram_remove(i);
+
+	}
 
 }
 
 void graph_vram_clear(void)
 {
 
-	graph_vram_pointer = 0;
+	graph_vram_regions[0].address = 0;
+	graph_vram_regions[0].size = GRAPH_VRAM_MAX_WORDS;
+	graph_vram_regions[0].used = 0;
+	graph_vram_count = 1;
+
+	graph_vram_used = 0;
+	graph_vram_peak = 0;
+	graph_vram_high = 0;
+	graph_vram_failures = 0;
+
+}
+
+void graph_vram_get_stats(graph_vram_stats_t *stats)
+{
+
+	int i;
+
+	memset(stats, 0, sizeof(graph_vram_stats_t));
+
+	for (i = 0; i < graph_vram_count; i++)
+	{
+
+		if (graph_vram_regions[i].used)
+		{
+
+			stats->allocations++;
+			continue;
+
+		}
+
+		stats->free_regions++;
+
+		if (graph_vram_regions[i].size > stats->largest_free)
+		{
+			stats->largest_free = graph_vram_regions[i].size;
+		}
+
+	}
+
+	stats->used = graph_vram_used;
+	stats->free = GRAPH_VRAM_MAX_WORDS - graph_vram_used;
+	stats->peak_used = graph_vram_peak;
+	stats->high_water = graph_vram_high;
+	stats->failures = graph_vram_failures;
+
+	// Share of the free space that can't be had in one piece
+	if (stats->free > 0)
+	{
+		stats->fragmentation = 100 - (int)(((long long)stats->largest_free * 100) / stats->free);
+	}
 
 }
 
@@ -17,6 +17,9 @@ void Vu0IdMatrix(VU_MATRIX *m)
 
 void Vu0ResetMatrix(VU_MATRIX *m)
 {
+#ifdef VU0_REFERENCE
+	VuxResetMatrix(m);
+#else
 	asm __volatile__(
 #if __GNUC__ > 3
 	"vmr32.xyzw  $vf18, $vf0    \n"
@@ -38,6 +41,7 @@ void Vu0ResetMatrix(VU_MATRIX *m)
 
 	: : "r"(m)
     );
+#endif
 }
 
 #if 0
@@ -61,6 +65,12 @@ void VuxRotMatrix(VU_MATRIX *m, VU_VECTOR *r)
 void Vu0TransMatrix(VU_MATRIX *m, VU_VECTOR *t)
 {
 
+#ifdef VU0_REFERENCE
+	m->m[3][0] = t->x;
+	m->m[3][1] = t->y;
+	m->m[3][2] = t->z;
+	m->m[3][3] = t->w;
+#else
 	asm __volatile__ (
 #if __GNUC__ > 3
    "lqc2    $vf1,  0(%1)  \n"      // load 1 qword from 't' to vu's vf1
@@ -72,6 +82,7 @@ void Vu0TransMatrix(VU_MATRIX *m, VU_VECTOR *t)
 
    : : "r" (m), "r" (t)
    );
+#endif
 }
 
 void Vu0TransMatrixXYZ(VU_MATRIX *m,float x, float y, float z)
@@ -93,6 +104,11 @@ void Vu0TransMatrixXYZ(VU_MATRIX *m,float x, float y, float z)
 void Vu0ScaleMatrix(VU_MATRIX *m, VU_VECTOR *s)
 {
 
+#ifdef VU0_REFERENCE
+	m->m[0][0] *= s->x;
+	m->m[1][1] *= s->y;
+	m->m[2][2] *= s->z;
+#else
 	asm __volatile__ (
 #if __GNUC__ > 3
 	"lqc2    $vf1,   0(%1) \n"      // load 1 qword from 't' to vu's vf1
@@ -130,6 +146,7 @@ void Vu0ScaleMatrix(VU_MATRIX *m, VU_VECTOR *s)
 
    : : "r" (m), "r" (s)
    );
+#endif
 
 }
 
@@ -148,6 +165,9 @@ void Vu0ScaleMatrixXYZ(VU_MATRIX *m, float x, float y, float z)
 void Vu0MulMatrix(VU_MATRIX *m0, VU_MATRIX *m1, VU_MATRIX *out)
 {
 
+#ifdef VU0_REFERENCE
+	VuxMulMatrix(m0, m1, out);
+#else
 	asm __volatile__ (
 #if __GNUC__ > 3
    "lqc2   $vf1, 0x00(%0)  \n"
@@ -210,6 +230,7 @@ void Vu0MulMatrix(VU_MATRIX *m0, VU_MATRIX *m1, VU_MATRIX *out)
 #endif
    : :  "r" (m0), "r" (m1), "r" (out)
   );
+#endif
 }
 
 void Vu0InverseMatrix(VU_MATRIX *in, VU_MATRIX *out)
@@ -227,6 +248,12 @@ void Vu0ApplyMatrix(VU_MATRIX *m, VU_VECTOR *v0, VU_VECTOR *out)
 	out->w = m->m[0][3]*v0->x + m->m[1][3]*v0->y + m->m[2][3]*v0->z + m->m[3][3]*v0->w;
 	*/
 
+#ifdef VU0_REFERENCE
+	VU_VECTOR work;
+
+	VuxApplyMatrix(m, v0, &work);
+	*out = work;
+#else
 	asm __volatile__(
 #if __GNUC__ > 3
         "lqc2            $vf20,  0x00(%1)  \n"
@@ -253,6 +280,7 @@ void Vu0ApplyMatrix(VU_MATRIX *m, VU_VECTOR *v0, VU_VECTOR *out)
 #endif
         : : "r"(m), "r"(v0), "r"(out)
     );
+#endif
 
 }
 
@@ -264,6 +292,12 @@ void Vu0ApplyRotMatrix(VU_MATRIX *m, VU_VECTOR *v0, VU_VECTOR *out)
 	out->z = m->m[0][2]*v0->x + m->m[1][2]*v0->y + m->m[2][2]*v0->z;
 	*/
 
+#ifdef VU0_REFERENCE
+	VU_VECTOR work;
+
+	VuxApplyRotMatrix(m, v0, &work);
+	*out = work;
+#else
 	asm __volatile__(
 #if __GNUC__ > 3
         "lqc2            $vf20,  0x00(%1)  \n"
@@ -288,12 +322,16 @@ void Vu0ApplyRotMatrix(VU_MATRIX *m, VU_VECTOR *v0, VU_VECTOR *out)
 #endif
         : : "r"(m), "r"(v0), "r"(out)
     );
+#endif
 
 }
 
 void Vu0CopyMatrix(VU_MATRIX *dest, VU_MATRIX *src)
 {
 
+#ifdef VU0_REFERENCE
+	*dest = *src;
+#else
 	asm __volatile__ (
 #if __GNUC__ > 3
    "lqc2   $vf1,   0(%1) \n"   // load 1 qword from ee
@@ -319,6 +357,7 @@ void Vu0CopyMatrix(VU_MATRIX *dest, VU_MATRIX *src)
 
    : : "r" (dest), "r" (src)
    );
+#endif
 }
 
 float Vu0DotProduct(VU_VECTOR *v0, VU_VECTOR *v1)
@@ -327,6 +366,9 @@ float Vu0DotProduct(VU_VECTOR *v0, VU_VECTOR *v1)
 
 	/*	ret = (v0.x*v1.x + v0.y*v1.y + v0.z*v1.z);*/
 
+#ifdef VU0_REFERENCE
+	ret = VuxDotProduct(v0, v1);
+#else
 	asm __volatile__ (
 #if __GNUC__ > 3
    "lqc2 $vf1, 0(%1) \n"   // load 1 qword from ee
@@ -351,6 +393,7 @@ float Vu0DotProduct(VU_VECTOR *v0, VU_VECTOR *v1)
 #endif
    : "=r" (ret) : "r" (v0), "r" (v1)
    );
+#endif
 
 	return ret;
 }
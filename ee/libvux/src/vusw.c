@@ -461,10 +461,10 @@ void VuxVectorNormal0(VU_VECTOR *in, VU_VECTOR *out)
 {
    float m = sqrtf(in->x*in->x + in->y*in->y + in->z*in->z + in->w*in->w);
 
-   out->x /= m;
-   out->y /= m;
-   out->z /= m;
-   out->w /= m;
+   out->x = in->x / m;
+   out->y = in->y / m;
+   out->z = in->z / m;
+   out->w = in->w / m;
 }
 
 
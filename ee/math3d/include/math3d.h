@@ -128,6 +128,60 @@ void calculate_colours(VECTOR *output, int count, VECTOR *colours, VECTOR *light
 /** Calculate vertex values by applying the specific local_screen matrix. */
 void calculate_vertices(VECTOR *output, int count, VECTOR *vertices, MATRIX local_screen);
 
+/* BATCH FUNCTIONS */
+
+/** Maximum number of directional lights in a batch. Ambient lights aren't limited. */
+#define MATH3D_BATCH_LIGHTS	4
+
+/** Transformation and lighting state of a batch, filled in by create_batch(). */
+typedef struct {
+ MATRIX local_screen;
+ MATRIX local_light;
+ /** Directional light directions, one per column: divided by their w and negated. */
+ MATRIX light_directions;
+ /** Directional light colours, one per row. */
+ MATRIX light_colours;
+ /** Sum of the ambient light colours. */
+ VECTOR ambient;
+} math3d_batch_t;
+
+/** Set up a batch from the same values given to calculate_vertices(), calculate_normals() and calculate_lights().
+ * Returns -1 if there are more than MATH3D_BATCH_LIGHTS directional lights, 0 otherwise.
+ */
+int create_batch(math3d_batch_t *batch, MATRIX local_screen, MATRIX local_light, VECTOR *light_directions, VECTOR *light_colours, const int *light_types, int light_count);
+
+/** Same as calculate_normals(), two normals at a time. */
+void calculate_normals_batch(VECTOR *output, int count, VECTOR *normals, MATRIX local_light);
+
+/** Same as calculate_vertices(), two vertices at a time.
+ * Vertices outside of the clipping volume are output as (0, 0, 0, 1).
+ */
+void calculate_vertices_batch(VECTOR *output, int count, VECTOR *vertices, MATRIX local_screen);
+
+/** Transform and light an array of vertices in a single pass.
+ * Gives the same vertices as calculate_vertices_batch(), and the same colours as
+ * calculate_normals(), calculate_lights() then calculate_colours(), except that
+ * the w of the colours is the input one, clamped.
+ */
+void calculate_batch(VECTOR *vertex_output, VECTOR *colour_output, int count, VECTOR *vertices, VECTOR *normals, VECTOR *colours, math3d_batch_t *batch);
+
+/* REFERENCE FUNCTIONS */
+
+/** Plain C versions of the functions that use VU0.
+ * They give the same results, within the rounding differences of VU0, and are
+ * meant for checking them. When the library is built with VU0_REFERENCE
+ * defined, the VU0 functions use them instead, so that it builds on any host.
+ */
+void vector_apply_ref(VECTOR output, VECTOR input0, MATRIX input1);
+void vector_copy_ref(VECTOR output, VECTOR input0);
+void vector_normalize_ref(VECTOR output, VECTOR input0);
+void vector_outerproduct_ref(VECTOR output, VECTOR input0, VECTOR input1);
+void matrix_copy_ref(MATRIX output, MATRIX input0);
+void matrix_multiply_ref(MATRIX output, MATRIX input0, MATRIX input1);
+void calculate_normals_ref(VECTOR *output, int count, VECTOR *normals, MATRIX local_light);
+void calculate_vertices_ref(VECTOR *output, int count, VECTOR *vertices, MATRIX local_screen);
+void calculate_batch_ref(VECTOR *vertex_output, VECTOR *colour_output, int count, VECTOR *vertices, VECTOR *normals, VECTOR *colours, math3d_batch_t *batch);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,174 @@
+/*
+# _____     ___ ____     ___ ____
+#  ____|   |    ____|   |        | |____|
+# |     ___|   |____ ___|    ____| |    \    PS2DEV Open Source Project.
+#-----------------------------------------------------------------------
+# Copyright 2001-2004, ps2dev - http://www.ps2dev.org
+# Licenced under Academic Free License version 2.0
+# Review ps2sdk README & LICENSE files for further details.
+#
+# math3d batch benchmark
+#
+# Times the per-vertex calculate functions against the batch ones and their
+# C references, in cpu cycles per vertex, and checks that the batch functions
+# give the same results as the references.
+*/
+
+#include <stdio.h>
+#include <math.h>
+
+#include <kernel.h>
+#include <tamtypes.h>
+#include <timer.h>
+#include <math3d.h>
+
+#define COUNT	1024
+#define RUNS	16
+
+static VECTOR vertices[COUNT], normals[COUNT], colours[COUNT];
+static VECTOR vertex_output[COUNT], normal_output[COUNT], light_output[COUNT], colour_output[COUNT];
+static VECTOR ref_vertices[COUNT], ref_normals[COUNT], ref_colours[COUNT];
+
+static VECTOR object_position = { 0.00f, 0.00f, 0.00f, 1.00f };
+static VECTOR object_rotation = { 0.30f, 0.60f, 0.00f, 1.00f };
+static VECTOR camera_position = { 0.00f, 0.00f, 100.00f, 1.00f };
+static VECTOR camera_rotation = { 0.00f, 0.00f, 0.00f, 1.00f };
+
+#define LIGHT_COUNT	4
+
+static VECTOR light_directions[LIGHT_COUNT] = {
+	{ 0.00f, 0.00f, 0.00f, 1.00f },
+	{ 1.00f, 0.00f, -1.00f, 1.00f },
+	{ 0.00f, 1.00f, -1.00f, 1.00f },
+	{ -1.00f, -1.00f, -1.00f, 1.00f },
+};
+
+static VECTOR light_colours[LIGHT_COUNT] = {
+	{ 0.00f, 0.00f, 0.00f, 1.00f },
+	{ 1.00f, 0.00f, 0.00f, 1.00f },
+	{ 0.30f, 0.30f, 0.30f, 1.00f },
+	{ 0.50f, 0.50f, 0.50f, 1.00f },
+};
+
+static const int light_types[LIGHT_COUNT] = {
+	LIGHT_AMBIENT,
+	LIGHT_DIRECTIONAL,
+	LIGHT_DIRECTIONAL,
+	LIGHT_DIRECTIONAL,
+};
+
+static math3d_batch_t batch;
+static MATRIX local_screen, local_light;
+
+// Best time of RUNS runs, in cycles per vertex.
+#define BENCH(name, call) do { \
+	u32 start, ticks, best = 0xffffffff; \
+	int run; \
+	for (run = 0; run < RUNS; run++) { \
+		start = cpu_ticks(); \
+		call; \
+		ticks = cpu_ticks() - start; \
+		if (ticks < best) \
+			best = ticks; \
+	} \
+	printf("%-36s %4u.%02u cycles/vertex\n", name, best / COUNT, (best % COUNT) * 100 / COUNT); \
+} while (0)
+
+static void create_sphere(void)
+{
+	int i;
+
+	// A spiral around a sphere of radius 10
+	for (i = 0; i < COUNT; i++)
+	{
+		float z = 1.00f - (2.00f * i + 1.00f) / COUNT;
+		float r = sqrtf(1.00f - z * z);
+		float a = i * 2.39996f;
+
+		normals[i][0] = r * cosf(a);
+		normals[i][1] = r * sinf(a);
+		normals[i][2] = z;
+		normals[i][3] = 1.00f;
+
+		vertices[i][0] = normals[i][0] * 10.00f;
+		vertices[i][1] = normals[i][1] * 10.00f;
+		vertices[i][2] = normals[i][2] * 10.00f;
+		vertices[i][3] = 1.00f;
+
+		colours[i][0] = 0.50f + normals[i][0] * 0.50f;
+		colours[i][1] = 0.50f + normals[i][1] * 0.50f;
+		colours[i][2] = 0.50f + normals[i][2] * 0.50f;
+		colours[i][3] = 1.00f;
+	}
+}
+
+static void create_matrices(void)
+{
+	MATRIX local_world, world_view, view_screen;
+
+	create_local_world(local_world, object_position, object_rotation);
+	create_local_light(local_light, object_rotation);
+	create_world_view(world_view, camera_position, camera_rotation);
+	create_view_screen(view_screen, 4.00f / 3.00f, -3.00f, 3.00f, -3.00f, 3.00f, 1.00f, 2000.00f);
+	create_local_screen(local_screen, local_world, world_view, view_screen);
+}
+
+static void calculate_separate(void)
+{
+	calculate_normals(normal_output, COUNT, normals, local_light);
+	calculate_lights(light_output, COUNT, normal_output, light_directions, light_colours, light_types, LIGHT_COUNT);
+	calculate_colours(colour_output, COUNT, colours, light_output);
+	calculate_vertices(vertex_output, COUNT, vertices, local_screen);
+}
+
+static float max_error(VECTOR *a, VECTOR *b)
+{
+	float error = 0.00f, e;
+	int i, j;
+
+	for (i = 0; i < COUNT; i++)
+	{
+		for (j = 0; j < 4; j++)
+		{
+			e = fabsf(a[i][j] - b[i][j]);
+			if (e > error)
+				error = e;
+		}
+	}
+
+	return error;
+}
+
+int main(int argc, char *argv[])
+{
+	(void)argc;
+	(void)argv;
+
+	create_sphere();
+	create_matrices();
+
+	if (create_batch(&batch, local_screen, local_light, light_directions, light_colours, light_types, LIGHT_COUNT) < 0)
+	{
+		printf("batchbench: too many lights\n");
+		return 1;
+	}
+
+	printf("%d vertices, best of %d runs\n", COUNT, RUNS);
+
+	BENCH("calculate_vertices", calculate_vertices(vertex_output, COUNT, vertices, local_screen));
+	BENCH("calculate_vertices_batch", calculate_vertices_batch(vertex_output, COUNT, vertices, local_screen));
+	BENCH("calculate_vertices_ref", calculate_vertices_ref(ref_vertices, COUNT, vertices, local_screen));
+	printf("  max error %f\n", max_error(vertex_output, ref_vertices));
+
+	BENCH("calculate_normals", calculate_normals(normal_output, COUNT, normals, local_light));
+	BENCH("calculate_normals_batch", calculate_normals_batch(normal_output, COUNT, normals, local_light));
+	BENCH("calculate_normals_ref", calculate_normals_ref(ref_normals, COUNT, normals, local_light));
+	printf("  max error %f\n", max_error(normal_output, ref_normals));
+
+	BENCH("normals, lights, colours, vertices", calculate_separate());
+	BENCH("calculate_batch", calculate_batch(vertex_output, colour_output, COUNT, vertices, normals, colours, &batch));
+	BENCH("calculate_batch_ref", calculate_batch_ref(ref_vertices, ref_colours, COUNT, vertices, normals, colours, &batch));
+	printf("  max error %f, %f\n", max_error(vertex_output, ref_vertices), max_error(colour_output, ref_colours));
+
+	return 0;
+}
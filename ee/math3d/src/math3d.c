@@ -18,6 +18,9 @@
  /* VECTOR FUNCTIONS */
 
  void vector_apply(VECTOR output, VECTOR input0, MATRIX input1) {
+#ifdef VU0_REFERENCE
+  vector_apply_ref(output, input0, input1);
+#else
   asm __volatile__ (
 #if __GNUC__ > 3
    "lqc2		$vf1, 0x00(%2)	\n"
@@ -45,6 +48,7 @@
    : : "r" (output), "r" (input0), "r" (input1)
    : "memory"
   );
+#endif
  }
 
  void vector_clamp(VECTOR output, VECTOR input0, float min, float max) {
@@ -71,6 +75,9 @@
  }
 
  void vector_copy(VECTOR output, VECTOR input0) {
+#ifdef VU0_REFERENCE
+  vector_copy_ref(output, input0);
+#else
   asm __volatile__ (
 #if __GNUC__ > 3
    "lqc2		$vf1, 0x00(%1)	\n"
@@ -82,6 +89,7 @@
    : : "r" (output), "r" (input0)
    : "memory"
   );
+#endif
  }
 
  float vector_innerproduct(VECTOR input0, VECTOR input1) {
@@ -119,6 +127,9 @@
  }
 
  void vector_normalize(VECTOR output, VECTOR input0) {
+#ifdef VU0_REFERENCE
+  vector_normalize_ref(output, input0);
+#else
   asm __volatile__ (
 #if __GNUC__ > 3
    "lqc2		$vf1, 0x00(%1)	\n"
@@ -146,9 +157,13 @@
    : : "r" (output), "r" (input0)
    : "memory"
   );
+#endif
  }
 
  void vector_outerproduct(VECTOR output, VECTOR input0, VECTOR input1) {
+#ifdef VU0_REFERENCE
+  vector_outerproduct_ref(output, input0, input1);
+#else
   asm __volatile__ (
 #if __GNUC__ > 3
    "lqc2		$vf1, 0x00(%1)	\n"
@@ -168,6 +183,7 @@
    : : "r" (output), "r" (input0), "r" (input1)
    : "memory"
   );
+#endif
  }
  
  void vector_add(VECTOR sum, VECTOR addend, VECTOR summand) {
@@ -205,6 +221,9 @@ void vector_triangle_normal(VECTOR output, VECTOR a, VECTOR b, VECTOR c) {
  /* MATRIX FUNCTIONS */
 
  void matrix_copy(MATRIX output, MATRIX input0) {
+#ifdef VU0_REFERENCE
+  matrix_copy_ref(output, input0);
+#else
   asm __volatile__ (
 #if __GNUC__ > 3
    "lqc2		$vf1, 0x00(%1)  \n"
@@ -228,6 +247,7 @@ void vector_triangle_normal(VECTOR output, VECTOR a, VECTOR b, VECTOR c) {
    : : "r" (output), "r" (input0)
    : "memory"
   );
+#endif
  }
 
  void matrix_inverse(MATRIX output, MATRIX input0) {
@@ -249,6 +269,9 @@ void vector_triangle_normal(VECTOR output, VECTOR a, VECTOR b, VECTOR c) {
  }
 
  void matrix_multiply(MATRIX output, MATRIX input0, MATRIX input1) {
+#ifdef VU0_REFERENCE
+  matrix_multiply_ref(output, input0, input1);
+#else
   asm __volatile__ (
 #if __GNUC__ > 3
    "lqc2		$vf1, 0x00(%1)	\n"
@@ -312,6 +335,7 @@ void vector_triangle_normal(VECTOR output, VECTOR a, VECTOR b, VECTOR c) {
    : : "r" (output), "r" (input0), "r" (input1)
    : "memory"
   );
+#endif
  }
 
  void matrix_rotate(MATRIX output, MATRIX input0, VECTOR input1) {
@@ -476,6 +500,9 @@ void vector_triangle_normal(VECTOR output, VECTOR a, VECTOR b, VECTOR c) {
  /* CALCULATE FUNCTIONS */
 
  void calculate_normals(VECTOR *output, int count, VECTOR *normals, MATRIX local_light) {
+#ifdef VU0_REFERENCE
+  calculate_normals_ref(output, count, normals, local_light);
+#else
   asm __volatile__ (
 #if __GNUC__ > 3
    "lqc2		$vf1, 0x00(%3)	\n"
@@ -519,6 +546,7 @@ void vector_triangle_normal(VECTOR output, VECTOR a, VECTOR b, VECTOR c) {
    : : "r" (output), "r" (count), "r" (normals), "r" (local_light)
    : "memory"
   );
+#endif
  }
 
  void calculate_lights(VECTOR *output, int count, VECTOR *normals, VECTOR *light_direction, VECTOR *light_colour, const int *light_type, int light_count) {
@@ -587,6 +615,9 @@ void vector_triangle_normal(VECTOR output, VECTOR a, VECTOR b, VECTOR c) {
  }
 
  void calculate_vertices(VECTOR *output, int count, VECTOR *vertices, MATRIX local_screen) {
+#ifdef VU0_REFERENCE
+  calculate_vertices_ref(output, count, vertices, local_screen);
+#else
   asm __volatile__ (
 #if __GNUC__ > 3
    "lqc2		$vf1, 0x00(%3)	\n"
@@ -641,4 +672,5 @@ void vector_triangle_normal(VECTOR output, VECTOR a, VECTOR b, VECTOR c) {
    : : "r" (output), "r" (count), "r" (vertices), "r" (local_screen)
    : "$10", "memory"
   );
+#endif
  }
@@ -0,0 +1,439 @@
+/*
+# _____     ___ ____     ___ ____
+#  ____|   |    ____|   |        | |____|
+# |     ___|   |____ ___|    ____| |    \    PS2DEV Open Source Project.
+#-----------------------------------------------------------------------
+# Copyright 2001-2005, ps2dev - http://www.ps2dev.org
+# Licenced under Academic Free License version 2.0
+# Review ps2sdk README & LICENSE files for further details.
+*/
+
+ #include <tamtypes.h>
+
+ #include <math3d.h>
+ #include <string.h>
+
+#ifndef VU0_REFERENCE
+ // Upper limit of the colours, as in calculate_colours().
+ static VECTOR colour_max = { 1.99f, 1.99f, 1.99f, 1.99f };
+#endif
+
+ /* CREATE FUNCTIONS */
+
+ int create_batch(math3d_batch_t *batch, MATRIX local_screen, MATRIX local_light, VECTOR *light_directions, VECTOR *light_colours, const int *light_types, int light_count) {
+  int loop0, lights = 0;
+
+  // Copy the matrices.
+  matrix_copy(batch->local_screen, local_screen);
+  matrix_copy(batch->local_light, local_light);
+
+  // Clear the lights.
+  memset(batch->light_directions, 0, sizeof(MATRIX));
+  memset(batch->light_colours, 0, sizeof(MATRIX));
+  memset(batch->ambient, 0, sizeof(VECTOR));
+
+  // For each light...
+  for (loop0=0;loop0<light_count;loop0++) {
+
+   // If this is an ambient light, add it to the others.
+   if (light_types[loop0] == LIGHT_AMBIENT) {
+
+    batch->ambient[0] += light_colours[loop0][0];
+    batch->ambient[1] += light_colours[loop0][1];
+    batch->ambient[2] += light_colours[loop0][2];
+
+   // Else, if this is a directional light, give it the next column.
+   } else if (light_types[loop0] == LIGHT_DIRECTIONAL) {
+
+    if (lights == MATH3D_BATCH_LIGHTS) { return -1; }
+
+    batch->light_directions[0x00 + lights] = -(light_directions[loop0][0] / light_directions[loop0][3]);
+    batch->light_directions[0x04 + lights] = -(light_directions[loop0][1] / light_directions[loop0][3]);
+    batch->light_directions[0x08 + lights] = -(light_directions[loop0][2] / light_directions[loop0][3]);
+
+    batch->light_colours[(lights * 4) + 0] = light_colours[loop0][0];
+    batch->light_colours[(lights * 4) + 1] = light_colours[loop0][1];
+    batch->light_colours[(lights * 4) + 2] = light_colours[loop0][2];
+
+    lights++;
+
+   }
+
+  }
+
+  return 0;
+
+ }
+
+ /* BATCH FUNCTIONS */
+
+ void calculate_normals_batch(VECTOR *output, int count, VECTOR *normals, MATRIX local_light) {
+#ifdef VU0_REFERENCE
+  calculate_normals_ref(output, count, normals, local_light);
+#else
+  int pairs = count >> 1;
+
+  // Two normals per loop, so that each one's math fills the other's stalls.
+  if (pairs > 0) {
+   asm __volatile__ (
+#if __GNUC__ > 3
+    "lqc2		$vf1, 0x00(%3)	\n"
+    "lqc2		$vf2, 0x10(%3)	\n"
+    "lqc2		$vf3, 0x20(%3)	\n"
+    "lqc2		$vf4, 0x30(%3)	\n"
+    "1:					\n"
+    "lqc2		$vf5, 0x00(%2)	\n"
+    "lqc2		$vf6, 0x10(%2)	\n"
+    "vmulaw		$ACC, $vf4, $vf0	\n"
+    "vmaddax		$ACC, $vf1, $vf5	\n"
+    "vmadday		$ACC, $vf2, $vf5	\n"
+    "vmaddz		$vf7, $vf3, $vf5	\n"
+    "vmulaw		$ACC, $vf4, $vf0	\n"
+    "vmaddax		$ACC, $vf1, $vf6	\n"
+    "vmadday		$ACC, $vf2, $vf6	\n"
+    "vmaddz		$vf8, $vf3, $vf6	\n"
+    "vdiv		$Q, $vf0w, $vf7w	\n"
+    "addi		%2, 0x20	\n"
+    "vwaitq			\n"
+    "vmulq.xyzw		$vf7, $vf7, $Q	\n"
+    "vdiv		$Q, $vf0w, $vf8w	\n"
+    "sqc2		$vf7, 0x00(%0)	\n"
+    "vwaitq			\n"
+    "vmulq.xyzw		$vf8, $vf8, $Q	\n"
+    "sqc2		$vf8, 0x10(%0)	\n"
+    "addi		%0, 0x20	\n"
+    "addi		%1, -1	\n"
+    "bne		$0, %1, 1b	\n"
+#else
+    "lqc2		vf1, 0x00(%3)	\n"
+    "lqc2		vf2, 0x10(%3)	\n"
+    "lqc2		vf3, 0x20(%3)	\n"
+    "lqc2		vf4, 0x30(%3)	\n"
+    "1:					\n"
+    "lqc2		vf5, 0x00(%2)	\n"
+    "lqc2		vf6, 0x10(%2)	\n"
+    "vmulaw		ACC, vf4, vf0	\n"
+    "vmaddax		ACC, vf1, vf5	\n"
+    "vmadday		ACC, vf2, vf5	\n"
+    "vmaddz		vf7, vf3, vf5	\n"
+    "vmulaw		ACC, vf4, vf0	\n"
+    "vmaddax		ACC, vf1, vf6	\n"
+    "vmadday		ACC, vf2, vf6	\n"
+    "vmaddz		vf8, vf3, vf6	\n"
+    "vdiv		Q, vf0w, vf7w	\n"
+    "addi		%2, 0x20	\n"
+    "vwaitq			\n"
+    "vmulq.xyzw		vf7, vf7, Q	\n"
+    "vdiv		Q, vf0w, vf8w	\n"
+    "sqc2		vf7, 0x00(%0)	\n"
+    "vwaitq			\n"
+    "vmulq.xyzw		vf8, vf8, Q	\n"
+    "sqc2		vf8, 0x10(%0)	\n"
+    "addi		%0, 0x20	\n"
+    "addi		%1, -1	\n"
+    "bne		$0, %1, 1b	\n"
+#endif
+    : "+r" (output), "+r" (pairs), "+r" (normals) : "r" (local_light)
+    : "memory"
+   );
+  }
+
+  // The odd one out.
+  if (count & 1) { calculate_normals(output, 1, normals, local_light); }
+#endif
+ }
+
+ void calculate_vertices_batch(VECTOR *output, int count, VECTOR *vertices, MATRIX local_screen) {
+#ifdef VU0_REFERENCE
+  calculate_vertices_ref(output, count, vertices, local_screen);
+#else
+  int pairs = count >> 1;
+
+  // Two vertices per loop. The clipping flags hold the judgements of both,
+  // the second one's in the low bits.
+  if (pairs > 0) {
+   asm __volatile__ (
+#if __GNUC__ > 3
+    "lqc2		$vf1, 0x00(%3)	\n"
+    "lqc2		$vf2, 0x10(%3)	\n"
+    "lqc2		$vf3, 0x20(%3)	\n"
+    "lqc2		$vf4, 0x30(%3)	\n"
+    "1:					\n"
+    "lqc2		$vf5, 0x00(%2)	\n"
+    "lqc2		$vf6, 0x10(%2)	\n"
+    "vmulaw		$ACC, $vf4, $vf0	\n"
+    "vmaddax		$ACC, $vf1, $vf5	\n"
+    "vmadday		$ACC, $vf2, $vf5	\n"
+    "vmaddz		$vf7, $vf3, $vf5	\n"
+    "vmulaw		$ACC, $vf4, $vf0	\n"
+    "vmaddax		$ACC, $vf1, $vf6	\n"
+    "vmadday		$ACC, $vf2, $vf6	\n"
+    "vmaddz		$vf8, $vf3, $vf6	\n"
+    "vdiv		$Q, $vf0w, $vf7w	\n"
+    "vclipw.xyz		$vf7, $vf7	\n"
+    "vclipw.xyz		$vf8, $vf8	\n"
+    "addi		%2, 0x20	\n"
+    "vwaitq			\n"
+    "vmulq.xyz		$vf7, $vf7, $Q	\n"
+    "vdiv		$Q, $vf0w, $vf8w	\n"
+    "cfc2		$10, $18	\n"
+    "andi		$11, $10, 0xfc0	\n"
+    "beq		$11, $0, 2f	\n"
+    "vmove.xyzw		$vf7, $vf0	\n"
+    "2:					\n"
+    "sqc2		$vf7, 0x00(%0)	\n"
+    "andi		$11, $10, 0x3f	\n"
+    "vwaitq			\n"
+    "vmulq.xyz		$vf8, $vf8, $Q	\n"
+    "beq		$11, $0, 3f	\n"
+    "vmove.xyzw		$vf8, $vf0	\n"
+    "3:					\n"
+    "sqc2		$vf8, 0x10(%0)	\n"
+    "addi		%0, 0x20	\n"
+    "addi		%1, -1	\n"
+    "bne		$0, %1, 1b	\n"
+#else
+    "lqc2		vf1, 0x00(%3)	\n"
+    "lqc2		vf2, 0x10(%3)	\n"
+    "lqc2		vf3, 0x20(%3)	\n"
+    "lqc2		vf4, 0x30(%3)	\n"
+    "1:					\n"
+    "lqc2		vf5, 0x00(%2)	\n"
+    "lqc2		vf6, 0x10(%2)	\n"
+    "vmulaw		ACC, vf4, vf0	\n"
+    "vmaddax		ACC, vf1, vf5	\n"
+    "vmadday		ACC, vf2, vf5	\n"
+    "vmaddz		vf7, vf3, vf5	\n"
+    "vmulaw		ACC, vf4, vf0	\n"
+    "vmaddax		ACC, vf1, vf6	\n"
+    "vmadday		ACC, vf2, vf6	\n"
+    "vmaddz		vf8, vf3, vf6	\n"
+    "vdiv		Q, vf0w, vf7w	\n"
+    "vclipw.xyz		vf7, vf7	\n"
+    "vclipw.xyz		vf8, vf8	\n"
+    "addi		%2, 0x20	\n"
+    "vwaitq			\n"
+    "vmulq.xyz		vf7, vf7, Q	\n"
+    "vdiv		Q, vf0w, vf8w	\n"
+    "cfc2		$10, $18	\n"
+    "andi		$11, $10, 0xfc0	\n"
+    "beq		$11, $0, 2f	\n"
+    "vmove.xyzw		vf7, vf0	\n"
+    "2:					\n"
+    "sqc2		vf7, 0x00(%0)	\n"
+    "andi		$11, $10, 0x3f	\n"
+    "vwaitq			\n"
+    "vmulq.xyz		vf8, vf8, Q	\n"
+    "beq		$11, $0, 3f	\n"
+    "vmove.xyzw		vf8, vf0	\n"
+    "3:					\n"
+    "sqc2		vf8, 0x10(%0)	\n"
+    "addi		%0, 0x20	\n"
+    "addi		%1, -1	\n"
+    "bne		$0, %1, 1b	\n"
+#endif
+    : "+r" (output), "+r" (pairs), "+r" (vertices) : "r" (local_screen)
+    : "$10", "$11", "memory"
+   );
+  }
+
+  // The odd one out.
+  if (count & 1) {
+   asm __volatile__ (
+#if __GNUC__ > 3
+    "lqc2		$vf1, 0x00(%2)	\n"
+    "lqc2		$vf2, 0x10(%2)	\n"
+    "lqc2		$vf3, 0x20(%2)	\n"
+    "lqc2		$vf4, 0x30(%2)	\n"
+    "lqc2		$vf5, 0x00(%1)	\n"
+    "vmulaw		$ACC, $vf4, $vf0	\n"
+    "vmaddax		$ACC, $vf1, $vf5	\n"
+    "vmadday		$ACC, $vf2, $vf5	\n"
+    "vmaddz		$vf7, $vf3, $vf5	\n"
+    "vdiv		$Q, $vf0w, $vf7w	\n"
+    "vclipw.xyz		$vf7, $vf7	\n"
+    "vwaitq			\n"
+    "vmulq.xyz		$vf7, $vf7, $Q	\n"
+    "cfc2		$10, $18	\n"
+    "andi		$10, $10, 0x3f	\n"
+    "beq		$10, $0, 1f	\n"
+    "vmove.xyzw		$vf7, $vf0	\n"
+    "1:					\n"
+    "sqc2		$vf7, 0x00(%0)	\n"
+#else
+    "lqc2		vf1, 0x00(%2)	\n"
+    "lqc2		vf2, 0x10(%2)	\n"
+    "lqc2		vf3, 0x20(%2)	\n"
+    "lqc2		vf4, 0x30(%2)	\n"
+    "lqc2		vf5, 0x00(%1)	\n"
+    "vmulaw		ACC, vf4, vf0	\n"
+    "vmaddax		ACC, vf1, vf5	\n"
+    "vmadday		ACC, vf2, vf5	\n"
+    "vmaddz		vf7, vf3, vf5	\n"
+    "vdiv		Q, vf0w, vf7w	\n"
+    "vclipw.xyz		vf7, vf7	\n"
+    "vwaitq			\n"
+    "vmulq.xyz		vf7, vf7, Q	\n"
+    "cfc2		$10, $18	\n"
+    "andi		$10, $10, 0x3f	\n"
+    "beq		$10, $0, 1f	\n"
+    "vmove.xyzw		vf7, vf0	\n"
+    "1:					\n"
+    "sqc2		vf7, 0x00(%0)	\n"
+#endif
+    : : "r" (output), "r" (vertices), "r" (local_screen)
+    : "$10", "memory"
+   );
+  }
+#endif
+ }
+
+ void calculate_batch(VECTOR *vertex_output, VECTOR *colour_output, int count, VECTOR *vertices, VECTOR *normals, VECTOR *colours, math3d_batch_t *batch) {
+#ifdef VU0_REFERENCE
+  calculate_batch_ref(vertex_output, colour_output, count, vertices, normals, colours, batch);
+#else
+
+  if (count <= 0) { return; }
+
+  // All of the batch stays in vf1-vf17 for the whole loop:
+  //  vf1-vf4   local_screen
+  //  vf5-vf8   local_light
+  //  vf9-vf11  light directions, one light per column
+  //  vf12-vf15 light colours, one light per row
+  //  vf16      ambient colour
+  //  vf17      colour_max
+  // The lighting is done while the vertex division is under way.
+  asm __volatile__ (
+#if __GNUC__ > 3
+   "lqc2		$vf1, 0x00(%6)	\n"
+   "lqc2		$vf2, 0x10(%6)	\n"
+   "lqc2		$vf3, 0x20(%6)	\n"
+   "lqc2		$vf4, 0x30(%6)	\n"
+   "lqc2		$vf5, 0x40(%6)	\n"
+   "lqc2		$vf6, 0x50(%6)	\n"
+   "lqc2		$vf7, 0x60(%6)	\n"
+   "lqc2		$vf8, 0x70(%6)	\n"
+   "lqc2		$vf9, 0x80(%6)	\n"
+   "lqc2		$vf10, 0x90(%6)	\n"
+   "lqc2		$vf11, 0xa0(%6)	\n"
+   "lqc2		$vf12, 0xc0(%6)	\n"
+   "lqc2		$vf13, 0xd0(%6)	\n"
+   "lqc2		$vf14, 0xe0(%6)	\n"
+   "lqc2		$vf15, 0xf0(%6)	\n"
+   "lqc2		$vf16, 0x100(%6)	\n"
+   "lqc2		$vf17, 0x00(%7)	\n"
+   "1:					\n"
+   "lqc2		$vf18, 0x00(%3)	\n"
+   "lqc2		$vf19, 0x00(%4)	\n"
+   "lqc2		$vf20, 0x00(%5)	\n"
+   "vmulaw		$ACC, $vf8, $vf0	\n"
+   "vmaddax		$ACC, $vf5, $vf19	\n"
+   "vmadday		$ACC, $vf6, $vf19	\n"
+   "vmaddz		$vf22, $vf7, $vf19	\n"
+   "vmulaw		$ACC, $vf4, $vf0	\n"
+   "vmaddax		$ACC, $vf1, $vf18	\n"
+   "vmadday		$ACC, $vf2, $vf18	\n"
+   "vmaddz		$vf21, $vf3, $vf18	\n"
+   "vdiv		$Q, $vf0w, $vf22w	\n"
+   "vclipw.xyz		$vf21, $vf21	\n"
+   "addi		%3, 0x10	\n"
+   "addi		%4, 0x10	\n"
+   "addi		%5, 0x10	\n"
+   "vwaitq			\n"
+   "vmulq.xyz		$vf22, $vf22, $Q	\n"
+   "vdiv		$Q, $vf0w, $vf21w	\n"
+   "vmulax.xyzw		$ACC, $vf9, $vf22	\n"
+   "vmadday.xyzw	$ACC, $vf10, $vf22	\n"
+   "vmaddz.xyzw		$vf23, $vf11, $vf22	\n"
+   "vmaxx.xyzw		$vf23, $vf23, $vf0x	\n"
+   "vmulaw.xyzw		$ACC, $vf16, $vf0	\n"
+   "vmaddax.xyzw	$ACC, $vf12, $vf23	\n"
+   "vmadday.xyzw	$ACC, $vf13, $vf23	\n"
+   "vmaddaz.xyzw	$ACC, $vf14, $vf23	\n"
+   "vmaddw.xyzw		$vf24, $vf15, $vf23	\n"
+   "vmul.xyz		$vf20, $vf20, $vf24	\n"
+   "vmaxx.xyzw		$vf20, $vf20, $vf0x	\n"
+   "vminix.xyzw		$vf20, $vf20, $vf17x	\n"
+   "sqc2		$vf20, 0x00(%1)	\n"
+   "cfc2		$10, $18	\n"
+   "andi		$10, $10, 0x3f	\n"
+   "vwaitq			\n"
+   "vmulq.xyz		$vf21, $vf21, $Q	\n"
+   "beq		$10, $0, 2f	\n"
+   "vmove.xyzw		$vf21, $vf0	\n"
+   "2:					\n"
+   "sqc2		$vf21, 0x00(%0)	\n"
+   "addi		%0, 0x10	\n"
+   "addi		%1, 0x10	\n"
+   "addi		%2, -1	\n"
+   "bne		$0, %2, 1b	\n"
+#else
+   "lqc2		vf1, 0x00(%6)	\n"
+   "lqc2		vf2, 0x10(%6)	\n"
+   "lqc2		vf3, 0x20(%6)	\n"
+   "lqc2		vf4, 0x30(%6)	\n"
+   "lqc2		vf5, 0x40(%6)	\n"
+   "lqc2		vf6, 0x50(%6)	\n"
+   "lqc2		vf7, 0x60(%6)	\n"
+   "lqc2		vf8, 0x70(%6)	\n"
+   "lqc2		vf9, 0x80(%6)	\n"
+   "lqc2		vf10, 0x90(%6)	\n"
+   "lqc2		vf11, 0xa0(%6)	\n"
+   "lqc2		vf12, 0xc0(%6)	\n"
+   "lqc2		vf13, 0xd0(%6)	\n"
+   "lqc2		vf14, 0xe0(%6)	\n"
+   "lqc2		vf15, 0xf0(%6)	\n"
+   "lqc2		vf16, 0x100(%6)	\n"
+   "lqc2		vf17, 0x00(%7)	\n"
+   "1:					\n"
+   "lqc2		vf18, 0x00(%3)	\n"
+   "lqc2		vf19, 0x00(%4)	\n"
+   "lqc2		vf20, 0x00(%5)	\n"
+   "vmulaw		ACC, vf8, vf0	\n"
+   "vmaddax		ACC, vf5, vf19	\n"
+   "vmadday		ACC, vf6, vf19	\n"
+   "vmaddz		vf22, vf7, vf19	\n"
+   "vmulaw		ACC, vf4, vf0	\n"
+   "vmaddax		ACC, vf1, vf18	\n"
+   "vmadday		ACC, vf2, vf18	\n"
+   "vmaddz		vf21, vf3, vf18	\n"
+   "vdiv		Q, vf0w, vf22w	\n"
+   "vclipw.xyz		vf21, vf21	\n"
+   "addi		%3, 0x10	\n"
+   "addi		%4, 0x10	\n"
+   "addi		%5, 0x10	\n"
+   "vwaitq			\n"
+   "vmulq.xyz		vf22, vf22, Q	\n"
+   "vdiv		Q, vf0w, vf21w	\n"
+   "vmulax.xyzw		ACC, vf9, vf22	\n"
+   "vmadday.xyzw	ACC, vf10, vf22	\n"
+   "vmaddz.xyzw		vf23, vf11, vf22	\n"
+   "vmaxx.xyzw		vf23, vf23, vf0x	\n"
+   "vmulaw.xyzw		ACC, vf16, vf0	\n"
+   "vmaddax.xyzw	ACC, vf12, vf23	\n"
+   "vmadday.xyzw	ACC, vf13, vf23	\n"
+   "vmaddaz.xyzw	ACC, vf14, vf23	\n"
+   "vmaddw.xyzw		vf24, vf15, vf23	\n"
+   "vmul.xyz		vf20, vf20, vf24	\n"
+   "vmaxx.xyzw		vf20, vf20, vf0x	\n"
+   "vminix.xyzw		vf20, vf20, vf17x	\n"
+   "sqc2		vf20, 0x00(%1)	\n"
+   "cfc2		$10, $18	\n"
+   "andi		$10, $10, 0x3f	\n"
+   "vwaitq			\n"
+   "vmulq.xyz		vf21, vf21, Q	\n"
+   "beq		$10, $0, 2f	\n"
+   "vmove.xyzw		vf21, vf0	\n"
+   "2:					\n"
+   "sqc2		vf21, 0x00(%0)	\n"
+   "addi		%0, 0x10	\n"
+   "addi		%1, 0x10	\n"
+   "addi		%2, -1	\n"
+   "bne		$0, %2, 1b	\n"
+#endif
+   : "+r" (vertex_output), "+r" (colour_output), "+r" (count), "+r" (vertices), "+r" (normals), "+r" (colours)
+   : "r" (batch), "r" (colour_max)
+   : "$10", "memory"
+  );
+#endif
+ }
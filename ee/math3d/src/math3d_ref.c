@@ -0,0 +1,183 @@
+/*
+# _____     ___ ____     ___ ____
+#  ____|   |    ____|   |        | |____|
+# |     ___|   |____ ___|    ____| |    \    PS2DEV Open Source Project.
+#-----------------------------------------------------------------------
+# Copyright 2001-2005, ps2dev - http://www.ps2dev.org
+# Licenced under Academic Free License version 2.0
+# Review ps2sdk README & LICENSE files for further details.
+*/
+
+ #include <tamtypes.h>
+
+ #include <math3d.h>
+ #include <string.h>
+ #include <math.h>
+
+ /* VECTOR FUNCTIONS */
+
+ void vector_apply_ref(VECTOR output, VECTOR input0, MATRIX input1) {
+  VECTOR work; int loop0;
+
+  // Apply the matrix the way VU0 does: the input w is taken as 1.
+  for (loop0=0;loop0<4;loop0++) {
+   work[loop0] = (input1[0x00 + loop0] * input0[0]) + (input1[0x04 + loop0] * input0[1]) + (input1[0x08 + loop0] * input0[2]) + input1[0x0C + loop0];
+  }
+
+  // Output the result.
+  memcpy(output, work, sizeof(VECTOR));
+
+ }
+
+ void vector_copy_ref(VECTOR output, VECTOR input0) {
+
+  memmove(output, input0, sizeof(VECTOR));
+
+ }
+
+ void vector_normalize_ref(VECTOR output, VECTOR input0) {
+  float q;
+
+  // Divide x, y and z by the length, and clear w.
+  q = 1.00f / sqrtf((input0[0] * input0[0]) + (input0[1] * input0[1]) + (input0[2] * input0[2]));
+  output[0] = input0[0] * q;
+  output[1] = input0[1] * q;
+  output[2] = input0[2] * q;
+  output[3] = 0.00f;
+
+ }
+
+ void vector_outerproduct_ref(VECTOR output, VECTOR input0, VECTOR input1) {
+  VECTOR work;
+
+  // Calculate the outer product, with a w of 0.
+  work[0] = (input0[1] * input1[2]) - (input1[1] * input0[2]);
+  work[1] = (input0[2] * input1[0]) - (input1[2] * input0[0]);
+  work[2] = (input0[0] * input1[1]) - (input1[0] * input0[1]);
+  work[3] = 0.00f;
+
+  // Output the result.
+  memcpy(output, work, sizeof(VECTOR));
+
+ }
+
+ /* MATRIX FUNCTIONS */
+
+ void matrix_copy_ref(MATRIX output, MATRIX input0) {
+
+  memmove(output, input0, sizeof(MATRIX));
+
+ }
+
+ void matrix_multiply_ref(MATRIX output, MATRIX input0, MATRIX input1) {
+  MATRIX work; int loop0, loop1;
+
+  // Each row of the output is the row of input0 applied to input1.
+  for (loop0=0;loop0<4;loop0++) {
+   for (loop1=0;loop1<4;loop1++) {
+    work[(loop0 * 4) + loop1] = (input1[0x00 + loop1] * input0[(loop0 * 4) + 0]) + (input1[0x04 + loop1] * input0[(loop0 * 4) + 1]) + (input1[0x08 + loop1] * input0[(loop0 * 4) + 2]) + (input1[0x0C + loop1] * input0[(loop0 * 4) + 3]);
+   }
+  }
+
+  // Output the result.
+  memcpy(output, work, sizeof(MATRIX));
+
+ }
+
+ /* CALCULATE FUNCTIONS */
+
+ static void normal_ref(VECTOR output, VECTOR normal, MATRIX local_light) {
+  VECTOR work; float q;
+
+  // Transform the normal and divide it by its w.
+  vector_apply_ref(work, normal, local_light);
+  q = 1.00f / work[3];
+  output[0] = work[0] * q;
+  output[1] = work[1] * q;
+  output[2] = work[2] * q;
+  output[3] = work[3] * q;
+
+ }
+
+ static void vertex_ref(VECTOR output, VECTOR vertex, MATRIX local_screen) {
+  VECTOR work; float q, w;
+
+  // Transform the vertex.
+  vector_apply_ref(work, vertex, local_screen);
+
+  // If it's outside of the clipping volume, output (0, 0, 0, 1).
+  w = fabsf(work[3]);
+  if (work[0] > w || work[0] < -w || work[1] > w || work[1] < -w || work[2] > w || work[2] < -w) {
+   output[0] = 0.00f;
+   output[1] = 0.00f;
+   output[2] = 0.00f;
+   output[3] = 1.00f;
+   return;
+  }
+
+  // Else, divide x, y and z by w.
+  q = 1.00f / work[3];
+  output[0] = work[0] * q;
+  output[1] = work[1] * q;
+  output[2] = work[2] * q;
+  output[3] = work[3];
+
+ }
+
+ static float clamp(float value) {
+
+  if (value < 0.00f) { return 0.00f; }
+  if (value > 1.99f) { return 1.99f; }
+  return value;
+
+ }
+
+ void calculate_normals_ref(VECTOR *output, int count, VECTOR *normals, MATRIX local_light) {
+  int loop0;
+
+  for (loop0=0;loop0<count;loop0++) { normal_ref(output[loop0], normals[loop0], local_light); }
+
+ }
+
+ void calculate_vertices_ref(VECTOR *output, int count, VECTOR *vertices, MATRIX local_screen) {
+  int loop0;
+
+  for (loop0=0;loop0<count;loop0++) { vertex_ref(output[loop0], vertices[loop0], local_screen); }
+
+ }
+
+ void calculate_batch_ref(VECTOR *vertex_output, VECTOR *colour_output, int count, VECTOR *vertices, VECTOR *normals, VECTOR *colours, math3d_batch_t *batch) {
+  int loop0, loop1; VECTOR normal, light; float intensity;
+
+  // For each vertex...
+  for (loop0=0;loop0<count;loop0++) {
+
+   vertex_ref(vertex_output[loop0], vertices[loop0], batch->local_screen);
+   normal_ref(normal, normals[loop0], batch->local_light);
+
+   // Start from the ambient light.
+   light[0] = batch->ambient[0];
+   light[1] = batch->ambient[1];
+   light[2] = batch->ambient[2];
+
+   // Add each directional light.
+   for (loop1=0;loop1<MATH3D_BATCH_LIGHTS;loop1++) {
+
+    intensity = (batch->light_directions[0x00 + loop1] * normal[0]) + (batch->light_directions[0x04 + loop1] * normal[1]) + (batch->light_directions[0x08 + loop1] * normal[2]);
+    if (intensity < 0.00f) { intensity = 0.00f; }
+
+    light[0] += batch->light_colours[(loop1 * 4) + 0] * intensity;
+    light[1] += batch->light_colours[(loop1 * 4) + 1] * intensity;
+    light[2] += batch->light_colours[(loop1 * 4) + 2] * intensity;
+
+   }
+
+   // Apply the light value to the colour, and clamp it.
+   colour_output[loop0][0] = clamp(colours[loop0][0] * light[0]);
+   colour_output[loop0][1] = clamp(colours[loop0][1] * light[1]);
+   colour_output[loop0][2] = clamp(colours[loop0][2] * light[2]);
+   colour_output[loop0][3] = clamp(colours[loop0][3]);
+
+  }
+
+ }
@@ -269,6 +269,109 @@ int audsrv_available();
  */
 int audsrv_queued();
 
+/** Opens an additional audio stream
+ * @param fmt format of the audio queued on the stream
+ * @returns stream id on success, negative error code otherwise
+ *
+ * audsrv mixes all of its streams together, so that several producers
+ * can play at once without mixing on the EE. Stream 0 always exists, and
+ * is the one that audsrv_play_audio() and friends use. Any frequency up to
+ * 48000hz is accepted; the ones without a table-driven upsampler go
+ * through a polyphase resampler.
+ */
+int audsrv_stream_open(struct audsrv_fmt_t *fmt);
+
+/** Closes a stream opened with audsrv_stream_open()
+ * @param stream stream id
+ * @returns error code
+ */
+int audsrv_stream_close(int stream);
+
+/** Queues audio on a stream, see audsrv_play_audio()
+ * @param stream  stream id
+ * @param chunk   audio buffer
+ * @param bytes   size of chunk in bytes
+ * @returns number of bytes queued
+ */
+int audsrv_stream_play(int stream, const char *chunk, int bytes);
+
+/** Blocks until there is enough space on a stream, see audsrv_wait_audio()
+ * @param stream stream id
+ * @param bytes size of chunk requested to be enqueued (in bytes)
+ * @returns error code
+ */
+int audsrv_stream_wait(int stream, int bytes);
+
+/** Sets the mixing volume of a stream
+ * @param stream stream id
+ * @param volume volume in percentage
+ * @returns error code
+ *
+ * The output volume set with audsrv_set_volume() applies to the mix.
+ */
+int audsrv_stream_set_volume(int stream, int volume);
+
+/** Returns the number of bytes that can be queued on a stream
+ * @param stream stream id
+ * @returns byte count
+ */
+int audsrv_stream_available(int stream);
+
+/** Returns the number of bytes already queued on a stream
+ * @param stream stream id
+ * @returns byte count
+ */
+int audsrv_stream_queued(int stream);
+
+/** Switches a stream to zero-copy submission
+ * @param stream stream id, 0 for the default stream
+ * @returns error code
+ *
+ * Audio is then written straight into a ring that mirrors the one of the
+ * stream on the IOP (see audsrv_ring_get()), and audsrv_ring_commit()
+ * sends it there with SIF DMA, without any RPC. The IOP reports its
+ * progress asynchronously. audsrv_play_audio() and audsrv_stream_play()
+ * mustn't be used on the stream meanwhile. Changing its format or closing
+ * it ends ring mode and frees the ring, and the ring functions then fail
+ * with AUDSRV_ERR_ARGS until it is opened again.
+ */
+int audsrv_ring_open(int stream);
+
+/** Switches a stream back to audsrv_stream_play() and frees its ring
+ * @param stream stream id
+ * @returns error code
+ */
+int audsrv_ring_close(int stream);
+
+/** Returns where to write the next audio of a stream
+ * @param stream stream id
+ * @param bytes  number of bytes that can be written there
+ * @returns pointer into the ring, NULL on error
+ */
+void *audsrv_ring_get(int stream, int *bytes);
+
+/** Sends audio written at audsrv_ring_get() to audsrv
+ * @param stream stream id
+ * @param bytes  number of bytes written, at most what audsrv_ring_get() returned
+ * @returns number of bytes sent, negative error code on error
+ */
+int audsrv_ring_commit(int stream, int bytes);
+
+/** Blocks until there is space for bytes in the ring of a stream
+ * @param stream stream id
+ * @param bytes  number of bytes
+ * @returns error code
+ *
+ * The space may wrap around the end of the ring.
+ */
+int audsrv_ring_wait(int stream, int bytes);
+
+/** Returns the space in the ring of a stream, without any RPC
+ * @param stream stream id
+ * @returns byte count, negative error code on error
+ */
+int audsrv_ring_available(int stream);
+
 #ifdef __cplusplus
 }
 #endif
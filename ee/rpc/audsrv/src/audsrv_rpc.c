@@ -14,6 +14,8 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <malloc.h>
 #include <kernel.h>
 #include <sifrpc.h>
 #include <tamtypes.h>
@@ -38,6 +40,29 @@ static int initialized = 0;
 static int rpc_server_thread_id;
 static int audsrv_error = AUDSRV_ERR_NOERROR;
 static int completion_sema;
+static int ring_sema;
+
+/** space kept free in a ring, for the 16-byte granularity of SIF DMA */
+#define RING_RESERVE 16
+
+/** zero-copy ring of a stream, with the same size and positions as on the IOP */
+typedef struct ring_t
+{
+	char *buf;
+	int size;
+	int writepos;
+	/** ring buffer and control block on the IOP */
+	void *iop_buf;
+	void *iop_ctl;
+	/** SIF DMA of the last push */
+	int dma_id;
+	/** source of the control block DMA, not to be touched while it runs */
+	audsrv_ring_ctl_t ctl __attribute__((aligned (64)));
+} ring_t;
+
+static ring_t rings[AUDSRV_MAX_STREAMS];
+/** written by the IOP, a cache line each and only read uncached */
+static audsrv_ring_status_t ring_status[AUDSRV_MAX_STREAMS][4] __attribute__((aligned (64)));
 
 static audsrv_callback_t on_cdda_stop = NULL;
 static void *on_cdda_stop_arg = NULL;
@@ -55,6 +80,15 @@ static const unsigned short vol_values[26] =
 	0x28D2, 0x2EFE, 0x34F8, 0x3A5C, 0x3FFF
 };
 
+/** Frees the EE copy of a ring, once its last push is done */
+static void ring_free_buf(ring_t *r)
+{
+	while (SifDmaStat(r->dma_id) >= 0);
+
+	free(r->buf);
+	r->buf = NULL;
+}
+
 /** Internal function to set last error
  * @param err
  */
@@ -116,6 +150,16 @@ static int call_rpc_2(int func, int arg1, int arg2)
 
 int audsrv_quit()
 {
+	int i;
+
+	for (i = 0; i < AUDSRV_MAX_STREAMS; i++)
+	{
+		if (rings[i].buf != NULL)
+		{
+			audsrv_ring_close(i);
+		}
+	}
+
 	WaitSema(completion_sema);
 
 	SifCallRpc(&cd0, AUDSRV_QUIT, 0, sbuff, 1*4, sbuff, 4, NULL, NULL);
@@ -127,6 +171,7 @@ int audsrv_quit()
 	DeleteThread(rpc_server_thread_id);
 
 	DeleteSema(completion_sema);
+	DeleteSema(ring_sema);
 	return 0;
 }
 
@@ -134,6 +179,12 @@ int audsrv_set_format(struct audsrv_fmt_t *fmt)
 {
 	int ret;
 
+	/* the IOP ends ring mode of the default stream */
+	if (rings[0].buf != NULL)
+	{
+		ring_free_buf(&rings[0]);
+	}
+
 	WaitSema(completion_sema);
 
 	sbuff[0] = fmt->freq;
@@ -283,6 +334,9 @@ static void *audsrv_ee_rpc_handler(int fnum, void *buffer, int len)
 			if (on_cdda_stop != NULL)
 				on_cdda_stop(on_cdda_stop_arg);
 			break;
+		case AUDSRV_RING_CALLBACK:
+			SignalSema(ring_sema);
+			break;
 	}
 
 	return buffer;
@@ -339,6 +393,14 @@ int audsrv_init()
 		return -1;
 	}
 
+	compSema.init_count = 0;
+	ring_sema = CreateSema(&compSema);
+	if (ring_sema < 0)
+	{
+		set_error(AUDSRV_ERR_FAILED_TO_CREATE_SEMA);
+		return -1;
+	}
+
 	/* Create RPC server */
 	rpcThread.attr = 0;
 	rpcThread.option = 0;
@@ -497,8 +559,367 @@ int audsrv_available()
 	return call_rpc_1(AUDSRV_AVAILABLE, 0);
 }
 
+int audsrv_stream_open(struct audsrv_fmt_t *fmt)
+{
+	int ret;
+
+	WaitSema(completion_sema);
+
+	sbuff[0] = fmt->freq;
+	sbuff[1] = fmt->bits;
+	sbuff[2] = fmt->channels;
+	SifCallRpc(&cd0, AUDSRV_STREAM_OPEN, 0, sbuff, 3*4, sbuff, 4, NULL, NULL);
+
+	ret = sbuff[0];
+	SignalSema(completion_sema);
+
+	set_error(ret < 0 ? -ret : AUDSRV_ERR_NOERROR);
+
+	/* a new stream has no ring, even if a closed one with its id had */
+	if (ret > 0 && ret < AUDSRV_MAX_STREAMS && rings[ret].buf != NULL)
+	{
+		ring_free_buf(&rings[ret]);
+	}
+
+	return ret;
+}
+
+int audsrv_stream_close(int stream)
+{
+	ring_t *r = NULL;
+	int ret;
+
+	if (stream >= 0 && stream < AUDSRV_MAX_STREAMS)
+	{
+		/* the IOP frees the buffer the ring pushes to */
+		r = &rings[stream];
+		while (SifDmaStat(r->dma_id) >= 0);
+	}
+
+	ret = call_rpc_1(AUDSRV_STREAM_CLOSE, stream);
+	if (ret == 0 && r != NULL && r->buf != NULL)
+	{
+		ring_free_buf(r);
+	}
+
+	return ret;
+}
+
+int audsrv_stream_play(int stream, const char *chunk, int bytes)
+{
+	int maxcopy;
+	int sent = 0;
+
+	set_error(AUDSRV_ERR_NOERROR);
+	maxcopy = sizeof(sbuff) - 2*sizeof(int);
+	while (bytes > 0)
+	{
+		int copy, copied;
+		int packet_size;
+
+		WaitSema(completion_sema);
+
+		copy = MIN(bytes, maxcopy);
+		sbuff[0] = stream;
+		sbuff[1] = copy;
+		memcpy(&sbuff[2], chunk, copy);
+		packet_size = copy + 2*sizeof(int);
+		SifCallRpc(&cd0, AUDSRV_STREAM_PLAY, 0, sbuff, packet_size, sbuff, 1*4, NULL, NULL);
+
+		copied = sbuff[0];
+		SignalSema(completion_sema);
+
+		if (copied < 0)
+		{
+			/* there was an error */
+			set_error(-copied);
+			break;
+		}
+
+		chunk = chunk + copy;
+		bytes = bytes - copy;
+		sent = sent + copied;
+	}
+
+	return sent;
+}
+
+int audsrv_stream_wait(int stream, int bytes)
+{
+	return call_rpc_2(AUDSRV_STREAM_WAIT, stream, bytes);
+}
+
+int audsrv_stream_set_volume(int stream, int volume)
+{
+	if (volume > MAX_VOLUME)
+	{
+		volume = MAX_VOLUME;
+	}
+	else if (volume < MIN_VOLUME)
+	{
+		volume = MIN_VOLUME;
+	}
+
+	return call_rpc_2(AUDSRV_STREAM_SET_VOLUME, stream, vol_values[volume/4]);
+}
+
+int audsrv_stream_available(int stream)
+{
+	return call_rpc_1(AUDSRV_STREAM_AVAILABLE, stream);
+}
+
+int audsrv_stream_queued(int stream)
+{
+	return call_rpc_1(AUDSRV_STREAM_QUEUED, stream);
+}
+
 int audsrv_queued()
 {
 	return call_rpc_1(AUDSRV_QUEUED, 0);
 }
 
+/** Returns the ring of a stream, if it is open */
+static ring_t *get_ring(int stream)
+{
+	if (stream < 0 || stream >= AUDSRV_MAX_STREAMS || rings[stream].buf == NULL)
+	{
+		return NULL;
+	}
+
+	return &rings[stream];
+}
+
+/** Returns the space in a ring, with the read position last sent by the IOP */
+static int ring_free(ring_t *r, int stream)
+{
+	volatile audsrv_ring_status_t *status = UNCACHED_SEG(&ring_status[stream][0]);
+	int readpos, space;
+
+	/* same as the IOP's reckoning */
+	readpos = status->readpos;
+	if (r->writepos <= readpos)
+	{
+		space = readpos - r->writepos;
+	}
+	else
+	{
+		space = r->size - (r->writepos - readpos);
+	}
+
+	space -= RING_RESERVE;
+	return space > 0 ? space : 0;
+}
+
+int audsrv_ring_open(int stream)
+{
+	volatile audsrv_ring_status_t *status;
+	ring_t *r;
+	int ret, size;
+
+	if (stream < 0 || stream >= AUDSRV_MAX_STREAMS)
+	{
+		set_error(AUDSRV_ERR_ARGS);
+		return -AUDSRV_ERR_ARGS;
+	}
+
+	r = &rings[stream];
+	if (r->buf != NULL)
+	{
+		/* the positions start over */
+		audsrv_ring_close(stream);
+	}
+
+	WaitSema(completion_sema);
+
+	sbuff[0] = stream;
+	sbuff[1] = (int)&ring_status[stream][0];
+	SifCallRpc(&cd0, AUDSRV_RING_OPEN, 0, sbuff, 2*4, sbuff, 10*4, NULL, NULL);
+
+	ret = sbuff[0];
+	if (ret == 0)
+	{
+		r->iop_buf = (void *)sbuff[1];
+		size = sbuff[2];
+		r->iop_ctl = (void *)sbuff[3];
+		status = UNCACHED_SEG(&ring_status[stream][0]);
+		status->readpos = sbuff[4];
+		r->writepos = sbuff[5];
+	}
+
+	/* DMA is in qwords, and may go past the end of the ring */
+	r->buf = ret == 0 ? memalign(64, (size + 63) & ~63) : NULL;
+	if (r->buf != NULL)
+	{
+		/* the first push resends the queued bytes of the qword it starts in */
+		memcpy(r->buf + (r->writepos & ~15), &sbuff[6], 16);
+	}
+
+	SignalSema(completion_sema);
+
+	if (ret != 0)
+	{
+		set_error(-ret);
+		return ret;
+	}
+
+	if (r->buf == NULL)
+	{
+		call_rpc_1(AUDSRV_RING_CLOSE, stream);
+		set_error(AUDSRV_ERR_OUT_OF_MEMORY);
+		return -AUDSRV_ERR_OUT_OF_MEMORY;
+	}
+
+	r->size = size;
+	r->dma_id = 0;
+	memset(&r->ctl, 0, sizeof(r->ctl));
+	/* the control block also goes out with the waits, before any push */
+	r->ctl.writepos = r->writepos;
+
+	set_error(AUDSRV_ERR_NOERROR);
+	return AUDSRV_ERR_NOERROR;
+}
+
+int audsrv_ring_close(int stream)
+{
+	ring_t *r;
+	int ret;
+
+	r = get_ring(stream);
+	if (r == NULL)
+	{
+		set_error(AUDSRV_ERR_ARGS);
+		return -AUDSRV_ERR_ARGS;
+	}
+
+	ret = call_rpc_1(AUDSRV_RING_CLOSE, stream);
+
+	ring_free_buf(r);
+	return ret;
+}
+
+void *audsrv_ring_get(int stream, int *bytes)
+{
+	ring_t *r;
+	int space;
+
+	r = get_ring(stream);
+	if (r == NULL)
+	{
+		set_error(AUDSRV_ERR_ARGS);
+		*bytes = 0;
+		return NULL;
+	}
+
+	space = ring_free(r, stream);
+	*bytes = MIN(space, r->size - r->writepos);
+	return r->buf + r->writepos;
+}
+
+int audsrv_ring_commit(int stream, int bytes)
+{
+	SifDmaTransfer_t dmat[2];
+	ring_t *r;
+	int start, end, id;
+
+	r = get_ring(stream);
+	if (r == NULL || bytes < 0 || bytes > r->size - r->writepos)
+	{
+		set_error(AUDSRV_ERR_ARGS);
+		return -AUDSRV_ERR_ARGS;
+	}
+
+	if (bytes == 0)
+	{
+		return 0;
+	}
+
+	/* the previous push reads the control block, and maybe the same cache lines */
+	while (SifDmaStat(r->dma_id) >= 0);
+
+	/* whole qwords: the bytes before are the same as on the IOP, the ones
+	 * after are in the space kept free
+	 */
+	start = r->writepos & ~15;
+	end = (r->writepos + bytes + 15) & ~15;
+	SifWriteBackDCache(r->buf + start, end - start);
+
+	r->writepos += bytes;
+	if (r->writepos >= r->size)
+	{
+		r->writepos = 0;
+	}
+
+	r->ctl.writepos = r->writepos;
+	SifWriteBackDCache(&r->ctl, sizeof(r->ctl));
+
+	/* the data first, then the new write position */
+	dmat[0].src = r->buf + start;
+	dmat[0].dest = (char *)r->iop_buf + start;
+	dmat[0].size = end - start;
+	dmat[0].attr = 0;
+	dmat[1].src = &r->ctl;
+	dmat[1].dest = r->iop_ctl;
+	dmat[1].size = sizeof(r->ctl);
+	dmat[1].attr = 0;
+
+	while ((id = SifSetDma(dmat, 2)) == 0);
+	r->dma_id = id;
+
+	return bytes;
+}
+
+int audsrv_ring_wait(int stream, int bytes)
+{
+	SifDmaTransfer_t dmat;
+	ring_t *r;
+	int id;
+
+	r = get_ring(stream);
+	if (r == NULL || bytes > r->size - RING_RESERVE)
+	{
+		set_error(AUDSRV_ERR_ARGS);
+		return -AUDSRV_ERR_ARGS;
+	}
+
+	while (ring_free(r, stream) < bytes)
+	{
+		/* ask the IOP to call back once there is enough space */
+		while (SifDmaStat(r->dma_id) >= 0);
+
+		r->ctl.wait_seq++;
+		r->ctl.wait_bytes = bytes + RING_RESERVE;
+		SifWriteBackDCache(&r->ctl, sizeof(r->ctl));
+
+		dmat.src = &r->ctl;
+		dmat.dest = r->iop_ctl;
+		dmat.size = sizeof(r->ctl);
+		dmat.attr = 0;
+
+		while ((id = SifSetDma(&dmat, 1)) == 0);
+		r->dma_id = id;
+
+		/* the space may have been made meanwhile */
+		if (ring_free(r, stream) >= bytes)
+		{
+			break;
+		}
+
+		WaitSema(ring_sema);
+	}
+
+	return AUDSRV_ERR_NOERROR;
+}
+
+int audsrv_ring_available(int stream)
+{
+	ring_t *r;
+
+	r = get_ring(stream);
+	if (r == NULL)
+	{
+		set_error(AUDSRV_ERR_ARGS);
+		return -AUDSRV_ERR_ARGS;
+	}
+
+	return ring_free(r, stream);
+}
@@ -55,7 +55,40 @@
 #define AUDSRV_AVAILABLE            0x001a
 #define AUDSRV_QUEUED               0x001b
 
+/** mixed stream functions */
+#define AUDSRV_STREAM_OPEN          0x001c
+#define AUDSRV_STREAM_CLOSE         0x001d
+#define AUDSRV_STREAM_PLAY          0x001e
+#define AUDSRV_STREAM_WAIT          0x001f
+#define AUDSRV_STREAM_SET_VOLUME    0x0020
+#define AUDSRV_STREAM_AVAILABLE     0x0021
+#define AUDSRV_STREAM_QUEUED        0x0022
+
+/** zero-copy ring functions */
+#define AUDSRV_RING_OPEN            0x0023
+#define AUDSRV_RING_CLOSE           0x0024
+
 #define AUDSRV_FILLBUF_CALLBACK     0x0001
 #define AUDSRV_CDDA_CALLBACK        0x0002
+#define AUDSRV_RING_CALLBACK        0x0003
+
+/** number of streams of the IOP side, including the default one */
+#define AUDSRV_MAX_STREAMS          4
+
+/** Ring control block of a stream on the IOP, written by the EE with SIF DMA */
+typedef struct audsrv_ring_ctl_t
+{
+	int writepos;
+	int wait_seq;
+	int wait_bytes;
+	int reserved;
+} audsrv_ring_ctl_t;
+
+/** Ring status of a stream on the EE, written by the IOP with SIF DMA */
+typedef struct audsrv_ring_status_t
+{
+	int readpos;
+	int reserved[3];
+} audsrv_ring_status_t;
 
 #endif
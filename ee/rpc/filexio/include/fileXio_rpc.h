@@ -69,7 +69,31 @@ int fileXioDread(int fd, iox_dirent_t *dirent);
 int fileXioDevctl(const char *name, int cmd, void *arg, unsigned int arglen, void *buf,unsigned int buflen);
 int fileXioIoctl(int fd, int cmd, void *arg);
 int fileXioIoctl2(int fd, int command, void *arg, unsigned int arglen, void *buf, unsigned int buflen);
+/** Sets the total size of the IOP's RW buffers. It is shared between them, each one rounded down to a multiple of 64 */
 int fileXioSetRWBufferSize(int size);
+/** Sets the number of IOP RW buffers (1-8): the device works on one while the others are transferred.
+ * The total size stays the same, so each buffer gets smaller as the count grows.
+ */
+int fileXioSetRWBufferCount(int count);
+/** Gets the IOP read and write counters, then clears them if reset is nonzero */
+int fileXioGetRWStats(struct fileXioRWStats *stats, int reset);
+
+/** Starts up to FILEXIO_MAX_WORKERS worker threads on the IOP, and returns the number of request slots.
+ * Each slot has its own worker, so queued requests don't wait for each other nor for the other calls.
+ * The workers' RW buffers are set up like the main ones, on their first transfer.
+ */
+int fileXioQueueInit(int workers);
+void fileXioQueueExit(void);
+/** Queue a request and return its handle, waiting for a free slot if there is none.
+ * The buffer mustn't be touched until the request is complete.
+ */
+int fileXioQueueRead(int fd, void *buf, int size);
+int fileXioQueueWrite(int fd, const void *buf, int size);
+int fileXioQueueLseek(int fd, int offset, int whence);
+/** Waits for (FXIO_WAIT) or polls (FXIO_NOWAIT) a request, like fileXioWaitAsync.
+ * Once it returns FXIO_COMPLETE, the handle is free for other requests.
+ */
+int fileXioQueueWait(int handle, int mode, int *retVal);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,208 @@
+/*
+# _____     ___ ____     ___ ____
+#  ____|   |    ____|   |        | |____|
+# |     ___|   |____ ___|    ____| |    \    PS2DEV Open Source Project.
+#-----------------------------------------------------------------------
+# Copyright 2001-2004, ps2dev - http://www.ps2dev.org
+# Licenced under Academic Free License version 2.0
+# Review ps2sdk README & LICENSE files for further details.
+#
+# fileXio request queue benchmark
+#
+# A thread streams a large file in big reads while the main thread times
+# small metadata calls, first with the streaming done through the regular
+# calls, then through the request queue.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <kernel.h>
+#include <sifrpc.h>
+#include <loadfile.h>
+#include <tamtypes.h>
+#include <timer.h>
+
+#define NEWLIB_PORT_AWARE
+#include <io_common.h>
+#include <fileXio_rpc.h>
+
+// Any large file
+#define STREAM_PATH	"host:stream.bin"
+// Any file, for the metadata calls
+#define STAT_PATH	"host:queuebench.elf"
+
+#define STREAM_CHUNK	(256 * 1024)
+#define SAMPLES		256
+
+extern void *_gp;
+
+static u8 stream_buffer[STREAM_CHUNK] __attribute__((aligned(64)));
+static u8 stream_stack[0x4000] __attribute__((aligned(16)));
+static u64 latency[SAMPLES];
+
+static int stream_fd;
+static int use_queue;
+static volatile int streaming;
+static u32 stream_bytes;
+static int done_sema;
+
+static int stream_read(void)
+{
+	int handle, ret;
+
+	if (!use_queue)
+		return fileXioRead(stream_fd, stream_buffer, STREAM_CHUNK);
+
+	if ((handle = fileXioQueueRead(stream_fd, stream_buffer, STREAM_CHUNK)) < 0)
+		return handle;
+
+	fileXioQueueWait(handle, FXIO_WAIT, &ret);
+	return ret;
+}
+
+static void stream_rewind(void)
+{
+	int handle;
+
+	if (!use_queue)
+	{
+		fileXioLseek(stream_fd, 0, FIO_SEEK_SET);
+		return;
+	}
+
+	if ((handle = fileXioQueueLseek(stream_fd, 0, FIO_SEEK_SET)) >= 0)
+		fileXioQueueWait(handle, FXIO_WAIT, NULL);
+}
+
+static void stream_thread(void *arg)
+{
+	int ret;
+
+	(void)arg;
+
+	while (streaming)
+	{
+		ret = stream_read();
+		if (ret < STREAM_CHUNK)
+			stream_rewind();
+		if (ret > 0)
+			stream_bytes += ret;
+	}
+
+	SignalSema(done_sema);
+	ExitDeleteThread();
+}
+
+static int compare_latency(const void *a, const void *b)
+{
+	u64 x = *(const u64 *)a, y = *(const u64 *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static unsigned int to_usec(u64 ticks)
+{
+	return (unsigned int)(ticks * 1000000 / kBUSCLK);
+}
+
+static void run(const char *name, int stream, int queue)
+{
+	ee_thread_t thread;
+	iox_stat_t stat;
+	u64 start, elapsed;
+	int i, tid = -1;
+
+	stream_bytes = 0;
+	use_queue = queue;
+	streaming = stream;
+
+	if (stream)
+	{
+		thread.func = stream_thread;
+		thread.stack = stream_stack;
+		thread.stack_size = sizeof(stream_stack);
+		thread.gp_reg = &_gp;
+		thread.initial_priority = 64;
+		thread.attr = 0;
+		thread.option = 0;
+		if ((tid = CreateThread(&thread)) >= 0)
+			StartThread(tid, NULL);
+	}
+
+	start = GetTimerSystemTime();
+	for (i = 0; i < SAMPLES; i++)
+	{
+		u64 t = GetTimerSystemTime();
+
+		fileXioGetStat(STAT_PATH, &stat);
+		latency[i] = GetTimerSystemTime() - t;
+	}
+	elapsed = GetTimerSystemTime() - start;
+
+	if (tid >= 0)
+	{
+		streaming = 0;
+		WaitSema(done_sema);
+	}
+
+	qsort(latency, SAMPLES, sizeof(latency[0]), &compare_latency);
+
+	printf("%-8s getstat usec: p50 %u p90 %u p99 %u max %u", name,
+		to_usec(latency[SAMPLES / 2]), to_usec(latency[SAMPLES * 9 / 10]),
+		to_usec(latency[SAMPLES * 99 / 100]), to_usec(latency[SAMPLES - 1]));
+	if (stream)
+		printf(", stream %u KB/s", (unsigned int)((u64)stream_bytes * 1000 / 1024 / (to_usec(elapsed) / 1000 + 1)));
+	printf("\n");
+}
+
+int main(int argc, char *argv[])
+{
+	ee_sema_t sema;
+	int ret;
+
+	(void)argc;
+	(void)argv;
+
+	SifInitRpc(0);
+
+	ret = SifLoadModule("host:iomanX.irx", 0, NULL);
+	printf("iomanX loadmodule %d\n", ret);
+	ret = SifLoadModule("host:fileXio.irx", 0, NULL);
+	printf("fileXio loadmodule %d\n", ret);
+
+	if (fileXioInitSkipOverride() < 0)
+	{
+		printf("queuebench: failed to initialize fileXio\n");
+		return 1;
+	}
+
+	ret = fileXioQueueInit(2);
+	printf("fileXioQueueInit %d\n", ret);
+	if (ret < 0)
+		return 1;
+
+	stream_fd = fileXioOpen(STREAM_PATH, FIO_O_RDONLY);
+	if (stream_fd < 0)
+	{
+		printf("queuebench: failed to open %s\n", STREAM_PATH);
+		return 1;
+	}
+
+	sema.init_count = 0;
+	sema.max_count = 1;
+	sema.option = 0;
+	done_sema = CreateSema(&sema);
+
+	// The streaming thread has the same priority as the main thread
+	ChangeThreadPriority(GetThreadId(), 64);
+
+	run("idle", 0, 0);
+	run("read", 1, 0);
+	run("queued", 1, 1);
+
+	fileXioClose(stream_fd);
+	DeleteSema(done_sema);
+
+	return 0;
+}
@@ -52,6 +52,45 @@ static inline int _unlock(void)
 	return(SignalSema(_lock_sema_id));
 }
 
+// Queued requests. Each slot is bound to its own worker server on the IOP, so the
+// requests of different slots are served concurrently, and independently of the other calls.
+struct fxio_request {
+	SifRpcClientData_t cd;
+	int sema;
+	int busy;
+	union {
+		struct fxio_read_packet read;
+		struct fxio_write_packet write;
+		struct fxio_lseek_packet lseek;
+	} packet __attribute__((aligned(64)));
+	// Written by the IOP
+	int result[16] __attribute__((aligned(64)));
+	rests_pkt rests __attribute__((aligned(64)));
+} __attribute__((aligned(64)));
+
+static struct fxio_request requests[FILEXIO_MAX_WORKERS];
+static int requestCount = 0;
+static int requestLockSema = -1;
+static int requestFreeSema = -1;
+
+static void _fxio_request_intr(void *data)
+{
+	struct fxio_request *req = (struct fxio_request *)data;
+
+	iSignalSema(req->sema);
+}
+
+static void _fxio_request_recv_intr(void *data)
+{
+	struct fxio_request *req = (struct fxio_request *)data;
+	rests_pkt *rests = UNCACHED_SEG(&req->rests);
+
+	if(rests->ssize) memcpy(rests->sbuf, rests->sbuffer, rests->ssize);
+	if(rests->esize) memcpy(rests->ebuf, rests->ebuffer, rests->esize);
+
+	iSignalSema(req->sema);
+}
+
 static time_t io_to_posix_time(const unsigned char *ps2time)
 {
         struct tm tim;
@@ -258,6 +297,8 @@ void fileXioExit(void)
 
 		memset(&cd0, 0, sizeof(cd0));
 
+		fileXioQueueExit();
+
 		fileXioInited = 0;
 	}
 }
@@ -1172,3 +1213,269 @@ int fileXioSetRWBufferSize(int size){
 	return(rv);
 }
 
+int fileXioSetRWBufferCount(int count){
+	struct fxio_rwbuff *packet = (struct fxio_rwbuff *)sbuff;
+	int rv;
+
+	if(fileXioInit() < 0)
+		return -ENOPKG;
+
+	_lock();
+	WaitSema(fileXioCompletionSema);
+
+	packet->size = count;
+
+	if((rv = SifCallRpc(&cd0, FILEXIO_SETRWBUFFCOUNT, 0, packet, sizeof(struct fxio_rwbuff), sbuff, 4, (void *)&_fxio_intr, NULL)) >= 0)
+	{
+		rv = sbuff[0];
+	}
+	else
+		SignalSema(fileXioCompletionSema);
+
+	_unlock();
+	return(rv);
+}
+
+int fileXioGetRWStats(struct fileXioRWStats *stats, int reset){
+	int rv;
+
+	if(fileXioInit() < 0)
+		return -ENOPKG;
+
+	_lock();
+	WaitSema(fileXioCompletionSema);
+
+	sbuff[0] = reset;
+
+	if((rv = SifCallRpc(&cd0, FILEXIO_GETRWSTATS, 0, sbuff, 4, sbuff, sizeof(struct fileXioRWStats), (void *)&_fxio_intr, NULL)) >= 0)
+	{
+		memcpy(stats, sbuff, sizeof(struct fileXioRWStats));
+		rv = 0;
+	}
+	else
+		SignalSema(fileXioCompletionSema);
+
+	_unlock();
+	return(rv);
+}
+
+int fileXioQueueInit(int workers){
+	ee_sema_t sp;
+	int rv, i;
+
+	if(fileXioInit() < 0)
+		return -ENOPKG;
+
+	if(requestCount > 0)
+		return requestCount;
+
+	_lock();
+	WaitSema(fileXioCompletionSema);
+
+	sbuff[0] = workers;
+
+	if((rv = SifCallRpc(&cd0, FILEXIO_STARTWORKERS, 0, sbuff, 4, sbuff, 4, (void *)&_fxio_intr, NULL)) >= 0)
+		rv = sbuff[0];
+	else
+		SignalSema(fileXioCompletionSema);
+
+	_unlock();
+
+	if(rv <= 0)
+		return rv < 0 ? rv : -ENOMEM;
+
+	sp.init_count = 1;
+	sp.max_count = 1;
+	sp.option = 0;
+	requestLockSema = CreateSema(&sp);
+
+	sp.init_count = rv;
+	sp.max_count = rv;
+	requestFreeSema = CreateSema(&sp);
+
+	for(i = 0; i < rv; i++)
+	{
+		struct fxio_request *req = &requests[i];
+		int res;
+
+		sp.init_count = 0;
+		sp.max_count = 1;
+		req->sema = CreateSema(&sp);
+		req->busy = 0;
+
+		while(((res = SifBindRpc(&req->cd, FILEXIO_WORKER_IRX + i, 0)) >= 0) && (req->cd.server == NULL))
+			nopdelay();
+
+		if(res < 0 || req->sema < 0)
+		{
+			requestCount = i + 1;
+			fileXioQueueExit();
+			return res < 0 ? res : -1;
+		}
+	}
+
+	requestCount = rv;
+
+	return requestCount;
+}
+
+void fileXioQueueExit(void)
+{
+	int i;
+
+	if(requestCount > 0)
+	{
+		for(i = 0; i < requestCount; i++)
+		{
+			if(requests[i].sema >= 0) DeleteSema(requests[i].sema);
+			memset(&requests[i].cd, 0, sizeof(requests[i].cd));
+		}
+
+		if(requestLockSema >= 0) DeleteSema(requestLockSema);
+		if(requestFreeSema >= 0) DeleteSema(requestFreeSema);
+
+		requestCount = 0;
+	}
+}
+
+// Waits for a free slot and claims it
+static int fileXioQueueGet(void)
+{
+	int i;
+
+	if(requestCount <= 0)
+		return -ENOPKG;
+
+	WaitSema(requestFreeSema);
+	WaitSema(requestLockSema);
+
+	for(i = 0; requests[i].busy; i++);
+	requests[i].busy = 1;
+
+	SignalSema(requestLockSema);
+
+	return i;
+}
+
+static void fileXioQueuePut(int handle)
+{
+	WaitSema(requestLockSema);
+	requests[handle].busy = 0;
+	SignalSema(requestLockSema);
+
+	SignalSema(requestFreeSema);
+}
+
+int fileXioQueueRead(int fd, void *buf, int size){
+	struct fxio_request *req;
+	int handle, rv;
+
+	if((handle = fileXioQueueGet()) < 0)
+		return handle;
+
+	req = &requests[handle];
+	req->packet.read.fd = fd;
+	req->packet.read.buffer = buf;
+	req->packet.read.size = size;
+	req->packet.read.intrData = &req->rests;
+
+	if (!IS_UNCACHED_SEG(buf))
+		SifWriteBackDCache(buf, size);
+
+	if((rv = SifCallRpc(&req->cd, FILEXIO_READ, SIF_RPC_M_NOWAIT, &req->packet, sizeof(struct fxio_read_packet), req->result, 4, &_fxio_request_recv_intr, req)) < 0)
+	{
+		fileXioQueuePut(handle);
+		return rv;
+	}
+
+	return handle;
+}
+
+int fileXioQueueWrite(int fd, const void *buf, int size){
+	struct fxio_request *req;
+	unsigned int miss;
+	int handle, rv;
+
+	if((handle = fileXioQueueGet()) < 0)
+		return handle;
+
+	if((unsigned int)buf & 0x3F)
+	{
+		miss = 64 - ((unsigned int)buf & 0x3F);
+		if(miss > (unsigned int)size) miss = size;
+	} else {
+		miss = 0;
+	}
+
+	req = &requests[handle];
+	req->packet.write.fd = fd;
+	req->packet.write.buffer = buf;
+	req->packet.write.size = size;
+	req->packet.write.unalignedDataLen = miss;
+
+	memcpy(req->packet.write.unalignedData, buf, miss);
+
+	if(!IS_UNCACHED_SEG(buf))
+		SifWriteBackDCache((void*)buf, size);
+
+	if((rv = SifCallRpc(&req->cd, FILEXIO_WRITE, SIF_RPC_M_NOWAIT, &req->packet, sizeof(struct fxio_write_packet), req->result, 4, &_fxio_request_intr, req)) < 0)
+	{
+		fileXioQueuePut(handle);
+		return rv;
+	}
+
+	return handle;
+}
+
+int fileXioQueueLseek(int fd, int offset, int whence){
+	struct fxio_request *req;
+	int handle, rv;
+
+	if((handle = fileXioQueueGet()) < 0)
+		return handle;
+
+	req = &requests[handle];
+	req->packet.lseek.fd = fd;
+	req->packet.lseek.offset = (u32)offset;
+	req->packet.lseek.whence = whence;
+
+	if((rv = SifCallRpc(&req->cd, FILEXIO_LSEEK, SIF_RPC_M_NOWAIT, &req->packet, sizeof(struct fxio_lseek_packet), req->result, 4, &_fxio_request_intr, req)) < 0)
+	{
+		fileXioQueuePut(handle);
+		return rv;
+	}
+
+	return handle;
+}
+
+int fileXioQueueWait(int handle, int mode, int *retVal){
+	struct fxio_request *req;
+
+	if(handle < 0 || handle >= requestCount || !requests[handle].busy)
+		return -EINVAL;
+
+	req = &requests[handle];
+
+	switch(mode)
+	{
+		case FXIO_WAIT:
+			WaitSema(req->sema);
+			break;
+
+		case FXIO_NOWAIT:
+			if(PollSema(req->sema) < 0)
+				return FXIO_INCOMPLETE;
+			break;
+
+		default:
+			return -1;
+	}
+
+	if(retVal != NULL)
+		*retVal = *(int *)UNCACHED_SEG(&req->result[0]);
+
+	fileXioQueuePut(handle);
+
+	return FXIO_COMPLETE;
+}
+
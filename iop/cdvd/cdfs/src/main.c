@@ -1,8 +1,10 @@
+#include <errno.h>
 #include <stdio.h>
 #include <ioman.h>
 #include <iox_stat.h>
 #include <loadcore.h>
 #include <sysclib.h>
+#include <sysmem.h>
 
 #include "cdfs_iop.h"
 
@@ -10,7 +12,8 @@
 #define MAX_FILES_PER_FOLDER 256
 #define MAX_FILES_OPENED 16
 #define MAX_FOLDERS_OPENED 16
-#define MAX_BYTES_READ 16384
+// Default size of the per-file read-ahead window, in sectors
+#define DEFAULT_READAHEAD_SECTORS 16
 
 #define DRIVER_UNIT_NAME "cdfs"
 #define DRIVER_UNIT_VERSION 2
@@ -22,6 +25,10 @@ struct fdtable
     int fileSize;
     int LBA;
     int filePos;
+    u8 *raBuffer;   // Read-ahead window, allocated on first use
+    int raLBA;      // First sector in the window
+    int raSectors;  // Number of valid sectors in the window, 0 if empty
+    int raNextPos;  // File position following the last read, to detect streaming
 };
 
 struct fodtable
@@ -41,8 +48,11 @@ static struct fodtable fod_table[MAX_FOLDERS_OPENED];
 static int fod_used[MAX_FOLDERS_OPENED];
 
 // global variables
-static int lastsector = -1;
-static int last_bk = 0;
+static int readahead_sectors = DEFAULT_READAHEAD_SECTORS;
+
+// Used by files that could not get a window of their own
+static u8 fallback_buffer[2048] __attribute__((aligned(64)));
+static int fallback_owner = -1;
 
 /***********************************************
 *                                              *
@@ -64,8 +74,17 @@ static int fio_init(iop_device_t *driver)
 
 static int fio_deinit(iop_device_t *f)
 {
+    int i;
+
     (void)f;
 
+    for (i = 0; i < MAX_FILES_OPENED; i++) {
+        if (fd_table[i].raBuffer != NULL && fd_table[i].raBuffer != fallback_buffer)
+            FreeSysMemory(fd_table[i].raBuffer);
+        fd_table[i].raBuffer = NULL;
+    }
+    fallback_owner = -1;
+
     DPRINTF("CDFS: fio_deinit called.\n");
     DPRINTF("      kernel_fd.. %p\n", f);
     return cdfs_finish();
@@ -81,10 +100,10 @@ static int fio_open(iop_file_t *f, const char *name, int mode)
     DPRINTF("      name....... %s %x\n", name, (int)name);
     DPRINTF("      mode....... %d\n\n", mode);
 
-    // Invalidate last sector cache if disk changed
+    // Invalidate the read-ahead windows if disk changed
     if (cdfs_checkDiskChanged(CHANGED_FIO)) {
-        lastsector = -1;
-        last_bk = 0;
+        for (j = 0; j < MAX_FILES_OPENED; j++)
+            fd_table[j].raSectors = 0;
     }
 
     // check if the file exists
@@ -122,6 +141,9 @@ static int fio_open(iop_file_t *f, const char *name, int mode)
     fd_table[j].fileSize = tocEntry.fileSize;
     fd_table[j].LBA = tocEntry.fileLBA;
     fd_table[j].filePos = 0;
+    fd_table[j].raBuffer = NULL;
+    fd_table[j].raSectors = 0;
+    fd_table[j].raNextPos = -1;
 
     f->privdata = (void *)j;
 
@@ -142,21 +164,67 @@ static int fio_close(iop_file_t *f)
         return -1;
     }
 
+    if (fd_table[i].raBuffer != NULL && fd_table[i].raBuffer != fallback_buffer)
+        FreeSysMemory(fd_table[i].raBuffer);
+    if (fallback_owner == i)
+        fallback_owner = -1;
+    fd_table[i].raBuffer = NULL;
     fd_used[i] = 0;
 
     return 0;
 }
 
-static int fio_read(iop_file_t *f, void *buffer, int size)
+/*
+ * Loads sectors starting at lsn into the read-ahead window of the file.
+ * Only a streaming reader gets the whole window; a random access only
+ * loads the sectors it needs, so that it does not pay for the read-ahead.
+ */
+static int fillWindow(int i, int lsn, int wanted, int streaming)
 {
-    int i;
+    struct fdtable *fdt = &fd_table[i];
+    int maxSectors, lastLBA, sectors;
+
+    if (fdt->raBuffer == NULL) {
+        fdt->raBuffer = AllocSysMemory(ALLOC_FIRST, readahead_sectors * 2048, NULL);
+        if (fdt->raBuffer == NULL)
+            fdt->raBuffer = fallback_buffer;
+    }
+
+    if (fdt->raBuffer == fallback_buffer) {
+        // Take the shared sector over from its previous user
+        if (fallback_owner >= 0 && fallback_owner != i)
+            fd_table[fallback_owner].raSectors = 0;
+        fallback_owner = i;
+        maxSectors = 1;
+    } else {
+        maxSectors = readahead_sectors;
+    }
+
+    lastLBA = fdt->LBA + ((fdt->fileSize - 1) >> 11);
+    sectors = streaming ? maxSectors : wanted;
+    if (sectors > maxSectors)
+        sectors = maxSectors;
+    if (sectors > lastLBA - lsn + 1)
+        sectors = lastLBA - lsn + 1;
+
+    fdt->raSectors = 0;
+    if (!cdfs_readSect(lsn, sectors, fdt->raBuffer)) {
+        DPRINTF("Couldn't Read from file for some reason\n");
+        return 0;
+    }
+
+    fdt->raLBA = lsn;
+    fdt->raSectors = sectors;
 
-    int start_sector;
-    int off_sector;
-    int num_sectors;
+    return 1;
+}
 
-    int read = 0;
-    static u8 local_buffer[9 * 2048];
+static int fio_read(iop_file_t *f, void *buffer, int size)
+{
+    int i;
+    struct fdtable *fdt;
+    u8 *out = buffer;
+    int pos, left, streaming;
 
     DPRINTF("CDFS: fio_read called\n\n");
     DPRINTF("      kernel_fd... %p\n", f);
@@ -169,54 +237,64 @@ static int fio_read(iop_file_t *f, void *buffer, int size)
         printf("fio_read: ERROR: File does not appear to be open!\n");
         return -1;
     }
+    fdt = &fd_table[i];
 
     // A few sanity checks
-    if (fd_table[i].filePos > fd_table[i].fileSize) {
+    if (fdt->filePos > fdt->fileSize) {
         // We cant start reading from past the beginning of the file
         return 0;  // File exists but we couldnt read anything from it
     }
 
-    if ((fd_table[i].filePos + size) > fd_table[i].fileSize)
-        size = fd_table[i].fileSize - fd_table[i].filePos;
+    if ((fdt->filePos + size) > fdt->fileSize)
+        size = fdt->fileSize - fdt->filePos;
 
     if (size <= 0)
         return 0;
 
-    if (size > MAX_BYTES_READ)
-        size = MAX_BYTES_READ;
-
-    // Now work out where we want to start reading from
-    start_sector = fd_table[i].LBA + (fd_table[i].filePos >> 11);
-    off_sector = (fd_table[i].filePos & 0x7FF);
-
-    num_sectors = (off_sector + size);
-    num_sectors = (num_sectors >> 11) + ((num_sectors & 2047) != 0);
-
-    DPRINTF("fio_read: read sectors %d to %d\n", start_sector, start_sector + num_sectors);
+    pos = fdt->filePos;
+    left = size;
+    streaming = (pos == fdt->raNextPos);
+
+    while (left > 0) {
+        int lsn = fdt->LBA + (pos >> 11);
+        int off = pos & 0x7FF;
+        int n;
+
+        if (fdt->raSectors > 0 && lsn >= fdt->raLBA && lsn < fdt->raLBA + fdt->raSectors) {
+            // Served from the read-ahead window
+            n = ((fdt->raLBA + fdt->raSectors - lsn) << 11) - off;
+            if (n > left)
+                n = left;
+            memcpy(out, fdt->raBuffer + ((lsn - fdt->raLBA) << 11) + off, n);
+        } else if (off == 0 && left >= 2048 && ((u32)out & 3) == 0) {
+            // Whole sectors go straight into the caller's buffer, with a single command
+            int sectors = left >> 11;
+
+            DPRINTF("fio_read: read sectors %d to %d\n", lsn, lsn + sectors);
+            if (!cdfs_readSect(lsn, sectors, out)) {
+                DPRINTF("Couldn't Read from file for some reason\n");
+                break;
+            }
+            n = sectors << 11;
+        } else {
+            // Partial sector, or a buffer that is not suitable for DMA
+            if (!fillWindow(i, lsn, (off + left + 2047) >> 11, streaming))
+                break;
+            continue;
+        }
 
-    // Skip a Sector for equal (use the last sector in buffer)
-    if (start_sector == lastsector) {
-        read = 1;
-        if (last_bk > 0)
-            memcpy(local_buffer, local_buffer + 2048 * (last_bk), 2048);
-        last_bk = 0;
+        out += n;
+        pos += n;
+        left -= n;
     }
 
-    lastsector = start_sector + num_sectors - 1;
-    // Read the data (we only ever get 16KB max request at once)
+    if (left == size)
+        return -EIO;
 
-    if (read == 0 || (read == 1 && num_sectors > 1)) {
-        if (!cdfs_readSect(start_sector + read, num_sectors - read, local_buffer + ((read) << 11))) {
-            DPRINTF("Couldn't Read from file for some reason\n");
-        }
-        
-        last_bk = num_sectors - 1;
-    }
-
-    memcpy(buffer, local_buffer + off_sector, size);
-    fd_table[i].filePos += size;
+    fdt->filePos = pos;
+    fdt->raNextPos = pos;
 
-    return (size);
+    return size - left;
 }
 
 static int fio_write(iop_file_t *f, void *buffer, int size)
@@ -450,8 +528,16 @@ static iop_device_t fio_driver = {
 
 int _start(int argc, char *argv[])
 {
-    (void)argc;
-    (void)argv;
+    int i;
+
+    for (i = 1; i < argc; i++) {
+        // Size of the per-file read-ahead window
+        if (!strncmp(argv[i], "readahead=", 10)) {
+            readahead_sectors = strtol(&argv[i][10], NULL, 10);
+            if (readahead_sectors < 1)
+                readahead_sectors = 1;
+        }
+    }
 
     // Prepare cache and read mode
     cdfs_prepare();
@@ -0,0 +1,244 @@
+/*
+# _____     ___ ____     ___ ____
+#  ____|   |    ____|   |        | |____|
+# |     ___|   |____ ___|    ____| |    \    PS2DEV Open Source Project.
+#-----------------------------------------------------------------------
+# Licenced under Academic Free License version 2.0
+# Review ps2sdk README & LICENSE files for further details.
+*/
+
+/**
+ * @file
+ * BDM block device driver for the internal HDD, on top of ATAD.
+ *
+ * The HDD is accessed through ATAD only, which does no locking of its own:
+ * do not use this module and the APA/PFS drivers on the same drive at the
+ * same time.
+ */
+
+#include <atad.h>
+#include <atahw.h>
+#include <bdm.h>
+#include <errno.h>
+#include <irx.h>
+#include <loadcore.h>
+#include <sysclib.h>
+#include <thsemap.h>
+
+// #define DEBUG  //comment out this line when not debugging
+#include "module_debug.h"
+
+#define MAJOR_VER 1
+#define MINOR_VER 1
+#define MODNAME   "ata_bd"
+
+IRX_ID(MODNAME, MAJOR_VER, MINOR_VER);
+
+#define SECTOR_SIZE 512
+#define MAX_DEVICES 2
+// Size of the buffer used for requests that are not word aligned (DMA requirement)
+#define BOUNCE_SECTORS 16
+
+struct ata_bd_device
+{
+    struct block_device bd;
+    int device;
+};
+
+static struct ata_bd_device g_ata_bd[MAX_DEVICES];
+static int ata_bd_sema = -1;
+static u8 bounce_buffer[BOUNCE_SECTORS * SECTOR_SIZE] __attribute__((aligned(64)));
+
+/* Transfer count sectors, ATAD splits it into as few commands as possible. Call with the semaphore held. */
+static int ata_bd_io(int device, unsigned int op, u32 sector, void *buffer, u32 count)
+{
+    int dir = (op == BD_REQ_WRITE) ? ATA_DIR_WRITE : ATA_DIR_READ;
+    u8 *buf = buffer;
+    u32 left;
+    int rv;
+
+    if (((u32)buffer & 3) == 0) {
+        rv = ata_device_sector_io(device, buffer, sector, count, dir);
+        if (rv != 0) {
+            M_PRINTF("ERROR: %s %u sectors @ %u failed (%d)\n", (dir == ATA_DIR_WRITE) ? "write" : "read", (unsigned int)count, (unsigned int)sector, rv);
+            return -EIO;
+        }
+        return count;
+    }
+
+    M_DEBUG("unaligned buffer 0x%x\n", (unsigned int)buffer);
+
+    for (left = count; left > 0;) {
+        u32 n = (left > BOUNCE_SECTORS) ? BOUNCE_SECTORS : left;
+
+        if (dir == ATA_DIR_WRITE)
+            memcpy(bounce_buffer, buf, n * SECTOR_SIZE);
+
+        rv = ata_device_sector_io(device, bounce_buffer, sector, n, dir);
+        if (rv != 0) {
+            M_PRINTF("ERROR: %s %u sectors @ %u failed (%d)\n", (dir == ATA_DIR_WRITE) ? "write" : "read", (unsigned int)n, (unsigned int)sector, rv);
+            return -EIO;
+        }
+
+        if (dir == ATA_DIR_READ)
+            memcpy(buf, bounce_buffer, n * SECTOR_SIZE);
+
+        buf += n * SECTOR_SIZE;
+        sector += n;
+        left -= n;
+    }
+
+    return count;
+}
+
+//
+// Block device interface
+//
+static int ata_bd_read(struct block_device *bd, u32 sector, void *buffer, u16 count)
+{
+    struct ata_bd_device *dev = bd->priv;
+    int rv;
+
+    M_DEBUG("%s(%u, %u)\n", __func__, (unsigned int)sector, count);
+
+    WaitSema(ata_bd_sema);
+    rv = ata_bd_io(dev->device, BD_REQ_READ, sector, buffer, count);
+    SignalSema(ata_bd_sema);
+
+    return rv;
+}
+
+static int ata_bd_write(struct block_device *bd, u32 sector, const void *buffer, u16 count)
+{
+    struct ata_bd_device *dev = bd->priv;
+    int rv;
+
+    M_DEBUG("%s(%u, %u)\n", __func__, (unsigned int)sector, count);
+
+    WaitSema(ata_bd_sema);
+    rv = ata_bd_io(dev->device, BD_REQ_WRITE, sector, (void *)buffer, count);
+    SignalSema(ata_bd_sema);
+
+    return rv;
+}
+
+static void ata_bd_flush(struct block_device *bd)
+{
+    struct ata_bd_device *dev = bd->priv;
+
+    M_DEBUG("%s\n", __func__);
+
+    WaitSema(ata_bd_sema);
+    ata_device_flush_cache(dev->device);
+    SignalSema(ata_bd_sema);
+}
+
+static int ata_bd_stop(struct block_device *bd)
+{
+    struct ata_bd_device *dev = bd->priv;
+
+    M_DEBUG("%s\n", __func__);
+
+    WaitSema(ata_bd_sema);
+    ata_device_flush_cache(dev->device);
+    ata_device_idle_immediate(dev->device);
+    SignalSema(ata_bd_sema);
+
+    return 0;
+}
+
+/* Vectored requests are not limited to 16-bit sector counts, each element is a single ATAD call */
+static int ata_bd_submit(struct block_device *bd, struct bd_request *req)
+{
+    struct ata_bd_device *dev = bd->priv;
+    u32 sector                = req->sector;
+    unsigned int i;
+    int total = 0;
+
+    M_DEBUG("%s(%u, %u)\n", __func__, (unsigned int)req->sector, req->sg_count);
+
+    WaitSema(ata_bd_sema);
+    for (i = 0; i < req->sg_count; i++) {
+        int rv = ata_bd_io(dev->device, req->op, sector, req->sg[i].buffer, req->sg[i].count);
+
+        if (rv < 0) {
+            total = rv;
+            break;
+        }
+        sector += rv;
+        total += rv;
+    }
+    SignalSema(ata_bd_sema);
+
+    req->result = total;
+    if (req->complete != NULL)
+        req->complete(req);
+
+    return 0;
+}
+
+static const struct block_device_ext ata_bd_ext = {
+    ata_bd_submit,
+    1,
+};
+
+int _start(int argc, char *argv[])
+{
+    iop_sema_t sema;
+    int i, connected = 0;
+
+    (void)argc;
+    (void)argv;
+
+    M_PRINTF("ATA block device driver v%d.%d\n", MAJOR_VER, MINOR_VER);
+
+    sema.attr    = 0;
+    sema.option  = 0;
+    sema.initial = 1;
+    sema.max     = 1;
+    if ((ata_bd_sema = CreateSema(&sema)) < 0) {
+        M_PRINTF("ERROR: CreateSema returned %d\n", ata_bd_sema);
+        return MODULE_NO_RESIDENT_END;
+    }
+
+    for (i = 0; i < MAX_DEVICES; i++) {
+        ata_devinfo_t *devinfo = ata_get_devinfo(i);
+        struct block_device *bd;
+
+        if (devinfo == NULL || !devinfo->exists || devinfo->has_packet)
+            continue;
+
+        if (devinfo->security_status & ATA_F_SEC_LOCKED) {
+            M_PRINTF("device %d is locked, skipping\n", i);
+            continue;
+        }
+
+        g_ata_bd[i].device = i;
+
+        bd               = &g_ata_bd[i].bd;
+        bd->priv         = &g_ata_bd[i];
+        bd->name         = "ata";
+        bd->devNr        = i;
+        bd->parNr        = 0;
+        bd->parId        = 0x00;
+        bd->sectorSize   = SECTOR_SIZE;
+        bd->sectorOffset = 0;
+        bd->sectorCount  = devinfo->lba48 ? devinfo->total_sectors_lba48 : devinfo->total_sectors;
+        bd->read         = ata_bd_read;
+        bd->write        = ata_bd_write;
+        bd->flush        = ata_bd_flush;
+        bd->stop         = ata_bd_stop;
+        bdm_set_ext(bd, &ata_bd_ext);
+
+        M_PRINTF("device %d: %u sectors (%uMiB)\n", i, bd->sectorCount, bd->sectorCount / ((1024 * 1024) / SECTOR_SIZE));
+        bdm_connect_bd(bd);
+        connected++;
+    }
+
+    if (connected == 0) {
+        M_PRINTF("no HDD found\n");
+        return MODULE_NO_RESIDENT_END;
+    }
+
+    return MODULE_RESIDENT_END;
+}
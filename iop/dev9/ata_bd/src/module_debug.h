@@ -0,0 +1,15 @@
+#ifndef _MODULE_DEBUG_H
+#define _MODULE_DEBUG_H
+
+#include "stdio.h"
+#define M_PRINTF(format, args...) printf("ATA_BD: " format, ##args)
+
+#ifdef DEBUG
+#define M_DEBUG M_PRINTF
+#else
+#define M_DEBUG(format, args...) \
+    do {                         \
+    } while (0)
+#endif
+
+#endif
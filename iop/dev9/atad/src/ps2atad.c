@@ -852,7 +852,8 @@ int ata_device_sector_io(int device, void *buf, u32 lba, u32 nsectors, int dir)
 {
     USE_SPD_REGS;
     int res = 0, retries;
-    u16 sector, lcyl, hcyl, select, command, len;
+    u16 sector, lcyl, hcyl, select, command;
+    u32 len; // Up to 65536, which is sent to the device as 0
 
     while (res == 0 && nsectors > 0) {
         /* Variable lba is only 32 bits so no change for lcyl and hcyl.  */
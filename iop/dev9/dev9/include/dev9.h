@@ -24,10 +24,38 @@
 typedef int (*dev9_intr_cb_t)(int flag);
 typedef void (*dev9_shutdown_cb_t)(void);
 typedef void (*dev9_dma_cb_t)(int bcr, int dir);
+typedef void (*dev9_dma_done_cb_t)(void *arg);
+
+/** DMA statistics, for tuning the spin threshold. */
+typedef struct dev9_dma_stats
+{
+    /** Transfers queued for the DMA interrupt to complete: asynchronous ones, and synchronous ones above the spin threshold or issued while the channel was busy. */
+    u32 queued;
+    /** Synchronous transfers that were busy-waited for. */
+    u32 spin_completed;
+    /** Transfers completed by the DMA interrupt. */
+    u32 irq_completed;
+    /** Time spent busy-waiting for transfers, in microseconds. */
+    u32 spin_wait_usec;
+    /** Time synchronous callers spent sleeping until their transfer completed, in microseconds. */
+    u32 sleep_wait_usec;
+} dev9_dma_stats_t;
 
 void dev9RegisterIntrCb(int intr, dev9_intr_cb_t cb);
 
+/** Transfers bcr blocks and returns when done.
+ * Transfers up to the spin threshold are busy-waited for if the channel is idle, the calling thread sleeps for others.
+ */
 int dev9DmaTransfer(int ctrl, void *buf, int bcr, int dir);
+/** Queues a transfer and returns immediately. Must be called from a thread.
+ * cb is called from the DMA interrupt once the transfer has completed, after the post-DMA callback.
+ * Transfers are done in the order they were queued; the caller blocks only while the queue is full.
+ */
+int dev9DmaTransferAsync(int ctrl, void *buf, int bcr, int dir, dev9_dma_done_cb_t cb, void *arg);
+/** Sets the size, in bytes, of the largest transfer dev9DmaTransfer() busy-waits for. Returns the previous value; a negative size only queries it. */
+int dev9DmaSetSpinThreshold(int bytes);
+/** Returns the DMA statistics, and optionally resets them. */
+void dev9DmaGetStats(dev9_dma_stats_t *stats, int reset);
 
 void dev9Shutdown(void);
 void dev9IntrEnable(int mask);
@@ -48,17 +76,20 @@ void dev9RegisterPostDmaCb(int ctrl, dev9_dma_cb_t cb);
 #define dev9_IMPORTS_start DECLARE_IMPORT_TABLE(dev9, 1, 9)
 #define dev9_IMPORTS_end   END_IMPORT_TABLE
 
-#define I_dev9RegisterIntrCb     DECLARE_IMPORT(4, dev9RegisterIntrCb)
-#define I_dev9DmaTransfer        DECLARE_IMPORT(5, dev9DmaTransfer)
-#define I_dev9Shutdown           DECLARE_IMPORT(6, dev9Shutdown)
-#define I_dev9IntrEnable         DECLARE_IMPORT(7, dev9IntrEnable)
-#define I_dev9IntrDisable        DECLARE_IMPORT(8, dev9IntrDisable)
-#define I_dev9GetEEPROM          DECLARE_IMPORT(9, dev9GetEEPROM)
-#define I_dev9LEDCtl             DECLARE_IMPORT(10, dev9LEDCtl)
-#define I_dev9RegisterShutdownCb DECLARE_IMPORT(11, dev9RegisterShutdownCb)
-#define I_dev9RegisterPreDmaCb   DECLARE_IMPORT(12, dev9RegisterPreDmaCb)
-#define I_dev9RegisterPostDmaCb  DECLARE_IMPORT(13, dev9RegisterPostDmaCb)
-#define I_dev9ControlPIO3        DECLARE_IMPORT(14, dev9ControlPIO3)
-#define I_dev9LED2Ctl            DECLARE_IMPORT(15, dev9LED2Ctl)
+#define I_dev9RegisterIntrCb      DECLARE_IMPORT(4, dev9RegisterIntrCb)
+#define I_dev9DmaTransfer         DECLARE_IMPORT(5, dev9DmaTransfer)
+#define I_dev9Shutdown            DECLARE_IMPORT(6, dev9Shutdown)
+#define I_dev9IntrEnable          DECLARE_IMPORT(7, dev9IntrEnable)
+#define I_dev9IntrDisable         DECLARE_IMPORT(8, dev9IntrDisable)
+#define I_dev9GetEEPROM           DECLARE_IMPORT(9, dev9GetEEPROM)
+#define I_dev9LEDCtl              DECLARE_IMPORT(10, dev9LEDCtl)
+#define I_dev9RegisterShutdownCb  DECLARE_IMPORT(11, dev9RegisterShutdownCb)
+#define I_dev9RegisterPreDmaCb    DECLARE_IMPORT(12, dev9RegisterPreDmaCb)
+#define I_dev9RegisterPostDmaCb   DECLARE_IMPORT(13, dev9RegisterPostDmaCb)
+#define I_dev9ControlPIO3         DECLARE_IMPORT(14, dev9ControlPIO3)
+#define I_dev9LED2Ctl             DECLARE_IMPORT(15, dev9LED2Ctl)
+#define I_dev9DmaTransferAsync    DECLARE_IMPORT(16, dev9DmaTransferAsync)
+#define I_dev9DmaSetSpinThreshold DECLARE_IMPORT(17, dev9DmaSetSpinThreshold)
+#define I_dev9DmaGetStats         DECLARE_IMPORT(18, dev9DmaGetStats)
 
 #endif /* __DEV9_H__ */
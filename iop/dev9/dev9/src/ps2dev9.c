@@ -51,7 +51,31 @@ static const char *mod_name; /* Module name. */
 static int dev9type  = -1;   /* 0 for PCMCIA, 1 for expansion bay */
 static int using_aif = 0;    /* 1 if using AIF on a T10K */
 
-static int dma_lock_sem; /* used to arbitrate DMA */
+/* Transfers at most this big are waited for by busy-waiting, bigger ones by sleeping until the DMA interrupt.  */
+#define DEV9_DMA_SPIN_THRESHOLD 2048
+/* Number of transfers that can be queued at once, including the running one.  */
+#define DEV9_DMA_QUEUE_SIZE 8
+
+struct dev9_dma_request
+{
+    int device;
+    void *buf;
+    int bcr;
+    int dir;
+    dev9_dma_done_cb_t cb;
+    void *arg;
+    int spin; /* Completed by the thread that started it, not by the interrupt handler. */
+};
+
+/* The running transfer is always dma_queue[dma_head]. Only accessed with interrupts disabled.  */
+static struct dev9_dma_request dma_queue[DEV9_DMA_QUEUE_SIZE];
+static unsigned int dma_head, dma_count;
+
+static int dma_slot_sem; /* counts the free entries of dma_queue */
+static int dma_spin_threshold = DEV9_DMA_SPIN_THRESHOLD;
+
+static dev9_dma_stats_t dma_stats;
+static u64 dma_spin_clocks, dma_sleep_clocks;
 
 enum PC_CARD_TYPE {
     PC_CARD_TYPE_NONE = 0,
@@ -88,6 +112,7 @@ static dev9_dma_cb_t dev9_predma_cbs[4], dev9_postdma_cbs[4];
 static u8 dev9_has_dvr_capability = 0;
 
 static int dev9_intr_dispatch(int flag);
+static int dev9_dma_intr(void *unused);
 
 static void dev9_set_stat(int stat);
 static int dev9_ssbus_mode(int mode);
@@ -185,11 +210,12 @@ static iop_device_t dev9x_device =
 static int print_help(void)
 { // The original made a printf() call for each line.
     printf("Usage:\n"
-           "  %s [-sa] <attribute>]\n"
+           "  %s [-sa <attribute>] [-spin <bytes>]\n"
            "      -sa  You can specify attibute of sempahore for queuing thread.\n"
            "           List of possible <attribute>:\n"
-           "             SA_THPRI(default), SA_THFIFO\n",
-           mod_name);
+           "             SA_THPRI(default), SA_THFIFO\n"
+           "      -spin  Largest DMA transfer in bytes to busy-wait for (default %d).\n",
+           mod_name, DEV9_DMA_SPIN_THRESHOLD);
 
     return MODULE_NO_RESIDENT_END;
 }
@@ -225,6 +251,13 @@ int _start(int argc, char *argv[])
             } else {
                 return print_help();
             }
+        } else if (strcmp("-spin", *argv) == 0) {
+            --argc;
+            ++argv;
+            if (argc > 0)
+                dma_spin_threshold = strtol(*argv, NULL, 0);
+            else
+                return print_help();
         } else {
             return print_help();
         }
@@ -410,13 +443,8 @@ void dev9IntrDisable(int mask)
     CpuResumeIntr(flags);
 }
 
-/* Export 5 */
-int dev9DmaTransfer(int device, void *buf, int bcr, int dir)
+static int dev9_dma_check(int device)
 {
-    USE_SPD_REGS;
-    volatile iop_dmac_chan_t *dev9_chan = (iop_dmac_chan_t *)DEV9_DMAC_BASE;
-    int res, dmactrl, OldState;
-
     if (device >= 4) {
         return -1;
     } else if (device >= 2) {
@@ -426,10 +454,17 @@ int dev9DmaTransfer(int device, void *buf, int bcr, int dir)
             return -1;
     }
 
-    if ((res = WaitSema(dma_lock_sem)) < 0)
-        return res;
+    return 0;
+}
 
-    switch (device) {
+/* Interrupts must be disabled.  */
+static void dev9_dma_start(const struct dev9_dma_request *req)
+{
+    USE_SPD_REGS;
+    volatile iop_dmac_chan_t *dev9_chan = (iop_dmac_chan_t *)DEV9_DMAC_BASE;
+    int dmactrl;
+
+    switch (req->device) {
         case 0:
             dmactrl = 0;
             break;
@@ -451,27 +486,230 @@ int dev9DmaTransfer(int device, void *buf, int bcr, int dir)
 
     SPD_REG16(SPD_R_DMA_CTRL) = (SPD_REG16(SPD_R_REV_1) < 17) ? (dmactrl & 0x03) | 0x04 : dmactrl | 0x06;
 
-    if (dev9_predma_cbs[device])
-        dev9_predma_cbs[device](bcr, dir);
+    if (dev9_predma_cbs[req->device])
+        dev9_predma_cbs[req->device](req->bcr, req->dir);
+
+    dev9_chan->madr = (u32)req->buf;
+    dev9_chan->bcr  = req->bcr;
+    dev9_chan->chcr = DMAC_CHCR_30 | DMAC_CHCR_TR | DMAC_CHCR_CO | (req->dir & DMAC_CHCR_DR);
+}
 
-    dev9_chan->madr = (u32)buf;
+/* Adds a transfer to the queue and starts it if the channel is idle. Interrupts must be disabled.  */
+static void dev9_dma_push(const struct dev9_dma_request *req)
+{
+    dma_queue[(dma_head + dma_count) % DEV9_DMA_QUEUE_SIZE] = *req;
+    if (dma_count++ == 0)
+        dev9_dma_start(req);
+}
 
-    /* Older versions of DEV9 do not suspend interrupts. Not sure why this must be done though. */
-    CpuSuspendIntr(&OldState);
-    dev9_chan->bcr  = bcr;
-    dev9_chan->chcr = DMAC_CHCR_30 | DMAC_CHCR_TR | DMAC_CHCR_CO | (dir & DMAC_CHCR_DR);
+/* Completes the running transfer and starts the next one. Interrupts must be disabled.  */
+static void dev9_dma_finish(struct dev9_dma_request *done)
+{
+    *done = dma_queue[dma_head];
+
+    if (dev9_postdma_cbs[done->device])
+        dev9_postdma_cbs[done->device](done->bcr, done->dir);
+
+    dma_head = (dma_head + 1) % DEV9_DMA_QUEUE_SIZE;
+    if (--dma_count > 0)
+        dev9_dma_start(&dma_queue[dma_head]);
+}
+
+static int dev9_dma_intr(void *unused)
+{
+    volatile iop_dmac_chan_t *dev9_chan = (iop_dmac_chan_t *)DEV9_DMAC_BASE;
+    struct dev9_dma_request done;
+
+    (void)unused;
+
+    /* Ignore transfers that are still running (stale interrupts) and those that are busy-waited for.  */
+    if (dma_count == 0 || dma_queue[dma_head].spin || (dev9_chan->chcr & DMAC_CHCR_TR))
+        return 1;
+
+    dev9_dma_finish(&done);
+    dma_stats.irq_completed++;
+    iSignalSema(dma_slot_sem);
+
+    if (done.cb != NULL)
+        done.cb(done.arg);
+
+    return 1;
+}
+
+static int dev9_dma_bytes(int bcr)
+{
+    return (bcr >> 16) * (bcr & 0xFFFF) * 4;
+}
+
+static void dev9_dma_add_time(u64 *total, const iop_sys_clock_t *start)
+{
+    iop_sys_clock_t now;
+
+    GetSystemTime(&now);
+    *total += (((u64)now.hi << 32) | now.lo) - (((u64)start->hi << 32) | start->lo);
+}
+
+struct dev9_dma_waiter
+{
+    int sema;
+};
+
+static void dev9_dma_wakeup(void *arg)
+{
+    struct dev9_dma_waiter *waiter = arg;
+
+    iSignalSema(waiter->sema);
+}
+
+/* Export 5 */
+int dev9DmaTransfer(int device, void *buf, int bcr, int dir)
+{
+    volatile iop_dmac_chan_t *dev9_chan = (iop_dmac_chan_t *)DEV9_DMAC_BASE;
+    struct dev9_dma_request req, done;
+    struct dev9_dma_waiter waiter;
+    iop_sys_clock_t start;
+    iop_sema_t sema;
+    int res, OldState;
+
+    if (dev9_dma_check(device) < 0)
+        return -1;
+
+    if ((res = WaitSema(dma_slot_sem)) < 0)
+        return res;
+
+    req.device  = device;
+    req.buf     = buf;
+    req.bcr     = bcr;
+    req.dir     = dir;
+    req.cb      = &dev9_dma_wakeup;
+    req.arg     = &waiter;
+    req.spin    = 0;
+    waiter.sema = -1;
+
+    sema.attr    = 0;
+    sema.initial = 0;
+    sema.max     = 1;
+    sema.option  = 0;
+
+    GetSystemTime(&start);
+
+    /* Small transfers on an idle channel are busy-waited for, as thread switching costs more than the transfer.
+       Others are waited for on a semaphore of their own, which can't be created with interrupts disabled.  */
+    while (1) {
+        CpuSuspendIntr(&OldState);
+        if (dma_count == 0 && dev9_dma_bytes(bcr) <= dma_spin_threshold) {
+            req.spin = 1;
+            break;
+        }
+        if (waiter.sema >= 0) {
+            dma_stats.queued++;
+            break;
+        }
+        CpuResumeIntr(OldState);
+
+        if ((waiter.sema = CreateSema(&sema)) < 0) {
+            SignalSema(dma_slot_sem);
+            return waiter.sema;
+        }
+    }
+    dev9_dma_push(&req);
     CpuResumeIntr(OldState);
 
-    /* Wait for DMA to complete. Do not use a semaphore as thread switching hurts throughput greatly.  */
-    while (dev9_chan->chcr & DMAC_CHCR_TR) {}
+    if (req.spin) {
+        while (dev9_chan->chcr & DMAC_CHCR_TR) {}
+
+        CpuSuspendIntr(&OldState);
+        dev9_dma_finish(&done);
+        dma_stats.spin_completed++;
+        CpuResumeIntr(OldState);
+
+        SignalSema(dma_slot_sem);
+        /* The channel became idle while the semaphore was created.  */
+        if (waiter.sema >= 0)
+            DeleteSema(waiter.sema);
+        dev9_dma_add_time(&dma_spin_clocks, &start);
+    } else {
+        WaitSema(waiter.sema);
+        DeleteSema(waiter.sema);
+
+        dev9_dma_add_time(&dma_sleep_clocks, &start);
+    }
+
+    return 0;
+}
+
+/* Export 16 */
+int dev9DmaTransferAsync(int device, void *buf, int bcr, int dir, dev9_dma_done_cb_t cb, void *arg)
+{
+    struct dev9_dma_request req;
+    int res, OldState;
+
+    if (dev9_dma_check(device) < 0)
+        return -1;
+
+    if ((res = WaitSema(dma_slot_sem)) < 0)
+        return res;
+
+    req.device = device;
+    req.buf    = buf;
+    req.bcr    = bcr;
+    req.dir    = dir;
+    req.cb     = cb;
+    req.arg    = arg;
+    req.spin   = 0;
 
-    if (dev9_postdma_cbs[device])
-        dev9_postdma_cbs[device](bcr, dir);
+    CpuSuspendIntr(&OldState);
+    dma_stats.queued++;
+    dev9_dma_push(&req);
+    CpuResumeIntr(OldState);
 
-    SignalSema(dma_lock_sem);
     return 0;
 }
 
+/* Export 17 */
+int dev9DmaSetSpinThreshold(int bytes)
+{
+    int old = dma_spin_threshold;
+
+    if (bytes >= 0)
+        dma_spin_threshold = bytes;
+
+    return old;
+}
+
+static u32 dev9_dma_clocks_to_usec(u64 clocks)
+{
+    iop_sys_clock_t clock;
+    u32 sec, usec;
+
+    clock.lo = (u32)clocks;
+    clock.hi = (u32)(clocks >> 32);
+    SysClock2USec(&clock, &sec, &usec);
+
+    return sec * 1000000 + usec;
+}
+
+/* Export 18 */
+void dev9DmaGetStats(dev9_dma_stats_t *stats, int reset)
+{
+    u64 spin_clocks, sleep_clocks;
+    int OldState;
+
+    CpuSuspendIntr(&OldState);
+    *stats       = dma_stats;
+    spin_clocks  = dma_spin_clocks;
+    sleep_clocks = dma_sleep_clocks;
+    if (reset) {
+        memset(&dma_stats, 0, sizeof(dma_stats));
+        dma_spin_clocks  = 0;
+        dma_sleep_clocks = 0;
+    }
+    CpuResumeIntr(OldState);
+
+    stats->spin_wait_usec  = dev9_dma_clocks_to_usec(spin_clocks);
+    stats->sleep_wait_usec = dev9_dma_clocks_to_usec(sleep_clocks);
+}
+
 static int read_eeprom_data(void)
 {
     USE_SPD_REGS;
@@ -628,14 +866,17 @@ static int dev9_init(int sema_attr)
     int i, flags;
 
     sema.attr    = sema_attr;
-    sema.initial = 1;
-    sema.max     = 1;
-    if ((dma_lock_sem = CreateSema(&sema)) < 0)
+    sema.initial = DEV9_DMA_QUEUE_SIZE;
+    sema.max     = DEV9_DMA_QUEUE_SIZE;
+    if ((dma_slot_sem = CreateSema(&sema)) < 0)
         return -1;
 
     CpuSuspendIntr(&flags);
     /* Enable the DEV9 DMAC channel.  */
     dmac_set_dpcr2(dmac_get_dpcr2() | 0x80);
+    /* Transfers that are not busy-waited for complete from the DMA interrupt.  */
+    RegisterIntrHandler(IOP_IRQ_DMA_DEV9, 1, &dev9_dma_intr, NULL);
+    EnableIntr(IOP_IRQ_DMA_DEV9);
     CpuResumeIntr(flags);
 
     /* Not quite sure what this enables yet.  */
@@ -18,6 +18,55 @@
 #include <irx.h>
 #include <types.h>
 
+struct block_device;
+
+/* Request operations */
+#define BD_REQ_READ  0
+#define BD_REQ_WRITE 1
+
+/* Scatter-gather list element */
+struct bd_sg
+{
+    void *buffer;
+    u32 count; // number of sectors
+};
+
+/*
+ * Asynchronous, vectored block device request.
+ * The request and its scatter-gather list belong to the submitter until
+ * 'complete' has been called. 'complete' can be called from any thread or
+ * from interrupt context, and may be called before submit returns.
+ */
+struct bd_request
+{
+    // Can be used by the driver to queue the request
+    struct bd_request *next;
+
+    unsigned int op;
+    u32 sector;
+    struct bd_sg *sg;
+    unsigned int sg_count;
+
+    // Number of sectors transferred, or a negative error code
+    int result;
+    void (*complete)(struct bd_request *req);
+    // Private submitter data
+    void *priv;
+};
+
+/*
+ * Optional extended operations, registered with bdm_set_ext().
+ * Drivers that do not provide these are driven through their read/write
+ * functions by bdm_submit/bdm_transfer.
+ */
+struct block_device_ext
+{
+    // Queue a request, returns 0 if it was accepted (and 'complete' will be called)
+    int (*submit)(struct block_device *bd, struct bd_request *req);
+    // Number of requests the driver can have in flight
+    unsigned int queue_depth;
+};
+
 struct block_device
 {
     // Private driver data
@@ -56,6 +105,8 @@ struct file_system
 
 typedef void (*bdm_cb)(int event);
 
+struct bd_cache_stats;
+
 // Exported functions
 void bdm_connect_bd(struct block_device *bd);
 void bdm_disconnect_bd(struct block_device *bd);
@@ -63,8 +114,28 @@ void bdm_connect_fs(struct file_system *fs);
 void bdm_disconnect_fs(struct file_system *fs);
 void bdm_get_bd(struct block_device **pbd, unsigned int count);
 void bdm_RegisterCallback(bdm_cb cb);
+int bdm_get_cache_stats(struct block_device *bd, struct bd_cache_stats *stats);
+int bdm_reset_cache_stats(struct block_device *bd);
+
+/*
+ * Register the extended operations of a block device, before connecting it.
+ * They are kept outside of struct block_device, so that drivers built
+ * without them keep working. The registration is dropped when the device is
+ * disconnected, or with a NULL 'ext'. Returns 0, or -1 if the table is full.
+ */
+int bdm_set_ext(struct block_device *bd, const struct block_device_ext *ext);
+/* Get the extended operations of a block device, NULL if it has none */
+const struct block_device_ext *bdm_get_ext(struct block_device *bd);
+
+/* Asynchronous vectored I/O, works with any block device */
+int bdm_submit(struct block_device *bd, struct bd_request *req);
+/* Synchronous vectored I/O, returns the number of sectors transferred */
+int bdm_transfer(struct block_device *bd, unsigned int op, u32 sector, struct bd_sg *sg, unsigned int sg_count);
+/* Synchronous I/O without the 16-bit sector count limit */
+int bdm_read(struct block_device *bd, u32 sector, void *buffer, u32 count);
+int bdm_write(struct block_device *bd, u32 sector, const void *buffer, u32 count);
 
-#define bdm_IMPORTS_start DECLARE_IMPORT_TABLE(bdm, 1, 1)
+#define bdm_IMPORTS_start DECLARE_IMPORT_TABLE(bdm, 1, 2)
 #define bdm_IMPORTS_end   END_IMPORT_TABLE
 
 #define I_bdm_connect_bd       DECLARE_IMPORT(4, bdm_connect_bd)
@@ -73,5 +144,13 @@ void bdm_RegisterCallback(bdm_cb cb);
 #define I_bdm_disconnect_fs    DECLARE_IMPORT(7, bdm_disconnect_fs)
 #define I_bdm_get_bd           DECLARE_IMPORT(8, bdm_get_bd)
 #define I_bdm_RegisterCallback DECLARE_IMPORT(9, bdm_RegisterCallback)
+#define I_bdm_get_cache_stats   DECLARE_IMPORT(10, bdm_get_cache_stats)
+#define I_bdm_reset_cache_stats DECLARE_IMPORT(11, bdm_reset_cache_stats)
+#define I_bdm_submit            DECLARE_IMPORT(12, bdm_submit)
+#define I_bdm_transfer          DECLARE_IMPORT(13, bdm_transfer)
+#define I_bdm_read              DECLARE_IMPORT(14, bdm_read)
+#define I_bdm_write             DECLARE_IMPORT(15, bdm_write)
+#define I_bdm_set_ext           DECLARE_IMPORT(16, bdm_set_ext)
+#define I_bdm_get_ext           DECLARE_IMPORT(17, bdm_get_ext)
 
 #endif
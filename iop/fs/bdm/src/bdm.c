@@ -1,5 +1,6 @@
 #include <bdm.h>
 #include <stdio.h>
+#include <sysclib.h>
 #include <thbase.h>
 #include <thevent.h>
 
@@ -86,6 +87,7 @@ void bdm_disconnect_bd(struct block_device *bd)
             }
 
             g_mount[i].bd = NULL;
+            bdm_set_ext(bd, NULL);
 
             if (g_cb != NULL)
                 SetEventFlag(bdm_event, BDM_EVENT_CB_UMOUNT);
@@ -145,6 +147,47 @@ void bdm_get_bd(struct block_device **pbd, unsigned int count)
         pbd[i] = g_mount[i].bd;
 }
 
+static struct block_device *bdm_find_cache(struct block_device *bd)
+{
+    int i;
+
+    // Partitions share the cache of the entire device
+    for (i = 0; i < MAX_CONNECTIONS; ++i) {
+        if ((g_mount[i].cbd != NULL) &&
+            ((g_mount[i].bd == bd) || (g_mount[i].cbd == bd) ||
+             ((g_mount[i].bd->devNr == bd->devNr) && (strcmp(g_mount[i].bd->name, bd->name) == 0))))
+            return g_mount[i].cbd;
+    }
+
+    return NULL;
+}
+
+int bdm_get_cache_stats(struct block_device *bd, struct bd_cache_stats *stats)
+{
+    struct block_device *cbd;
+
+    M_DEBUG("%s\n", __func__);
+
+    if ((cbd = bdm_find_cache(bd)) == NULL)
+        return -1;
+
+    bd_cache_get_stats(cbd, stats);
+    return 0;
+}
+
+int bdm_reset_cache_stats(struct block_device *bd)
+{
+    struct block_device *cbd;
+
+    M_DEBUG("%s\n", __func__);
+
+    if ((cbd = bdm_find_cache(bd)) == NULL)
+        return -1;
+
+    bd_cache_reset_stats(cbd);
+    return 0;
+}
+
 static void bdm_try_mount(struct bdm_mounts *mount)
 {
     int i;
@@ -0,0 +1,198 @@
+#include <bdm.h>
+#include <errno.h>
+#include <intrman.h>
+#include <stdio.h>
+#include <thsemap.h>
+
+// #define DEBUG  //comment out this line when not debugging
+#include "module_debug.h"
+
+// Largest transfer handed to the 16-bit read/write functions at once
+#define BDM_LEGACY_MAX_SECTORS 0x8000
+
+struct bdm_wait
+{
+    int sema;
+};
+
+// Extended operations of the block devices that have them: drivers, partitions and caches
+#define BDM_MAX_EXT 32
+
+struct bdm_ext_entry
+{
+    struct block_device *bd;
+    const struct block_device_ext *ext;
+};
+
+static struct bdm_ext_entry g_ext[BDM_MAX_EXT];
+
+int bdm_set_ext(struct block_device *bd, const struct block_device_ext *ext)
+{
+    int i, free = -1, state, rv = 0;
+
+    M_DEBUG("%s(%s%d)\n", __func__, bd->name, bd->devNr);
+
+    CpuSuspendIntr(&state);
+    for (i = 0; i < BDM_MAX_EXT; i++) {
+        if (g_ext[i].bd == bd)
+            break;
+        if ((g_ext[i].bd == NULL) && (free < 0))
+            free = i;
+    }
+
+    if (i < BDM_MAX_EXT) {
+        if (ext != NULL)
+            g_ext[i].ext = ext;
+        else
+            g_ext[i].bd = NULL;
+    } else if (ext != NULL) {
+        if (free >= 0) {
+            g_ext[free].bd  = bd;
+            g_ext[free].ext = ext;
+        } else {
+            rv = -1;
+        }
+    }
+    CpuResumeIntr(state);
+
+    return rv;
+}
+
+const struct block_device_ext *bdm_get_ext(struct block_device *bd)
+{
+    const struct block_device_ext *ext = NULL;
+    int i, state;
+
+    CpuSuspendIntr(&state);
+    for (i = 0; i < BDM_MAX_EXT; i++) {
+        if (g_ext[i].bd == bd) {
+            ext = g_ext[i].ext;
+            break;
+        }
+    }
+    CpuResumeIntr(state);
+
+    return ext;
+}
+
+/* Execute a request with the synchronous read/write functions of a driver */
+static int bdm_legacy_transfer(struct block_device *bd, struct bd_request *req)
+{
+    unsigned int i;
+    u32 sector = req->sector;
+    int total  = 0;
+
+    for (i = 0; i < req->sg_count; i++) {
+        u8 *buffer = req->sg[i].buffer;
+        u32 left   = req->sg[i].count;
+
+        while (left > 0) {
+            u16 count = (left > BDM_LEGACY_MAX_SECTORS) ? BDM_LEGACY_MAX_SECTORS : left;
+            int rv;
+
+            if (req->op == BD_REQ_WRITE)
+                rv = bd->write(bd, sector, buffer, count);
+            else
+                rv = bd->read(bd, sector, buffer, count);
+
+            if (rv != count) {
+                M_DEBUG("ERROR: %s sector %u failed %d\n", (req->op == BD_REQ_WRITE) ? "write" : "read", sector, rv);
+                return (rv < 0) ? rv : -EIO;
+            }
+
+            sector += count;
+            buffer += count * bd->sectorSize;
+            left -= count;
+            total += count;
+        }
+    }
+
+    return total;
+}
+
+int bdm_submit(struct block_device *bd, struct bd_request *req)
+{
+    const struct block_device_ext *ext = bdm_get_ext(bd);
+
+    M_DEBUG("%s(%u, %u)\n", __func__, req->sector, req->sg_count);
+
+    if ((ext != NULL) && (ext->submit != NULL))
+        return ext->submit(bd, req);
+
+    // Compatibility: complete the request synchronously
+    req->result = bdm_legacy_transfer(bd, req);
+    if (req->complete != NULL)
+        req->complete(req);
+
+    return 0;
+}
+
+static void bdm_wait_complete(struct bd_request *req)
+{
+    struct bdm_wait *wait = req->priv;
+
+    if (QueryIntrContext())
+        iSignalSema(wait->sema);
+    else
+        SignalSema(wait->sema);
+}
+
+int bdm_transfer(struct block_device *bd, unsigned int op, u32 sector, struct bd_sg *sg, unsigned int sg_count)
+{
+    const struct block_device_ext *ext = bdm_get_ext(bd);
+    struct bd_request req;
+    struct bdm_wait wait;
+    iop_sema_t sp;
+    int rv;
+
+    req.next     = NULL;
+    req.op       = op;
+    req.sector   = sector;
+    req.sg       = sg;
+    req.sg_count = sg_count;
+    req.result   = 0;
+
+    if ((ext == NULL) || (ext->submit == NULL))
+        return bdm_legacy_transfer(bd, &req);
+
+    // A semaphore of its own, the wakeups of the calling thread are not ours to take
+    sp.initial = 0;
+    sp.max     = 1;
+    sp.option  = 0;
+    sp.attr    = 0;
+    if ((wait.sema = CreateSema(&sp)) < 0)
+        return -ENOMEM;
+
+    req.complete = bdm_wait_complete;
+    req.priv     = &wait;
+
+    rv = ext->submit(bd, &req);
+    if (rv >= 0) {
+        WaitSema(wait.sema);
+        rv = req.result;
+    }
+
+    DeleteSema(wait.sema);
+
+    return rv;
+}
+
+int bdm_read(struct block_device *bd, u32 sector, void *buffer, u32 count)
+{
+    struct bd_sg sg;
+
+    sg.buffer = buffer;
+    sg.count  = count;
+
+    return bdm_transfer(bd, BD_REQ_READ, sector, &sg, 1);
+}
+
+int bdm_write(struct block_device *bd, u32 sector, const void *buffer, u32 count)
+{
+    struct bd_sg sg;
+
+    sg.buffer = (void *)buffer;
+    sg.count  = count;
+
+    return bdm_transfer(bd, BD_REQ_WRITE, sector, &sg, 1);
+}
@@ -2,12 +2,15 @@
 #include <irx.h>
 #include <loadcore.h>
 #include <stdio.h>
+#include <sysclib.h>
+
+#include <bd_cache.h>
 
 // #define DEBUG  //comment out this line when not debugging
 #include "module_debug.h"
 
 #define MAJOR_VER 1
-#define MINOR_VER 1
+#define MINOR_VER 2
 
 IRX_ID("bdm", MAJOR_VER, MINOR_VER);
 
@@ -15,13 +18,30 @@ extern struct irx_export_table _exp_bdm;
 extern int bdm_init();
 extern void part_init();
 
+#define DEFAULT_CACHE_BLOCKS  32
+#define DEFAULT_CACHE_SECTORS  8
+
 int _start(int argc, char *argv[])
 {
-    (void)argc;
-    (void)argv;
+    unsigned int cache_blocks  = DEFAULT_CACHE_BLOCKS;
+    unsigned int cache_sectors = DEFAULT_CACHE_SECTORS;
+    int i;
 
     printf("Block Device Manager (BDM) v%d.%d\n", MAJOR_VER, MINOR_VER);
 
+    // Parse arguments:
+    //  - cache_blocks=<n>  : number of cache blocks per device
+    //  - cache_sectors=<n> : number of sectors per cache block
+    for (i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "cache_blocks=", 13) == 0)
+            cache_blocks = strtol(&argv[i][13], NULL, 10);
+        else if (strncmp(argv[i], "cache_sectors=", 14) == 0)
+            cache_sectors = strtol(&argv[i][14], NULL, 10);
+        else
+            M_PRINTF("WARNING: unknown argument '%s'\n", argv[i]);
+    }
+    bd_cache_configure(cache_blocks, cache_sectors);
+
     if (RegisterLibraryEntries(&_exp_bdm) != 0) {
         M_PRINTF("ERROR: Already registered!\n");
         return MODULE_NO_RESIDENT_END;
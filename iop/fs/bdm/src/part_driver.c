@@ -46,6 +46,7 @@ struct partition
 static struct partition g_part[MAX_PARTITIONS];
 static struct block_device g_part_bd[MAX_PARTITIONS];
 static struct file_system g_part_fs;
+static struct block_device_ext g_part_ext[MAX_PARTITIONS];
 
 //---------------------------------------------------------------------------
 static int part_isPartitionRecordInvalid(struct block_device *bd, part_raw_record *raw, part_record *rec)
@@ -103,6 +104,7 @@ static int part_getPartitionTable(struct block_device *bd, part_table *part)
 //---------------------------------------------------------------------------
 void part_create(struct block_device *bd, part_record *rec, unsigned int parNr)
 {
+    const struct block_device_ext *ext = bdm_get_ext(bd);
     int i;
 
     M_DEBUG("%s\n", __func__);
@@ -117,6 +119,10 @@ void part_create(struct block_device *bd, part_record *rec, unsigned int parNr)
             g_part_bd[i].sectorSize   = bd->sectorSize;
             g_part_bd[i].sectorOffset = bd->sectorOffset + rec->start;
             g_part_bd[i].sectorCount  = rec->count;
+            if (ext != NULL) {
+                g_part_ext[i].queue_depth = ext->queue_depth;
+                bdm_set_ext(&g_part_bd[i], &g_part_ext[i]);
+            }
             bdm_connect_bd(&g_part_bd[i]);
             break;
         }
@@ -222,6 +228,18 @@ static int part_stop(struct block_device *bd)
     return part->bd->stop(part->bd);
 }
 
+static int part_submit(struct block_device *bd, struct bd_request *req)
+{
+    struct partition *part = (struct partition *)bd->priv;
+
+    M_DEBUG("%s\n", __func__);
+
+    if ((part == NULL) || (part->bd == NULL))
+        return -1;
+
+    return bdm_submit(part->bd, req);
+}
+
 void part_init()
 {
     int i;
@@ -236,6 +254,9 @@ void part_init()
         g_part_bd[i].write = part_write;
         g_part_bd[i].flush = part_flush;
         g_part_bd[i].stop  = part_stop;
+
+        g_part_ext[i].submit      = part_submit;
+        g_part_ext[i].queue_depth = 1;
     }
 
     g_part_fs.priv          = NULL;
@@ -69,7 +69,7 @@ DRESULT disk_read(
         return RES_NOTRDY;
     }
 
-    res = mounted_bd->read(mounted_bd, sector, buff, count);
+    res = bdm_read(mounted_bd, sector, buff, count);
 
     return (res == count) ? RES_OK : RES_ERROR;
 }
@@ -98,7 +98,7 @@ DRESULT disk_write(
         return RES_NOTRDY;
     }
 
-    res = mounted_bd->write(mounted_bd, sector, buff, count);
+    res = bdm_write(mounted_bd, sector, buff, count);
 
     return (res == count) ? RES_OK : RES_ERROR;
 }
@@ -24,6 +24,7 @@
 #include <usbhdfsd-common.h>
 
 #include "fs_driver.h"
+#include "fs_readahead.h"
 
 //#define DEBUG  //comment out this line when not debugging
 #include "module_debug.h"
@@ -43,6 +44,7 @@ fatfs_fs_driver_mount_info fs_driver_mount_info[FF_VOLUMES];
     modified_##varname[0] = '0' + (fd)->unit; \
     modified_##varname[1] = ':'; \
     modified_##varname[2] = '/'; \
+    memcpy(&modified_##varname[3], varname, strlen_##varname); \
     modified_##varname[3 + strlen_##varname] = '\x00';
 
 //---------------------------------------------------------------------------
@@ -206,6 +208,14 @@ void disconnect_bd(struct block_device *bd)
 
 #define MAX_FILES 16
 static FIL fil_structures[MAX_FILES];
+static fatfs_fs_driver_readahead fil_readahead[MAX_FILES];
+
+// Fast seek: cluster link map tables (CLMT) of large read-only files
+#define FASTSEEK_PROBE_ITEMS 64
+static unsigned int fil_clmt_size[MAX_FILES];
+static unsigned int fastseek_min_size   = 1024 * 1024;
+static unsigned int fastseek_mem_budget = 32 * 1024;
+static unsigned int fastseek_mem_used   = 0;
 
 #define MAX_DIRS 16
 static DIR dir_structures[MAX_DIRS];
@@ -224,6 +234,99 @@ static FIL *fs_find_free_fil_structure(void)
     return NULL;
 }
 
+static fatfs_fs_driver_readahead *fs_get_readahead(FIL *file)
+{
+    return &fil_readahead[file - fil_structures];
+}
+
+static void fs_invalidate_readahead_all(void)
+{
+    int i;
+
+    for (i = 0; i < MAX_FILES; i++) {
+        fs_readahead_invalidate(&fil_readahead[i]);
+    }
+}
+
+void fatfs_fs_driver_configure_fastseek(unsigned int min_size, unsigned int mem_budget)
+{
+    fastseek_min_size   = min_size;
+    fastseek_mem_budget = mem_budget;
+}
+
+static void fs_fastseek_free(FIL *file)
+{
+    int i = file - fil_structures;
+
+    if (file->cltbl != NULL) {
+        free(file->cltbl);
+        file->cltbl = NULL;
+        fastseek_mem_used -= fil_clmt_size[i];
+        fil_clmt_size[i] = 0;
+    }
+}
+
+static void fs_fastseek_create(FIL *file)
+{
+    DWORD probe[FASTSEEK_PROBE_ITEMS];
+    unsigned int size;
+    DWORD *clmt;
+    FRESULT res;
+
+    if ((fastseek_min_size == 0) || (file->obj.objsize < fastseek_min_size))
+        return;
+
+    // Probe the chain with a small table first, most files have few fragments
+    probe[0]    = FASTSEEK_PROBE_ITEMS;
+    file->cltbl = probe;
+    res         = f_lseek(file, CREATE_LINKMAP);
+    if (res == FR_NOT_ENOUGH_CORE) {
+        // probe[0] now contains the required number of items
+        size = probe[0] * sizeof(DWORD);
+        if ((fastseek_mem_used + size > fastseek_mem_budget) || ((clmt = malloc(size)) == NULL)) {
+            M_DEBUG("fast seek: no memory for %u bytes CLMT\n", size);
+            file->cltbl = NULL;
+            return;
+        }
+        clmt[0]     = probe[0];
+        file->cltbl = clmt;
+        if (f_lseek(file, CREATE_LINKMAP) != FR_OK) {
+            file->cltbl = NULL;
+            free(clmt);
+            return;
+        }
+    } else if ((res == FR_OK) && (probe[0] <= FASTSEEK_PROBE_ITEMS)) {
+        size = probe[0] * sizeof(DWORD);
+        if ((fastseek_mem_used + size > fastseek_mem_budget) || ((clmt = malloc(size)) == NULL)) {
+            file->cltbl = NULL;
+            return;
+        }
+        memcpy(clmt, probe, size);
+        file->cltbl = clmt;
+    } else {
+        // The chain could not be walked (disk error), keep using normal seeks
+        M_DEBUG("fast seek: CLMT creation failed %d\n", res);
+        file->cltbl = NULL;
+        return;
+    }
+
+    fil_clmt_size[file - fil_structures] = size;
+    fastseek_mem_used += size;
+    M_DEBUG("fast seek: %u bytes CLMT, %u/%u bytes used\n", size, fastseek_mem_used, fastseek_mem_budget);
+}
+
+/* The cluster chain of the file can change, drop the CLMTs of all handles on it */
+static void fs_fastseek_invalidate(FIL *file)
+{
+    int i;
+
+    for (i = 0; i < MAX_FILES; i++) {
+        FIL *f = &fil_structures[i];
+        if ((f->obj.fs == file->obj.fs) && (f->obj.sclust == file->obj.sclust) && (f->cltbl != NULL))
+            fs_fastseek_free(f);
+    }
+}
+
 static DIR *fs_find_free_dir_structure(void)
 {
     int i;
@@ -296,6 +399,11 @@ static int fs_open(iop_file_t *fd, const char *name, int flags, int mode)
         fd->privdata = NULL;
         ret          = -ret;
     } else {
+        // Only read-only files use read-ahead, so the buffer never needs write-back
+        fs_readahead_open(fs_get_readahead(fd->privdata), !(f_mode & FA_WRITE));
+        // Files in fast seek mode can not be expanded, so only read-only files get a CLMT
+        if (!(f_mode & FA_WRITE))
+            fs_fastseek_create(fd->privdata);
         ret = 1;
     }
 
@@ -313,6 +421,8 @@ static int fs_close(iop_file_t *fd)
     _fs_lock();
 
     if (fd->privdata) {
+        fs_readahead_close(fs_get_readahead(fd->privdata));
+        fs_fastseek_free(fd->privdata);
         ret = f_close(fd->privdata);
         fd->privdata = NULL;
     }
@@ -335,22 +445,29 @@ s64 fs_lseek64(iop_file_t *fd, s64 offset, int whence)
     _fs_lock();
 
     FIL *file = (FIL *)(fd->privdata);
+    fatfs_fs_driver_readahead *ra = fs_get_readahead(file);
 
     FSIZE_t off = offset;
 
     switch (whence) {
         case SEEK_CUR:
-            off += file->fptr;
+            off += ra->enabled ? ra->pos : file->fptr;
             break;
         case SEEK_END:
             off = file->obj.objsize - offset;
             break;
     }
 
-    res = f_lseek(file, off);
+    if (ra->enabled) {
+        res = fs_readahead_lseek(file, ra, off);
+        off = ra->pos;
+    } else {
+        res = f_lseek(file, off);
+        off = file->fptr;
+    }
 
     _fs_unlock();
-    return (res == FR_OK) ? (s64)(file->fptr) : -res;
+    return (res == FR_OK) ? (s64)off : -res;
 }
 
 static int fs_lseek(iop_file_t *fd, int offset, int whence)
@@ -371,6 +488,10 @@ static int fs_write(iop_file_t *fd, void *buffer, int size)
 
     _fs_lock();
 
+    // Drop prefetched data of read-only handles that could be stale now
+    fs_invalidate_readahead_all();
+    fs_fastseek_invalidate(fd->privdata);
+
     ret = f_write(fd->privdata, buffer, size, &bw);
 
     _fs_unlock();
@@ -390,7 +511,11 @@ static int fs_read(iop_file_t *fd, void *buffer, int size)
 
     _fs_lock();
 
-    ret = f_read(fd->privdata, buffer, size, &br);
+    fatfs_fs_driver_readahead *ra = fs_get_readahead(fd->privdata);
+    if (ra->enabled)
+        ret = fs_readahead_read(fd->privdata, ra, buffer, size, &br);
+    else
+        ret = f_read(fd->privdata, buffer, size, &br);
 
     _fs_unlock();
     return (ret == FR_OK) ? br : 0;
@@ -706,8 +831,6 @@ static int fs_devctl(iop_file_t *fd, const char *name, int cmd, void *arg, unsig
     (void)name;
     (void)arg;
     (void)arglen;
-    (void)buf;
-    (void)buflen;
 
     _fs_lock();
 
@@ -723,6 +846,38 @@ static int fs_devctl(iop_file_t *fd, const char *name, int cmd, void *arg, unsig
             ret        = FR_OK;
             break;
         }
+        case USBMASS_DEVCTL_GET_CACHE_STATS: {
+            struct block_device *mounted_bd = fatfs_fs_driver_get_mounted_bd_from_index(fd->unit);
+            if (mounted_bd == NULL)
+                ret = -ENXIO;
+            else if ((buf == NULL) || (buflen < sizeof(bd_cache_stats_t)))
+                ret = -EINVAL;
+            else
+                ret = (bdm_get_cache_stats(mounted_bd, buf) == 0) ? FR_OK : -ENODEV;
+            break;
+        }
+        case USBMASS_DEVCTL_GET_READAHEAD_STATS: {
+            if ((buf == NULL) || (buflen < sizeof(fs_readahead_stats_t))) {
+                ret = -EINVAL;
+            } else {
+                fs_readahead_get_stats(buf);
+                ret = FR_OK;
+            }
+            break;
+        }
+        case USBMASS_DEVCTL_RESET_READAHEAD_STATS: {
+            fs_readahead_reset_stats();
+            ret = FR_OK;
+            break;
+        }
+        case USBMASS_DEVCTL_RESET_CACHE_STATS: {
+            struct block_device *mounted_bd = fatfs_fs_driver_get_mounted_bd_from_index(fd->unit);
+            if (mounted_bd == NULL)
+                ret = -ENXIO;
+            else
+                ret = (bdm_reset_cache_stats(mounted_bd) == 0) ? FR_OK : -ENODEV;
+            break;
+        }
         default: {
             ret = -ENXIO;
             break;
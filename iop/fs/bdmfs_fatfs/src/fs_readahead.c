@@ -0,0 +1,154 @@
+//---------------------------------------------------------------------------
+// Per-file read-ahead for sequential streaming
+//
+// After FS_READAHEAD_TRIGGER consecutive sequential reads smaller than the
+// read-ahead size, the next reads are served from a prefetch buffer that is
+// refilled with one large f_read. Large reads are passed straight to FatFs.
+// While read-ahead is active, FatFs' file pointer is at the end of the
+// buffer; the application position is tracked in 'pos'.
+//---------------------------------------------------------------------------
+#include <stdio.h>
+#include <sysclib.h>
+
+#include "fs_driver.h"
+#include "fs_readahead.h"
+
+//#define DEBUG  //comment out this line when not debugging
+#include "module_debug.h"
+
+#define FS_READAHEAD_TRIGGER 2
+
+static unsigned int fs_readahead_size;
+static fs_readahead_stats_t fs_readahead_stats;
+
+void fs_readahead_init(unsigned int size)
+{
+    M_DEBUG("%s(%u)\n", __func__, size);
+
+    // Keep the buffer a multiple of the sector size
+    fs_readahead_size = size & ~(FF_MAX_SS - 1);
+    fs_readahead_reset_stats();
+}
+
+void fs_readahead_open(fatfs_fs_driver_readahead *ra, int enable)
+{
+    ra->buffer    = NULL;
+    ra->buf_pos   = 0;
+    ra->buf_len   = 0;
+    ra->pos       = 0;
+    ra->next      = 0;
+    ra->seq_count = 0;
+    ra->enabled   = (enable && (fs_readahead_size != 0)) ? 1 : 0;
+}
+
+void fs_readahead_close(fatfs_fs_driver_readahead *ra)
+{
+    if (ra->buffer != NULL) {
+        free(ra->buffer);
+        ra->buffer = NULL;
+    }
+    ra->buf_len = 0;
+    ra->enabled = 0;
+}
+
+void fs_readahead_invalidate(fatfs_fs_driver_readahead *ra)
+{
+    ra->buf_len = 0;
+}
+
+FRESULT fs_readahead_lseek(FIL *file, fatfs_fs_driver_readahead *ra, FSIZE_t offset)
+{
+    // Read-only file: seeking past the end is clipped, like f_lseek does
+    if (offset > file->obj.objsize)
+        offset = file->obj.objsize;
+
+    // FatFs is repositioned lazily, by the next read outside of the buffer
+    ra->pos = offset;
+    return FR_OK;
+}
+
+FRESULT fs_readahead_read(FIL *file, fatfs_fs_driver_readahead *ra, void *buffer, UINT size, UINT *br)
+{
+    FRESULT res = FR_OK;
+    u8 *dst     = buffer;
+    UINT n;
+
+    *br = 0;
+
+    if (ra->pos == ra->next) {
+        if (ra->seq_count < 255)
+            ra->seq_count++;
+    } else {
+        ra->seq_count = 0;
+    }
+
+    fs_readahead_stats.reads++;
+
+    while (size > 0) {
+        // Serve from the prefetch buffer
+        if ((ra->buf_len != 0) && (ra->pos >= ra->buf_pos) && (ra->pos < ra->buf_pos + ra->buf_len)) {
+            n = (UINT)(ra->buf_pos + ra->buf_len - ra->pos);
+            if (n > size)
+                n = size;
+            memcpy(dst, &ra->buffer[ra->pos - ra->buf_pos], n);
+            fs_readahead_stats.hit_bytes += n;
+            dst += n;
+            ra->pos += n;
+            *br += n;
+            size -= n;
+            continue;
+        }
+
+        if (file->fptr != ra->pos) {
+            res = f_lseek(file, ra->pos);
+            if (res != FR_OK)
+                break;
+        }
+
+        if ((ra->seq_count >= FS_READAHEAD_TRIGGER) && (size < fs_readahead_size)) {
+            if (ra->buffer == NULL) {
+                ra->buffer = malloc(fs_readahead_size);
+                if (ra->buffer == NULL)
+                    M_DEBUG("read-ahead buffer allocation failed\n");
+            }
+
+            if (ra->buffer != NULL) {
+                // Refill the buffer
+                res = f_read(file, ra->buffer, fs_readahead_size, &n);
+                if (res != FR_OK) {
+                    ra->buf_len = 0;
+                    break;
+                }
+                ra->buf_pos = ra->pos;
+                ra->buf_len = n;
+                fs_readahead_stats.fills++;
+                fs_readahead_stats.fill_bytes += n;
+                if (n == 0)
+                    break; // End of file
+                continue;
+            }
+        }
+
+        // Large or random read: read directly into the caller's buffer
+        res = f_read(file, dst, size, &n);
+        fs_readahead_stats.direct_bytes += n;
+        ra->pos += n;
+        *br += n;
+        break;
+    }
+
+    ra->next = ra->pos;
+
+    return res;
+}
+
+void fs_readahead_get_stats(fs_readahead_stats_t *stats)
+{
+    memcpy(stats, &fs_readahead_stats, sizeof(fs_readahead_stats_t));
+    stats->size = fs_readahead_size;
+}
+
+void fs_readahead_reset_stats(void)
+{
+    memset(&fs_readahead_stats, 0, sizeof(fs_readahead_stats_t));
+}
@@ -13,9 +13,14 @@ typedef struct fatfs_fs_driver_mount_info_
 
 extern fatfs_fs_driver_mount_info fs_driver_mount_info[FF_VOLUMES];
 
+// Memory allocation, see main.c
+extern void *malloc(int size);
+extern void free(void *ptr);
+
 extern int InitFS(void);
 extern int connect_bd(struct block_device *bd);
 extern void disconnect_bd(struct block_device *bd);
 extern struct block_device *fatfs_fs_driver_get_mounted_bd_from_index(int mount_info_index);
+extern void fatfs_fs_driver_configure_fastseek(unsigned int min_size, unsigned int mem_budget);
 
 #endif
@@ -0,0 +1,27 @@
+#ifndef FS_READAHEAD_H
+#define FS_READAHEAD_H
+
+#include <usbhdfsd-common.h>
+#include "ff.h"
+
+typedef struct fatfs_fs_driver_readahead_
+{
+    u8 *buffer;       // prefetch buffer, allocated on demand
+    FSIZE_t buf_pos;  // file offset of the buffer contents
+    UINT buf_len;     // valid bytes in the buffer
+    FSIZE_t pos;      // file position seen by the application
+    FSIZE_t next;     // expected offset of the next sequential read
+    u8 enabled;
+    u8 seq_count;     // number of consecutive sequential reads
+} fatfs_fs_driver_readahead;
+
+extern void fs_readahead_init(unsigned int size);
+extern void fs_readahead_open(fatfs_fs_driver_readahead *ra, int enable);
+extern void fs_readahead_close(fatfs_fs_driver_readahead *ra);
+extern void fs_readahead_invalidate(fatfs_fs_driver_readahead *ra);
+extern FRESULT fs_readahead_read(FIL *file, fatfs_fs_driver_readahead *ra, void *buffer, UINT size, UINT *br);
+extern FRESULT fs_readahead_lseek(FIL *file, fatfs_fs_driver_readahead *ra, FSIZE_t offset);
+extern void fs_readahead_get_stats(fs_readahead_stats_t *stats);
+extern void fs_readahead_reset_stats(void);
+
+#endif
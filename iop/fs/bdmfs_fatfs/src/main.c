@@ -3,17 +3,19 @@
 #include <irx.h>
 #include <loadcore.h>
 #include <stdio.h>
+#include <sysclib.h>
 #include <sysmem.h>
 #include <cdvdman.h>
 
 #include "ff.h"
 #include "fs_driver.h"
+#include "fs_readahead.h"
 
 //#define DEBUG  //comment out this line when not debugging
 #include "module_debug.h"
 
 #define MAJOR_VER 1
-#define MINOR_VER 4
+#define MINOR_VER 5
 
 IRX_ID("bdmff", MAJOR_VER, MINOR_VER);
 
@@ -24,13 +26,37 @@ static struct file_system g_fs = {
     .disconnect_bd = disconnect_bd,
 };
 
+// Default read-ahead buffer size per sequentially read file, in KiB
+#define DEFAULT_READAHEAD_KB 32
+// Default minimum file size for fast seek, in KiB
+#define DEFAULT_FASTSEEK_MIN_KB 1024
+// Default memory budget for all fast seek tables, in KiB
+#define DEFAULT_FASTSEEK_MEM_KB 32
+
 int _start(int argc, char *argv[])
 {
-    (void)argc;
-    (void)argv;
+    unsigned int readahead_kb    = DEFAULT_READAHEAD_KB;
+    unsigned int fastseek_min_kb = DEFAULT_FASTSEEK_MIN_KB;
+    unsigned int fastseek_mem_kb = DEFAULT_FASTSEEK_MEM_KB;
+    int i;
 
     printf("BDM FatFs driver (FAT/exFAT) v%d.%d\n", MAJOR_VER, MINOR_VER);
 
+    // Parse arguments:
+    //  - readahead=<KiB>    : read-ahead buffer size, 0 to disable
+    //  - fastseek_min=<KiB> : minimum size of read-only files that use fast seek, 0 to disable
+    //  - fastseek_mem=<KiB> : memory budget for the fast seek tables of all open files
+    for (i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "readahead=", 10) == 0)
+            readahead_kb = strtol(&argv[i][10], NULL, 10);
+        else if (strncmp(argv[i], "fastseek_min=", 13) == 0)
+            fastseek_min_kb = strtol(&argv[i][13], NULL, 10);
+        else if (strncmp(argv[i], "fastseek_mem=", 13) == 0)
+            fastseek_mem_kb = strtol(&argv[i][13], NULL, 10);
+    }
+    fs_readahead_init(readahead_kb * 1024);
+    fatfs_fs_driver_configure_fastseek(fastseek_min_kb * 1024, fastseek_mem_kb * 1024);
+
     // initialize the file system driver
     if (InitFS() != 0) {
         M_DEBUG("Error initializing FatFs driver!\n");
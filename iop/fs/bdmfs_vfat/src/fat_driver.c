@@ -1101,6 +1101,28 @@ int fat_stopUnit(int device)
     return (fatd != NULL) ? fatd->bd->stop(fatd->bd) : -ENODEV;
 }
 
+int fat_getCacheStats(int device, bd_cache_stats_t *stats)
+{
+    fat_driver *fatd;
+
+    fatd = fat_getData(device);
+    if (fatd == NULL)
+        return -ENODEV;
+
+    return (bdm_get_cache_stats(fatd->bd, stats) == 0) ? 0 : -ENODEV;
+}
+
+int fat_resetCacheStats(int device)
+{
+    fat_driver *fatd;
+
+    fatd = fat_getData(device);
+    if (fatd == NULL)
+        return -ENODEV;
+
+    return (bdm_reset_cache_stats(fatd->bd) == 0) ? 0 : -ENODEV;
+}
+
 void fat_stopAll(void)
 {
     int i;
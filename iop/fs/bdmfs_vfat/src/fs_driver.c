@@ -858,8 +858,6 @@ static int fs_devctl(iop_file_t *fd, const char *name, int cmd, void *arg, unsig
     (void)name;
     (void)arg;
     (void)arglen;
-    (void)buf;
-    (void)buflen;
 
     _fs_lock();
 
@@ -871,6 +869,15 @@ static int fs_devctl(iop_file_t *fd, const char *name, int cmd, void *arg, unsig
             fat_stopAll();
             ret = 0;
             break;
+        case USBMASS_DEVCTL_GET_CACHE_STATS:
+            if ((buf == NULL) || (buflen < sizeof(bd_cache_stats_t)))
+                ret = -EINVAL;
+            else
+                ret = fat_getCacheStats(fd->unit, buf);
+            break;
+        case USBMASS_DEVCTL_RESET_CACHE_STATS:
+            ret = fat_resetCacheStats(fd->unit);
+            break;
         default:
             ret = -ENXIO;
     }
@@ -3,6 +3,7 @@
 
 #include "scache.h"
 #include <bdm.h>
+#include <usbhdfsd-common.h>
 
 #define DIR_CHAIN_SIZE 32
 
@@ -112,5 +113,7 @@ int fat_CheckChain(fat_driver *fatd, unsigned int cluster);
 
 int fat_stopUnit(int device);
 void fat_stopAll(void);
+int fat_getCacheStats(int device, bd_cache_stats_t *stats);
+int fat_resetCacheStats(int device);
 
 #endif
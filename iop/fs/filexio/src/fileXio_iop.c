@@ -48,9 +48,35 @@ IRX_ID(MODNAME, 1, 2);
 #define MIN(a, b)	(((a)<(b))?(a):(b))
 #define RDOWN_64(a)	((unsigned int)(a)&~0x3F)
 
+// Total size of the RW buffers, shared between them
 #define DEFAULT_RWSIZE	16384
-static void *rwbuf = NULL;
-static unsigned int RWBufferSize=DEFAULT_RWSIZE;
+#define DEFAULT_RWCOUNT	2
+#define MAX_RWCOUNT	8
+
+// A ring of count buffers of size bytes, allocated as one block.
+struct rw_buffers {
+	void *buf;
+	unsigned int size;
+	unsigned int count;
+	// Last SIF DMA from each buffer, also across calls
+	int dma[MAX_RWCOUNT];
+	// Unaligned data at the ends of reads, sent to the EE
+	rests_pkt rests;
+};
+// The buffers of the main server
+static struct rw_buffers rwbuffers = { NULL, DEFAULT_RWSIZE / DEFAULT_RWCOUNT, DEFAULT_RWCOUNT };
+// Total size set by the EE, kept when the count changes
+static unsigned int RWBufferTotal = DEFAULT_RWSIZE;
+
+// Times are in system clock ticks.
+// The main server and the workers all update them, with interrupts disabled.
+struct rw_counters {
+	u32 reads, writes;
+	u32 read_bytes, write_bytes;
+	u64 read_device, read_sif, read_total;
+	u64 write_device, write_sif, write_total;
+};
+static struct rw_counters rwcounters;
 
 // 0x4800 bytes for DirEntry structures
 // 0x400 bytes for the filename string
@@ -58,13 +84,49 @@ static unsigned char fileXio_rpc_buffer[0x4C00]; // RPC send/receive buffer
 struct t_SifRpcDataQueue qd;
 struct t_SifRpcServerData sd0;
 
-static rests_pkt rests;
+// Worker servers, for reads and writes queued by the EE
+struct fxio_worker {
+	// Receive buffer, first so the server function can find its worker
+	unsigned int rpc_buffer[sizeof(struct fxio_write_packet)/4];
+	struct t_SifRpcDataQueue qd;
+	struct t_SifRpcServerData sd;
+	struct rw_buffers rw;
+};
+static struct fxio_worker workers[FILEXIO_MAX_WORKERS];
+static int WorkerCount;
+
+static u32 GetTicks(void)
+{
+	iop_sys_clock_t clock;
+
+	GetSystemTime(&clock);
+	return clock.lo;
+}
+
+// Adds to a counter without another thread seeing it half updated
+static void AddRWTicks(u64 *counter, u32 ticks)
+{
+	int OldState;
+
+	CpuSuspendIntr(&OldState);
+	*counter += ticks;
+	CpuResumeIntr(OldState);
+}
+
+// Waits for the DMAs from the RW buffers to the EE to complete
+static void WaitRWBuffersIdle(struct rw_buffers *rw)
+{
+	unsigned int i;
+
+	for (i = 0; i < MAX_RWCOUNT; i++)
+		while(SifDmaStat(rw->dma[i])>=0);
+}
 
 /* RPC exported functions */
 static int fileXio_GetDeviceList_RPC(struct fileXioDevice* ee_devices, int eecount);
 static int fileXio_CopyFile_RPC(const char *src, const char *dest, int mode);
-static int fileXio_Read_RPC(int infd, char *read_buf, int read_size, void *intr_data);
-static int fileXio_Write_RPC(int outfd, const char *write_buf, int write_size, int mis,u8 *misbuf);
+static int fileXio_Read_RPC(struct rw_buffers *rw, int infd, char *read_buf, int read_size, void *intr_data);
+static int fileXio_Write_RPC(struct rw_buffers *rw, int outfd, const char *write_buf, int write_size, int mis,u8 *misbuf);
 static int fileXio_GetDir_RPC(const char* pathname, struct fileXioDirEntry dirEntry[], unsigned int req_entries);
 static int fileXio_Mount_RPC(const char* mountstring, const char* mountpoint, int flag);
 static int fileXio_chstat_RPC(char *filename, void* eeptr, int mask);
@@ -87,8 +149,8 @@ static void* fileXioRpc_ReadLink(unsigned int* sbuff);
 static void* fileXioRpc_ChDir(unsigned int* sbuff);
 static void* fileXioRpc_Open(unsigned int* sbuff);
 static void* fileXioRpc_Close(unsigned int* sbuff);
-static void* fileXioRpc_Read(unsigned int* sbuff);
-static void* fileXioRpc_Write(unsigned int* sbuff);
+static void* fileXioRpc_Read(struct rw_buffers *rw, unsigned int* sbuff);
+static void* fileXioRpc_Write(struct rw_buffers *rw, unsigned int* sbuff);
 static void* fileXioRpc_Lseek(unsigned int* sbuff);
 static void* fileXioRpc_Lseek64(unsigned int* sbuff);
 static void* fileXioRpc_ChStat(unsigned int* sbuff);
@@ -104,6 +166,9 @@ static void* fileXioRpc_Dopen(unsigned int* sbuff);
 static void* fileXioRpc_Dread(unsigned int* sbuff);
 static void* fileXioRpc_Dclose(unsigned int* sbuff);
 static void* filexioRpc_SetRWBufferSize(void *sbuff);
+static void* filexioRpc_SetRWBufferCount(void *sbuff);
+static void* fileXioRpc_GetRWStats(void *sbuff);
+static void* fileXioRpc_StartWorkers(void *sbuff);
 static void* fileXioRpc_Getdir(unsigned int* sbuff);
 static void DirEntryCopy(struct fileXioDirEntry* dirEntry, iox_dirent_t* internalDirEntry);
 
@@ -188,13 +253,14 @@ static int fileXio_CopyFile_RPC(const char *src, const char *dest, int mode)
   if (!size)
     return 0;
 
-  remain = size % RWBufferSize;
-  for (i = 0; (unsigned int)i < (size / RWBufferSize); i++) {
-    read(infd, rwbuf, RWBufferSize);
-    write(outfd, rwbuf, RWBufferSize);
+  WaitRWBuffersIdle(&rwbuffers);
+  remain = size % rwbuffers.size;
+  for (i = 0; (unsigned int)i < (size / rwbuffers.size); i++) {
+    read(infd, rwbuffers.buf, rwbuffers.size);
+    write(outfd, rwbuffers.buf, rwbuffers.size);
   }
-  read(infd, rwbuf, remain);
-  write(outfd, rwbuf, remain);
+  read(infd, rwbuffers.buf, remain);
+  write(outfd, rwbuffers.buf, remain);
   close(infd);
   close(outfd);
 
@@ -204,7 +270,7 @@ static int fileXio_CopyFile_RPC(const char *src, const char *dest, int mode)
   return size;
 }
 
-static int fileXio_Read_RPC(int infd, char *read_buf, int read_size, void *intr_data)
+static int fileXio_Read_RPC(struct rw_buffers *rw, int infd, char *read_buf, int read_size, void *intr_data)
 {
      int srest;
      int erest;
@@ -213,13 +279,15 @@ static int fileXio_Read_RPC(int infd, char *read_buf, int read_size, void *intr_
      int rlen;
      int total;
      int readlen;
-     int status;
      struct t_SifDmaTransfer dmaStruct;
      void *buffer;
      void *aebuffer;
      int intStatus;	// interrupt status - for dis/en-abling interrupts
      int read_buf2 = (int)read_buf;
+     unsigned int slot;
+     u32 start, now, begin;
 
+	begin = GetTicks();
 	total = 0;
 
 	if(read_size < 64)
@@ -241,7 +309,7 @@ static int fileXio_Read_RPC(int infd, char *read_buf, int read_size, void *intr_
 	}
 	if (srest>0)
 	{
-		if (srest!=(rlen=read(infd, rests.sbuffer, srest)))
+		if (srest!=(rlen=read(infd, rw->rests.sbuffer, srest)))
 		{
 			total += srest = (rlen>0 ? rlen:0);
 			goto EXIT;
@@ -250,22 +318,29 @@ static int fileXio_Read_RPC(int infd, char *read_buf, int read_size, void *intr_
 			total += srest;
 	}
 
-	status=0;
+	// The buffers are used in turn: the device reads into one while the previous ones are DMA'd to the EE.
+	slot=0;
 	while (asize>0)
 	{
-		readlen=MIN(RWBufferSize, (unsigned int)asize);
+		void *rbuf = (u8*)rw->buf + slot * rw->size;
 
-		while(SifDmaStat(status)>=0);
+		readlen=MIN(rw->size, (unsigned int)asize);
 
-		rlen=read(infd, rwbuf, readlen);
+		start = GetTicks();
+		while(SifDmaStat(rw->dma[slot])>=0);
+		now = GetTicks();
+		AddRWTicks(&rwcounters.read_sif, now - start);
+
+		rlen=read(infd, rbuf, readlen);
+		AddRWTicks(&rwcounters.read_device, GetTicks() - now);
 		if (readlen!=rlen){
 			if (rlen<=0)goto EXIT;
 			dmaStruct.dest=(void *)abuffer;
 			dmaStruct.size=rlen;
 			dmaStruct.attr=0;
-			dmaStruct.src =rwbuf;
+			dmaStruct.src =rbuf;
 			CpuSuspendIntr(&intStatus);
-			SifSetDma(&dmaStruct, 1);
+			rw->dma[slot]=SifSetDma(&dmaStruct, 1);
 			CpuResumeIntr(intStatus);
 			total	+=rlen;
 			goto EXIT;
@@ -276,70 +351,136 @@ static int fileXio_Read_RPC(int infd, char *read_buf, int read_size, void *intr_
 			abuffer +=rlen;
 			dmaStruct.size=rlen;
 			dmaStruct.attr=0;
-			dmaStruct.src =rwbuf;
+			dmaStruct.src =rbuf;
 			CpuSuspendIntr(&intStatus);
-			status=SifSetDma(&dmaStruct, 1);
+			rw->dma[slot]=SifSetDma(&dmaStruct, 1);
 			CpuResumeIntr(intStatus);
 		}
+
+		if (++slot == rw->count)
+			slot = 0;
 	}
 	if (erest>0)
 	{
-		rlen = read(infd, rests.ebuffer, erest);
+		rlen = read(infd, rw->rests.ebuffer, erest);
 		total += (rlen>0 ? rlen : 0);
 	}
 EXIT:
-	rests.ssize=srest;
-	rests.esize=erest;
-	rests.sbuf =buffer;
-	rests.ebuf =aebuffer;
-      dmaStruct.src =&rests;
+	rw->rests.ssize=srest;
+	rw->rests.esize=erest;
+	rw->rests.sbuf =buffer;
+	rw->rests.ebuf =aebuffer;
+      dmaStruct.src =&rw->rests;
 	dmaStruct.size=sizeof(rests_pkt);
 	dmaStruct.attr=0;
 	dmaStruct.dest=intr_data;
 	CpuSuspendIntr(&intStatus);
 	SifSetDma(&dmaStruct, 1);
 	CpuResumeIntr(intStatus);
+
+	now = GetTicks();
+	CpuSuspendIntr(&intStatus);
+	rwcounters.reads++;
+	rwcounters.read_bytes += total;
+	rwcounters.read_total += now - begin;
+	CpuResumeIntr(intStatus);
+
 	return (total);
 }
 
-static int fileXio_Write_RPC(int outfd, const char *write_buf, int write_size, int mis,u8 *misbuf)
+// Waits for the data of a buffer to arrive from the EE
+static void WaitRWBuffer(SifRpcReceiveData_t *rdata)
 {
-     SifRpcReceiveData_t rdata;
+	u32 start = GetTicks();
+
+	while(SifCheckStatRpc((SifRpcClientData_t *)rdata));
+
+	AddRWTicks(&rwcounters.write_sif, GetTicks() - start);
+}
+
+static int fileXio_Write_RPC(struct rw_buffers *rw, int outfd, const char *write_buf, int write_size, int mis,u8 *misbuf)
+{
+     SifRpcReceiveData_t rdata[MAX_RWCOUNT];
+     unsigned int chunklen[MAX_RWCOUNT];
+     unsigned int slot, fetch, pending;
      int left;
      int wlen;
      int pos;
      int total;
+     u32 begin, start;
+     int OldState;
+
+	begin = GetTicks();
 
 	left  = write_size;
 	total = 0;
 	if (mis > 0)
       {
+		start = GetTicks();
 		wlen=write(outfd, misbuf, mis);
+		AddRWTicks(&rwcounters.write_device, GetTicks() - start);
 		if (wlen != mis)
             {
 			if (wlen > 0)
 				total += wlen;
-			return (total);
+			goto EXIT;
 		}
 		total += wlen;
 	}
 
 	left-=mis;
 	pos=(int)write_buf+mis;
-	while(left){
+
+	// The data of the next buffers is fetched from the EE while the device writes the current one.
+	slot = fetch = pending = 0;
+	while(left || pending){
 		int writelen;
-		writelen = MIN(RWBufferSize, (unsigned int)left);
-		SifRpcGetOtherData(&rdata, (void *)pos, rwbuf, writelen, 0);
-		wlen=write(outfd, rwbuf, writelen);
+
+		while(left && pending < rw->count){
+			while(SifDmaStat(rw->dma[fetch])>=0);
+			chunklen[fetch] = MIN(rw->size, (unsigned int)left);
+			SifRpcGetOtherData(&rdata[fetch], (void *)pos, (u8*)rw->buf + fetch * rw->size, chunklen[fetch], SIF_RPC_M_NOWAIT);
+			left -= chunklen[fetch];
+			pos  += chunklen[fetch];
+			pending++;
+			if (++fetch == rw->count)
+				fetch = 0;
+		}
+
+		WaitRWBuffer(&rdata[slot]);
+
+		writelen = chunklen[slot];
+		start = GetTicks();
+		wlen=write(outfd, (u8*)rw->buf + slot * rw->size, writelen);
+		AddRWTicks(&rwcounters.write_device, GetTicks() - start);
+		pending--;
+
 		if (wlen != writelen){
 			if (wlen>0)
 				total+=wlen;
-			return (total);
+
+			// Don't leave transfers into the buffers behind
+			while(pending){
+				if (++slot == rw->count)
+					slot = 0;
+				WaitRWBuffer(&rdata[slot]);
+				pending--;
+			}
+			goto EXIT;
 		}
-		left -=writelen;
-		pos  +=writelen;
 		total+=writelen;
+
+		if (++slot == rw->count)
+			slot = 0;
 	}
+EXIT:
+	start = GetTicks();
+	CpuSuspendIntr(&OldState);
+	rwcounters.writes++;
+	rwcounters.write_bytes += total;
+	rwcounters.write_total += start - begin;
+	CpuResumeIntr(OldState);
+
 	return (total);
 }
 
@@ -700,13 +841,13 @@ static void* fileXioRpc_Close(unsigned int* sbuff)
 // Send:   Offset 4 = pointer to buffer in EE mem
 // Send:   Offset 8 = buffer size (int)
 // Send:   Offset 12 = pointer to intr_data in EE mem
-static void* fileXioRpc_Read(unsigned int* sbuff)
+static void* fileXioRpc_Read(struct rw_buffers *rw, unsigned int* sbuff)
 {
 	int ret;
 	struct fxio_read_packet *packet=(struct fxio_read_packet*)sbuff;
 
 	M_DEBUG("Read Request\n");
-	ret=fileXio_Read_RPC(packet->fd, packet->buffer, packet->size, packet->intrData);
+	ret=fileXio_Read_RPC(rw, packet->fd, packet->buffer, packet->size, packet->intrData);
 	sbuff[0] = ret;
 	return sbuff;
 }
@@ -716,13 +857,13 @@ static void* fileXioRpc_Read(unsigned int* sbuff)
 // Send:   Offset 8 = buffer size (int)
 // Send:   Offset 12 = misaligned buffer size (int)
 // Send:   Offset 16 = misaligned buffer (16)
-static void* fileXioRpc_Write(unsigned int* sbuff)
+static void* fileXioRpc_Write(struct rw_buffers *rw, unsigned int* sbuff)
 {
 	int ret;
 	struct fxio_write_packet *packet=(struct fxio_write_packet*)sbuff;
 
 	M_DEBUG("Write Request\n");
-	ret=fileXio_Write_RPC(packet->fd, packet->buffer, packet->size,
+	ret=fileXio_Write_RPC(rw, packet->fd, packet->buffer, packet->size,
                             packet->unalignedDataLen, packet->unalignedData);
 	sbuff[0] = ret;
 	return sbuff;
@@ -851,13 +992,15 @@ static void* fileXioRpc_Sync(unsigned int* sbuff)
 static void* fileXioRpc_Devctl(unsigned int* sbuff)
 {
 	struct fxio_devctl_packet *packet = (struct fxio_devctl_packet *)sbuff;
-	struct fxio_ctl_return_pkt *ret_buf = (struct fxio_ctl_return_pkt *)rwbuf;
+	struct fxio_ctl_return_pkt *ret_buf = (struct fxio_ctl_return_pkt *)rwbuffers.buf;
 	SifDmaTransfer_t dmatrans;
 	int intStatus;
 	int ret;
 
 	M_DEBUG("Devctl Request\n");
 
+	WaitRWBuffersIdle(&rwbuffers);
+
 	ret = devctl(packet->name, packet->cmd, packet->arg, packet->arglen, ret_buf->buf, packet->buflen);
 
 	// Transfer buffer back to EE
@@ -903,13 +1046,15 @@ static void* fileXioRpc_Ioctl(unsigned int* sbuff)
 static void* fileXioRpc_Ioctl2(unsigned int* sbuff)
 {
 	struct fxio_ioctl2_packet *packet = (struct fxio_ioctl2_packet *)sbuff;
-	struct fxio_ctl_return_pkt *ret_buf = (struct fxio_ctl_return_pkt *)rwbuf;
+	struct fxio_ctl_return_pkt *ret_buf = (struct fxio_ctl_return_pkt *)rwbuffers.buf;
 	SifDmaTransfer_t dmatrans;
 	int intStatus;
 	int ret;
 
 	M_DEBUG("ioctl2 Request\n");
 
+	WaitRWBuffersIdle(&rwbuffers);
+
 	ret = ioctl2(packet->fd, packet->cmd, packet->arg, packet->arglen, ret_buf->buf, packet->buflen);
 
 	// Transfer buffer back to EE
@@ -975,10 +1120,66 @@ static void* fileXioRpc_Dclose(unsigned int* sbuff)
 * and are not to be exported                     *
 *************************************************/
 
-static void fileXio_Thread(void* param)
+static int AllocRWBuffers(struct rw_buffers *rw)
+{
+	unsigned int size, i;
+	int OldState;
+
+	// devctl and ioctl2 return their data through the buffers
+	size = rw->size * rw->count;
+	if (size < sizeof(struct fxio_ctl_return_pkt))
+		size = sizeof(struct fxio_ctl_return_pkt);
+
+	CpuSuspendIntr(&OldState);
+	rw->buf = AllocSysMemory(ALLOC_FIRST, size, NULL);
+	CpuResumeIntr(OldState);
+
+	for (i = 0; i < MAX_RWCOUNT; i++)
+		rw->dma[i] = 0;
+
+	return rw->buf != NULL ? 0 : -ENOMEM;
+}
+
+static int SetRWBuffers(unsigned int total, unsigned int count)
 {
+	unsigned int size, OldSize, OldCount;
 	int OldState;
 
+	if (count == 0 || count > MAX_RWCOUNT)
+		return -EINVAL;
+
+	// The buffers are DMA'd from and to
+	size = (total / count) & ~0x3F;
+	if (size == 0)
+		return -EINVAL;
+
+	if(rwbuffers.buf!=NULL){
+		WaitRWBuffersIdle(&rwbuffers);
+
+		CpuSuspendIntr(&OldState);
+		FreeSysMemory(rwbuffers.buf);
+		CpuResumeIntr(OldState);
+	}
+
+	OldSize = rwbuffers.size;
+	OldCount = rwbuffers.count;
+	rwbuffers.size = size;
+	rwbuffers.count = count;
+
+	if (AllocRWBuffers(&rwbuffers) < 0)
+	{
+		rwbuffers.size = OldSize;
+		rwbuffers.count = OldCount;
+		AllocRWBuffers(&rwbuffers);
+		return -ENOMEM;
+	}
+
+	RWBufferTotal = total;
+	return 0;
+}
+
+static void fileXio_Thread(void* param)
+{
 	(void)param;
 
 	M_PRINTF("fileXio: fileXio RPC Server v1.00\nCopyright (c) 2003 adresd\n");
@@ -986,11 +1187,9 @@ static void fileXio_Thread(void* param)
 
 	SifInitRpc(0);
 
-	RWBufferSize=DEFAULT_RWSIZE;
-	CpuSuspendIntr(&OldState);
-	rwbuf = AllocSysMemory(ALLOC_FIRST, RWBufferSize, NULL);
-	CpuResumeIntr(OldState);
-	if (rwbuf == NULL)
+	rwbuffers.size=DEFAULT_RWSIZE / DEFAULT_RWCOUNT;
+	rwbuffers.count=DEFAULT_RWCOUNT;
+	if (AllocRWBuffers(&rwbuffers) < 0)
 	{
 		M_DEBUG("Failed to allocate memory for RW buffer!\n");
 
@@ -1004,20 +1203,127 @@ static void fileXio_Thread(void* param)
 
 static void* filexioRpc_SetRWBufferSize(void *sbuff)
 {
-	int OldState;
+	int size = ((struct fxio_rwbuff*)sbuff)->size;
 
-	if(rwbuf!=NULL){
-		CpuSuspendIntr(&OldState);
-		FreeSysMemory(rwbuf);
-		CpuResumeIntr(OldState);
-	}
+	((int*)sbuff)[0] = SetRWBuffers(size > 0 ? (unsigned int)size : 0, rwbuffers.count);
+	return sbuff;
+}
 
-	RWBufferSize=((struct fxio_rwbuff*)sbuff)->size;
+static void* filexioRpc_SetRWBufferCount(void *sbuff)
+{
+	int count = ((struct fxio_rwbuff*)sbuff)->size;
+
+	((int*)sbuff)[0] = SetRWBuffers(RWBufferTotal, count > 0 ? (unsigned int)count : 0);
+	return sbuff;
+}
+
+static void ClockToUSec(u64 ticks, u32 *usec)
+{
+	iop_sys_clock_t clock;
+	u32 sec;
+
+	clock.hi = (u32)(ticks >> 32);
+	clock.lo = (u32)ticks;
+	SysClock2USec(&clock, &sec, usec);
+	*usec += sec * 1000000;
+}
+
+static void* fileXioRpc_GetRWStats(void *sbuff)
+{
+	struct fileXioRWStats *stats = (struct fileXioRWStats *)sbuff;
+	int reset = ((int*)sbuff)[0];
+	struct rw_counters counters;
+	int OldState;
+
+	// Take the counters in one go, while no worker can update them
 	CpuSuspendIntr(&OldState);
-	rwbuf=AllocSysMemory(ALLOC_FIRST, RWBufferSize, NULL);
+	counters = rwcounters;
+	if (reset)
+		memset(&rwcounters, 0, sizeof(rwcounters));
 	CpuResumeIntr(OldState);
 
-	((int*)sbuff)[0] = rwbuf!=NULL?0:-ENOMEM;
+	stats->reads = counters.reads;
+	stats->writes = counters.writes;
+	stats->read_bytes = counters.read_bytes;
+	stats->write_bytes = counters.write_bytes;
+	ClockToUSec(counters.read_device, &stats->read_device_usec);
+	ClockToUSec(counters.read_sif, &stats->read_sif_usec);
+	ClockToUSec(counters.read_total, &stats->read_usec);
+	ClockToUSec(counters.write_device, &stats->write_device_usec);
+	ClockToUSec(counters.write_sif, &stats->write_sif_usec);
+	ClockToUSec(counters.write_total, &stats->write_usec);
+	stats->buffer_size = rwbuffers.size;
+	stats->buffer_count = rwbuffers.count;
+
+	return sbuff;
+}
+
+static void* fileXio_worker_server(int fno, void *data, int size)
+{
+	struct fxio_worker *worker = (struct fxio_worker *)data;
+
+	(void)size;
+
+	switch(fno) {
+		case FILEXIO_READ:
+		case FILEXIO_WRITE:
+			// The buffers are allocated on the first transfer, as the main server's are set up then
+			if (worker->rw.buf == NULL)
+			{
+				worker->rw.size = rwbuffers.size;
+				worker->rw.count = rwbuffers.count;
+				if (AllocRWBuffers(&worker->rw) < 0)
+				{
+					((int*)data)[0] = -ENOMEM;
+					return data;
+				}
+			}
+
+			if (fno == FILEXIO_READ)
+				return fileXioRpc_Read(&worker->rw, (unsigned*)data);
+			return fileXioRpc_Write(&worker->rw, (unsigned*)data);
+		case FILEXIO_LSEEK:
+			return fileXioRpc_Lseek((unsigned*)data);
+	}
+	return NULL;
+}
+
+static void fileXio_Worker(void* param)
+{
+	struct fxio_worker *worker = (struct fxio_worker *)param;
+
+	SifSetRpcQueue(&worker->qd, GetThreadId());
+	SifRegisterRpc(&worker->sd, FILEXIO_WORKER_IRX + (worker - workers), &fileXio_worker_server, worker->rpc_buffer, NULL, NULL, &worker->qd);
+	SifRpcLoop(&worker->qd);
+}
+
+// Send:   Offset 0 = number of workers (int)
+// Return: Offset 0 = number of workers running, or error (int)
+static void* fileXioRpc_StartWorkers(void *sbuff)
+{
+	struct _iop_thread param;
+	int count = ((int*)sbuff)[0];
+	int th;
+
+	if (count > FILEXIO_MAX_WORKERS)
+		count = FILEXIO_MAX_WORKERS;
+
+	param.attr         = TH_C;
+	param.thread       = (void*)fileXio_Worker;
+	param.priority 	  = 40;
+	param.stacksize    = 0x8000;
+	param.option      = 0;
+
+	while (WorkerCount < count)
+	{
+		if ((th = CreateThread(&param)) < 0)
+			break;
+
+		StartThread(th, &workers[WorkerCount]);
+		WorkerCount++;
+	}
+
+	((int*)sbuff)[0] = WorkerCount > 0 ? WorkerCount : -ENOMEM;
 	return sbuff;
 }
 
@@ -1057,9 +1363,9 @@ static void* fileXio_rpc_server(int fno, void *data, int size)
 		case FILEXIO_CLOSE:
 			return fileXioRpc_Close((unsigned*)data);
 		case FILEXIO_READ:
-			return fileXioRpc_Read((unsigned*)data);
+			return fileXioRpc_Read(&rwbuffers, (unsigned*)data);
 		case FILEXIO_WRITE:
-			return fileXioRpc_Write((unsigned*)data);
+			return fileXioRpc_Write(&rwbuffers, (unsigned*)data);
 		case FILEXIO_LSEEK:
 			return fileXioRpc_Lseek((unsigned*)data);
 		case FILEXIO_IOCTL:
@@ -1090,6 +1396,12 @@ static void* fileXio_rpc_server(int fno, void *data, int size)
 			return fileXioRpc_GetDeviceList((unsigned*)data);
 		case FILEXIO_SETRWBUFFSIZE:
 			return filexioRpc_SetRWBufferSize(data);
+		case FILEXIO_SETRWBUFFCOUNT:
+			return filexioRpc_SetRWBufferCount(data);
+		case FILEXIO_GETRWSTATS:
+			return fileXioRpc_GetRWStats(data);
+		case FILEXIO_STARTWORKERS:
+			return fileXioRpc_StartWorkers(data);
 	}
 	return NULL;
 }
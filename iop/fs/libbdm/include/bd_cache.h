@@ -18,13 +18,21 @@
 
 #include <tamtypes.h>
 #include <bdm.h>
+#include <usbhdfsd-common.h>
 
 
+/* Set the geometry used by caches created from now on */
+void bd_cache_configure(unsigned int block_count, unsigned int sectors_per_block);
+
 /* Create a new cached block device */
 struct block_device *bd_cache_create(struct block_device *bd);
 
 /* Destroy a cached block device */
 void bd_cache_destroy(struct block_device *cbd);
 
+/* Get/reset the hit/miss/eviction counters of a cached block device */
+void bd_cache_get_stats(struct block_device *cbd, bd_cache_stats_t *stats);
+void bd_cache_reset_stats(struct block_device *cbd);
+
 
 #endif
@@ -1,137 +1,542 @@
 #include <bd_cache.h>
+#include <intrman.h>
 #include <string.h>
 #include <sysmem.h>
+#include <thsemap.h>
 
 //#define DEBUG  //comment out this line when not debugging
 #include "module_debug.h"
 
-#define SECTORS_PER_BLOCK     8 //  8 * 512b =   4KiB
-#define BLOCK_COUNT          32 // 32 * 4KiB = 128KiB
-#define BLOCK_WEIGHT_FACTOR 256 // Fixed point math (24.8)
+/*
+ * 2Q block cache
+ *
+ * Blocks are aligned to 'sectors_per_block' and looked up through a hash
+ * table. New blocks enter the small FIFO queue 'A1in'. When they fall out of
+ * A1in only their tag is remembered in the ghost queue 'A1out'. A block that
+ * is requested again while its tag is still in A1out has proven to be
+ * re-used (FAT tables, directories) and is promoted to the LRU queue 'Am'.
+ * Streaming reads therefore only ever churn A1in, and never push the
+ * frequently used metadata out of Am.
+ */
+
+#define BD_CACHE_DEFAULT_SECTORS_PER_BLOCK  8 //  8 * 512b =   4KiB
+#define BD_CACHE_DEFAULT_BLOCK_COUNT       32 // 32 * 4KiB = 128KiB
+#define BD_CACHE_MAX_BLOCK_COUNT         1024
+
+#define ENTRY_NONE (-1)
+
+// Asynchronous writes that can be in flight at once, more are done synchronously
+#define BD_CACHE_MAX_WRITES 8
+
+enum bd_cache_queue {
+    Q_FREE = 0,
+    Q_A1IN,
+    Q_AM,
+    Q_A1OUT,
+    Q_COUNT
+};
+
+struct bd_cache_entry
+{
+    u32 block;  // block number (sector / sectors_per_block)
+    s16 hnext;  // next entry in hash chain
+    s16 prev;   // previous entry in queue
+    s16 next;   // next entry in queue
+    s16 slot;   // data slot, ENTRY_NONE for ghost/free entries
+    u8 queue;
+};
+
+struct bd_cache_list
+{
+    s16 head; // most recently inserted
+    s16 tail; // least recently inserted
+    u16 count;
+};
+
+struct bd_cache;
+
+/*
+ * Asynchronous write in flight. Until it completes, the blocks it covers
+ * are read around the cache, so that the old data is not cached again.
+ */
+struct bd_cache_write
+{
+    struct bd_request req; // request passed to the device
+    struct bd_request *parent; // request of the submitter
+    struct bd_cache *c;
+    u32 sector;
+    u32 count;
+    volatile int busy;
+};
 
 struct bd_cache
 {
     struct block_device *bd;
-    int weight[BLOCK_COUNT];
-    u32 sector[BLOCK_COUNT];
-    u8 cache[BLOCK_COUNT][SECTORS_PER_BLOCK*512];
-#ifdef DEBUG
-    u32 sectors_read;
-    u32 sectors_cache;
-    u32 sectors_dev;
-#endif
+
+    unsigned int sectors_per_block;
+    unsigned int block_count; // number of data slots
+    unsigned int entry_count; // data slots + ghost tags
+    unsigned int a1in_max;
+    unsigned int a1out_max;
+    unsigned int hash_mask;
+    unsigned int block_size;
+
+    struct bd_cache_entry *entry;
+    s16 *hash;
+    s16 *free_slot;
+    unsigned int free_slot_count;
+    struct bd_cache_list list[Q_COUNT];
+    u8 *data;
+
+    struct block_device_ext ext;
+    struct bd_cache_write write[BD_CACHE_MAX_WRITES];
+    volatile int writes_pending;
+    // Signalled by the last write to complete, once bd_cache_destroy() waits for it
+    int drain_sema;
+    volatile int draining;
+    bd_cache_stats_t stats;
 };
 
-/* cache overlaps with requested area ? */
-static int _overlaps(u32 csector, u32 sector, u16 count)
+static unsigned int g_block_count       = BD_CACHE_DEFAULT_BLOCK_COUNT;
+static unsigned int g_sectors_per_block = BD_CACHE_DEFAULT_SECTORS_PER_BLOCK;
+
+void bd_cache_configure(unsigned int block_count, unsigned int sectors_per_block)
 {
-    if ((sector < (csector + SECTORS_PER_BLOCK)) && ((sector + count) > csector))
-        return 1;
+    M_DEBUG("%s(%u, %u)\n", __FUNCTION__, block_count, sectors_per_block);
+
+    if (block_count < 4)
+        block_count = 4;
+    if (block_count > BD_CACHE_MAX_BLOCK_COUNT)
+        block_count = BD_CACHE_MAX_BLOCK_COUNT;
+    if (sectors_per_block < 1)
+        sectors_per_block = 1;
+    if (sectors_per_block > 128)
+        sectors_per_block = 128;
+
+    g_block_count       = block_count;
+    g_sectors_per_block = sectors_per_block;
+}
+
+//
+// Queue handling
+//
+static void _list_remove(struct bd_cache *c, s16 idx)
+{
+    struct bd_cache_entry *e = &c->entry[idx];
+    struct bd_cache_list *l  = &c->list[e->queue];
+
+    if (e->prev != ENTRY_NONE)
+        c->entry[e->prev].next = e->next;
     else
-        return 0;
+        l->head = e->next;
+
+    if (e->next != ENTRY_NONE)
+        c->entry[e->next].prev = e->prev;
+    else
+        l->tail = e->prev;
+
+    l->count--;
 }
 
-/* cache contains requested area ? */
-static int _contains(u32 csector, u32 sector, u16 count)
+static void _list_push(struct bd_cache *c, s16 idx, u8 queue)
 {
-    if ((sector >= csector) && ((sector + count) <= (csector + SECTORS_PER_BLOCK)))
-        return 1;
+    struct bd_cache_entry *e = &c->entry[idx];
+    struct bd_cache_list *l  = &c->list[queue];
+
+    e->queue = queue;
+    e->prev  = ENTRY_NONE;
+    e->next  = l->head;
+    if (l->head != ENTRY_NONE)
+        c->entry[l->head].prev = idx;
     else
-        return 0;
+        l->tail = idx;
+    l->head = idx;
+    l->count++;
+}
+
+//
+// Hash handling
+//
+static s16 _hash_find(struct bd_cache *c, u32 block)
+{
+    s16 idx;
+
+    for (idx = c->hash[block & c->hash_mask]; idx != ENTRY_NONE; idx = c->entry[idx].hnext) {
+        if (c->entry[idx].block == block)
+            return idx;
+    }
+
+    return ENTRY_NONE;
+}
+
+static void _hash_insert(struct bd_cache *c, s16 idx)
+{
+    s16 *bucket = &c->hash[c->entry[idx].block & c->hash_mask];
+
+    c->entry[idx].hnext = *bucket;
+    *bucket             = idx;
 }
 
-static void _invalidate(struct bd_cache *c, u32 sector, u16 count)
+static void _hash_remove(struct bd_cache *c, s16 idx)
 {
-    int blkidx;
+    s16 *pidx = &c->hash[c->entry[idx].block & c->hash_mask];
 
-    for (blkidx = 0; blkidx < BLOCK_COUNT; blkidx++) {
-        if (_overlaps(c->sector[blkidx], sector, count)) {
-            // Invalidate cache entry
-            c->sector[blkidx] = 0xffffffff;
+    while (*pidx != ENTRY_NONE) {
+        if (*pidx == idx) {
+            *pidx = c->entry[idx].hnext;
+            break;
         }
+        pidx = &c->entry[*pidx].hnext;
     }
 }
 
+//
+// Entry life cycle
+//
+static void _entry_free(struct bd_cache *c, s16 idx)
+{
+    struct bd_cache_entry *e = &c->entry[idx];
+
+    _list_remove(c, idx);
+    _hash_remove(c, idx);
+    if (e->slot != ENTRY_NONE) {
+        c->free_slot[c->free_slot_count++] = e->slot;
+        e->slot                            = ENTRY_NONE;
+    }
+    _list_push(c, idx, Q_FREE);
+}
+
+/* Move the oldest A1in entry to the ghost queue, releasing its data slot */
+static void _evict_a1in(struct bd_cache *c)
+{
+    s16 idx                  = c->list[Q_A1IN].tail;
+    struct bd_cache_entry *e = &c->entry[idx];
+
+    M_DEBUG("evict A1in block %u\n", e->block);
+
+    _list_remove(c, idx);
+    c->free_slot[c->free_slot_count++] = e->slot;
+    e->slot                            = ENTRY_NONE;
+    _list_push(c, idx, Q_A1OUT);
+
+    // Forget the oldest ghost when A1out is full
+    if (c->list[Q_A1OUT].count > c->a1out_max)
+        _entry_free(c, c->list[Q_A1OUT].tail);
+
+    c->stats.evictions++;
+}
+
+/* Drop the least recently used Am entry */
+static void _evict_am(struct bd_cache *c)
+{
+    M_DEBUG("evict Am block %u\n", c->entry[c->list[Q_AM].tail].block);
+
+    _entry_free(c, c->list[Q_AM].tail);
+    c->stats.evictions++;
+}
+
+static s16 _slot_alloc(struct bd_cache *c)
+{
+    if (c->free_slot_count == 0) {
+        if ((c->list[Q_A1IN].count > c->a1in_max) || (c->list[Q_AM].count == 0))
+            _evict_a1in(c);
+        else
+            _evict_am(c);
+    }
+
+    return c->free_slot[--c->free_slot_count];
+}
+
+static inline u8 *_slot_data(struct bd_cache *c, s16 slot)
+{
+    return &c->data[(u32)slot * c->block_size];
+}
+
+/* Get a resident entry for a block, reading it from the device when needed */
+static s16 _get_block(struct bd_cache *c, u32 block)
+{
+    struct bd_cache_entry *e;
+    s16 idx;
+    int rv;
+
+    idx = _hash_find(c, block);
+    if (idx != ENTRY_NONE) {
+        e = &c->entry[idx];
+        if (e->queue == Q_AM) {
+            // Hit in Am: move to MRU position
+            _list_remove(c, idx);
+            _list_push(c, idx, Q_AM);
+            c->stats.hits++;
+            return idx;
+        }
+        if (e->queue == Q_A1IN) {
+            // Hit in A1in: leave it where it is (correlated reference)
+            c->stats.hits++;
+            return idx;
+        }
+    }
+
+    c->stats.misses++;
+
+    // Data slot must be obtained before an entry, it can release ghost entries
+    s16 slot = _slot_alloc(c);
+    if (idx != ENTRY_NONE)
+        idx = _hash_find(c, block);
+
+    if (idx != ENTRY_NONE) {
+        // Ghost hit in A1out: block is re-used, promote it to Am
+        M_DEBUG("promote block %u\n", block);
+        _list_remove(c, idx);
+        c->stats.promotions++;
+    } else {
+        idx = c->list[Q_FREE].tail;
+        if ((idx == ENTRY_NONE) && (c->list[Q_A1OUT].tail != ENTRY_NONE)) {
+            // Out of entries, forget the oldest ghost
+            _entry_free(c, c->list[Q_A1OUT].tail);
+            idx = c->list[Q_FREE].tail;
+        }
+        _list_remove(c, idx);
+        c->entry[idx].block = block;
+        _hash_insert(c, idx);
+    }
+
+    e       = &c->entry[idx];
+    e->slot = slot;
+    _list_push(c, idx, (e->queue == Q_A1OUT) ? Q_AM : Q_A1IN);
+
+    rv = c->bd->read(c->bd, block * c->sectors_per_block, _slot_data(c, slot), c->sectors_per_block);
+    if (rv != (int)c->sectors_per_block) {
+        M_DEBUG("ERROR: reading block %u failed %d\n", block, rv);
+        _entry_free(c, idx);
+        return ENTRY_NONE;
+    }
+
+    return idx;
+}
+
+/* Check if an asynchronous write to a block is in flight */
+static int _write_pending(struct bd_cache *c, u32 block)
+{
+    u32 start = block * c->sectors_per_block;
+    u32 end   = start + c->sectors_per_block;
+    int i;
+
+    if (c->writes_pending == 0)
+        return 0;
+
+    for (i = 0; i < BD_CACHE_MAX_WRITES; i++) {
+        struct bd_cache_write *w = &c->write[i];
+
+        if (w->busy && (w->sector < end) && ((w->sector + w->count) > start))
+            return 1;
+    }
+
+    return 0;
+}
+
 static int _read(struct block_device *bd, u32 sector, void *buffer, u16 count)
 {
     struct bd_cache *c = bd->priv;
+    u8 *buf            = buffer;
+    u16 left           = count;
 
     //M_DEBUG("%s(%d, %d)\n", __FUNCTION__, sector, count);
 
-    if (count >= SECTORS_PER_BLOCK) {
-        // Do a direct read
+    if (count >= c->sectors_per_block) {
+        // Do a direct read, large (streaming) reads must not pollute the cache
+        c->stats.direct_sectors += count;
         return c->bd->read(c->bd, sector, buffer, count);
     }
 
-#ifdef DEBUG
-    c->sectors_read += count;
-#endif
-
-    // Do a cached read
-    int blkidx;
-    for (blkidx = 0; blkidx < BLOCK_COUNT; blkidx++) {
-        if (_contains(c->sector[blkidx], sector, count)) {
-#ifdef DEBUG
-            c->sectors_cache += count;
-            //M_DEBUG("- CACHE HIT[%d] [block %d] [devread %ds, hit-ratio %d%%]\n", sector, blkidx, c->sectors_dev, (c->sectors_cache * 100) / c->sectors_read);
-#endif
-            // Minimum weight
-            if (c->weight[blkidx] < 0)
-                c->weight[blkidx] = 0;
-
-            c->weight[blkidx] += count * BLOCK_WEIGHT_FACTOR;
-
-            // Read from cache
-            u32 offset = (sector - c->sector[blkidx]) * 512;
-            memcpy(buffer, &c->cache[blkidx][offset], count * 512);
-            return count;
+    // Do a cached read, one request can span at most two blocks
+    while (left > 0) {
+        u32 block  = sector / c->sectors_per_block;
+        u32 offset = sector - (block * c->sectors_per_block);
+        u32 n      = c->sectors_per_block - offset;
+        s16 idx;
+
+        if (n > left)
+            n = left;
+
+        // The last block of the device can be incomplete, and blocks being
+        // written are changing: read them directly
+        if ((((block + 1) * c->sectors_per_block) > (bd->sectorOffset + bd->sectorCount)) || _write_pending(c, block)) {
+            int rv = c->bd->read(c->bd, sector, buf, n);
+            if (rv != (int)n)
+                return rv;
+        } else {
+            idx = _get_block(c, block);
+            if (idx == ENTRY_NONE)
+                return -1;
+            memcpy(buf, _slot_data(c, c->entry[idx].slot) + offset * bd->sectorSize, n * bd->sectorSize);
         }
+
+        sector += n;
+        buf += n * bd->sectorSize;
+        left -= n;
     }
 
-    // Find block with the lowest weight
-    int blkidx_best_weight = 0x7fffffff;
-    int blkidx_best = 0;
-    M_DEBUG("- list: ");
-    for (blkidx = 0; blkidx < BLOCK_COUNT; blkidx++) {
-#ifdef DEBUG
-        printf("%*d ", 3, c->weight[blkidx] / BLOCK_WEIGHT_FACTOR);
-#endif
+    return count;
+}
+
+static int _write(struct block_device *bd, u32 sector, const void *buffer, u16 count)
+{
+    struct bd_cache *c = bd->priv;
+    u32 block, block_end;
+    int rv;
+
+    M_DEBUG("%s(%d, %d)\n", __FUNCTION__, sector, count);
+
+    rv = c->bd->write(c->bd, sector, buffer, count);
+
+    // Write-through: keep cached copies of the written blocks up to date,
+    // so frequently written metadata (FAT) stays resident.
+    block_end = (sector + count + c->sectors_per_block - 1) / c->sectors_per_block;
+    for (block = sector / c->sectors_per_block; block < block_end; block++) {
+        s16 idx = _hash_find(c, block);
+        struct bd_cache_entry *e;
+        u32 bstart, start, end;
 
-        // Dynamic aging
-        c->weight[blkidx] -= (SECTORS_PER_BLOCK * BLOCK_WEIGHT_FACTOR / BLOCK_COUNT) + (c->weight[blkidx] / 32);
+        if (idx == ENTRY_NONE)
+            continue;
 
-        if (c->weight[blkidx] < blkidx_best_weight) {
-            // Better block found
-            blkidx_best_weight = c->weight[blkidx];
-            blkidx_best = blkidx;
+        e = &c->entry[idx];
+        if (e->slot == ENTRY_NONE)
+            continue;
+
+        if (rv != count) {
+            // Unknown device state, drop the block
+            _entry_free(c, idx);
+            continue;
         }
+
+        bstart = block * c->sectors_per_block;
+        start  = (sector > bstart) ? sector : bstart;
+        end    = ((sector + count) < (bstart + c->sectors_per_block)) ? (sector + count) : (bstart + c->sectors_per_block);
+        memcpy(_slot_data(c, e->slot) + (start - bstart) * bd->sectorSize,
+               (const u8 *)buffer + (start - sector) * bd->sectorSize,
+               (end - start) * bd->sectorSize);
+        c->stats.write_updates++;
     }
-#ifdef DEBUG
-    printf(" devread: %*d, evict %*d [%*d], add [%*d]\n", 4, c->sectors_dev, 2, blkidx_best, 8, c->sector[blkidx_best], 8, sector);
-    c->sectors_dev += SECTORS_PER_BLOCK;
-    //M_DEBUG("- CACHE READ[%d] -> [block %d] [devread %ds, hit-ratio %d%%]\n", sector, blkidx_best, c->sectors_dev, (c->sectors_cache * 100) / c->sectors_read);
-#endif
 
-    // Fill the block
-    c->bd->read(c->bd, sector, c->cache[blkidx_best], SECTORS_PER_BLOCK);
-    c->sector[blkidx_best] = sector;
+    return rv;
+}
 
-    // Read from cache
-    u32 offset = (sector - c->sector[blkidx_best]) * 512;
-    c->weight[blkidx_best] = count * BLOCK_WEIGHT_FACTOR;
-    memcpy(buffer, &c->cache[blkidx_best][offset], count * 512);
-    return count;
+static void _invalidate(struct bd_cache *c, u32 sector, u32 count)
+{
+    u32 block, block_end;
+
+    block_end = (sector + count + c->sectors_per_block - 1) / c->sectors_per_block;
+    for (block = sector / c->sectors_per_block; block < block_end; block++) {
+        s16 idx = _hash_find(c, block);
+
+        if ((idx != ENTRY_NONE) && (c->entry[idx].slot != ENTRY_NONE))
+            _entry_free(c, idx);
+    }
 }
 
-static int _write(struct block_device *bd, u32 sector, const void *buffer, u16 count)
+/* Can be called from interrupt context: only the write slot is released here */
+static void _write_complete(struct bd_request *req)
 {
-    struct bd_cache *c = bd->priv;
+    struct bd_cache_write *w  = req->priv;
+    struct bd_request *parent = w->parent;
+    struct bd_cache *c        = w->c;
+    int state, drained;
+
+    parent->result = req->result;
+
+    CpuSuspendIntr(&state);
+    w->busy = 0;
+    c->writes_pending--;
+    drained = c->draining && (c->writes_pending == 0);
+    CpuResumeIntr(state);
+
+    if (parent->complete != NULL)
+        parent->complete(parent);
+
+    // The cache can be freed from here on
+    if (drained) {
+        if (QueryIntrContext())
+            iSignalSema(c->drain_sema);
+        else
+            SignalSema(c->drain_sema);
+    }
+}
 
-    M_DEBUG("%s(%d, %d)\n", __FUNCTION__, sector, count);
+static int _submit_write(struct bd_cache *c, struct bd_request *req, u32 count)
+{
+    struct bd_cache_write *w = NULL;
+    int i, state, rv;
+
+    // The data is not available to us at completion, drop the blocks now.
+    // Until the write completes, they are read around the cache.
+    _invalidate(c, req->sector, count);
+
+    CpuSuspendIntr(&state);
+    for (i = 0; i < BD_CACHE_MAX_WRITES; i++) {
+        if (!c->write[i].busy) {
+            w       = &c->write[i];
+            w->busy = 1;
+            c->writes_pending++;
+            break;
+        }
+    }
+    CpuResumeIntr(state);
+
+    if (w == NULL) {
+        // All slots in flight, write synchronously
+        req->result = bdm_transfer(c->bd, req->op, req->sector, req->sg, req->sg_count);
+        if (req->complete != NULL)
+            req->complete(req);
+        return 0;
+    }
 
-    _invalidate(c, sector, count);
+    w->parent       = req;
+    w->c            = c;
+    w->sector       = req->sector;
+    w->count        = count;
+    w->req.next     = NULL;
+    w->req.op       = req->op;
+    w->req.sector   = req->sector;
+    w->req.sg       = req->sg;
+    w->req.sg_count = req->sg_count;
+    w->req.result   = 0;
+    w->req.complete = _write_complete;
+    w->req.priv     = w;
+
+    rv = bdm_submit(c->bd, &w->req);
+    if (rv < 0) {
+        CpuSuspendIntr(&state);
+        w->busy = 0;
+        c->writes_pending--;
+        CpuResumeIntr(state);
+    }
+
+    return rv;
+}
+
+static int _submit(struct block_device *bd, struct bd_request *req)
+{
+    struct bd_cache *c = bd->priv;
+    unsigned int i;
+    u32 count = 0;
+
+    for (i = 0; i < req->sg_count; i++)
+        count += req->sg[i].count;
+
+    if (req->op == BD_REQ_WRITE) {
+        return _submit_write(c, req, count);
+    } else if ((req->sg_count == 1) && (count < c->sectors_per_block)) {
+        // Small reads are served by the cache
+        req->result = _read(bd, req->sector, req->sg[0].buffer, count);
+        if (req->complete != NULL)
+            req->complete(req);
+        return 0;
+    } else {
+        c->stats.direct_sectors += count;
+    }
 
-    return c->bd->write(c->bd, sector, buffer, count);
+    return bdm_submit(c->bd, req);
 }
 
 static void _flush(struct block_device *bd)
@@ -152,27 +557,87 @@ static int _stop(struct block_device *bd)
     return c->bd->stop(c->bd);
 }
 
-struct block_device *bd_cache_create(struct block_device *bd)
+static void _free_cache(struct bd_cache *c)
 {
-    int blkidx;
+    if (c->drain_sema >= 0)
+        DeleteSema(c->drain_sema);
+    if (c->data != NULL)
+        FreeSysMemory(c->data);
+    if (c->free_slot != NULL)
+        FreeSysMemory(c->free_slot);
+    if (c->hash != NULL)
+        FreeSysMemory(c->hash);
+    if (c->entry != NULL)
+        FreeSysMemory(c->entry);
+    FreeSysMemory(c);
+}
 
-    // Create new block device
-    struct block_device *cbd = AllocSysMemory(ALLOC_FIRST, sizeof(struct block_device), NULL);
-    // Create new private data
-    struct bd_cache *c = AllocSysMemory(ALLOC_FIRST, sizeof(struct bd_cache), NULL);
+struct block_device *bd_cache_create(struct block_device *bd)
+{
+    const struct block_device_ext *ext;
+    struct block_device *cbd;
+    struct bd_cache *c;
+    unsigned int i, hash_size;
+    iop_sema_t sp;
 
     M_DEBUG("%s\n", __FUNCTION__);
 
-    c->bd = bd;
-    for (blkidx = 0; blkidx < BLOCK_COUNT; blkidx++) {
-        c->weight[blkidx] = 0;
-        c->sector[blkidx] = 0xffffffff;
+    // Create new private data
+    c = AllocSysMemory(ALLOC_FIRST, sizeof(struct bd_cache), NULL);
+    if (c == NULL)
+        return NULL;
+    memset(c, 0, sizeof(struct bd_cache));
+
+    sp.initial    = 0;
+    sp.max        = 1;
+    sp.option     = 0;
+    sp.attr       = 0;
+    c->drain_sema = CreateSema(&sp);
+
+    c->bd                = bd;
+    c->sectors_per_block = g_sectors_per_block;
+    c->block_count       = g_block_count;
+    c->block_size        = c->sectors_per_block * bd->sectorSize;
+    c->a1in_max          = c->block_count / 4;
+    c->a1out_max         = c->block_count / 2;
+    c->entry_count       = c->block_count + c->a1out_max;
+    for (hash_size = 1; hash_size < c->entry_count; hash_size <<= 1)
+        ;
+    c->hash_mask = hash_size - 1;
+
+    c->entry     = AllocSysMemory(ALLOC_FIRST, c->entry_count * sizeof(struct bd_cache_entry), NULL);
+    c->hash      = AllocSysMemory(ALLOC_FIRST, hash_size * sizeof(s16), NULL);
+    c->free_slot = AllocSysMemory(ALLOC_FIRST, c->block_count * sizeof(s16), NULL);
+    c->data      = AllocSysMemory(ALLOC_FIRST, c->block_count * c->block_size, NULL);
+    // Create new block device
+    cbd = AllocSysMemory(ALLOC_FIRST, sizeof(struct block_device), NULL);
+    if ((c->drain_sema < 0) || (c->entry == NULL) || (c->hash == NULL) || (c->free_slot == NULL) || (c->data == NULL) || (cbd == NULL)) {
+        M_DEBUG("ERROR: out of memory\n");
+        if (cbd != NULL)
+            FreeSysMemory(cbd);
+        _free_cache(c);
+        return NULL;
     }
-#ifdef DEBUG
-    c->sectors_read = 0;
-    c->sectors_cache = 0;
-    c->sectors_dev = 0;
-#endif
+
+    for (i = 0; i < Q_COUNT; i++) {
+        c->list[i].head  = ENTRY_NONE;
+        c->list[i].tail  = ENTRY_NONE;
+        c->list[i].count = 0;
+    }
+    for (i = 0; i < hash_size; i++)
+        c->hash[i] = ENTRY_NONE;
+    for (i = 0; i < c->entry_count; i++) {
+        c->entry[i].block = 0xffffffff;
+        c->entry[i].hnext = ENTRY_NONE;
+        c->entry[i].slot  = ENTRY_NONE;
+        _list_push(c, i, Q_FREE);
+    }
+    for (i = 0; i < c->block_count; i++)
+        c->free_slot[i] = i;
+    c->free_slot_count = c->block_count;
+
+    c->stats.block_count       = c->block_count;
+    c->stats.sectors_per_block = c->sectors_per_block;
 
     // copy all parameters becouse we are the same blocks device
     // only difference is we are cached.
@@ -190,13 +655,54 @@ struct block_device *bd_cache_create(struct block_device *bd)
     cbd->flush = _flush;
     cbd->stop = _stop;
 
+    ext = bdm_get_ext(bd);
+    if (ext != NULL) {
+        c->ext.submit      = _submit;
+        c->ext.queue_depth = ext->queue_depth;
+        if (bdm_set_ext(cbd, &c->ext) < 0)
+            M_DEBUG("ERROR: no room for the extended operations\n");
+    }
+
     return cbd;
 }
 
+void bd_cache_get_stats(struct block_device *cbd, bd_cache_stats_t *stats)
+{
+    struct bd_cache *c = cbd->priv;
+
+    memcpy(stats, &c->stats, sizeof(bd_cache_stats_t));
+}
+
+void bd_cache_reset_stats(struct block_device *cbd)
+{
+    struct bd_cache *c = cbd->priv;
+
+    c->stats.hits           = 0;
+    c->stats.misses         = 0;
+    c->stats.evictions      = 0;
+    c->stats.promotions     = 0;
+    c->stats.direct_sectors = 0;
+    c->stats.write_updates  = 0;
+}
+
 void bd_cache_destroy(struct block_device *cbd)
 {
+    struct bd_cache *c = cbd->priv;
+    int state, pending;
+
     M_DEBUG("%s\n", __FUNCTION__);
 
-    FreeSysMemory(cbd->priv);
+    // No new submits, then wait for the writes in flight to complete
+    bdm_set_ext(cbd, NULL);
+
+    CpuSuspendIntr(&state);
+    pending     = c->writes_pending;
+    c->draining = 1;
+    CpuResumeIntr(state);
+
+    if (pending > 0)
+        WaitSema(c->drain_sema);
+
+    _free_cache(c);
     FreeSysMemory(cbd);
 }
@@ -13,6 +13,7 @@
 #define __LIBPFS_H__
 
 #include <types.h>
+#include <hdd-ioctl.h>
 
 // General constants
 #define PFS_BLOCKSIZE 		0x2000
@@ -189,6 +190,7 @@ typedef struct {
 typedef struct pfs_cache_s {
 	struct pfs_cache_s *next;	//
 	struct pfs_cache_s *prev;	//
+	struct pfs_cache_s *hnext;	// next buffer in hash chain
 	u16 flags;					//
 	u16 nused;					//
 	pfs_mount_t *pfsMount;		//
@@ -245,6 +247,8 @@ int pfsCacheIsFull(void);
 int pfsCacheInit(u32 numBuf, u32 bufSize);
 void pfsCacheClose(pfs_mount_t *pfsMount);
 void pfsCacheMarkClean(const pfs_mount_t *pfsMount, u32 subpart, u32 blockStart, u32 blockEnd);
+void pfsCacheGetStats(pfs_cache_stats_t *stats);
+void pfsCacheClearStats(void);
 
 ///////////////////////////////////////////////////////////////////////////////
 //	Bitmap functions
@@ -27,6 +27,34 @@ extern u32 pfsBlockSize;
 pfs_cache_t *pfsCacheBuf;
 u32 pfsCacheNumBuffers;
 
+// Every buffer is always in the hash chain of its sub/block, also when it has no mount.
+static pfs_cache_t **pfsCacheHash;
+static u32 pfsCacheHashMask;
+static pfs_cache_stats_t pfsCacheStats;
+
+#define PFS_CACHE_HASH(sub, block)	(((block) ^ ((sub) << 4)) & pfsCacheHashMask)
+
+static void pfsCacheHashInsert(pfs_cache_t *clink)
+{
+	pfs_cache_t **bucket = &pfsCacheHash[PFS_CACHE_HASH(clink->sub, clink->block)];
+
+	clink->hnext = *bucket;
+	*bucket = clink;
+}
+
+static void pfsCacheHashRemove(pfs_cache_t *clink)
+{
+	pfs_cache_t **pclink = &pfsCacheHash[PFS_CACHE_HASH(clink->sub, clink->block)];
+
+	while(*pclink != NULL) {
+		if(*pclink == clink) {
+			*pclink = clink->hnext;
+			break;
+		}
+		pclink = &(*pclink)->hnext;
+	}
+}
+
 void pfsCacheFree(pfs_cache_t *clink)
 {
 	if(clink==NULL) {
@@ -107,23 +135,35 @@ int pfsCacheTransfer(pfs_cache_t* clink, int mode)
 	return pfsMount->lastError;
 }
 
+static int pfsCacheCompare(const pfs_cache_t *a, const pfs_cache_t *b)
+{
+	if(a->sub != b->sub)
+		return a->sub < b->sub ? -1 : 1;
+	return a->block < b->block ? -1 : (a->block > b->block);
+}
+
 void pfsCacheFlushAllDirty(pfs_mount_t *pfsMount)
 {
-	u32 i;
-	int found=0;
+	u8 dirty[128];
+	u32 i, j, count=0;
 
+	// Collect the dirty buffers, sorted by sub/block so the disk is written in one sweep.
 	for(i=1;i<pfsCacheNumBuffers+1;i++){
 		if(pfsCacheBuf[i].pfsMount == pfsMount &&
-			pfsCacheBuf[i].flags & PFS_CACHE_FLAG_DIRTY)
-				found=1;
+			pfsCacheBuf[i].flags & PFS_CACHE_FLAG_DIRTY) {
+				for(j=count; j>0 && pfsCacheCompare(&pfsCacheBuf[dirty[j-1]], &pfsCacheBuf[i]) > 0; j--)
+					dirty[j]=dirty[j-1];
+				dirty[j]=i;
+				count++;
+		}
 	}
-	if(found) {
+	if(count) {
+		// All dirty buffers are journalled together, the journal must be written before any of them.
 		pfsJournalWrite(pfsMount, pfsCacheBuf+1, pfsCacheNumBuffers);
-		for(i=1;i<pfsCacheNumBuffers+1;i++){
-			if(pfsCacheBuf[i].pfsMount == pfsMount &&
-				pfsCacheBuf[i].flags & PFS_CACHE_FLAG_DIRTY)
-					pfsCacheTransfer(&pfsCacheBuf[i], 1);
-		}
+		for(i=0;i<count;i++)
+			pfsCacheTransfer(&pfsCacheBuf[dirty[i]], PFS_IO_MODE_WRITE);
+		pfsCacheStats.flushes++;
+		pfsCacheStats.blocksWritten+=count;
 	}
 
 	pfsJournalReset(pfsMount);
@@ -132,7 +172,7 @@ void pfsCacheFlushAllDirty(pfs_mount_t *pfsMount)
 pfs_cache_t *pfsCacheAlloc(pfs_mount_t *pfsMount, u16 sub, u32 block,
 					int flags, int *result)
 {
-	pfs_cache_t *allocated;
+	pfs_cache_t *allocated, *clink;
 
 	if (pfsCacheBuf->prev==pfsCacheBuf && pfsCacheBuf->prev->next==pfsCacheBuf->prev) {
 		PFS_PRINTF(PFS_DRV_NAME": Error: Free buffer list is empty\n");
@@ -142,35 +182,52 @@ pfs_cache_t *pfsCacheAlloc(pfs_mount_t *pfsMount, u16 sub, u32 block,
 	allocated=pfsCacheBuf->next;
 	if (pfsCacheBuf->next==NULL)
 		PFS_PRINTF(PFS_DRV_NAME": Panic: Null pointer allocated\n");
-	if (allocated->pfsMount && (allocated->flags & PFS_CACHE_FLAG_DIRTY))
+
+	// Reuse the least recently used clean buffer. Reusing a dirty buffer forces all dirty buffers to be written back.
+	for (clink=allocated; clink!=pfsCacheBuf; clink=clink->next) {
+		if (clink->pfsMount==NULL || !(clink->flags & PFS_CACHE_FLAG_DIRTY)) {
+			allocated=clink;
+			break;
+		}
+	}
+
+	if (allocated->pfsMount && (allocated->flags & PFS_CACHE_FLAG_DIRTY)) {
+		pfsCacheStats.dirtyEvictions++;
 		pfsCacheFlushAllDirty(allocated->pfsMount);
+	} else if (allocated->pfsMount) {
+		pfsCacheStats.cleanEvictions++;
+	}
+
+	pfsCacheHashRemove(allocated);
 	allocated->flags 	= flags & PFS_CACHE_FLAG_MASKTYPE;
 	allocated->pfsMount	= pfsMount;
 	allocated->sub		= sub;
 	allocated->block	= block;
 	allocated->nused	= 1;
+	pfsCacheHashInsert(allocated);
 	return pfsCacheUnLink(allocated);
 }
 
 pfs_cache_t *pfsCacheGetData(pfs_mount_t *pfsMount, u16 sub, u32 block,
 					int flags, int *result)
 {
-	u32 i;
 	pfs_cache_t *clink;
 
 	*result=0;
 
-	for (i=1; i < pfsCacheNumBuffers + 1; i++)
-		if ( pfsCacheBuf[i].pfsMount &&
-		    (pfsCacheBuf[i].pfsMount==pfsMount) &&
-		    (pfsCacheBuf[i].block  == block))
-			if (pfsCacheBuf[i].sub==sub){
-				pfsCacheBuf[i].flags &= PFS_CACHE_FLAG_MASKSTATUS;
-				pfsCacheBuf[i].flags |= flags & PFS_CACHE_FLAG_MASKTYPE;
-				if (pfsCacheBuf[i].nused == 0)
-					pfsCacheUnLink(&pfsCacheBuf[i]);
-				pfsCacheBuf[i].nused++;
-				return &pfsCacheBuf[i];
+	pfsCacheStats.lookups++;
+	for (clink=pfsCacheHash[PFS_CACHE_HASH(sub, block)]; clink!=NULL; clink=clink->hnext)
+		if ( clink->pfsMount &&
+		    (clink->pfsMount==pfsMount) &&
+		    (clink->block  == block))
+			if (clink->sub==sub){
+				clink->flags &= PFS_CACHE_FLAG_MASKSTATUS;
+				clink->flags |= flags & PFS_CACHE_FLAG_MASKTYPE;
+				if (clink->nused == 0)
+					pfsCacheUnLink(clink);
+				clink->nused++;
+				pfsCacheStats.hits++;
+				return clink;
 			}
 
 	clink=pfsCacheAlloc(pfsMount, sub, block, flags, result);
@@ -204,7 +261,7 @@ int pfsCacheIsFull(void)
 int pfsCacheInit(u32 numBuf, u32 bufSize)
 {
 	char *cacheData;
-	u32 i;
+	u32 i, hashSize;
 
 	if(numBuf > 127) {
 		PFS_PRINTF(PFS_DRV_NAME": Error: Number of buffers larger than 127.\n");
@@ -216,6 +273,13 @@ int pfsCacheInit(u32 numBuf, u32 bufSize)
 	if(!cacheData || !(pfsCacheBuf = pfsAllocMem((numBuf + 1) * sizeof(pfs_cache_t))))
 		return -ENOMEM;
 
+	for(hashSize = 16; hashSize < numBuf; hashSize <<= 1)
+		;
+	if(!(pfsCacheHash = pfsAllocMem(hashSize * sizeof(pfs_cache_t *))))
+		return -ENOMEM;
+	pfsCacheHashMask = hashSize - 1;
+	memset(pfsCacheHash, 0, hashSize * sizeof(pfs_cache_t *));
+
 	pfsCacheNumBuffers = numBuf;
 	memset(pfsCacheBuf, 0, (numBuf + 1) * sizeof(pfs_cache_t));
 
@@ -226,6 +290,7 @@ int pfsCacheInit(u32 numBuf, u32 bufSize)
 	{
 		pfsCacheBuf[i].u.data = cacheData;
 		pfsCacheLink(pfsCacheBuf->prev, &pfsCacheBuf[i]);
+		pfsCacheHashInsert(&pfsCacheBuf[i]);
 		cacheData += bufSize;
 	}
 
@@ -259,3 +324,13 @@ void pfsCacheMarkClean(const pfs_mount_t *pfsMount, u32 subpart, u32 blockStart,
 		}
 	}
 }
+
+void pfsCacheGetStats(pfs_cache_stats_t *stats)
+{
+	memcpy(stats, &pfsCacheStats, sizeof(pfs_cache_stats_t));
+}
+
+void pfsCacheClearStats(void)
+{
+	memset(&pfsCacheStats, 0, sizeof(pfs_cache_stats_t));
+}
@@ -73,8 +73,6 @@ int pfsFioDevctl(iop_file_t *f, const char *name, int cmd, void *arg, unsigned i
 	(void)name;
 	(void)arg;
 	(void)arglen;
-	(void)buf;
-	(void)buflen;
 
 	if(!(pfsMount=pfsFioGetMountedUnit(f->unit)))
 		return -ENODEV;
@@ -111,6 +109,17 @@ int pfsFioDevctl(iop_file_t *f, const char *name, int cmd, void *arg, unsigned i
 		pfsBitmapShow(pfsMount);
 		break;
 
+	case PDIOC_GETCACHESTAT:
+		if(buf == NULL || buflen < sizeof(pfs_cache_stats_t))
+			rv=-EINVAL;
+		else
+			pfsCacheGetStats(buf);
+		break;
+
+	case PDIOC_CLRCACHESTAT:
+		pfsCacheClearStats();
+		break;
+
 	default:
 		rv=-EINVAL;
 		break;
@@ -4,3 +4,4 @@ void NetManRpcToggleGlobalNetIFLinkState(int state);
 void *NetManRpcNetProtStackAllocRxPacket(unsigned int length, void **payload);
 void NetManRpcNetProtStackFreeRxPacket(void *packet);
 void NetManRpcProtStackEnQRxPacket(void *packet);
+int NetManRpcIoctl(unsigned int command, void *args, unsigned int args_len, void *output, unsigned int length);
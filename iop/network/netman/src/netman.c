@@ -146,6 +146,9 @@ void NetManNetIFXmit(void){
 int NetManIoctl(unsigned int command, void *args, unsigned int args_len, void *output, unsigned int length){
 	int result;
 
+	if(command >= NETMAN_NETIF_IOCTL_SET_RX_COALESCE && command <= NETMAN_NETIF_IOCTL_GET_RX_COALESCE_STATS)
+		return NetManRpcIoctl(command, args, args_len, output, length);
+
 	WaitSema(NetManIOSemaID);
 
 	if(MainNetIF!=NULL){
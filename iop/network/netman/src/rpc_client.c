@@ -26,7 +26,16 @@ static union{
 
 //Data for IOP -> EE transfers
 static unsigned short int EEFrameBufferWrPtr, NumFramesInQueue;
-static SifDmaTransfer_t dmatReqs[NETMAN_FRAME_GROUP_SIZE*2];
+static SifDmaTransfer_t dmatReqs[NETMAN_FRAME_GROUP_MAX*2];
+
+//The SMAP Rx FIFO may only hold 16384 / 1518 = 10 frames. In 1ms, roughly 8 full-length frames can be transferred at 100Mbit within 1ms. 1ms = 36864 ticks.
+#define FRAME_GROUPING_INTERVAL	36864
+//At 100Mbit, full-length frames arrive every 122us (4500 ticks). Shorter waits will not group much.
+#define FRAME_GROUPING_INTERVAL_MIN	2304
+
+static struct NetManRxCoalesceParams RxCoalesce = {NETMAN_FRAME_GROUP_SIZE, 1, FRAME_GROUPING_INTERVAL_MIN, FRAME_GROUPING_INTERVAL};
+static struct NetManRxCoalesceStats RxCoalesceStats;
+static u32 LastFrameTime;
 
 static int NetManIOSemaID = -1;
 
@@ -59,6 +68,7 @@ int NetManInitRPCClient(void)
 		memset(FrameBufferStatus, 0, NETMAN_RPC_BLOCK_SIZE * sizeof(struct NetManBD));
 		EEFrameBufferWrPtr = 0;
 		NumFramesInQueue = 0;
+		RxCoalesceStats.FrameInterval = RxCoalesce.MaxHold * 2;	//Start as idle, so that the first frames are not held back.
 
 		for(i = 0; i < NETMAN_RPC_BLOCK_SIZE; i++)	//Mark all descriptors as "in-use", until the EE-side allocates buffers.
 			FrameBufferStatus[i].length = USHRT_MAX;
@@ -164,20 +174,58 @@ static int sendFramesToEE(int mode)
 				return -1;
 		}while(res == 0);
 
+		//Only count the group once it was handed over, as a failed attempt is retried later with the same frames.
+		RxCoalesceStats.Frames += NumFramesInQueue;
+		RxCoalesceStats.Groups++;
 		NumFramesInQueue = 0;
 	}
 
 	return 0;
 }
 
-//The SMAP Rx FIFO may only hold 16384 / 1518 = 10 frames. In 1ms, roughly 8 full-length frames can be transferred at 100Mbit within 1ms. 1ms = 36864 ticks.
-#define FRAME_GROUPING_INTERVAL	36864
-
 static unsigned int FrameSendCB(void *arg)
 {
+	unsigned short int frames = NumFramesInQueue;
+
 	(void)arg;
 
-	return(sendFramesToEE(1) == 0 ? 0 : FRAME_GROUPING_INTERVAL); //If sending failed, try again later.
+	if(sendFramesToEE(1) != 0)
+		return RxCoalesce.MaxHold; //If sending failed, try again later.
+
+	if(frames > 0)
+		RxCoalesceStats.TimedGroups++;
+	return 0;
+}
+
+/*	Returns how long to wait for a further frame, or 0 if the queued frames should be sent right away.
+	Like NIC interrupt moderation: the wait follows the (smoothed) time between frames, so that a stream of frames is grouped,
+	while a lone frame (i.e. a ping or request/response traffic) is not held back. */
+static unsigned int GetFrameHoldTime(void)
+{
+	iop_sys_clock_t clock;
+	u32 interval, hold;
+
+	if(!RxCoalesce.Adaptive)
+		return RxCoalesce.MaxHold;
+
+	GetSystemTime(&clock);
+	interval = clock.lo - LastFrameTime;
+	LastFrameTime = clock.lo;
+
+	//Limit the effect of idle periods, so that the estimate can follow the start of a stream quickly.
+	if(interval > RxCoalesce.MaxHold * 2)
+		interval = RxCoalesce.MaxHold * 2;
+	RxCoalesceStats.FrameInterval = RxCoalesceStats.FrameInterval - (RxCoalesceStats.FrameInterval >> 2) + (interval >> 2);
+
+	//Wait for up to two frame intervals, to allow for jitter.
+	hold = RxCoalesceStats.FrameInterval * 2;
+	if(hold > RxCoalesce.MaxHold)
+		hold = 0;	//The next frame is not expected in time.
+	else if(hold < RxCoalesce.MinHold)
+		hold = RxCoalesce.MinHold;
+
+	RxCoalesceStats.HoldTime = hold;
+	return hold;
 }
 
 //Only one thread can enter this critical section!
@@ -186,16 +234,20 @@ static void EnQFrame(const void *frame, unsigned int length)
 	SifDmaTransfer_t *dmat;
 	struct NetManBD *bd;
 	iop_sys_clock_t clock;
+	unsigned int hold;
 
 	//Cancel any ongoing callbacks.
 	CancelAlarm(&FrameSendCB, NULL);
 
-	if (NumFramesInQueue >= NETMAN_FRAME_GROUP_SIZE)
+	if (NumFramesInQueue >= RxCoalesce.MaxFrames)
 	{	/* If there are already sufficient frames, the frames can be sent right away.
 		   This may happen here if sending failed within the interrupt callback and there are more frames to send. */
 		sendFramesToEE(0);
+		RxCoalesceStats.FullGroups++;
 	}
 
+	hold = GetFrameHoldTime();
+
 	//No need to wait for a free spot to appear, as Alloc already took care of that.
 	bd = &FrameBufferStatus[EEFrameBufferWrPtr];
 
@@ -218,12 +270,17 @@ static void EnQFrame(const void *frame, unsigned int length)
 	//Increase the write (IOP -> EE) pointer by one place.
 	EEFrameBufferWrPtr = (EEFrameBufferWrPtr + 1) % NETMAN_RPC_BLOCK_SIZE;
 
-	if (NumFramesInQueue >= NETMAN_FRAME_GROUP_SIZE)
+	if (NumFramesInQueue >= RxCoalesce.MaxFrames)
 	{	//If there are sufficient frames, the frames can be sent right away.
 		sendFramesToEE(0);
+		RxCoalesceStats.FullGroups++;
+	} else if (hold == 0) {
+		//Frames are arriving too far apart to be grouped.
+		sendFramesToEE(0);
+		RxCoalesceStats.ImmediateGroups++;
 	} else {
 		//Wait a while in case further frames can be grouped, to allow sceSifSetDma() to chain the requests together.
-		clock.lo = FRAME_GROUPING_INTERVAL;
+		clock.lo = hold;
 		clock.hi = 0;
 		SetAlarm(&clock, &FrameSendCB, NULL);
 	}
@@ -234,3 +291,47 @@ void NetManRpcProtStackEnQRxPacket(void *packet)
 {
 	EnQFrame(((struct NetManPacketBuffer*)packet)->payload, ((struct NetManPacketBuffer*)packet)->length);
 }
+
+int NetManRpcIoctl(unsigned int command, void *args, unsigned int args_len, void *output, unsigned int length)
+{
+	struct NetManRxCoalesceParams params;
+	int OldState;
+
+	switch(command)
+	{
+		case NETMAN_NETIF_IOCTL_SET_RX_COALESCE:
+			if(args_len < sizeof(params))
+				return -EINVAL;
+			memcpy(&params, args, sizeof(params));
+			if(params.MaxFrames < 1 || params.MaxFrames > NETMAN_FRAME_GROUP_MAX || params.MaxHold == 0 || params.MinHold > params.MaxHold)
+				return -EINVAL;
+
+			//The alarm callback uses these too.
+			CpuSuspendIntr(&OldState);
+			RxCoalesce = params;
+			CpuResumeIntr(OldState);
+			return 0;
+		case NETMAN_NETIF_IOCTL_GET_RX_COALESCE:
+			if(length < sizeof(RxCoalesce))
+				return -EINVAL;
+			memcpy(output, &RxCoalesce, sizeof(RxCoalesce));
+			return 0;
+		case NETMAN_NETIF_IOCTL_GET_RX_COALESCE_STATS:
+			if(length < sizeof(RxCoalesceStats))
+				return -EINVAL;
+			CpuSuspendIntr(&OldState);
+			memcpy(output, &RxCoalesceStats, sizeof(RxCoalesceStats));
+			if(args_len >= sizeof(int) && *(int*)args != 0)
+			{
+				RxCoalesceStats.Frames = 0;
+				RxCoalesceStats.Groups = 0;
+				RxCoalesceStats.FullGroups = 0;
+				RxCoalesceStats.TimedGroups = 0;
+				RxCoalesceStats.ImmediateGroups = 0;
+			}
+			CpuResumeIntr(OldState);
+			return 0;
+		default:
+			return -EINVAL;
+	}
+}
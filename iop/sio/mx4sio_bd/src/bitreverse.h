@@ -0,0 +1,105 @@
+#ifndef BITREVERSE_H
+#define BITREVERSE_H
+
+
+#include <tamtypes.h>
+
+#include "crc16.h"
+
+
+/* The SIO2 receives every byte LSB first, these reverse the bits of each
+ * byte in a buffer of received 32bit words.
+ */
+
+static u32 reverseByteInWord_mask(u32 n, u32 maskF, u32 mask3, u32 mask5)
+{
+    n = ((n & (maskF << 4)) >> 4) | ((n & maskF) << 4);
+    n = ((n & (mask3 << 2)) >> 2) | ((n & mask3) << 2);
+    n = ((n & (mask5 << 1)) >> 1) | ((n & mask5) << 1);
+    return n;
+}
+
+static inline u32 reverseByteInWord(u32 n)
+{
+    return reverseByteInWord_mask(n, 0x0F0F0F0F, 0x33333333, 0x55555555);
+}
+
+/* The masks need to be defined as registers outside of the loop
+ * This extra function makes sure gcc 3.2.3 generates an efficient function
+ * Inner loop with 19 instructions:
+        $L38:
+            and    $2,$2,$10
+            sll    $3,$3,4
+            srl    $2,$2,4
+            or     $2,$2,$3
+            and    $4,$2,$7
+            and    $2,$2,$9
+            srl    $2,$2,2
+            sll    $4,$4,2
+            or     $2,$2,$4
+            and    $3,$2,$12
+            and    $2,$2,$5
+            srl    $2,$2,1
+            sll    $3,$3,1
+            or     $2,$2,$3
+            sw     $2,0($8)
+            addu   $8,$8,4
+            lw     $2,0($8)
+            bne    $8,$11,$L38
+            and    $3,$2,$6
+*/
+static void reverseBuffer32_mask(u32 *buffer, u32 count, u32 maskF, u32 mask3, u32 mask5)
+{
+    u32 n    = *buffer;
+    u32 *end = buffer + count;
+
+    while (buffer != end) {
+        n = ((n & (maskF << 4)) >> 4) | ((n & maskF) << 4);
+        n = ((n & (mask3 << 2)) >> 2) | ((n & mask3) << 2);
+        n = ((n & (mask5 << 1)) >> 1) | ((n & mask5) << 1);
+
+        *buffer = n;
+        buffer++;
+        n = *buffer;
+    }
+}
+
+//  7037KB/s (FAT  PS2, GCC 3.2.3, -O3)
+// 12052KB/s (slim PS2, GCC 3.2.3, -O3)
+static inline void reverseBuffer32(u32 *buffer, u32 count)
+{
+    reverseBuffer32_mask(buffer, count, 0x0F0F0F0F, 0x33333333, 0x55555555);
+}
+
+/* Fused bit-reversal and CRC16 over the received data, using a single load and
+ * store per word. The CRC is calculated over the data as received, see crc16.h.
+ * Same trick with the masks as above.
+ */
+static u32 reverseBuffer32_crc16_mask(u32 *buffer, u32 count, u32 maskF, u32 mask3, u32 mask5)
+{
+    u32 crc  = 0;
+    u32 *end = buffer + count;
+
+    while (buffer != end) {
+        u32 n = *buffer;
+
+        crc = crc16_update32(crc, n);
+
+        n = ((n & (maskF << 4)) >> 4) | ((n & maskF) << 4);
+        n = ((n & (mask3 << 2)) >> 2) | ((n & mask3) << 2);
+        n = ((n & (mask5 << 1)) >> 1) | ((n & mask5) << 1);
+
+        *buffer = n;
+        buffer++;
+    }
+
+    return crc;
+}
+
+static inline u16 reverseBuffer32_crc16(u32 *buffer, u32 count)
+{
+    return reverseBuffer32_crc16_mask(buffer, count, 0x0F0F0F0F, 0x33333333, 0x55555555);
+}
+
+
+#endif
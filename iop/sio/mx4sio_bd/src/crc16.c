@@ -1,27 +1,40 @@
 #include "crc16.h"
 
 
-uint16_t crc16(void *buf, int len)
+uint16_t crc16_table[4][256];
+
+void crc16_generate_table(void)
 {
-    uint16_t *bf  = buf;
-    uint32_t poly = 0; // Initializing poly to 0 AND using it as initializer in the loop for polyIn results in the compiler forcing it always to 0 in the loop (so don't use variables as initializers - i.e. u32 polyIn = poly; ).
-    int i;
-    len /= 2; // to u16
-    for (i = 0; i < len; i++) {
-        uint32_t polyIn, di;
-
-        di     = (((bf[i]) << 8) & 0xFF00) | (((bf[i]) >> 8) & 0xFF);
-        polyIn = poly;
-        // PPC has an instruction for shifting and masking (continuous mask) at the same time.
-        // This sequence must be folowed because some of the bits altered in the first operations are used in the folowing.
-        polyIn ^= ((polyIn ^ di) >> 4) & 0x0F00;
-        polyIn ^= ((polyIn ^ di) >> 4) & 0x00F0;
-        polyIn ^= ((polyIn ^ di) >> 11) & 0x001F;
-        polyIn ^= ((polyIn ^ di) >> 4) & 0x000F;
-        polyIn ^= di;
-        poly = polyIn ^ (polyIn << 5) ^ (polyIn << 12);
+    int i, j;
+
+    for (i = 0; i < 256; i++) {
+        uint32_t crc = i;
+
+        for (j = 0; j < 8; j++)
+            crc = (crc & 1) ? (crc >> 1) ^ 0x8408 : (crc >> 1);
+
+        crc16_table[0][i] = crc;
     }
 
-    uint16_t crc = poly;
+    // Each next table continues the previous one with a zero byte
+    for (i = 0; i < 256; i++) {
+        for (j = 1; j < 4; j++) {
+            uint32_t crc = crc16_table[j - 1][i];
+
+            crc16_table[j][i] = (crc >> 8) ^ crc16_table[0][crc & 0xff];
+        }
+    }
+}
+
+uint16_t crc16(const void *buf, int len)
+{
+    const uint32_t *bf = buf;
+    uint32_t crc       = 0;
+    int i;
+
+    len /= 4; // to u32
+    for (i = 0; i < len; i++)
+        crc = crc16_update32(crc, bf[i]);
+
     return crc;
 }
@@ -3,6 +3,28 @@
 
 #include "stdint.h"
 
-uint16_t crc16(void *buf, int len);
+/* CRC16 (CCITT, polynomial 0x1021) as used by SD cards for data blocks.
+ *
+ * The SD card sends each byte MSB first but the SIO2 receives LSB first, so
+ * every received byte is bit-reversed. Instead of reversing the data and then
+ * calculating the CRC, the CRC is calculated in reflected form (polynomial
+ * 0x8408) directly over the received bytes. The result then equals the two
+ * CRC bytes as received: low byte first, no bit-reversal needed.
+ *
+ * The tables allow processing one 32bit word at a time ("slicing-by-4").
+ */
+extern uint16_t crc16_table[4][256];
+
+void crc16_generate_table(void);
+
+/* CRC of len bytes, as received (not bit-reversed), len must be a multiple of 4 */
+uint16_t crc16(const void *buf, int len);
+
+static inline uint32_t crc16_update32(uint32_t crc, uint32_t word)
+{
+    uint32_t x = crc ^ word;
+
+    return crc16_table[3][x & 0xff] ^ crc16_table[2][(x >> 8) & 0xff] ^ crc16_table[1][(x >> 16) & 0xff] ^ crc16_table[0][x >> 24];
+}
 
 #endif
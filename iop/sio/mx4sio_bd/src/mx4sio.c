@@ -4,9 +4,11 @@
 #include <loadcore.h>
 #include <thbase.h>
 #include <thevent.h>
+#include <sysclib.h>
 #include <thsemap.h>
 #include <xsio2man.h>
 
+#include "bitreverse.h"
 #include "crc16.h"
 #include "ioplib.h"
 #include "sio2man_hook.h"
@@ -20,9 +22,6 @@ IRX_ID("mx4sio", 1, 1);
 
 #define WELCOME_STR "mx4sio v1.1\n"
 
-// Options
-#define CONFIG_USE_CRC16 // A little slower ~ 1700 KB/s -> 1400 KB/s
-
 // 3 is the second memory card slot
 #define PORT_NR                3
 #define MAX_SIO2_TRANSFER_SIZE 256 // 0x100
@@ -30,6 +29,22 @@ IRX_ID("mx4sio", 1, 1);
 #define MAX_SECTORS            64
 #define MAX_RETRIES            4
 
+#ifndef MINI_DRIVER
+/* With the "wcache" argument, adjacent writes are merged into one multi-block
+ * write of up to this many sectors. Off by default, every request is then
+ * written through.
+ *
+ * Merged writes are reported as done once they are in the buffer, before they
+ * reach the card. They are written when a write does not continue the run, a
+ * read overlaps it, BDM flushes or stops the device, the module is unloaded,
+ * or after a second without card access. Sectors that fail to be written stay
+ * in the buffer: the next write fails until they are written, and so do reads
+ * of them. Sectors still in the buffer when the card is pulled out are lost,
+ * and the next write fails to report it.
+ */
+#define WCACHE_SECTORS 32
+#endif
+
 /* Event flags */
 #define EF_SIO2_INTR_REVERSE  0x00000100
 #define EF_SIO2_INTR_COMPLETE 0x00000200
@@ -45,6 +60,19 @@ static int fastDiv = 0;
 static int spi_ss = 0;
 // SIO tranfer data, only 1 transfer at a time possible
 static sio2_transfer_data_t global_td;
+// Check the CRC16 of every sector read, can be disabled with the "nocrc" argument
+static int use_crc16 = 1;
+
+#ifdef WCACHE_SECTORS
+// Write coalescing buffer, holds a run of adjacent sectors not written yet
+static u8 wcache_buffer[WCACHE_SECTORS * SECTOR_SIZE] __attribute__((aligned(64)));
+static u32 wcache_sector;
+static u16 wcache_count;
+static int wcache_enabled = 0;
+// Buffered sectors were lost with the card, reported by the next write
+static int wcache_lost    = 0;
+static int wcache_sema    = -1;
+#endif
 
 struct dma_command
 {
@@ -53,9 +81,7 @@ struct dma_command
     volatile u16 sectors_transferred; // written by isr, read by thread
     u16 sectors_reversed;
     u16 portNr;
-#ifdef CONFIG_USE_CRC16
-    u16 crc[MAX_SECTORS];
-#endif
+    u16 crc[MAX_SECTORS]; // as received, see crc16.h
     uint8_t response;
     volatile uint8_t abort; // written by thread, read by isr
 };
@@ -63,8 +89,6 @@ struct dma_command cmd;
 
 static uint8_t wait_equal(uint8_t value, int count, int portNr);
 static void sendCmd_Rx_DMA_start(uint8_t *rdBufA, int portNr);
-static inline u8 reverseByte_LUT8(u8 n);
-static inline void reverseBuffer32(u32 *buffer, u32 count);
 
 int sio2_intr_handler(void *arg)
 {
@@ -78,14 +102,9 @@ int sio2_intr_handler(void *arg)
     while ((inl_sio2_stat6c_get() & (1 << 12)) == 0)
         ;
 
-        // Finish sector read, read 2 crc bytes
-#ifdef CONFIG_USE_CRC16
-    cmd.crc[cmd.sectors_transferred] = reverseByte_LUT8(inl_sio2_data_in()) << 8;
-    cmd.crc[cmd.sectors_transferred] |= reverseByte_LUT8(inl_sio2_data_in());
-#else
-    inl_sio2_data_in();
-    inl_sio2_data_in();
-#endif
+    // Finish sector read, read 2 crc bytes
+    cmd.crc[cmd.sectors_transferred] = inl_sio2_data_in();
+    cmd.crc[cmd.sectors_transferred] |= inl_sio2_data_in() << 8;
     cmd.sectors_transferred++;
 
     if ((cmd.abort == 0) && (cmd.sectors_transferred < cmd.sector_count)) {
@@ -144,66 +163,6 @@ static inline u8 reverseByte_LUT8(u8 n)
     return reverseByte_LUT8_table[n];
 }
 
-static u32 reverseByteInWord_mask(u32 n, u32 maskF, u32 mask3, u32 mask5)
-{
-    n = ((n & (maskF << 4)) >> 4) | ((n & maskF) << 4);
-    n = ((n & (mask3 << 2)) >> 2) | ((n & mask3) << 2);
-    n = ((n & (mask5 << 1)) >> 1) | ((n & mask5) << 1);
-    return n;
-}
-
-static inline u32 reverseByteInWord(u32 n)
-{
-    return reverseByteInWord_mask(n, 0x0F0F0F0F, 0x33333333, 0x55555555);
-}
-
-/* The masks need to be defined as registers outside of the loop
- * This extra function makes sure gcc 3.2.3 generates an efficient function
- * Inner loop with 19 instructions:
-        $L38:
-            and    $2,$2,$10
-            sll    $3,$3,4
-            srl    $2,$2,4
-            or     $2,$2,$3
-            and    $4,$2,$7
-            and    $2,$2,$9
-            srl    $2,$2,2
-            sll    $4,$4,2
-            or     $2,$2,$4
-            and    $3,$2,$12
-            and    $2,$2,$5
-            srl    $2,$2,1
-            sll    $3,$3,1
-            or     $2,$2,$3
-            sw     $2,0($8)
-            addu   $8,$8,4
-            lw     $2,0($8)
-            bne    $8,$11,$L38
-            and    $3,$2,$6
-*/
-static void reverseBuffer32_mask(u32 *buffer, u32 count, u32 maskF, u32 mask3, u32 mask5)
-{
-    u32 n    = *buffer;
-    u32 *end = buffer + count;
-
-    while (buffer != end) {
-        n = ((n & (maskF << 4)) >> 4) | ((n & maskF) << 4);
-        n = ((n & (mask3 << 2)) >> 2) | ((n & mask3) << 2);
-        n = ((n & (mask5 << 1)) >> 1) | ((n & mask5) << 1);
-
-        *buffer = n;
-        buffer++;
-        n = *buffer;
-    }
-}
-
-//  7037KB/s (FAT  PS2, GCC 3.2.3, -O3)
-// 12052KB/s (slim PS2, GCC 3.2.3, -O3)
-static inline void reverseBuffer32(u32 *buffer, u32 count)
-{
-    reverseBuffer32_mask(buffer, count, 0x0F0F0F0F, 0x33333333, 0x55555555);
-}
-
 // 4194KB/s (FAT  PS2, GCC 3.2.3, -O3)
 // 3771KB/s (slim PS2, GCC 3.2.3, -O3)
 static inline void reverseBuffer8x1_LUT(u8 *buffer, u32 count)
@@ -647,19 +606,21 @@ static int _msread_do(struct block_device *bd, void *buffer, u16 count)
         if (resbits & EF_SIO2_INTR_REVERSE) {
             ClearEventFlag(event_flag, ~EF_SIO2_INTR_REVERSE);
             while (cmd.sectors_reversed < cmd.sectors_transferred && cmd.abort == 0) {
-                void *buf = (u32 *)&cmd.buffer[cmd.sectors_reversed * SECTOR_SIZE];
-                reverseBuffer32(buf, SECTOR_SIZE / 4);
-#ifdef CONFIG_USE_CRC16
-                u16 crc_a = crc16(buf, SECTOR_SIZE);
-                u16 crc_b = cmd.crc[cmd.sectors_reversed];
-                if (crc_a != crc_b) {
-                    // CRC mismatch:
-                    // - Signal ISR to stop reading
-                    // - Wait for complete event from ISR
-                    cmd.abort = 1;
-                    M_PRINTF("ERROR: crc invalid (0x%x != 0x%x) @ sector %d of %d -> 0x%x\n", crc_a, crc_b, cmd.sectors_reversed, count, (int)buffer);
+                // The ISR is already receiving the next sector while this one is processed
+                u32 *buf = (u32 *)&cmd.buffer[cmd.sectors_reversed * SECTOR_SIZE];
+                if (use_crc16) {
+                    u16 crc_a = reverseBuffer32_crc16(buf, SECTOR_SIZE / 4);
+                    u16 crc_b = cmd.crc[cmd.sectors_reversed];
+                    if (crc_a != crc_b) {
+                        // CRC mismatch:
+                        // - Signal ISR to stop reading
+                        // - Wait for complete event from ISR
+                        cmd.abort = 1;
+                        M_PRINTF("ERROR: crc invalid (0x%x != 0x%x) @ sector %d of %d -> 0x%x\n", crc_a, crc_b, cmd.sectors_reversed, count, (int)buffer);
+                    }
+                } else {
+                    reverseBuffer32(buf, SECTOR_SIZE / 4);
                 }
-#endif
                 if (cmd.abort == 0)
                     cmd.sectors_reversed++;
             }
@@ -674,20 +635,11 @@ static int _msread_do(struct block_device *bd, void *buffer, u16 count)
     return cmd.sectors_reversed;
 }
 
-/*
- * BDM interface:
- * - BDM -> "spi_sdcard" library
- */
-static int spi_sdcard_read(struct block_device *bd, u32 sector, void *buffer, u16 count)
+static int _msread(struct block_device *bd, u32 sector, void *buffer, u16 count)
 {
     int count_left = count;
     int retry_count;
 
-    // M_DEBUG("%s(%d,%d)\n", __FUNCTION__, (int)sector, (int)count);
-
-    if (count == 0)
-        return 0;
-
     sio2_lock();
 
     for (retry_count = 0; retry_count < MAX_RETRIES; retry_count++) {
@@ -744,43 +696,151 @@ static int spi_sdcard_read(struct block_device *bd, u32 sector, void *buffer, u1
     return count - count_left;
 }
 
-static int spi_sdcard_write(struct block_device *bd, u32 sector, const void *buffer, u16 count)
+static int _mswrite(u32 sector, const void *buffer, u16 count)
 {
-    int rv;
-    u16 cs;
+    int rv, retry_count;
+    u16 cs = 0;
 
-    (void)bd;
+    sio2_lock();
+
+    // All sectors with a single command
+    rv = spisd_write_multi_block(sector, buffer, count);
+    if (rv == SPISD_RESULT_OK) {
+        cs = count;
+    } else {
+        // Some sectors may have been written, but we do not know which ones:
+        // write them all again, one by one
+        M_PRINTF("ERROR: spisd_write_multi_block = %d\n", rv);
+
+        for (retry_count = 0; retry_count < MAX_RETRIES && cs < count; retry_count++) {
+            spisd_init_recovery();
+
+            while (cs < count) {
+                rv = spisd_write_block(sector + cs, (const u8 *)buffer + (cs * SECTOR_SIZE));
+                if (rv != SPISD_RESULT_OK) {
+                    M_PRINTF("ERROR: spisd_write_block = %d\n", rv);
+                    break;
+                }
+                cs++;
+            }
+        }
+    }
+
+    // Let detection thread know the card has been used succesfully
+    if (cs == count)
+        card_used = 1;
+
+    sio2_unlock();
+
+    return cs;
+}
+
+#ifdef WCACHE_SECTORS
+// Write the coalesced sectors to the card, must be called with wcache_sema held
+static int wcache_flush(void)
+{
+    int rv = 0;
+
+    if (wcache_count > 0) {
+        rv = _mswrite(wcache_sector, wcache_buffer, wcache_count);
+        if (rv != wcache_count) {
+            // Kept for a retry, they are only dropped when the card is removed
+            M_PRINTF("ERROR: failed to write %d sectors @ %d\n", wcache_count, (int)wcache_sector);
+            return -1;
+        }
+
+        wcache_count = 0;
+    }
+
+    return 0;
+}
+
+// Merge a write into the buffer, or write it, returns the number of sectors done
+static int wcache_write(u32 sector, const void *buffer, u16 count)
+{
+    int rv = 0;
+
+    WaitSema(wcache_sema);
+
+    if (wcache_lost) {
+        wcache_lost = 0;
+        rv          = -1;
+    }
+
+    // Only a write that continues the buffered run can be merged
+    if (rv >= 0 && wcache_count > 0 && (sector != wcache_sector + wcache_count || wcache_count + count > WCACHE_SECTORS))
+        rv = wcache_flush();
+
+    if (rv >= 0) {
+        if (count >= WCACHE_SECTORS) {
+            // Large enough to be efficient on its own
+            rv = _mswrite(sector, buffer, count);
+        } else {
+            if (wcache_count == 0)
+                wcache_sector = sector;
+            memcpy(&wcache_buffer[wcache_count * SECTOR_SIZE], buffer, count * SECTOR_SIZE);
+            wcache_count += count;
+            rv = count;
+        }
+    }
+
+    SignalSema(wcache_sema);
+
+    return rv;
+}
+#endif
+
+/*
+ * BDM interface:
+ * - BDM -> "spi_sdcard" library
+ */
+static int spi_sdcard_read(struct block_device *bd, u32 sector, void *buffer, u16 count)
+{
+    int rv;
 
     // M_DEBUG("%s(%d,%d)\n", __FUNCTION__, (int)sector, (int)count);
 
     if (count == 0)
         return 0;
 
-    sio2_lock();
+#ifdef WCACHE_SECTORS
+    WaitSema(wcache_sema);
 
-#if 1
-    for (cs = 0; cs < count; cs++) {
-        rv = spisd_write_block(sector + cs, buffer);
-        if (rv != SPISD_RESULT_OK) {
-            M_PRINTF("ERROR: spisd_write_block = %d\n", rv);
-            sio2_unlock();
-            return 0;
-        }
-        buffer = (const u8*)buffer + 512;
-    }
+    // Sectors still in the write buffer are read from the card, the card would return old data if they can't be written
+    if (wcache_count > 0 && sector < wcache_sector + wcache_count && wcache_sector < sector + count && wcache_flush() < 0)
+        rv = 0;
+    else
+        rv = _msread(bd, sector, buffer, count);
+
+    SignalSema(wcache_sema);
 #else
-    rv = spisd_write_multi_block(sector, buffer, count);
-    if (rv != SPISD_RESULT_OK) {
-        M_PRINTF("ERROR: spisd_write_multi_block = %d\n", rv);
-        sio2_unlock();
-        return 0;
-    }
+    rv = _msread(bd, sector, buffer, count);
 #endif
 
-    // Let detection thread know the card has been used succesfully
-    card_used = 1;
+    return rv;
+}
 
-    sio2_unlock();
+static int spi_sdcard_write(struct block_device *bd, u32 sector, const void *buffer, u16 count)
+{
+    int rv;
+
+    (void)bd;
+
+    // M_DEBUG("%s(%d,%d)\n", __FUNCTION__, (int)sector, (int)count);
+
+    if (count == 0)
+        return 0;
+
+#ifdef WCACHE_SECTORS
+    if (wcache_enabled)
+        rv = wcache_write(sector, buffer, count);
+    else
+#endif
+        rv = _mswrite(sector, buffer, count);
+
+    // All or nothing, the caller can not tell which sectors of a failed write reached the card
+    if (rv != count)
+        return 0;
 
     return count;
 }
@@ -791,6 +851,12 @@ static void spi_sdcard_flush(struct block_device *bd)
 
     // M_DEBUG("%s\n", __FUNCTION__);
 
+#ifdef WCACHE_SECTORS
+    WaitSema(wcache_sema);
+    wcache_flush();
+    SignalSema(wcache_sema);
+#endif
+
     return;
 }
 
@@ -800,6 +866,12 @@ static int spi_sdcard_stop(struct block_device *bd)
 
     // M_DEBUG("%s\n", __FUNCTION__);
 
+#ifdef WCACHE_SECTORS
+    WaitSema(wcache_sema);
+    wcache_flush();
+    SignalSema(wcache_sema);
+#endif
+
     return 0;
 }
 
@@ -878,6 +950,17 @@ static void sd_detect()
         M_PRINTF("card removal detected\n");
         card_inserted = 0;
 
+#ifdef WCACHE_SECTORS
+        // Never write them to the next card
+        WaitSema(wcache_sema);
+        if (wcache_count > 0) {
+            M_PRINTF("ERROR: %d buffered sectors @ %d lost\n", wcache_count, (int)wcache_sector);
+            wcache_count = 0;
+            wcache_lost  = 1;
+        }
+        SignalSema(wcache_sema);
+#endif
+
         // Disconnect from block device manager
         bdm_disconnect_bd(&bd);
     }
@@ -896,6 +979,15 @@ static void sd_detect_thread(void *arg)
 
         M_DEBUG("Check card, inserted=%d, used=%d\n", card_inserted, card_used);
 
+#ifdef WCACHE_SECTORS
+        // Write back sectors that have been waiting for a second or more
+        if (card_used == 0) {
+            WaitSema(wcache_sema);
+            wcache_flush();
+            SignalSema(wcache_sema);
+        }
+#endif
+
         // Detect card if it has not been used recently
         if (card_used == 0)
             sd_detect();
@@ -917,13 +1009,24 @@ int module_start(int argc, char *argv[])
     int i;
 
     M_PRINTF("Starting module\n");
-    for (i = 0; i < argc; i++)
+    for (i = 0; i < argc; i++) {
         M_PRINTF(" - argv[%d] = %s\n", i, argv[i]);
+
+        // Merge adjacent writes, reporting them done before they reach the card
+        if (strcmp(argv[i], "wcache") == 0)
+            wcache_enabled = 1;
+        // Do not check the CRC16 of sectors read, a little faster
+        else if (strcmp(argv[i], "nocrc") == 0)
+            use_crc16 = 0;
+    }
 #else
     (void)argc;
     (void)argv;
 #endif
 
+    if (use_crc16)
+        crc16_generate_table();
+
     // Create default tranfer descriptor
     _init_td(&global_td, PORT_NR);
 
@@ -937,6 +1040,22 @@ int module_start(int argc, char *argv[])
         goto error1;
     }
 
+#ifdef WCACHE_SECTORS
+    {
+        iop_sema_t sema;
+
+        sema.attr    = 0;
+        sema.option  = 0;
+        sema.initial = 1;
+        sema.max     = 1;
+        rv = wcache_sema = CreateSema(&sema);
+        if (rv < 0) {
+            M_PRINTF("ERROR: CreateSema returned %d\n", rv);
+            goto error2;
+        }
+    }
+#endif
+
     rv = sio2man_hook_init();
     if (rv < 0) {
         M_PRINTF("ERROR: sio2man_hook_init returned %d\n", rv);
@@ -996,6 +1115,10 @@ error4:
 error3:
     sio2man_hook_deinit();
 error2:
+#ifdef WCACHE_SECTORS
+    if (wcache_sema >= 0)
+        DeleteSema(wcache_sema);
+#endif
     DeleteEventFlag(event_flag);
 error1:
     return MODULE_NO_RESIDENT_END;
@@ -1014,8 +1137,18 @@ int module_stop(int argc, char *argv[])
     (void)argv;
 #endif
 
+#ifdef WCACHE_SECTORS
+    // Write back what is still buffered, while the card is still ours
+    WaitSema(wcache_sema);
+    wcache_flush();
+    SignalSema(wcache_sema);
+#endif
+
     DeleteThread(sd_detect_thread_id);
     sio2man_hook_deinit();
+#ifdef WCACHE_SECTORS
+    DeleteSema(wcache_sema);
+#endif
     DeleteEventFlag(event_flag);
 
     return MODULE_NO_RESIDENT_END;
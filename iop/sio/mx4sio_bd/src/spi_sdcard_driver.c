@@ -521,18 +521,36 @@ spisd_result_t spisd_read_multi_block_end(void)
     return SPISD_RESULT_OK;
 }
 
+static spisd_result_t _wait_not_busy(void)
+{
+    uint32_t i;
+
+    /* The card holds the data line low while it is programming */
+    for (i = 0; i < 0x40000; i++) {
+        if (_io->wr_rd_byte(DUMMY_BYTE) == 0xFF) {
+            return SPISD_RESULT_OK;
+        }
+    }
+
+    return SPISD_RESULT_TIMEOUT;
+}
+
 spisd_result_t spisd_write_multi_block(uint32_t sector, uint8_t const *buffer, uint32_t num_sectors)
 {
-    uint32_t i, j;
+    uint32_t i;
+    spisd_result_t ret = SPISD_RESULT_OK;
+
     /* if ver = SD2.0 HC, sector need <<9 */
     if (_card_type != CARD_TYPE_SDV2HC) {
         sector = sector << 9;
     }
 
-    /* Send command ACMD23 berfore multi write if is not a MMC card */
+    /* Pre-erase hint: ACMD23 tells an SD card how many blocks will follow.
+     * Not supported by MMC cards, and not fatal if the card rejects it. */
     if (_card_type != CARD_TYPE_MMC) {
-        _send_command(CMD55, 0);
-        _send_command(ACMD23, num_sectors);
+        if (_send_command(CMD55, 0) == 0x00) {
+            _send_command(ACMD23, num_sectors);
+        }
     }
 
     if (_send_command(CMD25, sector) != 0x00) {
@@ -555,49 +573,31 @@ spisd_result_t spisd_write_multi_block(uint32_t sector, uint8_t const *buffer, u
         _io->wr_rd_byte(DUMMY_BYTE);
         _io->wr_rd_byte(DUMMY_BYTE);
 
-        /* MSD card accept the data */
+        /* Data response token: 0x05 accepted, 0x0B CRC error, 0x0D write error */
         if ((_io->wr_rd_byte(DUMMY_BYTE) & 0x1F) != 0x05) {
-            _io->relese();
-            _io->wr_rd_byte(DUMMY_BYTE);
-            return SPISD_RESULT_ERROR;
+            ret = SPISD_RESULT_ERROR;
+            break;
         }
 
-        /* Wait all the data programm finished    */
-        uint32_t timeout = 0;
-
-        while (_io->wr_rd_byte(DUMMY_BYTE) != 0xFF) {
-            /* Timeout return */
-            if (timeout++ == 0x40000) {
-                _io->relese();
-                _io->wr_rd_byte(DUMMY_BYTE);
-                return SPISD_RESULT_ERROR;
-            }
+        /* Wait all the data programm finished */
+        if (_wait_not_busy() != SPISD_RESULT_OK) {
+            ret = SPISD_RESULT_TIMEOUT;
+            break;
         }
     }
 
-    /* Send end of transmit token: 0xFD */
-    if (_io->wr_rd_byte(0xFD) != 0x00) {
-
-        _io->wr_rd_byte(DUMMY_BYTE);
-        _io->wr_rd_byte(DUMMY_BYTE);
+    /* Send stop transmission token: 0xFD, also after an error, so the card
+     * leaves the receive-data state. It is followed by a stuff byte, and
+     * the card goes busy while it programs the last block. */
+    _io->wr_rd_byte(0xFD);
+    _io->wr_rd_byte(DUMMY_BYTE);
 
-        /* Wait all the data programm finished */
-        for (i = 0; i < 0x40000; i++) {
-            if (_io->wr_rd_byte(DUMMY_BYTE) == 0xFF) {
-                _io->relese();
-                _io->wr_rd_byte(DUMMY_BYTE);
-
-                for (j = 0; j < 0x40000; j++) {
-                    if (_io->wr_rd_byte(DUMMY_BYTE) == 0xFF) {
-                        return SPISD_RESULT_OK;
-                    }
-                }
-            }
-        }
+    if (_wait_not_busy() != SPISD_RESULT_OK && ret == SPISD_RESULT_OK) {
+        ret = SPISD_RESULT_TIMEOUT;
     }
 
     _io->relese();
     _io->wr_rd_byte(DUMMY_BYTE);
 
-    return SPISD_RESULT_ERROR;
+    return ret;
 }
@@ -52,8 +52,42 @@
 #define AUDSRV_AVAILABLE            0x001a
 #define AUDSRV_QUEUED               0x001b
 
+/** mixed stream functions */
+#define AUDSRV_STREAM_OPEN          0x001c
+#define AUDSRV_STREAM_CLOSE         0x001d
+#define AUDSRV_STREAM_PLAY          0x001e
+#define AUDSRV_STREAM_WAIT          0x001f
+#define AUDSRV_STREAM_SET_VOLUME    0x0020
+#define AUDSRV_STREAM_AVAILABLE     0x0021
+#define AUDSRV_STREAM_QUEUED        0x0022
+
+/** zero-copy ring functions */
+#define AUDSRV_RING_OPEN            0x0023
+#define AUDSRV_RING_CLOSE           0x0024
+
 #define AUDSRV_FILLBUF_CALLBACK     0x0001
 #define AUDSRV_CDDA_CALLBACK        0x0002
+#define AUDSRV_RING_CALLBACK        0x0003
+
+/** Ring control block of a stream on the IOP, written by the EE with SIF DMA */
+typedef struct audsrv_ring_ctl_t
+{
+	/** the audio before this position is ready to play */
+	int writepos;
+	/** bumped by the EE when it waits for space */
+	int wait_seq;
+	/** space the EE waits for, in bytes */
+	int wait_bytes;
+	int reserved;
+} audsrv_ring_ctl_t;
+
+/** Ring status of a stream on the EE, written by the IOP with SIF DMA */
+typedef struct audsrv_ring_status_t
+{
+	/** the audio before this position has been played */
+	int readpos;
+	int reserved[3];
+} audsrv_ring_status_t;
 
 /* error codes */
 #define AUDSRV_ERR_NOERROR                 0x0000
@@ -78,6 +112,15 @@ int audsrv_set_volume(int vol);
 int audsrv_available();
 int audsrv_queued();
 
+/* mixed stream functions */
+int audsrv_stream_open(int freq, int bits, int channels);
+int audsrv_stream_close(int id);
+int audsrv_stream_play(int id, const char *buf, int buflen);
+int audsrv_stream_wait(int id, int buflen);
+int audsrv_stream_set_volume(int id, int vol);
+int audsrv_stream_available(int id);
+int audsrv_stream_queued(int id);
+
 /* cdda playing functions */
 int audsrv_play_cd(int track);
 int audsrv_stop_cd();
@@ -135,4 +178,13 @@ int audsrv_ch_play_adpcm(int ch, u32 id);
 #define I_audsrv_available         DECLARE_IMPORT(28, audsrv_available)
 #define I_audsrv_queued            DECLARE_IMPORT(29, audsrv_queued)
 
+/* mixed stream functions */
+#define I_audsrv_stream_open           DECLARE_IMPORT(30, audsrv_stream_open)
+#define I_audsrv_stream_close          DECLARE_IMPORT(31, audsrv_stream_close)
+#define I_audsrv_stream_play           DECLARE_IMPORT(32, audsrv_stream_play)
+#define I_audsrv_stream_wait           DECLARE_IMPORT(33, audsrv_stream_wait)
+#define I_audsrv_stream_set_volume     DECLARE_IMPORT(34, audsrv_stream_set_volume)
+#define I_audsrv_stream_available      DECLARE_IMPORT(35, audsrv_stream_available)
+#define I_audsrv_stream_queued         DECLARE_IMPORT(36, audsrv_stream_queued)
+
 #endif /* __AUDSRV_H__ */
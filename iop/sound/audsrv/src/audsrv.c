@@ -19,6 +19,7 @@
 #include <sysmem.h>
 #include <intrman.h>
 #include <sifcmd.h>
+#include <sifman.h>
 #include <libsd.h>
 #include <sysclib.h>
 
@@ -28,41 +29,81 @@
 #include "rpc_server.h"
 #include "rpc_client.h"
 #include "upsamplers.h"
+#include "resampler.h"
 #include "hw.h"
 #include "spu.h"
 
 #define MODNAME "audsrv"
-#define VERSION "0.93"
+#define VERSION "0.94"
 IRX_ID(MODNAME, 1, 4);
 
+/** PCM stream, mixed into core1 with the other streams */
+typedef struct stream_t
+{
+	/** slot is in use */
+	int used;
+	/** playing (not mute) status */
+	int playing;
+	/** mixing volume [0 .. MAX_VOLUME] */
+	int volume;
+
+	/** frequency set by user */
+	int freq;
+	/** bits per sample, set by user */
+	int bits;
+	/** number of audio channels */
+	int channels;
+	/** shift count from bytes to samples */
+	int sample_shift;
+	/** boolean to notify when format has changed */
+	int format_changed;
+
+	/** ring buffer itself */
+	char *ringbuf;
+	/** size of ring buffer in bytes */
+	int ringbuf_size;
+	/** reading head pointer */
+	int readpos;
+	/** writing head pointer */
+	int writepos;
+
+	/** table-driven upsampler, if there is one for the format */
+	upsampler_t upsampler;
+	/** polyphase resampler, used for all other formats */
+	struct resampler_t resampler;
+	/** boolean, use the resampler rather than the upsampler */
+	int resample;
+
+	/** zero-copy ring mode, the EE writes into ringbuf (see audsrv_ring_open()) */
+	int ring;
+	/** EE address of the ring status */
+	void *ring_ee_status;
+	/** SIF DMA of the ring status */
+	int ring_dma;
+	/** last wait of the EE that was answered */
+	int ring_notified;
+} stream_t;
+
 /* globals */
 /** core1 (sfx) volume */
 static int core1_volume = MAX_VOLUME;
-/** frequency set by user */
-static int core1_freq = 0;
-/** bits per sample, set by user */
-static int core1_bits = 0;
-/** number of audio channels */
-static int core1_channels = 0;
-/** shift count from bytes to samples */
-static int core1_sample_shift = 0;
+/** use the resampler for every frequency but 48000hz */
+static int resample_all = 0;
 
 /* status */
 /** initialization status */
 static int initialized = 0;
-/** playing (not mute) status */
-static int playing = 0;
 
+/** streams; the first one is driven by the single-stream functions */
+static stream_t streams[AUDSRV_MAX_STREAMS];
+
+/** ring buffer of the first stream; the others allocate theirs */
+static char ringbuf[AUDSRV_RINGBUF_SIZE] __attribute__((aligned (64)));
 
-/* ring buffer properties */
-/** ring buffer itself */
-static char ringbuf[20480];
-/** size of ring buffer in bytes */
-static int ringbuf_size = sizeof(ringbuf);
-/** reading head pointer */
-static int readpos;
-/** writing head pointer */
-static int writepos;
+/** ring control blocks of the streams, written by the EE */
+static audsrv_ring_ctl_t ring_ctl[AUDSRV_MAX_STREAMS] __attribute__((aligned (16)));
+/** ring status of the streams, sent to the EE */
+static audsrv_ring_status_t ring_status[AUDSRV_MAX_STREAMS] __attribute__((aligned (16)));
 
 /** playing thread id */
 static int play_tid = 0;
@@ -73,15 +114,16 @@ static int transfer_sema = 0;
 /** threshold to initiate a callback */
 static int fillbuf_threshold = 0;
 
-/** boolean to notify when format has changed */
-static int format_changed = 0;
-
 /** double buffer for streaming */
 static u8 core1_buf[0x1000] __attribute__((aligned (64)));
 
 static short rendered_left [ 512 ];
 static short rendered_right[ 512 ];
 
+/** render buffers of the streams mixed into the first one */
+static short mix_left [ 512 ];
+static short mix_right[ 512 ];
+
 /** exports table */
 extern struct irx_export_table _exp_audsrv;
 
@@ -103,6 +145,36 @@ static int transfer_complete(void *arg)
 	return 1;
 }
 
+/** Returns true if any of the streams is playing */
+static int any_playing()
+{
+	int i;
+
+	for (i=0; i<AUDSRV_MAX_STREAMS; i++)
+	{
+		if (streams[i].used && streams[i].playing)
+		{
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/** Returns a stream, if the id refers to one in use
+ * @param id    stream id, 0 for the first stream
+ * @returns stream, NULL if not in use
+ */
+static stream_t *get_stream(int id)
+{
+	if (id < 0 || id >= AUDSRV_MAX_STREAMS || !streams[id].used)
+	{
+		return NULL;
+	}
+
+	return &streams[id];
+}
+
 /** Apply volume changes, or keep mute if not playing */
 static void update_volume()
 {
@@ -117,7 +189,7 @@ static void update_volume()
 	sceSdSetParam(SD_CORE_0 | SD_PARAM_BVOLR, 0);
 
 	/* core1 input */
-	vol = playing ? core1_volume : 0;
+	vol = any_playing() ? core1_volume : 0;
 	sceSdSetParam(SD_CORE_1 | SD_PARAM_BVOLL, vol);
 	sceSdSetParam(SD_CORE_1 | SD_PARAM_BVOLR, vol);
 
@@ -138,7 +210,7 @@ static void update_volume()
 int audsrv_stop_audio()
 {
 	/* audio is still playing, just mute */
-	playing = 0;
+	streams[0].playing = 0;
 	update_volume();
 	fillbuf_threshold = 0;
 
@@ -159,6 +231,11 @@ int audsrv_format_ok(int freq, int bits, int channels)
 		return 1;
 	}
 
+	if (resampler_format_ok(freq, bits, channels))
+	{
+		return 1;
+	}
+
 	/* unsupported format */
 	return 0;
 }
@@ -174,7 +251,7 @@ int audsrv_format_ok(int freq, int bits, int channels)
  * change the format at any point. You might want to stop audio prior
  * to that, to prevent mismatched audio output.
  */
-int audsrv_set_format(int freq, int bits, int channels)
+static int stream_set_format(stream_t *s, int freq, int bits, int channels)
 {
 	int feed_size;
 
@@ -184,34 +261,66 @@ int audsrv_set_format(int freq, int bits, int channels)
 	}
 
 	/* update shift-right count */
-	core1_sample_shift = 0;
+	s->sample_shift = 0;
 	if (bits == 16)
 	{
-		core1_sample_shift++;
+		s->sample_shift++;
 	}
 
 	if (channels == 2)
 	{
-		core1_sample_shift++;
+		s->sample_shift++;
 	}
 
-	core1_freq = freq;
-	core1_bits = bits;
-	core1_channels = channels;
+	s->freq = freq;
+	s->bits = bits;
+	s->channels = channels;
+
+	/* the ring of the EE no longer matches */
+	s->ring = 0;
 
 	/* set ring buffer size to 10 iterations worth of data (~50 ms) */
-	feed_size = ((512 * core1_freq) / 48000) << core1_sample_shift;
-	ringbuf_size = feed_size * 10;
+	feed_size = ((512 * s->freq) / 48000) << s->sample_shift;
+	s->ringbuf_size = feed_size * 10;
 
-	writepos = 0;
-	readpos = (feed_size * 5) & ~3;
+	s->writepos = 0;
+	s->readpos = (feed_size * 5) & ~3;
 
-	printf("audsrv: freq %d bits %d channels %d ringbuf_sz %d feed_size %d shift %d\n", freq, bits, channels, ringbuf_size, feed_size, core1_sample_shift);
+	printf("audsrv: freq %d bits %d channels %d ringbuf_sz %d feed_size %d shift %d\n", freq, bits, channels, s->ringbuf_size, feed_size, s->sample_shift);
 
-	format_changed = 1;
+	s->format_changed = 1;
 	return AUDSRV_ERR_NOERROR;
 }
 
+int audsrv_set_format(int freq, int bits, int channels)
+{
+	return stream_set_format(&streams[0], freq, bits, channels);
+}
+
+/** Selects the converter of a stream, after its format has changed
+ * @param s     stream
+ *
+ * The table-driven upsamplers are cheap, and used wherever there is one
+ * for the format, unless the resampler was requested for all of them.
+ */
+static void stream_update_converter(stream_t *s)
+{
+	s->upsampler = NULL;
+	s->resample = 0;
+
+	if (!resample_all || s->freq == 48000)
+	{
+		s->upsampler = find_upsampler(s->freq, s->bits, s->channels);
+	}
+
+	if (s->upsampler == NULL && resampler_init(&s->resampler, s->freq, s->bits, s->channels) == 0)
+	{
+		s->resample = 1;
+	}
+
+	s->format_changed = 0;
+}
+
 /** Initializes audsrv library
  * @returns 0 on success
  */
@@ -229,8 +338,10 @@ int audsrv_init()
 		return -1;
 	}
 
-	readpos = 0;
-	writepos = 0;
+	memset(streams, 0, sizeof(streams));
+	streams[0].ringbuf = ringbuf;
+	streams[0].volume = MAX_VOLUME;
+	streams[0].used = 1;
 
 	/* initialize transfer_complete's semaphore */
 	transfer_sema = CreateMutex(0);
@@ -274,35 +385,45 @@ int audsrv_init()
  * is the total bytes that can be queued, without collision of the reading
  * head with the writing head.
  */
-int audsrv_available()
+static int stream_available(stream_t *s)
 {
-	if (writepos <= readpos)
+	if (s->writepos <= s->readpos)
 	{
-		return readpos - writepos;
+		return s->readpos - s->writepos;
 	}
 	else
 	{
-		return (ringbuf_size - (writepos - readpos));
+		return (s->ringbuf_size - (s->writepos - s->readpos));
 	}
 }
 
+int audsrv_available()
+{
+	return stream_available(&streams[0]);
+}
+
 /** Returns the number of bytes already in queue
  * @returns byte count
 
  * Returns the number of bytes that are already in the ring buffer.
  */
-int audsrv_queued()
+static int stream_queued(stream_t *s)
 {
-	if (writepos < readpos)
+	if (s->writepos < s->readpos)
 	{
-		return (ringbuf_size - (readpos - writepos));
+		return (s->ringbuf_size - (s->readpos - s->writepos));
 	}
 	else
 	{
-		return writepos - readpos;
+		return s->writepos - s->readpos;
 	}
 }
 
+int audsrv_queued()
+{
+	return stream_queued(&streams[0]);
+}
+
 /** Blocks until there is enough space to enqueue chunk
  * @param buflen   size of chunk requested to be enqueued (in bytes)
  * @returns error status code
@@ -310,9 +431,9 @@ int audsrv_queued()
  * Blocks until there are enough space to store the upcoming chunk
  * in audsrv's internal ring buffer.
  */
-int audsrv_wait_audio(int buflen)
+static int stream_wait(stream_t *s, int buflen)
 {
-	if (ringbuf_size < buflen)
+	if (s->ringbuf_size < buflen)
 	{
 		/* this will never happen */
 		return AUDSRV_ERR_ARGS;
@@ -320,7 +441,7 @@ int audsrv_wait_audio(int buflen)
 
 	while (1)
 	{
-		if (audsrv_available() >= buflen)
+		if (stream_available(s) >= buflen)
 		{
 			/* enough space! */
 			return AUDSRV_ERR_NOERROR;
@@ -330,6 +451,11 @@ int audsrv_wait_audio(int buflen)
 	}
 }
 
+int audsrv_wait_audio(int buflen)
+{
+	return stream_wait(&streams[0], buflen);
+}
+
 /** Uploads audio buffer to SPU
  * @param buf     audio chunk
  * @param buflen  size of chunk in bytes
@@ -340,51 +466,56 @@ int audsrv_wait_audio(int buflen)
  * interfering with fluent streaming. The buffer and buflen are given
  * in host format (i.e, 11025hz 8bit stereo.)
  */
-int audsrv_play_audio(const char *buf, int buflen)
+static int stream_play(stream_t *s, const char *buf, int buflen)
 {
 	int sent = 0;
 
-	if (initialized == 0)
-	{
-		return -AUDSRV_ERR_NOT_INITIALIZED;
-	}
-
-	if (playing == 0)
+	if (s->playing == 0)
 	{
 		/* audio is always playing, just change the volume */
-		playing = 1;
+		s->playing = 1;
 		update_volume();
 	}
 
-	//printf("play audio %d bytes, readpos %d, writepos %d avail %d\n", buflen, readpos, writepos, audsrv_available());
+	//printf("play audio %d bytes, readpos %d, writepos %d avail %d\n", buflen, s->readpos, s->writepos, stream_available(s));
 
 	/* limit to what's available, no crossing possible */
-	buflen = MIN(buflen, audsrv_available());
+	buflen = MIN(buflen, stream_available(s));
 
 	while (buflen > 0)
 	{
 		int copy = buflen;
-		if (writepos >= readpos)
+		if (s->writepos >= s->readpos)
 		{
-			copy = MIN(ringbuf_size - writepos, buflen);
+			copy = MIN(s->ringbuf_size - s->writepos, buflen);
 		}
 
-		memcpy(ringbuf + writepos, buf, copy);
+		memcpy(s->ringbuf + s->writepos, buf, copy);
 		buf = buf + copy;
 		buflen = buflen - copy;
 		sent = sent + copy;
 
-		writepos = writepos + copy;
-		if (writepos >= ringbuf_size)
+		s->writepos = s->writepos + copy;
+		if (s->writepos >= s->ringbuf_size)
 		{
 			/* rewind */
-			writepos = 0;
+			s->writepos = 0;
 		}
 	}
 
 	return sent;
 }
 
+int audsrv_play_audio(const char *buf, int buflen)
+{
+	if (initialized == 0)
+	{
+		return -AUDSRV_ERR_NOT_INITIALIZED;
+	}
+
+	return stream_play(&streams[0], buf, buflen);
+}
+
 /** Sets output volume
  * @param vol      volume in SPU2 units [0 .. 0x3fff]
  * @returns 0 on success, negative otherwise
@@ -404,7 +535,7 @@ int audsrv_set_volume(int vol)
 
 int audsrv_set_threshold(int amount)
 {
-	if (amount > (ringbuf_size / 2))
+	if (amount > (streams[0].ringbuf_size / 2))
 	{
 		/* amount is greater than what we'd recommend */
 		return AUDSRV_ERR_ARGS;
@@ -415,6 +546,380 @@ int audsrv_set_threshold(int amount)
 	return 0;
 }
 
+/** Opens an additional PCM stream
+ * @param freq     frequency in hz
+ * @param bits     bits per sample (8, 16)
+ * @param channels number of channels
+ * @returns stream id on success, negative error status otherwise
+ *
+ * All streams are converted to SPU2's native format and mixed together
+ * into core1, so that several producers can play at once. The stream
+ * with id 0 is always open, and is the one the single-stream functions
+ * (audsrv_play_audio() and friends) use.
+ */
+int audsrv_stream_open(int freq, int bits, int channels)
+{
+	int id, ret;
+	stream_t *s;
+
+	if (initialized == 0)
+	{
+		return -AUDSRV_ERR_NOT_INITIALIZED;
+	}
+
+	for (id=1; id<AUDSRV_MAX_STREAMS; id++)
+	{
+		if (!streams[id].used)
+		{
+			break;
+		}
+	}
+
+	if (id >= AUDSRV_MAX_STREAMS)
+	{
+		return -AUDSRV_ERR_NO_MORE_CHANNELS;
+	}
+
+	s = &streams[id];
+	memset(s, 0, sizeof(stream_t));
+	s->volume = MAX_VOLUME;
+
+	ret = stream_set_format(s, freq, bits, channels);
+	if (ret < 0)
+	{
+		return ret;
+	}
+
+	s->ringbuf = AllocSysMemory(ALLOC_FIRST, AUDSRV_RINGBUF_SIZE, NULL);
+	if (s->ringbuf == NULL)
+	{
+		return -AUDSRV_ERR_OUT_OF_MEMORY;
+	}
+
+	/* the play thread picks the stream up from here */
+	s->used = 1;
+	return id;
+}
+
+/** Closes a stream opened with audsrv_stream_open()
+ * @param id       stream id
+ * @returns 0 on success, negative error status otherwise
+ */
+int audsrv_stream_close(int id)
+{
+	stream_t *s;
+
+	s = get_stream(id);
+	if (s == NULL || id == 0)
+	{
+		return -AUDSRV_ERR_ARGS;
+	}
+
+	s->used = 0;
+	s->playing = 0;
+	s->ring = 0;
+	update_volume();
+
+	FreeSysMemory(s->ringbuf);
+	s->ringbuf = NULL;
+	return AUDSRV_ERR_NOERROR;
+}
+
+/** Queues audio on a stream, see audsrv_play_audio()
+ * @param id       stream id
+ * @param buf      audio chunk
+ * @param buflen   size of chunk in bytes
+ * @returns positive number of bytes queued or negative error status
+ */
+int audsrv_stream_play(int id, const char *buf, int buflen)
+{
+	stream_t *s;
+
+	if (initialized == 0)
+	{
+		return -AUDSRV_ERR_NOT_INITIALIZED;
+	}
+
+	s = get_stream(id);
+	if (s == NULL)
+	{
+		return -AUDSRV_ERR_ARGS;
+	}
+
+	return stream_play(s, buf, buflen);
+}
+
+/** Blocks until a chunk can be queued on a stream, see audsrv_wait_audio()
+ * @param id       stream id
+ * @param buflen   size of chunk requested to be enqueued (in bytes)
+ * @returns error status code
+ */
+int audsrv_stream_wait(int id, int buflen)
+{
+	stream_t *s;
+
+	s = get_stream(id);
+	if (s == NULL)
+	{
+		return -AUDSRV_ERR_ARGS;
+	}
+
+	return stream_wait(s, buflen);
+}
+
+/** Sets the mixing volume of a stream
+ * @param id       stream id
+ * @param vol      volume in SPU2 units [0 .. 0x3fff]
+ * @returns 0 on success, negative otherwise
+ *
+ * This scales the samples of the stream before mixing; the output volume
+ * set with audsrv_set_volume() applies to the mix.
+ */
+int audsrv_stream_set_volume(int id, int vol)
+{
+	stream_t *s;
+
+	s = get_stream(id);
+	if (s == NULL || vol < 0 || vol > MAX_VOLUME)
+	{
+		return -AUDSRV_ERR_ARGS;
+	}
+
+	s->volume = vol;
+	return AUDSRV_ERR_NOERROR;
+}
+
+/** Returns the number of bytes that can be queued on a stream
+ * @param id       stream id
+ * @returns byte count, negative error status if there is no such stream
+ */
+int audsrv_stream_available(int id)
+{
+	stream_t *s;
+
+	s = get_stream(id);
+	if (s == NULL)
+	{
+		return -AUDSRV_ERR_ARGS;
+	}
+
+	return stream_available(s);
+}
+
+/** Returns the number of bytes already queued on a stream
+ * @param id       stream id
+ * @returns byte count, negative error status if there is no such stream
+ */
+int audsrv_stream_queued(int id)
+{
+	stream_t *s;
+
+	s = get_stream(id);
+	if (s == NULL)
+	{
+		return -AUDSRV_ERR_ARGS;
+	}
+
+	return stream_queued(s);
+}
+
+/** Switches a stream to zero-copy ring mode
+ * @param id        stream id
+ * @param ee_status EE address of the stream's audsrv_ring_status_t, 16-byte aligned
+ * @param info      ring buffer address, ring size, control block address, read and write positions,
+ *                  then the 16 bytes of the qword the write position is in are stored here
+ * @returns 0 on success, negative error status otherwise
+ *
+ * In ring mode, the EE keeps a copy of the ring of the stream and sends
+ * what it writes there straight into ringbuf with SIF DMA, followed by
+ * the control block with the new write position; no RPC is involved.
+ * The play thread sends the read position back after every block, and
+ * calls the EE back once the space the EE waits for is available.
+ * Changing the format of the stream ends ring mode.
+ */
+int audsrv_ring_open(int id, void *ee_status, unsigned int *info)
+{
+	stream_t *s;
+
+	if (initialized == 0)
+	{
+		return -AUDSRV_ERR_NOT_INITIALIZED;
+	}
+
+	s = get_stream(id);
+	if (s == NULL || ee_status == NULL || ((u32)ee_status & 15) != 0)
+	{
+		return -AUDSRV_ERR_ARGS;
+	}
+
+	s->ring = 0;
+
+	/* the status DMA of a previous ring may still be running */
+	while (sceSifDmaStat(s->ring_dma) >= 0);
+
+	ring_ctl[id].writepos = s->writepos;
+	ring_ctl[id].wait_seq = 0;
+	ring_ctl[id].wait_bytes = 0;
+	s->ring_ee_status = ee_status;
+	s->ring_dma = 0;
+	s->ring_notified = 0;
+
+	info[0] = (u32)s->ringbuf;
+	info[1] = s->ringbuf_size;
+	info[2] = (u32)&ring_ctl[id];
+	info[3] = s->readpos;
+	info[4] = s->writepos;
+	/* pushes are whole qwords, so the EE resends the queued bytes before the write position */
+	memcpy(&info[5], s->ringbuf + (s->writepos & ~15), 16);
+
+	/* the play thread picks the ring up from here */
+	s->ring = 1;
+	return AUDSRV_ERR_NOERROR;
+}
+
+/** Switches a stream back to RPC submission
+ * @param id        stream id
+ * @returns 0 on success, negative error status otherwise
+ */
+int audsrv_ring_close(int id)
+{
+	stream_t *s;
+
+	s = get_stream(id);
+	if (s == NULL)
+	{
+		return -AUDSRV_ERR_ARGS;
+	}
+
+	s->ring = 0;
+	return AUDSRV_ERR_NOERROR;
+}
+
+/** Picks up the audio the EE committed to a ring stream
+ * @param s     stream
+ * @param ctl   control block of the stream
+ */
+static void ring_fetch(stream_t *s, volatile audsrv_ring_ctl_t *ctl)
+{
+	int writepos = ctl->writepos;
+
+	if (writepos != s->writepos)
+	{
+		s->writepos = writepos;
+
+		if (s->playing == 0)
+		{
+			/* audio is always playing, just change the volume */
+			s->playing = 1;
+			update_volume();
+		}
+	}
+}
+
+/** Sends the read position of a ring stream to the EE
+ * @param s     stream
+ * @param id    stream id
+ * @returns true if the EE waits for space, and there is enough now
+ */
+static int ring_send_status(stream_t *s, int id)
+{
+	volatile audsrv_ring_ctl_t *ctl = &ring_ctl[id];
+	SifDmaTransfer_t dmat;
+	int intr_state, wait_seq;
+
+	if (sceSifDmaStat(s->ring_dma) >= 0)
+	{
+		/* the previous status is still on its way, the next block sends this one */
+		return 0;
+	}
+
+	ring_status[id].readpos = s->readpos;
+
+	dmat.src = &ring_status[id];
+	dmat.dest = s->ring_ee_status;
+	dmat.size = sizeof(audsrv_ring_status_t);
+	dmat.attr = 0;
+
+	CpuSuspendIntr(&intr_state);
+	s->ring_dma = sceSifSetDma(&dmat, 1);
+	CpuResumeIntr(intr_state);
+
+	wait_seq = ctl->wait_seq;
+	if (wait_seq != s->ring_notified && stream_available(s) >= ctl->wait_bytes)
+	{
+		s->ring_notified = wait_seq;
+		return 1;
+	}
+
+	return 0;
+}
+
+/** Converts the next block of a stream to SPU2's native format
+ * @param s       stream
+ * @param left    512 left samples are stored here
+ * @param right   512 right samples are stored here
+ */
+static void render_stream(stream_t *s, short *left, short *right)
+{
+	struct upsample_t up;
+
+	if (s->resample)
+	{
+		s->readpos += resampler_render(&s->resampler, (const unsigned char *)s->ringbuf, s->ringbuf_size, s->readpos, left, right);
+		if (s->readpos >= s->ringbuf_size)
+		{
+			/* the resampler wraps around by itself */
+			s->readpos -= s->ringbuf_size;
+		}
+	}
+	else
+	{
+		up.src = (const unsigned char *)s->ringbuf + s->readpos;
+		up.left = left;
+		up.right = right;
+
+		s->readpos = s->readpos + s->upsampler(&up);
+		if (s->readpos >= s->ringbuf_size)
+		{
+			/* wrap around */
+			s->readpos = 0;
+		}
+	}
+}
+
+/** Scales a block of samples by a volume in SPU2 units */
+static void scale_block(short *buf, int vol)
+{
+	int i;
+
+	for (i=0; i<512; i++)
+	{
+		buf[i] = (short)((buf[i] * vol) >> 14);
+	}
+}
+
+/** Adds a block of samples to another, with saturation */
+static void mix_block(short *dst, const short *src)
+{
+	int i;
+
+	for (i=0; i<512; i++)
+	{
+		int v = dst[i] + src[i];
+
+		if (v > 32767)
+		{
+			v = 32767;
+		}
+		else if (v < -32768)
+		{
+			v = -32768;
+		}
+
+		dst[i] = (short)v;
+	}
+}
+
 /** Main playing thread
  * @param arg   not used
  *
@@ -428,9 +933,6 @@ int audsrv_set_threshold(int amount)
 static void play_thread(void *arg)
 {
 	int intr_state;
-	int step;
-	struct upsample_t up;
-	upsampler_t upsampler = NULL;
 
 	(void)arg;
 
@@ -440,28 +942,61 @@ static void play_thread(void *arg)
 		int block;
 		u8 *bufptr;
 		int available;
+		int i, active, wakeup, ring_wakeup;
 
-		if (format_changed)
+		active = 0;
+		ring_wakeup = 0;
+		for (i=0; i<AUDSRV_MAX_STREAMS; i++)
 		{
-			upsampler = find_upsampler(core1_freq, core1_bits, core1_channels);
-			format_changed = 0;
-		}
+			stream_t *s = &streams[i];
+			short *left, *right;
 
-		if (playing && upsampler != NULL)
-		{
-			up.src = (const unsigned char *)ringbuf + readpos;
-			up.left = rendered_left;
-			up.right = rendered_right;
-			step = upsampler(&up);
+			if (!s->used)
+			{
+				continue;
+			}
+
+			if (s->format_changed)
+			{
+				stream_update_converter(s);
+			}
+
+			if (s->ring)
+			{
+				ring_fetch(s, &ring_ctl[i]);
+			}
+
+			if (!s->playing || (s->upsampler == NULL && !s->resample))
+			{
+				continue;
+			}
+
+			/* the first stream renders in place, the others are mixed in */
+			left = (active == 0) ? rendered_left : mix_left;
+			right = (active == 0) ? rendered_right : mix_right;
+			render_stream(s, left, right);
 
-			readpos = readpos + step;
-			if (readpos >= ringbuf_size)
+			if (s->volume != MAX_VOLUME)
 			{
-				/* wrap around */
-				readpos = 0;
+				scale_block(left, s->volume);
+				scale_block(right, s->volume);
 			}
+
+			if (active > 0)
+			{
+				mix_block(rendered_left, mix_left);
+				mix_block(rendered_right, mix_right);
+			}
+
+			if (s->ring && ring_send_status(s, i))
+			{
+				ring_wakeup = 1;
+			}
+
+			active++;
 		}
-		else
+
+		if (active == 0)
 		{
 			/* not playing */
 			memset(rendered_left, '\0', sizeof(rendered_left));
@@ -486,21 +1021,37 @@ static void play_thread(void *arg)
 
 		CpuResumeIntr(intr_state);
 
-		available = audsrv_available();
-		if (available >= (ringbuf_size / 10))
+		/* arbitrarily selected ringbuf_size / 10, to reduce
+		 * number of semaphores signalled.
+		 */
+		wakeup = 0;
+		for (i=0; i<AUDSRV_MAX_STREAMS; i++)
+		{
+			if (streams[i].used && stream_available(&streams[i]) >= (streams[i].ringbuf_size / 10))
+			{
+				wakeup = 1;
+			}
+		}
+
+		if (wakeup)
 		{
-			/* arbitrarily selected ringbuf_size / 10, to reduce
-			 * number of semaphores signalled.
-			 */
 			SignalSema(queue_sema);
 		}
 
+		available = audsrv_available();
+
 		if (fillbuf_threshold > 0 && available >= fillbuf_threshold)
 		{
 			/* EE client requested a callback */
 			call_client_callback(AUDSRV_FILLBUF_CALLBACK);
 		}
 
+		if (ring_wakeup)
+		{
+			/* the EE waits for space in a ring */
+			call_client_callback(AUDSRV_RING_CALLBACK);
+		}
+
 		//printf("avaiable: %d, queued: %d\n", available, ringbuf_size - available);
 	}
 }
@@ -510,6 +1061,8 @@ static void play_thread(void *arg)
  */
 int audsrv_quit()
 {
+	int i;
+
 	/* silence! */
 	audsrv_stop_audio();
 	audsrv_stop_cd();
@@ -527,6 +1080,15 @@ int audsrv_quit()
 		play_tid = 0;
 	}
 
+	/* release the ring buffers of the additional streams */
+	for (i=1; i<AUDSRV_MAX_STREAMS; i++)
+	{
+		if (streams[i].used)
+		{
+			audsrv_stream_close(i);
+		}
+	}
+
 #ifndef NO_RPC_THREAD
 	/* Deinitialize RPC client, only once the playback thread is stopped. */
 	deinitialize_rpc_client();
@@ -554,10 +1116,16 @@ int audsrv_quit()
  */
 int _start(int argc, char *argv[])
 {
-	int err;
+	int err, i;
 
-	(void)argc;
-	(void)argv;
+	for (i=1; i<argc; i++)
+	{
+		/* high-quality conversion for all formats */
+		if (strcmp(argv[i], "hq") == 0)
+		{
+			resample_all = 1;
+		}
+	}
 
 	FlushDcache();
 	CpuEnableIntr(0);
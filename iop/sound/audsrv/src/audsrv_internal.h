@@ -21,8 +21,17 @@
 //RPC service ID
 #define	AUDSRV_IRX            0x870884e
 
+//PCM streams mixed into core1, including the default one
+#define AUDSRV_MAX_STREAMS      4
+//Ring buffer size of each stream, enough for ~100 ms at 48000hz 16bit stereo
+#define AUDSRV_RINGBUF_SIZE     20480
+
 //DMA channel allocation
 #define AUDSRV_VOICE_DMA_CH	0
 #define AUDSRV_BLOCK_DMA_CH	1
 
+//Zero-copy ring mode of the streams, driven by the EE
+int audsrv_ring_open(int id, void *ee_status, unsigned int *info);
+int audsrv_ring_close(int id);
+
 #endif
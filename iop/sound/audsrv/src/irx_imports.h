@@ -20,6 +20,7 @@
 #include <loadcore.h>
 #include <stdio.h>
 #include <sifcmd.h>
+#include <sifman.h>
 #include <sifrpc.h>
 #include <sysclib.h>
 #include <sysmem.h>
@@ -0,0 +1,477 @@
+/*
+# _____     ___ ____     ___ ____
+#  ____|   |    ____|   |        | |____|
+# |     ___|   |____ ___|    ____| |    \    PS2DEV Open Source Project.
+#-----------------------------------------------------------------------
+# Copyright 2005, ps2dev - http://www.ps2dev.org
+# Licenced under GNU Library General Public License version 2
+*/
+
+/**
+ * @file
+ * audsrv IOP-side polyphase resampler
+ *
+ * Converts any input frequency up to 48000hz to SPU2's native format,
+ * 512 frames at a time. Every output frame is interpolated from 8 input
+ * frames, with one of 256 phases of a Kaiser-windowed sinc filter.
+ * Unlike the table-driven upsamplers, which repeat input samples, this
+ * does not add audible aliasing, at the cost of more IOP cycles.
+ */
+
+#include <stdio.h>
+#include <sysclib.h>
+#include "resampler.h"
+
+/** number of filter phases, as a power of two */
+#define RESAMPLER_PHASE_BITS 8
+#define RESAMPLER_PHASES    (1 << RESAMPLER_PHASE_BITS)
+
+/** frames rendered per call */
+#define RESAMPLER_BLOCK     512
+
+/** Filter coefficients, in Q15 format, one row per phase.
+ * Kaiser window (beta = 7), cutoff at 0.42 of the input frequency;
+ * every row adds up to 32768, so that DC passes unchanged.
+ */
+static const short resampler_coefs[RESAMPLER_PHASES][RESAMPLER_TAPS] =
+{
+	{   403,  -1858,   4090,  27512,   4090,  -1858,    403,    -14},
+	{   400,  -1835,   3991,  27510,   4189,  -1880,    407,    -14},
+	{   396,  -1813,   3892,  27512,   4289,  -1903,    410,    -15},
+	{   393,  -1790,   3794,  27507,   4390,  -1925,    414,    -15},
+	{   389,  -1768,   3697,  27503,   4492,  -1947,    417,    -15},
+	{   385,  -1745,   3600,  27498,   4594,  -1970,    421,    -15},
+	{   382,  -1723,   3504,  27493,   4696,  -1992,    424,    -16},
+	{   378,  -1700,   3409,  27485,   4799,  -2015,    428,    -16},
+	{   374,  -1678,   3314,  27477,   4903,  -2037,    431,    -16},
+	{   371,  -1655,   3220,  27466,   5007,  -2059,    434,    -16},
+	{   367,  -1633,   3126,  27457,   5111,  -2081,    438,    -17},
+	{   363,  -1610,   3033,  27445,   5216,  -2103,    441,    -17},
+	{   360,  -1588,   2941,  27432,   5322,  -2126,    444,    -17},
+	{   356,  -1566,   2849,  27419,   5428,  -2148,    448,    -18},
+	{   352,  -1543,   2758,  27403,   5535,  -2170,    451,    -18},
+	{   349,  -1521,   2667,  27386,   5642,  -2191,    454,    -18},
+	{   345,  -1499,   2577,  27369,   5750,  -2213,    457,    -18},
+	{   341,  -1476,   2488,  27351,   5858,  -2235,    460,    -19},
+	{   337,  -1454,   2399,  27332,   5967,  -2257,    463,    -19},
+	{   334,  -1432,   2311,  27310,   6076,  -2278,    466,    -19},
+	{   330,  -1410,   2224,  27289,   6185,  -2300,    469,    -19},
+	{   326,  -1388,   2137,  27266,   6296,  -2321,    472,    -20},
+	{   322,  -1366,   2051,  27243,   6406,  -2343,    475,    -20},
+	{   319,  -1344,   1966,  27216,   6517,  -2364,    478,    -20},
+	{   315,  -1322,   1881,  27189,   6629,  -2385,    481,    -20},
+	{   311,  -1300,   1797,  27161,   6741,  -2406,    484,    -20},
+	{   307,  -1278,   1714,  27133,   6853,  -2427,    487,    -21},
+	{   304,  -1256,   1631,  27103,   6966,  -2448,    489,    -21},
+	{   300,  -1235,   1549,  27072,   7079,  -2468,    492,    -21},
+	{   296,  -1213,   1468,  27040,   7193,  -2489,    494,    -21},
+	{   292,  -1191,   1387,  27006,   7307,  -2509,    497,    -21},
+	{   289,  -1170,   1307,  26973,   7421,  -2530,    500,    -22},
+	{   285,  -1148,   1228,  26937,   7536,  -2550,    502,    -22},
+	{   281,  -1127,   1149,  26902,   7651,  -2570,    504,    -22},
+	{   278,  -1106,   1071,  26863,   7767,  -2590,    507,    -22},
+	{   274,  -1085,    994,  26825,   7883,  -2610,    509,    -22},
+	{   270,  -1064,    917,  26787,   7999,  -2629,    511,    -23},
+	{   267,  -1043,    841,  26746,   8116,  -2649,    513,    -23},
+	{   263,  -1022,    766,  26703,   8233,  -2668,    516,    -23},
+	{   259,  -1001,    691,  26660,   8351,  -2687,    518,    -23},
+	{   256,   -980,    617,  26615,   8469,  -2706,    520,    -23},
+	{   252,   -960,    544,  26571,   8587,  -2725,    522,    -23},
+	{   248,   -939,    472,  26525,   8705,  -2743,    523,    -23},
+	{   245,   -919,    400,  26478,   8824,  -2762,    525,    -23},
+	{   241,   -898,    329,  26430,   8943,  -2780,    527,    -24},
+	{   238,   -878,    258,  26380,   9063,  -2798,    529,    -24},
+	{   234,   -858,    189,  26331,   9182,  -2816,    530,    -24},
+	{   231,   -838,    120,  26279,   9302,  -2834,    532,    -24},
+	{   227,   -818,     52,  26226,   9423,  -2851,    533,    -24},
+	{   224,   -798,    -16,  26172,   9543,  -2868,    535,    -24},
+	{   220,   -779,    -83,  26119,   9664,  -2885,    536,    -24},
+	{   217,   -759,   -149,  26063,   9785,  -2902,    537,    -24},
+	{   213,   -740,   -214,  26007,   9907,  -2919,    538,    -24},
+	{   210,   -720,   -279,  25948,  10028,  -2935,    540,    -24},
+	{   206,   -701,   -343,  25890,  10150,  -2951,    541,    -24},
+	{   203,   -682,   -407,  25832,  10272,  -2967,    541,    -24},
+	{   199,   -663,   -469,  25771,  10394,  -2982,    542,    -24},
+	{   196,   -644,   -531,  25709,  10517,  -2998,    543,    -24},
+	{   193,   -626,   -592,  25646,  10640,  -3013,    544,    -24},
+	{   189,   -607,   -653,  25585,  10762,  -3028,    544,    -24},
+	{   186,   -589,   -712,  25518,  10886,  -3042,    545,    -24},
+	{   183,   -570,   -771,  25453,  11009,  -3057,    545,    -24},
+	{   180,   -552,   -830,  25387,  11132,  -3071,    546,    -24},
+	{   176,   -534,   -887,  25320,  11256,  -3085,    546,    -24},
+	{   173,   -516,   -944,  25250,  11380,  -3098,    546,    -23},
+	{   170,   -498,  -1001,  25181,  11504,  -3111,    546,    -23},
+	{   167,   -481,  -1056,  25111,  11628,  -3124,    546,    -23},
+	{   164,   -463,  -1111,  25040,  11752,  -3137,    546,    -23},
+	{   160,   -446,  -1165,  24969,  11876,  -3149,    546,    -23},
+	{   157,   -429,  -1218,  24896,  12001,  -3161,    545,    -23},
+	{   154,   -411,  -1271,  24821,  12125,  -3173,    545,    -22},
+	{   151,   -395,  -1323,  24746,  12250,  -3184,    545,    -22},
+	{   148,   -378,  -1374,  24671,  12374,  -3195,    544,    -22},
+	{   145,   -361,  -1425,  24595,  12499,  -3206,    543,    -22},
+	{   142,   -345,  -1475,  24519,  12624,  -3217,    542,    -22},
+	{   139,   -328,  -1524,  24438,  12749,  -3227,    542,    -21},
+	{   136,   -312,  -1572,  24359,  12874,  -3237,    541,    -21},
+	{   133,   -296,  -1620,  24280,  12999,  -3246,    539,    -21},
+	{   130,   -280,  -1667,  24198,  13124,  -3255,    538,    -20},
+	{   128,   -264,  -1713,  24115,  13249,  -3264,    537,    -20},
+	{   125,   -249,  -1759,  24034,  13374,  -3272,    535,    -20},
+	{   122,   -233,  -1804,  23949,  13499,  -3280,    534,    -19},
+	{   119,   -218,  -1848,  23866,  13624,  -3288,    532,    -19},
+	{   117,   -203,  -1891,  23779,  13749,  -3295,    530,    -18},
+	{   114,   -188,  -1934,  23694,  13874,  -3302,    528,    -18},
+	{   111,   -173,  -1976,  23608,  13999,  -3309,    526,    -18},
+	{   108,   -158,  -2018,  23520,  14124,  -3315,    524,    -17},
+	{   106,   -144,  -2059,  23431,  14249,  -3320,    522,    -17},
+	{   103,   -129,  -2099,  23341,  14374,  -3326,    520,    -16},
+	{   101,   -115,  -2138,  23252,  14498,  -3331,    517,    -16},
+	{    98,   -101,  -2177,  23160,  14623,  -3335,    515,    -15},
+	{    96,    -87,  -2215,  23068,  14748,  -3340,    512,    -14},
+	{    93,    -73,  -2252,  22976,  14872,  -3343,    509,    -14},
+	{    91,    -60,  -2289,  22883,  14997,  -3347,    506,    -13},
+	{    88,    -46,  -2325,  22789,  15121,  -3349,    503,    -13},
+	{    86,    -33,  -2360,  22694,  15245,  -3352,    500,    -12},
+	{    83,    -20,  -2395,  22600,  15369,  -3354,    496,    -11},
+	{    81,     -7,  -2429,  22504,  15493,  -3356,    493,    -11},
+	{    79,      6,  -2462,  22406,  15617,  -3357,    489,    -10},
+	{    76,     19,  -2495,  22308,  15740,  -3357,    486,     -9},
+	{    74,     31,  -2527,  22210,  15864,  -3358,    482,     -8},
+	{    72,     44,  -2558,  22111,  15987,  -3358,    478,     -8},
+	{    70,     56,  -2589,  22011,  16110,  -3357,    474,     -7},
+	{    67,     68,  -2619,  21912,  16233,  -3356,    469,     -6},
+	{    65,     80,  -2648,  21810,  16355,  -3354,    465,     -5},
+	{    63,     91,  -2677,  21709,  16478,  -3352,    460,     -4},
+	{    61,    103,  -2705,  21607,  16600,  -3350,    456,     -4},
+	{    59,    114,  -2732,  21504,  16722,  -3347,    451,     -3},
+	{    57,    125,  -2759,  21401,  16843,  -3343,    446,     -2},
+	{    55,    136,  -2785,  21296,  16965,  -3339,    441,     -1},
+	{    53,    147,  -2811,  21193,  17086,  -3335,    435,      0},
+	{    51,    158,  -2836,  21087,  17207,  -3330,    430,      1},
+	{    49,    169,  -2860,  20980,  17327,  -3324,    425,      2},
+	{    47,    179,  -2884,  20874,  17448,  -3318,    419,      3},
+	{    45,    189,  -2907,  20768,  17568,  -3312,    413,      4},
+	{    44,    199,  -2929,  20659,  17687,  -3305,    407,      6},
+	{    42,    209,  -2951,  20550,  17807,  -3297,    401,      7},
+	{    40,    219,  -2972,  20441,  17926,  -3289,    395,      8},
+	{    38,    229,  -2992,  20332,  18045,  -3281,    388,      9},
+	{    37,    238,  -3012,  20222,  18163,  -3272,    382,     10},
+	{    35,    247,  -3032,  20113,  18281,  -3262,    375,     11},
+	{    33,    257,  -3050,  20001,  18398,  -3252,    368,     13},
+	{    32,    266,  -3069,  19889,  18516,  -3241,    361,     14},
+	{    30,    274,  -3086,  19778,  18633,  -3230,    354,     15},
+	{    28,    283,  -3103,  19665,  18749,  -3218,    347,     17},
+	{    27,    292,  -3119,  19552,  18865,  -3206,    339,     18},
+	{    25,    300,  -3135,  19439,  18981,  -3193,    332,     19},
+	{    24,    308,  -3150,  19324,  19096,  -3179,    324,     21},
+	{    22,    316,  -3165,  19211,  19211,  -3165,    316,     22},
+	{    21,    324,  -3179,  19096,  19324,  -3150,    308,     24},
+	{    19,    332,  -3193,  18981,  19439,  -3135,    300,     25},
+	{    18,    339,  -3206,  18865,  19552,  -3119,    292,     27},
+	{    17,    347,  -3218,  18749,  19665,  -3103,    283,     28},
+	{    15,    354,  -3230,  18633,  19778,  -3086,    274,     30},
+	{    14,    361,  -3241,  18516,  19889,  -3069,    266,     32},
+	{    13,    368,  -3252,  18398,  20001,  -3050,    257,     33},
+	{    11,    375,  -3262,  18281,  20113,  -3032,    247,     35},
+	{    10,    382,  -3272,  18163,  20222,  -3012,    238,     37},
+	{     9,    388,  -3281,  18045,  20332,  -2992,    229,     38},
+	{     8,    395,  -3289,  17926,  20441,  -2972,    219,     40},
+	{     7,    401,  -3297,  17807,  20550,  -2951,    209,     42},
+	{     6,    407,  -3305,  17687,  20659,  -2929,    199,     44},
+	{     4,    413,  -3312,  17568,  20768,  -2907,    189,     45},
+	{     3,    419,  -3318,  17448,  20874,  -2884,    179,     47},
+	{     2,    425,  -3324,  17327,  20980,  -2860,    169,     49},
+	{     1,    430,  -3330,  17207,  21087,  -2836,    158,     51},
+	{     0,    435,  -3335,  17086,  21193,  -2811,    147,     53},
+	{    -1,    441,  -3339,  16965,  21296,  -2785,    136,     55},
+	{    -2,    446,  -3343,  16843,  21401,  -2759,    125,     57},
+	{    -3,    451,  -3347,  16722,  21504,  -2732,    114,     59},
+	{    -4,    456,  -3350,  16600,  21607,  -2705,    103,     61},
+	{    -4,    460,  -3352,  16478,  21709,  -2677,     91,     63},
+	{    -5,    465,  -3354,  16355,  21810,  -2648,     80,     65},
+	{    -6,    469,  -3356,  16233,  21912,  -2619,     68,     67},
+	{    -7,    474,  -3357,  16110,  22011,  -2589,     56,     70},
+	{    -8,    478,  -3358,  15987,  22111,  -2558,     44,     72},
+	{    -8,    482,  -3358,  15864,  22210,  -2527,     31,     74},
+	{    -9,    486,  -3357,  15740,  22308,  -2495,     19,     76},
+	{   -10,    489,  -3357,  15617,  22406,  -2462,      6,     79},
+	{   -11,    493,  -3356,  15493,  22504,  -2429,     -7,     81},
+	{   -11,    496,  -3354,  15369,  22600,  -2395,    -20,     83},
+	{   -12,    500,  -3352,  15245,  22694,  -2360,    -33,     86},
+	{   -13,    503,  -3349,  15121,  22789,  -2325,    -46,     88},
+	{   -13,    506,  -3347,  14997,  22883,  -2289,    -60,     91},
+	{   -14,    509,  -3343,  14872,  22976,  -2252,    -73,     93},
+	{   -14,    512,  -3340,  14748,  23068,  -2215,    -87,     96},
+	{   -15,    515,  -3335,  14623,  23160,  -2177,   -101,     98},
+	{   -16,    517,  -3331,  14498,  23252,  -2138,   -115,    101},
+	{   -16,    520,  -3326,  14374,  23341,  -2099,   -129,    103},
+	{   -17,    522,  -3320,  14249,  23431,  -2059,   -144,    106},
+	{   -17,    524,  -3315,  14124,  23520,  -2018,   -158,    108},
+	{   -18,    526,  -3309,  13999,  23608,  -1976,   -173,    111},
+	{   -18,    528,  -3302,  13874,  23694,  -1934,   -188,    114},
+	{   -18,    530,  -3295,  13749,  23779,  -1891,   -203,    117},
+	{   -19,    532,  -3288,  13624,  23866,  -1848,   -218,    119},
+	{   -19,    534,  -3280,  13499,  23949,  -1804,   -233,    122},
+	{   -20,    535,  -3272,  13374,  24034,  -1759,   -249,    125},
+	{   -20,    537,  -3264,  13249,  24115,  -1713,   -264,    128},
+	{   -20,    538,  -3255,  13124,  24198,  -1667,   -280,    130},
+	{   -21,    539,  -3246,  12999,  24280,  -1620,   -296,    133},
+	{   -21,    541,  -3237,  12874,  24359,  -1572,   -312,    136},
+	{   -21,    542,  -3227,  12749,  24438,  -1524,   -328,    139},
+	{   -22,    542,  -3217,  12624,  24519,  -1475,   -345,    142},
+	{   -22,    543,  -3206,  12499,  24595,  -1425,   -361,    145},
+	{   -22,    544,  -3195,  12374,  24671,  -1374,   -378,    148},
+	{   -22,    545,  -3184,  12250,  24746,  -1323,   -395,    151},
+	{   -22,    545,  -3173,  12125,  24821,  -1271,   -411,    154},
+	{   -23,    545,  -3161,  12001,  24896,  -1218,   -429,    157},
+	{   -23,    546,  -3149,  11876,  24969,  -1165,   -446,    160},
+	{   -23,    546,  -3137,  11752,  25040,  -1111,   -463,    164},
+	{   -23,    546,  -3124,  11628,  25111,  -1056,   -481,    167},
+	{   -23,    546,  -3111,  11504,  25181,  -1001,   -498,    170},
+	{   -23,    546,  -3098,  11380,  25250,   -944,   -516,    173},
+	{   -24,    546,  -3085,  11256,  25320,   -887,   -534,    176},
+	{   -24,    546,  -3071,  11132,  25387,   -830,   -552,    180},
+	{   -24,    545,  -3057,  11009,  25453,   -771,   -570,    183},
+	{   -24,    545,  -3042,  10886,  25518,   -712,   -589,    186},
+	{   -24,    544,  -3028,  10762,  25585,   -653,   -607,    189},
+	{   -24,    544,  -3013,  10640,  25646,   -592,   -626,    193},
+	{   -24,    543,  -2998,  10517,  25709,   -531,   -644,    196},
+	{   -24,    542,  -2982,  10394,  25771,   -469,   -663,    199},
+	{   -24,    541,  -2967,  10272,  25832,   -407,   -682,    203},
+	{   -24,    541,  -2951,  10150,  25890,   -343,   -701,    206},
+	{   -24,    540,  -2935,  10028,  25948,   -279,   -720,    210},
+	{   -24,    538,  -2919,   9907,  26007,   -214,   -740,    213},
+	{   -24,    537,  -2902,   9785,  26063,   -149,   -759,    217},
+	{   -24,    536,  -2885,   9664,  26119,    -83,   -779,    220},
+	{   -24,    535,  -2868,   9543,  26172,    -16,   -798,    224},
+	{   -24,    533,  -2851,   9423,  26226,     52,   -818,    227},
+	{   -24,    532,  -2834,   9302,  26279,    120,   -838,    231},
+	{   -24,    530,  -2816,   9182,  26331,    189,   -858,    234},
+	{   -24,    529,  -2798,   9063,  26380,    258,   -878,    238},
+	{   -24,    527,  -2780,   8943,  26430,    329,   -898,    241},
+	{   -23,    525,  -2762,   8824,  26478,    400,   -919,    245},
+	{   -23,    523,  -2743,   8705,  26525,    472,   -939,    248},
+	{   -23,    522,  -2725,   8587,  26571,    544,   -960,    252},
+	{   -23,    520,  -2706,   8469,  26615,    617,   -980,    256},
+	{   -23,    518,  -2687,   8351,  26660,    691,  -1001,    259},
+	{   -23,    516,  -2668,   8233,  26703,    766,  -1022,    263},
+	{   -23,    513,  -2649,   8116,  26746,    841,  -1043,    267},
+	{   -23,    511,  -2629,   7999,  26787,    917,  -1064,    270},
+	{   -22,    509,  -2610,   7883,  26825,    994,  -1085,    274},
+	{   -22,    507,  -2590,   7767,  26863,   1071,  -1106,    278},
+	{   -22,    504,  -2570,   7651,  26902,   1149,  -1127,    281},
+	{   -22,    502,  -2550,   7536,  26937,   1228,  -1148,    285},
+	{   -22,    500,  -2530,   7421,  26973,   1307,  -1170,    289},
+	{   -21,    497,  -2509,   7307,  27006,   1387,  -1191,    292},
+	{   -21,    494,  -2489,   7193,  27040,   1468,  -1213,    296},
+	{   -21,    492,  -2468,   7079,  27072,   1549,  -1235,    300},
+	{   -21,    489,  -2448,   6966,  27103,   1631,  -1256,    304},
+	{   -21,    487,  -2427,   6853,  27133,   1714,  -1278,    307},
+	{   -20,    484,  -2406,   6741,  27161,   1797,  -1300,    311},
+	{   -20,    481,  -2385,   6629,  27189,   1881,  -1322,    315},
+	{   -20,    478,  -2364,   6517,  27216,   1966,  -1344,    319},
+	{   -20,    475,  -2343,   6406,  27243,   2051,  -1366,    322},
+	{   -20,    472,  -2321,   6296,  27266,   2137,  -1388,    326},
+	{   -19,    469,  -2300,   6185,  27289,   2224,  -1410,    330},
+	{   -19,    466,  -2278,   6076,  27310,   2311,  -1432,    334},
+	{   -19,    463,  -2257,   5967,  27332,   2399,  -1454,    337},
+	{   -19,    460,  -2235,   5858,  27351,   2488,  -1476,    341},
+	{   -18,    457,  -2213,   5750,  27369,   2577,  -1499,    345},
+	{   -18,    454,  -2191,   5642,  27386,   2667,  -1521,    349},
+	{   -18,    451,  -2170,   5535,  27403,   2758,  -1543,    352},
+	{   -18,    448,  -2148,   5428,  27419,   2849,  -1566,    356},
+	{   -17,    444,  -2126,   5322,  27432,   2941,  -1588,    360},
+	{   -17,    441,  -2103,   5216,  27445,   3033,  -1610,    363},
+	{   -17,    438,  -2081,   5111,  27457,   3126,  -1633,    367},
+	{   -16,    434,  -2059,   5007,  27466,   3220,  -1655,    371},
+	{   -16,    431,  -2037,   4903,  27477,   3314,  -1678,    374},
+	{   -16,    428,  -2015,   4799,  27485,   3409,  -1700,    378},
+	{   -16,    424,  -1992,   4696,  27493,   3504,  -1723,    382},
+	{   -15,    421,  -1970,   4594,  27498,   3600,  -1745,    385},
+	{   -15,    417,  -1947,   4492,  27503,   3697,  -1768,    389},
+	{   -15,    414,  -1925,   4390,  27507,   3794,  -1790,    393},
+	{   -15,    410,  -1903,   4289,  27512,   3892,  -1813,    396},
+	{   -14,    407,  -1880,   4189,  27510,   3991,  -1835,    400}
+
+};
+
+/** input frames of the current block, preceded by the history */
+static short in_left[RESAMPLER_TAPS + RESAMPLER_BLOCK];
+static short in_right[RESAMPLER_TAPS + RESAMPLER_BLOCK];
+
+/** Checks if the resampler can convert a format
+ * @param freq      frequency used
+ * @param bits      bits per sample
+ * @param channels  number of audio channels
+ * @returns positive if supported, zero otherwise
+ */
+int resampler_format_ok(int freq, int bits, int channels)
+{
+	if (freq < RESAMPLER_MIN_FREQ || freq > RESAMPLER_MAX_FREQ)
+	{
+		return 0;
+	}
+
+	return (bits == 8 || bits == 16) && (channels == 1 || channels == 2);
+}
+
+/** Sets up a resampler for a source format
+ * @param rs        resampler state
+ * @param freq      frequency used
+ * @param bits      bits per sample
+ * @param channels  number of audio channels
+ * @returns 0 on success, -1 if the format is not supported
+ */
+int resampler_init(struct resampler_t *rs, int freq, int bits, int channels)
+{
+	if (!resampler_format_ok(freq, bits, channels))
+	{
+		return -1;
+	}
+
+	rs->step = ((unsigned int)freq << 16) / 48000;
+	rs->pos = 0;
+	rs->bits = bits;
+	rs->channels = channels;
+	memset(rs->hist_left, 0, sizeof(rs->hist_left));
+	memset(rs->hist_right, 0, sizeof(rs->hist_right));
+	return 0;
+}
+
+/** Converts source frames to 16bit, and demuxes them */
+static void convert(const struct resampler_t *rs, const unsigned char *src, int frames, short *left, short *right)
+{
+	int i;
+
+	if (rs->bits == 16)
+	{
+		const short *s = (const short *)src;
+
+		if (rs->channels == 2)
+		{
+			for (i=0; i<frames; i++)
+			{
+				*left++ = *s++;
+				*right++ = *s++;
+			}
+		}
+		else
+		{
+			memcpy(left, s, frames * sizeof(short));
+		}
+	}
+	else
+	{
+		if (rs->channels == 2)
+		{
+			for (i=0; i<frames; i++)
+			{
+				*left++ = (short)((*src++ << 8) - 32768);
+				*right++ = (short)((*src++ << 8) - 32768);
+			}
+		}
+		else
+		{
+			for (i=0; i<frames; i++)
+			{
+				*left++ = (short)((*src++ << 8) - 32768);
+			}
+		}
+	}
+}
+
+/** Applies one phase of the filter */
+static inline short filter(const short *x, const short *h)
+{
+	int acc;
+
+	acc  = x[0] * h[0] + x[1] * h[1] + x[2] * h[2] + x[3] * h[3];
+	acc += x[4] * h[4] + x[5] * h[5] + x[6] * h[6] + x[7] * h[7];
+	acc = (acc + 16384) >> 15;
+
+	if (acc > 32767)
+	{
+		acc = 32767;
+	}
+	else if (acc < -32768)
+	{
+		acc = -32768;
+	}
+
+	return (short)acc;
+}
+
+/** Renders one block of SPU2's native audio
+ * @param rs        resampler state
+ * @param ring      ring buffer holding the source audio
+ * @param ring_size size of the ring buffer, a multiple of the frame size
+ * @param readpos   offset of the first frame to read
+ * @param left      512 left samples are stored here
+ * @param right     512 right samples are stored here
+ * @returns number of bytes consumed from the ring buffer
+ *
+ * Output lags the input by RESAMPLER_TAPS / 2 frames. The number of bytes
+ * consumed varies from one call to the other, unless the frequency divides
+ * 48000 evenly.
+ */
+int resampler_render(struct resampler_t *rs, const unsigned char *ring, int ring_size, int readpos, short *left, short *right)
+{
+	int i, frames, first, shift;
+	unsigned int pos;
+
+	/* input frames that the whole block advances over */
+	frames = (rs->pos + RESAMPLER_BLOCK * rs->step) >> 16;
+
+	shift = 0;
+	if (rs->bits == 16)
+	{
+		shift++;
+	}
+
+	if (rs->channels == 2)
+	{
+		shift++;
+	}
+
+	memcpy(in_left, rs->hist_left, sizeof(rs->hist_left));
+	memcpy(in_right, rs->hist_right, sizeof(rs->hist_right));
+
+	/* the block may wrap around the end of the ring buffer */
+	first = (ring_size - readpos) >> shift;
+	if (first > frames)
+	{
+		first = frames;
+	}
+
+	convert(rs, ring + readpos, first, in_left + RESAMPLER_TAPS, in_right + RESAMPLER_TAPS);
+	convert(rs, ring, frames - first, in_left + RESAMPLER_TAPS + first, in_right + RESAMPLER_TAPS + first);
+
+	pos = rs->pos;
+	if (rs->channels == 2)
+	{
+		for (i=0; i<RESAMPLER_BLOCK; i++)
+		{
+			const short *h = resampler_coefs[(pos >> (16 - RESAMPLER_PHASE_BITS)) & (RESAMPLER_PHASES - 1)];
+
+			left[i] = filter(in_left + (pos >> 16), h);
+			right[i] = filter(in_right + (pos >> 16), h);
+			pos += rs->step;
+		}
+	}
+	else
+	{
+		for (i=0; i<RESAMPLER_BLOCK; i++)
+		{
+			const short *h = resampler_coefs[(pos >> (16 - RESAMPLER_PHASE_BITS)) & (RESAMPLER_PHASES - 1)];
+
+			left[i] = right[i] = filter(in_left + (pos >> 16), h);
+			pos += rs->step;
+		}
+	}
+
+	/* keep the last frames for the next block */
+	rs->pos = pos - ((unsigned int)frames << 16);
+	memcpy(rs->hist_left, in_left + frames, sizeof(rs->hist_left));
+	memcpy(rs->hist_right, in_right + frames, sizeof(rs->hist_right));
+
+	return frames << shift;
+}
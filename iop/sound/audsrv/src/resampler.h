@@ -0,0 +1,45 @@
+/*
+# _____     ___ ____     ___ ____
+#  ____|   |    ____|   |        | |____|
+# |     ___|   |____ ___|    ____| |    \    PS2DEV Open Source Project.
+#-----------------------------------------------------------------------
+# Copyright 2005, ps2dev - http://www.ps2dev.org
+# Licenced under GNU Library General Public License version 2
+*/
+
+/**
+ * @file
+ * audsrv IOP-side polyphase resampler
+ */
+
+#ifndef __RESAMPLER_INCLUDED__
+#define __RESAMPLER_INCLUDED__
+
+/** number of filter taps per output sample */
+#define RESAMPLER_TAPS      8
+
+/** lowest input frequency accepted by the resampler */
+#define RESAMPLER_MIN_FREQ  1000
+/** highest input frequency accepted by the resampler (SPU2's native) */
+#define RESAMPLER_MAX_FREQ  48000
+
+typedef struct resampler_t
+{
+	/** input frames consumed per output frame, 16.16 fixed point */
+	unsigned int step;
+	/** position of the next output frame, relative to the history */
+	unsigned int pos;
+	/** source sample bit count */
+	int bits;
+	/** source number of channels */
+	int channels;
+	/** last input frames of the previous block */
+	short hist_left[RESAMPLER_TAPS];
+	short hist_right[RESAMPLER_TAPS];
+} resampler_t;
+
+int resampler_format_ok(int freq, int bits, int channels);
+int resampler_init(struct resampler_t *rs, int freq, int bits, int channels);
+int resampler_render(struct resampler_t *rs, const unsigned char *ring, int ring_size, int readpos, short *left, short *right);
+
+#endif
@@ -156,6 +156,42 @@ static void *rpc_command(int func, unsigned *data, int size)
 		ret = audsrv_queued();
 		break;
 
+		case AUDSRV_STREAM_OPEN:
+		ret = audsrv_stream_open(data[0], data[1], data[2]);
+		break;
+
+		case AUDSRV_STREAM_CLOSE:
+		ret = audsrv_stream_close(data[0]);
+		break;
+
+		case AUDSRV_STREAM_PLAY:
+		ret = audsrv_stream_play(data[0], (const char *)&data[2], data[1]);
+		break;
+
+		case AUDSRV_STREAM_WAIT:
+		ret = audsrv_stream_wait(data[0], data[1]);
+		break;
+
+		case AUDSRV_STREAM_SET_VOLUME:
+		ret = audsrv_stream_set_volume(data[0], data[1]);
+		break;
+
+		case AUDSRV_STREAM_AVAILABLE:
+		ret = audsrv_stream_available(data[0]);
+		break;
+
+		case AUDSRV_STREAM_QUEUED:
+		ret = audsrv_stream_queued(data[0]);
+		break;
+
+		case AUDSRV_RING_OPEN:
+		ret = audsrv_ring_open(data[0], (void *)data[1], &data[1]);
+		break;
+
+		case AUDSRV_RING_CLOSE:
+		ret = audsrv_ring_close(data[0]);
+		break;
+
 		default:
 		ret = -1;
 		break;
@@ -0,0 +1,427 @@
+/*
+# _____     ___ ____     ___ ____
+#  ____|   |    ____|   |        | |____|
+# |     ___|   |____ ___|    ____| |    \    PS2DEV Open Source Project.
+#-----------------------------------------------------------------------
+# Copyright ps2dev - http://www.ps2dev.org
+# Licenced under Academic Free License version 2.0
+# Review ps2sdk README & LICENSE files for further details.
+*/
+
+/* adpcmcheck: checks the libadpcm encoder against golden outputs.
+ *
+ * The input is generated: noise, a tone, a gated tone with near silence
+ * and a clipped square wave, 250 blocks each. The standard encoder must
+ * produce golden/standard.adp with one thread, with several threads,
+ * in chunks and through AdpcmEncodeStreams(). That file was produced by
+ * the VAG-Packer encoder adpenc and ps2adpcm used before libadpcm. The
+ * quality search (beam width 8) must produce golden/quality.adp and must
+ * not be noisier than the standard encoder.
+ * With -g, writes the golden files from the current encoder instead.
+ * With -b, prints the encoding speed per thread count and beam width.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "libadpcm.h"
+
+#define SEGMENT_BLOCKS 250
+#define BLOCKS (4 * SEGMENT_BLOCKS)
+#define SAMPLES (BLOCKS * ADPCM_BLOCK_SAMPLES)
+#define QUALITY 8
+
+#define BENCH_SAMPLES (4 * 1024 * 1024)
+#define BENCH_QUALITY_SAMPLES (64 * 1024)
+
+static int checks, failures;
+
+/* Each failing check is only printed once */
+static void check(const char *name, int ok)
+{
+	static const char *failed[64];
+	static int failed_count;
+	int i;
+
+	checks++;
+	if(ok)
+		return;
+
+	failures++;
+	for(i=0;i<failed_count;i++)
+		if(failed[i] == name)
+			return;
+	if(failed_count < 64)
+		failed[failed_count++] = name;
+	printf("FAIL: %s\n", name);
+}
+
+static unsigned int seed = 1;
+
+static unsigned int rnd(unsigned int range)
+{
+	seed = seed * 1103515245 + 12345;
+	return (seed >> 8) % range;
+}
+
+static int clamp16(int v)
+{
+	if(v > 32767)
+		return 32767;
+	if(v < -32768)
+		return -32768;
+	return v;
+}
+
+/* Test input */
+
+/* Integer oscillator, so that the input is the same on every host */
+static int osc_x, osc_y;
+
+static int osc(int k)
+{
+	osc_x -= osc_y * k / 4096;
+	osc_y += osc_x * k / 4096;
+	return clamp16(osc_y);
+}
+
+static void make_input(double *pcm, int samples)
+{
+	int i;
+
+	seed = 1;
+	osc_x = 0;
+	osc_y = 30000;
+
+	for(i=0;i<samples;i++) {
+		int segment = (i / (SEGMENT_BLOCKS * ADPCM_BLOCK_SAMPLES)) % 4;
+		int v;
+
+		switch(segment) {
+			case 0:
+				v = (int)rnd(65536) - 32768;
+				break;
+			case 1:
+				v = osc(300);
+				break;
+			case 2:
+				// Bursts, and blocks quiet enough for the predictor search to give up
+				v = osc(700);
+				v = ((i / 700) & 1) ? v / 4 + (int)rnd(64) - 32 : (int)rnd(7) - 3;
+				break;
+			default:
+				// Beyond the range the search clamps to
+				v = ((i / 50) & 1) ? 32767 : -32768;
+				v = clamp16(v + (int)rnd(2048) - 1024);
+				break;
+		}
+		pcm[i] = v;
+	}
+}
+
+/* Golden files */
+
+static const char *golden_dir = "golden";
+
+static int golden_path(char *path, int size, const char *name)
+{
+	return snprintf(path, size, "%s/%s", golden_dir, name) < size ? 0 : -1;
+}
+
+static int read_golden(const char *name, uint8_t *out, int size)
+{
+	char path[1024];
+	FILE *f;
+	int ok;
+
+	if(golden_path(path, sizeof(path), name) != 0 || (f = fopen(path, "rb")) == NULL) {
+		printf("Can't open %s/%s\n", golden_dir, name);
+		return -1;
+	}
+	ok = fread(out, 1, size, f) == (size_t)size && fgetc(f) == EOF;
+	fclose(f);
+	if(!ok) {
+		printf("%s/%s is not %d bytes\n", golden_dir, name, size);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int write_golden(const char *name, const uint8_t *data, int size)
+{
+	char path[1024];
+	FILE *f;
+	int ok;
+
+	if(golden_path(path, sizeof(path), name) != 0 || (f = fopen(path, "wb")) == NULL) {
+		printf("Can't create %s/%s\n", golden_dir, name);
+		return -1;
+	}
+	ok = fwrite(data, 1, size, f) == (size_t)size;
+	if(fclose(f) != 0 || !ok) {
+		printf("Can't write %s/%s\n", golden_dir, name);
+		return -1;
+	}
+	printf("Wrote %s\n", path);
+
+	return 0;
+}
+
+/* Encoders */
+
+static int encode(const double *pcm, int blocks, uint8_t *out, int threads, int quality)
+{
+	AdpcmState state;
+
+	AdpcmStateInit(&state);
+	state.quality = quality;
+
+	return AdpcmEncodeBlocks(&state, pcm, blocks, out, threads);
+}
+
+/* Encodes in chunks of random sizes, carrying the state like the tools do */
+static int encode_chunks(const double *pcm, int blocks, uint8_t *out, int threads)
+{
+	AdpcmState state;
+	int done, n;
+
+	AdpcmStateInit(&state);
+
+	for(done=0;done<blocks;done+=n) {
+		n = 1 + rnd(3 * SEGMENT_BLOCKS / 2);
+		if(n > blocks - done)
+			n = blocks - done;
+		if(AdpcmEncodeBlocks(&state, &pcm[done * ADPCM_BLOCK_SAMPLES], n, &out[done * ADPCM_BLOCK_SIZE], threads) != 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+static double snr(const double *pcm, const uint8_t *adpcm, int blocks)
+{
+	AdpcmStats stats;
+	AdpcmDecoder dec;
+
+	memset(&stats, 0, sizeof(stats));
+	memset(&dec, 0, sizeof(dec));
+	AdpcmMeasure(&stats, &dec, pcm, adpcm, blocks);
+
+	return AdpcmSnr(&stats);
+}
+
+static int flags_clear(const uint8_t *adpcm, int blocks)
+{
+	int i;
+
+	for(i=0;i<blocks;i++)
+		if(adpcm[i * ADPCM_BLOCK_SIZE + 1] != 0)
+			return 0;
+
+	return 1;
+}
+
+/* Checks */
+
+static double pcm[SAMPLES], pcm2[SAMPLES];
+static uint8_t standard[BLOCKS * ADPCM_BLOCK_SIZE], quality[BLOCKS * ADPCM_BLOCK_SIZE];
+static uint8_t out[BLOCKS * ADPCM_BLOCK_SIZE], out2[BLOCKS * ADPCM_BLOCK_SIZE];
+
+static void check_standard(void)
+{
+	static const int threads[] = {2, 3, 4, 16};
+	unsigned int i;
+	int ok;
+
+	check("standard/encode", encode(pcm, BLOCKS, out, 1, 0) == 0);
+	check("standard/golden", !memcmp(out, standard, sizeof(out)));
+	check("standard/flags", flags_clear(out, BLOCKS));
+
+	// The search is split at different blocks, the result must not change
+	ok = 1;
+	for(i=0;i<sizeof(threads) / sizeof(threads[0]);i++) {
+		memset(out, 0xff, sizeof(out));
+		if(encode(pcm, BLOCKS, out, threads[i], 0) != 0 || memcmp(out, standard, sizeof(out)))
+			ok = 0;
+	}
+	check("standard/threads", ok);
+
+	ok = 1;
+	seed = 3;
+	for(i=0;i<8;i++) {
+		memset(out, 0xff, sizeof(out));
+		if(encode_chunks(pcm, BLOCKS, out, 1 + (i & 3)) != 0 || memcmp(out, standard, sizeof(out)))
+			ok = 0;
+	}
+	check("standard/chunks", ok);
+
+	check("standard/empty", encode(pcm, 0, out, 4, 0) == 0);
+}
+
+static void check_streams(void)
+{
+	static uint8_t expect2[BLOCKS * ADPCM_BLOCK_SIZE];
+	AdpcmStream streams[2];
+	AdpcmState state[2];
+	int i, threads;
+
+	// A second channel, the first one backwards
+	for(i=0;i<SAMPLES;i++)
+		pcm2[i] = pcm[SAMPLES - 1 - i];
+	encode(pcm2, BLOCKS, expect2, 1, 0);
+
+	for(threads=1;threads<=8;threads*=2) {
+		for(i=0;i<2;i++) {
+			AdpcmStateInit(&state[i]);
+			streams[i].state = &state[i];
+			streams[i].pcm = i ? pcm2 : pcm;
+			streams[i].blocks = BLOCKS;
+			streams[i].out = i ? out2 : out;
+		}
+		memset(out, 0xff, sizeof(out));
+		memset(out2, 0xff, sizeof(out2));
+		check("streams/encode", AdpcmEncodeStreams(streams, 2, threads) == 0);
+		check("streams/golden", !memcmp(out, standard, sizeof(out)));
+		check("streams/second channel", !memcmp(out2, expect2, sizeof(out2)));
+	}
+}
+
+static void check_quality(void)
+{
+	double standard_snr, quality_snr;
+
+	check("quality/encode", encode(pcm, BLOCKS, out, 1, QUALITY) == 0);
+	check("quality/golden", !memcmp(out, quality, sizeof(out)));
+	check("quality/flags", flags_clear(out, BLOCKS));
+	// The beam search runs in the calling thread only
+	check("quality/threads", encode(pcm, BLOCKS, out, 4, QUALITY) == 0 && !memcmp(out, quality, sizeof(out)));
+
+	standard_snr = snr(pcm, standard, BLOCKS);
+	quality_snr = snr(pcm, quality, BLOCKS);
+	check("quality/snr", quality_snr >= standard_snr);
+	// The tone: noise and clipping are hard on the standard encoder
+	check("standard/snr", snr(&pcm[SEGMENT_BLOCKS * ADPCM_BLOCK_SAMPLES], &standard[SEGMENT_BLOCKS * ADPCM_BLOCK_SIZE], SEGMENT_BLOCKS) > 40.0);
+}
+
+/* Golden files from the current encoder */
+
+static int generate(void)
+{
+	if(encode(pcm, BLOCKS, standard, 1, 0) != 0 || encode(pcm, BLOCKS, quality, 1, QUALITY) != 0) {
+		printf("Out of memory\n");
+		return 1;
+	}
+	if(write_golden("standard.adp", standard, sizeof(standard)) != 0 || write_golden("quality.adp", quality, sizeof(quality)) != 0)
+		return 1;
+
+	return 0;
+}
+
+/* Encoding speed */
+
+static double now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static int bench(void)
+{
+	static const int widths[] = {1, 4, 8, 32};
+	int threads[5] = {1, 2, 4, 8, 0};
+	int blocks = BENCH_SAMPLES / ADPCM_BLOCK_SAMPLES;
+	double *input, start, ms, base = 0.0;
+	uint8_t *output;
+	unsigned int i;
+
+	input = malloc(BENCH_SAMPLES * sizeof(double));
+	output = malloc(blocks * ADPCM_BLOCK_SIZE);
+	if(input == NULL || output == NULL) {
+		printf("Out of memory\n");
+		free(output);
+		free(input);
+		return 1;
+	}
+	make_input(input, BENCH_SAMPLES);
+	threads[4] = AdpcmThreadCount();
+
+	printf("Standard encoder, %d samples\n", BENCH_SAMPLES);
+	printf("%8s %10s %14s %8s\n", "threads", "time (ms)", "Msamples/s", "speedup");
+	for(i=0;i<sizeof(threads) / sizeof(threads[0]);i++) {
+		start = now_ms();
+		encode(input, blocks, output, threads[i], 0);
+		ms = now_ms() - start;
+		if(i == 0)
+			base = ms;
+		printf("%8d %10.1f %14.1f %8.2f\n", threads[i], ms, BENCH_SAMPLES / ms / 1e3, base / ms);
+	}
+
+	blocks = BENCH_QUALITY_SAMPLES / ADPCM_BLOCK_SAMPLES;
+	printf("\nQuality search, %d samples\n", blocks * ADPCM_BLOCK_SAMPLES);
+	printf("%8s %10s %14s %8s\n", "width", "time (ms)", "Msamples/s", "SNR (dB)");
+	for(i=0;i<sizeof(widths) / sizeof(widths[0]);i++) {
+		start = now_ms();
+		encode(input, blocks, output, 1, widths[i]);
+		ms = now_ms() - start;
+		printf("%8d %10.1f %14.3f %8.2f\n", widths[i], ms, blocks * ADPCM_BLOCK_SAMPLES / ms / 1e3, snr(input, output, blocks));
+	}
+	encode(input, blocks, output, 1, 0);
+	printf("%8s %10s %14s %8.2f\n", "standard", "", "", snr(input, output, blocks));
+
+	free(output);
+	free(input);
+
+	return 0;
+}
+
+static void usage(void)
+{
+	printf("Usage: adpcmcheck [-b | -g] [golden directory]\n");
+	printf("Checks the libadpcm encoder against the golden files, in ./golden by default.\n");
+	printf("  -b  print the encoding speed instead\n");
+	printf("  -g  write the golden files from the current encoder instead\n");
+}
+
+int main(int argc, char *argv[])
+{
+	int mode = 0, i;
+
+	for(i=1;i<argc;i++) {
+		if(!strcmp(argv[i], "-b") || !strcmp(argv[i], "-g")) {
+			if(mode != 0) {
+				usage();
+				return 1;
+			}
+			mode = argv[i][1];
+		} else if(argv[i][0] != '-' && i == argc - 1) {
+			golden_dir = argv[i];
+		} else {
+			usage();
+			return 1;
+		}
+	}
+
+	if(mode == 'b')
+		return bench();
+
+	make_input(pcm, SAMPLES);
+
+	if(mode == 'g')
+		return generate();
+
+	if(read_golden("standard.adp", standard, sizeof(standard)) != 0 || read_golden("quality.adp", quality, sizeof(quality)) != 0)
+		return 1;
+
+	check_standard();
+	check_streams();
+	check_quality();
+
+	printf("%d checks, %d failed\n", checks, failures);
+
+	return failures != 0;
+}
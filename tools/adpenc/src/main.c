@@ -3,10 +3,25 @@
 #include <string.h>
 #include <ctype.h>
 #include <math.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "libadpcm.h"
 
-#define VERSION	"1.2"
+#define VERSION	"1.4"
 
-extern int adpcm_encode(FILE* fp, FILE* sad, int offset, int sample_len, int flag_loop);
+extern int adpcm_encode(FILE* fp, FILE* sad, int offset, int sample_len, int flag_loop, AdpcmState *state, AdpcmStats *stats, int threads);
+
+/* Right channel, encoded by a second thread in quality mode */
+struct ChannelJob{
+	const char *InputFile;
+	long data_offset;
+	int sample_len;
+	int flag_loop;
+	AdpcmState *state;
+	AdpcmStats *stats;
+	FILE *out;
+	int result;
+};
 
 enum{ monoF = (1 << 0), stereo = (1 << 1), loopF = (1 << 2) } sad_flag;
 
@@ -20,7 +35,27 @@ struct AdpcmHeader{
 	unsigned int samples;
 };
 
-static int ConvertFile(const char *InputFile, const char *OutputFile, int flag_loop){
+static void *EncodeRight(void *arg){
+	struct ChannelJob *job = arg;
+	FILE *fp;
+
+	job->result=EIO;
+	if((fp = fopen(job->InputFile, "rb")) == NULL)
+		return NULL;
+	if((job->out = tmpfile()) != NULL){
+		fseek(fp, job->data_offset+2, SEEK_SET);
+		job->result=adpcm_encode(fp, job->out, 2, job->sample_len, job->flag_loop, job->state, job->stats, 1);
+	}
+	fclose(fp);
+
+	return NULL;
+}
+
+static void PrintSnr(const char *channel, const AdpcmStats *stats){
+	printf("%s: SNR %.2f dB, peak error %.0f\n", channel, AdpcmSnr(stats), stats->peak);
+}
+
+static int ConvertFile(const char *InputFile, const char *OutputFile, int flag_loop, int threads, int quality, int report){
 	FILE *fp, *sad;
 	int sample_freq, sample_len, result;
 	char s[4];
@@ -28,6 +63,13 @@ static int ConvertFile(const char *InputFile, const char *OutputFile, int flag_l
 	short e;
 	char channels;
 	struct AdpcmHeader AdpcmHeader;
+	AdpcmState state[2];
+	AdpcmStats stats[2];
+
+	memset(stats, 0, sizeof(stats));
+	AdpcmStateInit(&state[0]);
+	AdpcmStateInit(&state[1]);
+	state[0].quality = state[1].quality = quality;
 
 	result=0;
 	if ( (fp = fopen(InputFile, "rb" )) != NULL )
@@ -149,20 +191,70 @@ static int ConvertFile(const char *InputFile, const char *OutputFile, int flag_l
 
 			if(channels == 1)
 			{
-				result=adpcm_encode(fp, sad, 0, sample_len, flag_loop);
+				result=adpcm_encode(fp, sad, 0, sample_len, flag_loop, &state[0], report ? &stats[0] : NULL, threads);
+				if(result==0 && report)
+					PrintSnr("mono", &stats[0]);
 			}
-			else
+			else if(quality == 0)
 			{
 				int data_offset = ftell(fp);
 
+				// Like the original encoder, the state carries over from the left to the right channel
 				// Encode left
-				if((result=adpcm_encode(fp, sad, 2, sample_len, flag_loop))==0){
+				if((result=adpcm_encode(fp, sad, 2, sample_len, flag_loop, &state[0], report ? &stats[0] : NULL, threads))==0){
 					fseek(fp, data_offset+2, SEEK_SET);
 					// Encode right
-					result=adpcm_encode(fp, sad, 2, sample_len, flag_loop);
+					result=adpcm_encode(fp, sad, 2, sample_len, flag_loop, &state[0], report ? &stats[1] : NULL, threads);
+				}
+			}
+			else
+			{
+				struct ChannelJob job;
+				pthread_t thread;
+				int started;
+
+				// The quality search is sequential, so encode both channels at the same time
+				job = (struct ChannelJob)
+				{
+					.InputFile=InputFile,
+					.data_offset=ftell(fp),
+					.sample_len=sample_len,
+					.flag_loop=flag_loop,
+					.state=&state[1],
+					.stats=report ? &stats[1] : NULL,
+					.out=NULL
+				};
+				started = (threads > 1) && pthread_create(&thread, NULL, EncodeRight, &job) == 0;
+
+				// Encode left
+				result=adpcm_encode(fp, sad, 2, sample_len, flag_loop, &state[0], report ? &stats[0] : NULL, 1);
+
+				// Encode right, then append it
+				if(started)
+					pthread_join(thread, NULL);
+				else
+					EncodeRight(&job);
+				if(result==0)
+					result=job.result;
+				if(job.out != NULL){
+					if(result==0){
+						char buffer[4096];
+						size_t len;
+
+						rewind(job.out);
+						while((len = fread(buffer, 1, sizeof(buffer), job.out)) > 0)
+							fwrite(buffer, 1, len, sad);
+					}
+					fclose(job.out);
 				}
 			}
 
+			if(result==0 && report && channels == 2)
+			{
+				PrintSnr("left", &stats[0]);
+				PrintSnr("right", &stats[1]);
+			}
+
 			fclose(sad);
 		}
 		else
@@ -185,30 +277,56 @@ InputFileIOEnd:
 
 int main( int argc, char *argv[] )
 {
-	int result;
+	int result, flag_loop, threads, quality, report, i;
+
+	flag_loop = 0;
+	threads = AdpcmThreadCount();
+	quality = 0;
+	report = 0;
 
-	if( argc == 4)
+	for(i = 1; i < argc && argv[i][0] == '-'; i++)
 	{
-		if( strncmp( argv[1], "-L", 2 ) )
+		if( !strncmp( argv[i], "-L", 2 ) )
 		{
-			printf("Error: Option '%s' not recognized\n", argv[1]);
-			result=EINVAL;
+			flag_loop = 1;
+		}
+		else if( !strncmp( argv[i], "-j", 2 ) && atoi( &argv[i][2] ) > 0 )
+		{
+			threads = atoi( &argv[i][2] );
+		}
+		else if( !strncmp( argv[i], "-q", 2 ) )
+		{
+			quality = argv[i][2] ? atoi( &argv[i][2] ) : 4;
+			if( quality < 1 || quality > ADPCM_MAX_QUALITY )
+			{
+				printf("Error: Quality must be between 1 and %d\n", ADPCM_MAX_QUALITY);
+				return EINVAL;
+			}
+		}
+		else if( !strcmp( argv[i], "-r" ) )
+		{
+			report = 1;
 		}
 		else
 		{
-			result=ConvertFile(argv[2], argv[3], 1);
+			printf("Error: Option '%s' not recognized\n", argv[i]);
+			return EINVAL;
 		}
 	}
-	else if(argc == 3)
+
+	if(argc - i == 2)
 	{
-		result=ConvertFile(argv[1], argv[2], 0);
+		result=ConvertFile(argv[i], argv[i+1], flag_loop, threads, quality, report);
 	}
 	else
 	{
 		printf(	"ADPCM Encoder %s\n"
-			"Usage: sadenc [-L] <input wave> <output sad>\n"
+			"Usage: sadenc [-L] [-j<threads>] [-q[width]] [-r] <input wave> <output sad>\n"
 			"Options:\n"
-			"  -L  Loop\n", VERSION);
+			"  -L  Loop\n"
+			"  -j  Number of encoder threads (default: one per CPU)\n"
+			"  -q  High quality search with the given beam width (1-%d, default 4)\n"
+			"  -r  Report the signal-to-noise ratio of the encoded data\n", VERSION, ADPCM_MAX_QUALITY);
 		result=EINVAL;
 	}
 
@@ -0,0 +1,487 @@
+/*
+# _____     ___ ____     ___ ____
+#  ____|   |    ____|   |        | |____|
+# |     ___|   |____ ___|    ____| |    \    PS2DEV Open Source Project.
+#-----------------------------------------------------------------------
+# Copyright 2005, ps2dev - http://www.ps2dev.org
+# Licenced under GNU Library General Public License version 2
+# Review ps2sdk README & LICENSE files for further details.
+*/
+
+/* audsrvcheck: checks the audsrv converters on the host.
+ *
+ * Streams a sine through a ring buffer into the table-driven upsamplers
+ * and the polyphase resampler, the way the play thread does, and
+ * measures THD+N of the 48000hz output: the power of everything but the
+ * tone, against the tone. Also checks DC gain, the number of bytes
+ * consumed and the ring buffer wrap-around of the resampler.
+ * With -b, prints THD+N and host cycles per 512-frame block of every
+ * converter path.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#if defined(__i386__) || defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+
+#include "upsamplers.h"
+#include "resampler.h"
+
+#define BLOCK 512
+// Holds a whole measurement, so that the sine has no seam
+#define RING_SIZE (256 * 1024)
+// The table-driven upsamplers read a whole block past the read position
+#define RING_SLACK 2048
+// Blocks rendered before measuring, for the filter to settle
+#define SETTLE_BLOCKS 4
+#define MEASURE_BLOCKS 64
+
+static int checks, failures;
+
+/* Each failing check is only printed once */
+static void check(const char *name, int ok)
+{
+	static const char *failed[64];
+	static int failed_count;
+	int i;
+
+	checks++;
+	if(ok)
+		return;
+
+	failures++;
+	for(i=0;i<failed_count;i++)
+		if(failed[i] == name)
+			return;
+	if(failed_count < 64)
+		failed[failed_count++] = name;
+	printf("FAIL: %s\n", name);
+}
+
+static unsigned long long cycles(void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+	return __rdtsc();
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+/* Converter paths */
+
+enum
+{
+	PATH_TABLE,
+	PATH_POLYPHASE,
+};
+
+struct stream
+{
+	int path;
+	int freq;
+	int bits;
+	int channels;
+	upsampler_t upsampler;
+	struct resampler_t resampler;
+	unsigned char ring[RING_SIZE + RING_SLACK];
+	int readpos;
+	// Total bytes consumed
+	long consumed;
+	unsigned long long cycles;
+};
+
+static int frame_size(const struct stream *s)
+{
+	return (s->bits / 8) * s->channels;
+}
+
+static int stream_open(struct stream *s, int path, int freq, int bits, int channels)
+{
+	memset(s, 0, sizeof(*s));
+	s->path = path;
+	s->freq = freq;
+	s->bits = bits;
+	s->channels = channels;
+
+	if(path == PATH_TABLE)
+		return ((s->upsampler = find_upsampler(freq, bits, channels)) != NULL) ? 0 : -1;
+
+	return resampler_init(&s->resampler, freq, bits, channels);
+}
+
+/* Stores one frame of the source, with the same sample on every channel */
+static void stream_put(const struct stream *s, unsigned char *ring, int frame, int sample)
+{
+	unsigned char *p = ring + frame * frame_size(s);
+	int c;
+
+	for(c=0;c<s->channels;c++) {
+		if(s->bits == 16) {
+			((short *)p)[c] = (short)sample;
+		} else {
+			p[c] = (unsigned char)((sample + 32768) >> 8);
+		}
+	}
+}
+
+/* Renders one block, as render_stream() does in audsrv.c */
+static void stream_render(struct stream *s, short *left, short *right)
+{
+	unsigned long long start;
+	int bytes;
+
+	if(s->path == PATH_POLYPHASE) {
+		start = cycles();
+		bytes = resampler_render(&s->resampler, s->ring, RING_SIZE, s->readpos, left, right);
+		s->cycles += cycles() - start;
+		s->readpos += bytes;
+		if(s->readpos >= RING_SIZE)
+			s->readpos -= RING_SIZE;
+	} else {
+		struct upsample_t up;
+
+		up.src = s->ring + s->readpos;
+		up.left = left;
+		up.right = right;
+		start = cycles();
+		bytes = s->upsampler(&up);
+		s->cycles += cycles() - start;
+		s->readpos += bytes;
+		// The table-driven upsamplers can't wrap around, the ring buffer is sized for them
+		if(s->readpos >= RING_SIZE)
+			s->readpos = 0;
+	}
+
+	s->consumed += bytes;
+}
+
+/* THD+N */
+
+/* Fills the ring buffer with a sine of amplitude amp, tone hz */
+static void fill_sine(struct stream *s, double tone, double amp)
+{
+	int frames = RING_SIZE / frame_size(s), i;
+
+	for(i=0;i<frames;i++)
+		stream_put(s, s->ring, i, (int)lrint(amp * 32767 * sin(2 * M_PI * tone * i / s->freq)));
+}
+
+/* Fits a sine of the given frequency, in cycles per sample, and a DC
+ * offset to x, and returns the power of what is left against the power of
+ * the sine, in dB.
+ */
+static double thdn(const short *x, int n, double freq)
+{
+	double scc = 0, sss = 0, ssc = 0, sc = 0, ss = 0, s1 = n, xc = 0, xs = 0, x1 = 0;
+	double m[3][4], a, b, dc, signal, noise = 0;
+	int i, j, k;
+
+	for(i=0;i<n;i++) {
+		double c = cos(2 * M_PI * freq * i), s = sin(2 * M_PI * freq * i);
+
+		scc += c * c;
+		sss += s * s;
+		ssc += s * c;
+		sc += c;
+		ss += s;
+		xc += x[i] * c;
+		xs += x[i] * s;
+		x1 += x[i];
+	}
+
+	// Least squares: solve the normal equations by Gaussian elimination
+	m[0][0] = scc; m[0][1] = ssc; m[0][2] = sc; m[0][3] = xc;
+	m[1][0] = ssc; m[1][1] = sss; m[1][2] = ss; m[1][3] = xs;
+	m[2][0] = sc;  m[2][1] = ss;  m[2][2] = s1; m[2][3] = x1;
+	for(i=0;i<3;i++) {
+		for(j=i+1;j<3;j++) {
+			double f = m[j][i] / m[i][i];
+
+			for(k=i;k<4;k++)
+				m[j][k] -= f * m[i][k];
+		}
+	}
+	dc = m[2][3] / m[2][2];
+	b = (m[1][3] - m[1][2] * dc) / m[1][1];
+	a = (m[0][3] - m[0][1] * b - m[0][2] * dc) / m[0][0];
+
+	for(i=0;i<n;i++) {
+		double e = x[i] - (a * cos(2 * M_PI * freq * i) + b * sin(2 * M_PI * freq * i) + dc);
+
+		noise += e * e;
+	}
+	signal = (a * a + b * b) / 2 * n;
+
+	return 10 * log10(noise / signal);
+}
+
+/* Tone used for a source frequency */
+static double tone_for(int freq)
+{
+	return (freq >= 8000) ? 1000 : freq / 8.0;
+}
+
+/* Streams a half-scale sine through a converter path, returns THD+N of
+ * the left channel, or 0 if the format has no such path.
+ */
+static double measure(int path, int freq, int bits, int channels, unsigned long long *block_cycles)
+{
+	static struct stream s;
+	static short left[MEASURE_BLOCKS * BLOCK], right[MEASURE_BLOCKS * BLOCK];
+	double tone = tone_for(freq), rate;
+	long consumed;
+	int i;
+
+	if(stream_open(&s, path, freq, bits, channels) != 0)
+		return 0;
+	fill_sine(&s, tone, 0.5);
+
+	for(i=0;i<SETTLE_BLOCKS;i++)
+		stream_render(&s, left, right);
+
+	consumed = s.consumed;
+	s.cycles = 0;
+	for(i=0;i<MEASURE_BLOCKS;i++)
+		stream_render(&s, left + i * BLOCK, right + i * BLOCK);
+
+	if(block_cycles != NULL)
+		*block_cycles = s.cycles / MEASURE_BLOCKS;
+
+	/* The tables skip a fraction of a frame per block, and the resampler
+	 * steps in 16.16 fixed point: fit the pitch they actually play at.
+	 */
+	if(path == PATH_POLYPHASE)
+		rate = s.resampler.step / 65536.0;
+	else
+		rate = (double)(s.consumed - consumed) / frame_size(&s) / (MEASURE_BLOCKS * BLOCK);
+
+	return thdn(left, MEASURE_BLOCKS * BLOCK, tone / freq * rate);
+}
+
+/* Converter checks */
+
+static const int formats[][2] =
+{
+	{ 8, 1},
+	{ 8, 2},
+	{16, 1},
+	{16, 2},
+};
+
+#define FORMAT_COUNT (sizeof(formats) / sizeof(formats[0]))
+
+static const int rates[] =
+{
+	1000, 8000, 11025, 12000, 16000, 22050, 24000, 32000, 37800, 44100, 47999, 48000,
+};
+
+#define RATE_COUNT (sizeof(rates) / sizeof(rates[0]))
+
+/* The resampler is clean for every rate, down to the source's own quantization */
+static void check_thdn(void)
+{
+	unsigned int r, f;
+
+	for(r=0;r<RATE_COUNT;r++) {
+		for(f=0;f<FORMAT_COUNT;f++) {
+			int bits = formats[f][0], channels = formats[f][1];
+			double poly = measure(PATH_POLYPHASE, rates[r], bits, channels, NULL);
+			double table = measure(PATH_TABLE, rates[r], bits, channels, NULL);
+
+			// 8 bit sources are limited to about -44 dB at half scale
+			if(bits == 16)
+				check("resampler/thd+n 16 bit", poly < -58);
+			else
+				check("resampler/thd+n 8 bit", poly < -38);
+
+			// Wherever both exist, the resampler is the better one, except on a straight copy
+			if(table != 0 && rates[r] != 48000)
+				check("resampler/better than table", poly < table - 10);
+		}
+	}
+}
+
+/* Every frame goes through once: bytes consumed follow the source frequency */
+static void check_consumed(void)
+{
+	static struct stream s;
+	short left[BLOCK], right[BLOCK];
+	unsigned int r, f;
+	int i, blocks = 250;
+
+	for(r=0;r<RATE_COUNT;r++) {
+		for(f=0;f<FORMAT_COUNT;f++) {
+			double expected;
+
+			stream_open(&s, PATH_POLYPHASE, rates[r], formats[f][0], formats[f][1]);
+			for(i=0;i<blocks;i++)
+				stream_render(&s, left, right);
+
+			/* The step is rounded down, the stream can only lag behind, by at
+			 * most one 1/65536 of a frame per output frame.
+			 */
+			expected = (double)rates[r] * blocks * BLOCK / 48000 * frame_size(&s);
+			check("resampler/bytes consumed", s.consumed <= expected
+				&& s.consumed >= expected - ((double)blocks * BLOCK / 65536 + 1) * frame_size(&s));
+			check("resampler/frame aligned", s.consumed % frame_size(&s) == 0);
+		}
+	}
+}
+
+/* DC passes unchanged, and stereo channels stay apart */
+static void check_dc(void)
+{
+	static struct stream s;
+	short left[BLOCK], right[BLOCK];
+	int frames, i, ok = 1, apart = 1;
+
+	stream_open(&s, PATH_POLYPHASE, 22050, 16, 2);
+	frames = RING_SIZE / frame_size(&s);
+	for(i=0;i<frames;i++) {
+		((short *)s.ring)[i * 2 + 0] = 10000;
+		((short *)s.ring)[i * 2 + 1] = -20000;
+	}
+	for(i=0;i<SETTLE_BLOCKS;i++)
+		stream_render(&s, left, right);
+	for(i=0;i<BLOCK;i++) {
+		ok &= abs(left[i] - 10000) <= 1;
+		apart &= abs(right[i] + 20000) <= 1;
+	}
+	check("resampler/dc gain", ok);
+	check("resampler/stereo", apart);
+
+	// Full scale must saturate, not wrap around
+	stream_open(&s, PATH_POLYPHASE, 11025, 16, 1);
+	frames = RING_SIZE / frame_size(&s);
+	for(i=0;i<frames;i++)
+		((short *)s.ring)[i] = (i / 7) & 1 ? 32767 : -32768;
+	ok = 1;
+	for(i=0;i<8 && ok;i++) {
+		int j;
+
+		stream_render(&s, left, right);
+		for(j=1;j<BLOCK;j++)
+			ok &= abs(left[j] - left[j - 1]) < 32768;
+	}
+	check("resampler/saturation", ok);
+}
+
+/* Wrapping around the end of the ring buffer renders the same audio */
+static void check_wrap(void)
+{
+	static struct stream linear, wrapped;
+	static short left_a[BLOCK], right_a[BLOCK], left_b[BLOCK], right_b[BLOCK];
+	unsigned int r, f;
+	int i, b, ok, size;
+
+	for(r=0;r<RATE_COUNT;r++) {
+		for(f=0;f<FORMAT_COUNT;f++) {
+			int bits = formats[f][0], channels = formats[f][1], start;
+
+			stream_open(&linear, PATH_POLYPHASE, rates[r], bits, channels);
+			stream_open(&wrapped, PATH_POLYPHASE, rates[r], bits, channels);
+			size = frame_size(&linear);
+			for(i=0;i<RING_SIZE / size;i++)
+				stream_put(&linear, linear.ring, i, (int)((i * 2654435761u) >> 16) - 32768);
+
+			// The same audio, rotated so that it starts a little before the end
+			start = RING_SIZE - (rates[r] / 200 + 3) * size;
+			memcpy(wrapped.ring + start, linear.ring, RING_SIZE - start);
+			memcpy(wrapped.ring, linear.ring + RING_SIZE - start, start);
+			wrapped.readpos = start;
+
+			ok = 1;
+			for(b=0;b<8;b++) {
+				stream_render(&linear, left_a, right_a);
+				stream_render(&wrapped, left_b, right_b);
+				ok &= memcmp(left_a, left_b, sizeof(left_a)) == 0 && memcmp(right_a, right_b, sizeof(right_a)) == 0;
+			}
+			check("resampler/wrap around", ok);
+			check("resampler/wrap around position", (wrapped.readpos - start + RING_SIZE) % RING_SIZE == linear.readpos);
+		}
+	}
+}
+
+/* 48000hz sources are copied as they are by the table path */
+static void check_table_copy(void)
+{
+	static struct stream s;
+	short left[BLOCK], right[BLOCK];
+	int i, ok = 1;
+
+	stream_open(&s, PATH_TABLE, 48000, 16, 2);
+	for(i=0;i<BLOCK * 2;i++)
+		((short *)s.ring)[i] = (short)(i * 37);
+	stream_render(&s, left, right);
+	for(i=0;i<BLOCK;i++)
+		ok &= left[i] == (short)(i * 2 * 37) && right[i] == (short)((i * 2 + 1) * 37);
+	check("table/48000 copy", ok);
+}
+
+/* Converter measurements */
+
+static int bench(void)
+{
+	unsigned int r, f;
+
+	printf("Half-scale sine through every converter path, 512-frame output blocks\n");
+#if defined(__i386__) || defined(__x86_64__)
+	printf("Cost in host TSC cycles per block\n");
+#else
+	printf("Cost in host nanoseconds per block\n");
+#endif
+	printf("%6s %4s %3s %12s %10s %12s %10s\n", "rate", "bits", "ch", "table", "cost", "polyphase", "cost");
+
+	for(r=0;r<RATE_COUNT;r++) {
+		for(f=0;f<FORMAT_COUNT;f++) {
+			int bits = formats[f][0], channels = formats[f][1];
+			unsigned long long table_cycles = 0, poly_cycles = 0;
+			double table = measure(PATH_TABLE, rates[r], bits, channels, &table_cycles);
+			double poly = measure(PATH_POLYPHASE, rates[r], bits, channels, &poly_cycles);
+
+			printf("%6d %4d %3d ", rates[r], bits, channels);
+			if(table != 0)
+				printf("%9.1f dB %10llu ", table, table_cycles);
+			else
+				printf("%12s %10s ", "-", "-");
+			printf("%9.1f dB %10llu\n", poly, poly_cycles);
+		}
+	}
+
+	return 0;
+}
+
+static void usage(void)
+{
+	printf("Usage: audsrvcheck [-b]\n");
+	printf("Checks the audsrv upsamplers and resampler.\n");
+	printf("  -b  print THD+N and cost of every converter path instead\n");
+}
+
+int main(int argc, char *argv[])
+{
+	if(argc > 2 || (argc == 2 && strcmp(argv[1], "-b"))) {
+		usage();
+		return 1;
+	}
+
+	if(argc == 2)
+		return bench();
+
+	check_thdn();
+	check_consumed();
+	check_dc();
+	check_wrap();
+	check_table_copy();
+
+	printf("%d checks, %d failed\n", checks, failures);
+
+	return failures != 0;
+}
@@ -0,0 +1,967 @@
+/*
+# _____     ___ ____     ___ ____
+#  ____|   |    ____|   |        | |____|
+# |     ___|   |____ ___|    ____| |    \    PS2DEV Open Source Project.
+#-----------------------------------------------------------------------
+# Copyright 2001-2004, ps2dev - http://www.ps2dev.org
+# Licenced under Academic Free License version 2.0
+# Review ps2sdk README & LICENSE files for further details.
+*/
+
+/* bdmcheck: checks the BDM block cache (libbdm bd_cache) on the host.
+ *
+ * The cache sits on a RAM block device. Every read through the cache is
+ * compared with the device contents, for several cache geometries, and the
+ * 2Q policy is checked to keep metadata resident while a stream is read.
+ * The asynchronous paths of BDM (bdm_submit, bdm_transfer) are checked on a
+ * RAM block device that completes its requests from device threads.
+ * With -t, replays a recorded access trace instead and prints the counters.
+ * With -b, measures the throughput of queued requests per queue depth.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <thbase.h>
+#include <thsemap.h>
+#include <bd_cache.h>
+#include <iophost.h>
+
+#define SECTOR_SIZE 512
+
+static int checks, failures;
+
+static unsigned int seed = 1;
+
+static unsigned int rnd(unsigned int range)
+{
+	seed = seed * 1103515245 + 12345;
+	return ((seed >> 8) & 0xffffff) % range;
+}
+
+/* Each failing check is only printed once */
+static void check(const char *name, int ok)
+{
+	static const char *failed[64];
+	static int failed_count;
+	int i;
+
+	checks++;
+	if(ok)
+		return;
+
+	failures++;
+	for(i=0;i<failed_count;i++)
+		if(failed[i] == name)
+			return;
+	if(failed_count < 64)
+		failed[failed_count++] = name;
+	printf("FAIL: %s\n", name);
+}
+
+/* RAM block device */
+
+struct ramdisk
+{
+	struct block_device bd;
+	u8 *data;
+	u32 reads;
+	u32 read_sectors;
+	u32 writes;
+	// Reads of this range are counted separately
+	u32 watch_start, watch_end;
+	u32 watch_reads;
+	// Reads of this sector fail
+	u32 fail_sector;
+	// Time each request takes, in microseconds
+	u32 latency;
+};
+
+static void ramdisk_delay(struct ramdisk *rd)
+{
+	struct timespec ts;
+
+	if(rd->latency == 0)
+		return;
+
+	ts.tv_sec = 0;
+	ts.tv_nsec = rd->latency * 1000;
+	nanosleep(&ts, NULL);
+}
+
+static int ramdisk_read(struct block_device *bd, u32 sector, void *buffer, u16 count)
+{
+	struct ramdisk *rd = bd->priv;
+
+	if(sector + count > bd->sectorCount)
+		return -1;
+	if(rd->fail_sector >= sector && rd->fail_sector < sector + count)
+		return -1;
+
+	ramdisk_delay(rd);
+	rd->reads++;
+	rd->read_sectors += count;
+	if(sector < rd->watch_end && sector + count > rd->watch_start)
+		rd->watch_reads++;
+	memcpy(buffer, rd->data + (size_t)sector * SECTOR_SIZE, (size_t)count * SECTOR_SIZE);
+
+	return count;
+}
+
+static int ramdisk_write(struct block_device *bd, u32 sector, const void *buffer, u16 count)
+{
+	struct ramdisk *rd = bd->priv;
+
+	if(sector + count > bd->sectorCount)
+		return -1;
+
+	ramdisk_delay(rd);
+	rd->writes++;
+	memcpy(rd->data + (size_t)sector * SECTOR_SIZE, buffer, (size_t)count * SECTOR_SIZE);
+
+	return count;
+}
+
+static void ramdisk_flush(struct block_device *bd)
+{
+	(void)bd;
+}
+
+static int ramdisk_stop(struct block_device *bd)
+{
+	(void)bd;
+
+	return 0;
+}
+
+static void ramdisk_init(struct ramdisk *rd, u32 sectors)
+{
+	u32 i;
+
+	memset(rd, 0, sizeof(*rd));
+	rd->data = malloc((size_t)sectors * SECTOR_SIZE);
+	for(i=0;i<sectors * SECTOR_SIZE;i++)
+		rd->data[i] = rnd(256);
+	rd->fail_sector = 0xffffffff;
+
+	rd->bd.priv = rd;
+	rd->bd.name = "ram";
+	rd->bd.sectorSize = SECTOR_SIZE;
+	rd->bd.sectorOffset = 0;
+	rd->bd.sectorCount = sectors;
+	rd->bd.read = ramdisk_read;
+	rd->bd.write = ramdisk_write;
+	rd->bd.flush = ramdisk_flush;
+	rd->bd.stop = ramdisk_stop;
+}
+
+static void ramdisk_free(struct ramdisk *rd)
+{
+	free(rd->data);
+}
+
+/* Cache checks */
+
+/* Random reads and writes of random sizes, compared with the device */
+static void check_data(unsigned int block_count, unsigned int sectors_per_block, u32 sectors)
+{
+	struct ramdisk rd;
+	struct block_device *cbd;
+	u8 *buffer;
+	int i, ok = 1, wok = 1;
+
+	ramdisk_init(&rd, sectors);
+	bd_cache_configure(block_count, sectors_per_block);
+	cbd = bd_cache_create(&rd.bd);
+	buffer = malloc((size_t)(sectors_per_block * 2 + 2) * SECTOR_SIZE);
+
+	for(i=0;i<20000;i++) {
+		u32 count = 1 + rnd(sectors_per_block * 2 + 2);
+		u32 sector = rnd(sectors - count + 1);
+		int rv;
+
+		// Mostly around a working set, so that blocks are re-used
+		if(rnd(4) != 0 && sectors > 64 * sectors_per_block)
+			sector = rnd(64 * sectors_per_block);
+
+		if(rnd(4) == 0) {
+			u32 j;
+
+			for(j=0;j<count * SECTOR_SIZE;j++)
+				buffer[j] = rnd(256);
+			rv = cbd->write(cbd, sector, buffer, count);
+			if(rv != (int)count || memcmp(rd.data + (size_t)sector * SECTOR_SIZE, buffer, (size_t)count * SECTOR_SIZE))
+				wok = 0;
+		} else {
+			rv = cbd->read(cbd, sector, buffer, count);
+			if(rv != (int)count || memcmp(rd.data + (size_t)sector * SECTOR_SIZE, buffer, (size_t)count * SECTOR_SIZE))
+				ok = 0;
+		}
+	}
+
+	check("bd_cache/read", ok);
+	check("bd_cache/write", wok);
+
+	free(buffer);
+	bd_cache_destroy(cbd);
+	ramdisk_free(&rd);
+}
+
+/* Metadata read between the sectors of a long stream stays resident */
+static void check_scan_resistance(void)
+{
+	struct ramdisk rd;
+	struct block_device *cbd;
+	bd_cache_stats_t stats;
+	u8 buffer[SECTOR_SIZE];
+	const u32 meta_sectors = 64, stream_start = 4096, stream_sectors = 65536;
+	u32 i, warm_reads = 0, ok = 1;
+
+	ramdisk_init(&rd, stream_start + stream_sectors);
+	rd.watch_start = 0;
+	rd.watch_end = meta_sectors;
+	bd_cache_configure(32, 8);
+	cbd = bd_cache_create(&rd.bd);
+
+	// One metadata sector (a FAT lookup) for every 8 stream sectors
+	for(i=0;i<stream_sectors;i++) {
+		if(i == stream_sectors / 4)
+			warm_reads = rd.watch_reads;
+		if((i & 7) == 0) {
+			u32 sector = rnd(meta_sectors);
+
+			if(cbd->read(cbd, sector, buffer, 1) != 1 || memcmp(buffer, rd.data + sector * SECTOR_SIZE, SECTOR_SIZE))
+				ok = 0;
+		}
+		if(cbd->read(cbd, stream_start + i, buffer, 1) != 1 || memcmp(buffer, rd.data + (size_t)(stream_start + i) * SECTOR_SIZE, SECTOR_SIZE))
+			ok = 0;
+	}
+
+	bd_cache_get_stats(cbd, &stats);
+	check("bd_cache/scan/data", ok);
+	check("bd_cache/scan/metadata resident", rd.watch_reads == warm_reads);
+	check("bd_cache/scan/promotions", stats.promotions >= meta_sectors / 8);
+	check("bd_cache/scan/stream misses", stats.misses >= stream_sectors / 8);
+
+	bd_cache_destroy(cbd);
+	ramdisk_free(&rd);
+}
+
+static void check_stats(void)
+{
+	struct ramdisk rd;
+	struct block_device *cbd;
+	bd_cache_stats_t stats;
+	u8 buffer[16 * SECTOR_SIZE];
+
+	ramdisk_init(&rd, 1024);
+	bd_cache_configure(16, 8);
+	cbd = bd_cache_create(&rd.bd);
+
+	bd_cache_get_stats(cbd, &stats);
+	check("bd_cache/stats/geometry", stats.block_count == 16 && stats.sectors_per_block == 8);
+
+	cbd->read(cbd, 3, buffer, 1);
+	cbd->read(cbd, 4, buffer, 2);
+	cbd->read(cbd, 100, buffer, 16);
+	cbd->write(cbd, 5, buffer, 1);
+	bd_cache_get_stats(cbd, &stats);
+	check("bd_cache/stats/counters", stats.misses == 1 && stats.hits == 1 && stats.direct_sectors == 16 && stats.write_updates == 1);
+	check("bd_cache/stats/device reads", rd.reads == 2);
+
+	bd_cache_reset_stats(cbd);
+	bd_cache_get_stats(cbd, &stats);
+	check("bd_cache/stats/reset", stats.hits == 0 && stats.misses == 0 && stats.evictions == 0 && stats.promotions == 0
+		&& stats.direct_sectors == 0 && stats.write_updates == 0 && stats.block_count == 16);
+
+	// Geometry is clamped
+	bd_cache_destroy(cbd);
+	bd_cache_configure(1, 1000);
+	cbd = bd_cache_create(&rd.bd);
+	bd_cache_get_stats(cbd, &stats);
+	check("bd_cache/stats/clamped geometry", stats.block_count == 4 && stats.sectors_per_block == 128);
+
+	bd_cache_destroy(cbd);
+	ramdisk_free(&rd);
+}
+
+/* A failed device read must not leave a block behind */
+static void check_read_error(void)
+{
+	struct ramdisk rd;
+	struct block_device *cbd;
+	u8 buffer[SECTOR_SIZE];
+
+	ramdisk_init(&rd, 1024);
+	bd_cache_configure(16, 8);
+	cbd = bd_cache_create(&rd.bd);
+
+	rd.fail_sector = 21;
+	check("bd_cache/error/read fails", cbd->read(cbd, 17, buffer, 1) < 0);
+	rd.fail_sector = 0xffffffff;
+	check("bd_cache/error/read after", cbd->read(cbd, 17, buffer, 1) == 1 && !memcmp(buffer, rd.data + 17 * SECTOR_SIZE, SECTOR_SIZE));
+
+	bd_cache_destroy(cbd);
+	ramdisk_free(&rd);
+}
+
+/* Asynchronous RAM block device
+ *
+ * Registers a submit function with bdm_set_ext(). Requests are queued and
+ * served by device threads, one per channel, and complete from interrupt
+ * context. While 'hold' is set, queued requests are not served.
+ */
+
+#define ARAMDISK_MAX_CHANNELS 8
+
+struct aramdisk
+{
+	struct ramdisk rd;
+	struct block_device_ext ext;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	struct bd_request *head, *tail;
+	int hold;
+	int stop;
+	unsigned int channels;
+	int thid[ARAMDISK_MAX_CHANNELS];
+};
+
+static int aramdisk_submit(struct block_device *bd, struct bd_request *req)
+{
+	struct aramdisk *ad = bd->priv;
+
+	req->next = NULL;
+	pthread_mutex_lock(&ad->lock);
+	if(ad->tail != NULL)
+		ad->tail->next = req;
+	else
+		ad->head = req;
+	ad->tail = req;
+	pthread_cond_signal(&ad->cond);
+	pthread_mutex_unlock(&ad->lock);
+
+	return 0;
+}
+
+static void aramdisk_serve(struct aramdisk *ad, struct bd_request *req)
+{
+	u32 sector = req->sector;
+	unsigned int i;
+	int total = 0;
+
+	for(i=0;i<req->sg_count;i++) {
+		size_t offset = (size_t)sector * SECTOR_SIZE, size = (size_t)req->sg[i].count * SECTOR_SIZE;
+
+		if(sector + req->sg[i].count > ad->rd.bd.sectorCount) {
+			total = -1;
+			break;
+		}
+		if(req->op == BD_REQ_WRITE)
+			memcpy(ad->rd.data + offset, req->sg[i].buffer, size);
+		else
+			memcpy(req->sg[i].buffer, ad->rd.data + offset, size);
+		sector += req->sg[i].count;
+		total += req->sg[i].count;
+	}
+
+	req->result = total;
+}
+
+static void aramdisk_channel(void *arg)
+{
+	struct aramdisk *ad = arg;
+	struct bd_request *req;
+
+	for(;;) {
+		pthread_mutex_lock(&ad->lock);
+		while(!ad->stop && (ad->hold || ad->head == NULL))
+			pthread_cond_wait(&ad->cond, &ad->lock);
+		if(ad->stop) {
+			pthread_mutex_unlock(&ad->lock);
+			break;
+		}
+		req = ad->head;
+		ad->head = req->next;
+		if(ad->head == NULL)
+			ad->tail = NULL;
+		pthread_mutex_unlock(&ad->lock);
+
+		ramdisk_delay(&ad->rd);
+		aramdisk_serve(ad, req);
+
+		iophost_set_intr_context(1);
+		req->complete(req);
+		iophost_set_intr_context(0);
+	}
+}
+
+static void aramdisk_init(struct aramdisk *ad, u32 sectors, unsigned int channels)
+{
+	unsigned int i;
+
+	ramdisk_init(&ad->rd, sectors);
+	ad->rd.bd.priv = ad;
+	ad->head = ad->tail = NULL;
+	ad->hold = 0;
+	ad->stop = 0;
+	ad->channels = channels;
+	pthread_mutex_init(&ad->lock, NULL);
+	pthread_cond_init(&ad->cond, NULL);
+	for(i=0;i<channels;i++)
+		ad->thid[i] = iophost_start_thread(aramdisk_channel, ad);
+
+	ad->ext.submit = aramdisk_submit;
+	ad->ext.queue_depth = channels;
+	bdm_set_ext(&ad->rd.bd, &ad->ext);
+}
+
+static void aramdisk_hold(struct aramdisk *ad, int hold)
+{
+	pthread_mutex_lock(&ad->lock);
+	ad->hold = hold;
+	pthread_cond_broadcast(&ad->cond);
+	pthread_mutex_unlock(&ad->lock);
+}
+
+static void aramdisk_free(struct aramdisk *ad)
+{
+	unsigned int i;
+
+	pthread_mutex_lock(&ad->lock);
+	ad->stop = 1;
+	pthread_cond_broadcast(&ad->cond);
+	pthread_mutex_unlock(&ad->lock);
+	for(i=0;i<ad->channels;i++)
+		iophost_join_thread(ad->thid[i]);
+
+	bdm_set_ext(&ad->rd.bd, NULL);
+	pthread_cond_destroy(&ad->cond);
+	pthread_mutex_destroy(&ad->lock);
+	ramdisk_free(&ad->rd);
+}
+
+/* Completion of a single request, waited for by the submitting thread */
+struct waiter
+{
+	int sema;
+	volatile int done;
+};
+
+static void waiter_complete(struct bd_request *req)
+{
+	struct waiter *w = req->priv;
+
+	w->done = 1;
+	iSignalSema(w->sema);
+}
+
+static void waiter_init(struct waiter *w, struct bd_request *req, unsigned int op, u32 sector, struct bd_sg *sg, unsigned int sg_count)
+{
+	iop_sema_t sp;
+
+	sp.attr = 0;
+	sp.option = 0;
+	sp.initial = 0;
+	sp.max = 1;
+	w->sema = CreateSema(&sp);
+	w->done = 0;
+	req->op = op;
+	req->sector = sector;
+	req->sg = sg;
+	req->sg_count = sg_count;
+	req->result = 0;
+	req->complete = waiter_complete;
+	req->priv = w;
+}
+
+static void waiter_wait(struct waiter *w)
+{
+	WaitSema(w->sema);
+	DeleteSema(w->sema);
+}
+
+/* Asynchronous I/O checks */
+
+static void check_ext(void)
+{
+	struct ramdisk rd;
+	struct aramdisk ad;
+	struct block_device *cbd;
+	struct block_device dummy[40];
+	const struct block_device_ext *ext;
+	int i, registered = 0;
+
+	ramdisk_init(&rd, 1024);
+	bd_cache_configure(16, 8);
+	cbd = bd_cache_create(&rd.bd);
+	check("bdm/ext/none", bdm_get_ext(&rd.bd) == NULL && bdm_get_ext(cbd) == NULL);
+	bd_cache_destroy(cbd);
+	ramdisk_free(&rd);
+
+	aramdisk_init(&ad, 1024, 4);
+	check("bdm/ext/driver", bdm_get_ext(&ad.rd.bd) == &ad.ext);
+
+	// The cache queues requests with the driver, and has its queue depth
+	cbd = bd_cache_create(&ad.rd.bd);
+	ext = bdm_get_ext(cbd);
+	check("bdm/ext/cache", ext != NULL && ext != &ad.ext && ext->queue_depth == 4);
+	bd_cache_destroy(cbd);
+	check("bdm/ext/cache destroyed", bdm_get_ext(cbd) == NULL);
+
+	// The table is limited, but a full table is reported
+	memset(dummy, 0, sizeof(dummy));
+	for(i=0;i<40;i++) {
+		if(bdm_set_ext(&dummy[i], &ad.ext) < 0)
+			break;
+		registered++;
+	}
+	check("bdm/ext/table full", registered > 0 && registered < 40 && bdm_get_ext(&dummy[registered]) == NULL);
+	for(i=0;i<registered;i++)
+		bdm_set_ext(&dummy[i], NULL);
+	check("bdm/ext/removed", bdm_get_ext(&dummy[0]) == NULL && bdm_get_ext(&ad.rd.bd) == &ad.ext);
+
+	aramdisk_free(&ad);
+	check("bdm/ext/driver removed", bdm_get_ext(&ad.rd.bd) == NULL);
+}
+
+/* Transfers larger than the 16-bit count of the read/write functions */
+static void check_large_transfer(void)
+{
+	const u32 sectors = 0x11000, count = 0x10800;
+	struct ramdisk rd;
+	struct aramdisk ad;
+	u8 *buffer = malloc((size_t)count * SECTOR_SIZE);
+	u32 i;
+
+	ramdisk_init(&rd, sectors);
+	check("bdm/large/legacy read", bdm_read(&rd.bd, 0x100, buffer, count) == (int)count
+		&& !memcmp(buffer, rd.data + 0x100 * SECTOR_SIZE, (size_t)count * SECTOR_SIZE) && rd.reads == 3);
+	for(i=0;i<count * SECTOR_SIZE;i++)
+		buffer[i] = rnd(256);
+	check("bdm/large/legacy write", bdm_write(&rd.bd, 0x200, buffer, count) == (int)count
+		&& !memcmp(buffer, rd.data + 0x200 * SECTOR_SIZE, (size_t)count * SECTOR_SIZE));
+	rd.fail_sector = 0x10000;
+	check("bdm/large/legacy error", bdm_read(&rd.bd, 0, buffer, count) < 0);
+	ramdisk_free(&rd);
+
+	aramdisk_init(&ad, sectors, 2);
+	check("bdm/large/async read", bdm_read(&ad.rd.bd, 0x100, buffer, count) == (int)count
+		&& !memcmp(buffer, ad.rd.data + 0x100 * SECTOR_SIZE, (size_t)count * SECTOR_SIZE));
+	for(i=0;i<count * SECTOR_SIZE;i++)
+		buffer[i] = rnd(256);
+	check("bdm/large/async write", bdm_write(&ad.rd.bd, 0x200, buffer, count) == (int)count
+		&& !memcmp(buffer, ad.rd.data + 0x200 * SECTOR_SIZE, (size_t)count * SECTOR_SIZE));
+	check("bdm/large/async error", bdm_read(&ad.rd.bd, sectors - 8, buffer, 16) < 0);
+	aramdisk_free(&ad);
+
+	free(buffer);
+}
+
+/* Random vectored requests through the cache of an asynchronous device */
+static void check_async_data(void)
+{
+	struct aramdisk ad;
+	struct block_device *cbd;
+	struct bd_request req;
+	struct bd_sg sg[3];
+	struct waiter w;
+	u8 *buffer = malloc(3 * 32 * SECTOR_SIZE);
+	int i, ok = 1, wok = 1;
+
+	aramdisk_init(&ad, 4096, 4);
+	bd_cache_configure(32, 8);
+	cbd = bd_cache_create(&ad.rd.bd);
+
+	for(i=0;i<5000;i++) {
+		unsigned int sg_count = 1 + rnd(3), j;
+		u32 count = 0, sector;
+
+		for(j=0;j<sg_count;j++) {
+			sg[j].buffer = buffer + j * 32 * SECTOR_SIZE;
+			sg[j].count = 1 + rnd(sg_count == 1 ? 12 : 32);
+			count += sg[j].count;
+		}
+		sector = rnd(512 - count);
+
+		if(rnd(4) == 0) {
+			for(j=0;j<3 * 32 * SECTOR_SIZE;j++)
+				buffer[j] = rnd(256);
+			waiter_init(&w, &req, BD_REQ_WRITE, sector, sg, sg_count);
+		} else {
+			waiter_init(&w, &req, BD_REQ_READ, sector, sg, sg_count);
+		}
+		if(bdm_submit(cbd, &req) < 0) {
+			ok = 0;
+			continue;
+		}
+		waiter_wait(&w);
+		if(req.result != (int)count) {
+			ok = 0;
+			continue;
+		}
+
+		for(j=0;j<sg_count;j++) {
+			if(memcmp(sg[j].buffer, ad.rd.data + (size_t)sector * SECTOR_SIZE, (size_t)sg[j].count * SECTOR_SIZE)) {
+				if(req.op == BD_REQ_WRITE)
+					wok = 0;
+				else
+					ok = 0;
+			}
+			sector += sg[j].count;
+		}
+	}
+
+	check("bd_cache/async/read", ok);
+	check("bd_cache/async/write", wok);
+
+	bd_cache_destroy(cbd);
+	aramdisk_free(&ad);
+	free(buffer);
+}
+
+/* A block read while a write to it is in flight must not be cached */
+static void check_write_pending(void)
+{
+	struct aramdisk ad;
+	struct block_device *cbd;
+	struct bd_request req;
+	struct bd_sg sg;
+	struct waiter w;
+	u8 data[8 * SECTOR_SIZE], buffer[SECTOR_SIZE];
+
+	aramdisk_init(&ad, 1024, 2);
+	bd_cache_configure(16, 8);
+	cbd = bd_cache_create(&ad.rd.bd);
+
+	check("bd_cache/pending/read", cbd->read(cbd, 42, buffer, 1) == 1 && !memcmp(buffer, ad.rd.data + 42 * SECTOR_SIZE, SECTOR_SIZE));
+
+	memset(data, 0xa5, sizeof(data));
+	sg.buffer = data;
+	sg.count = 8;
+	aramdisk_hold(&ad, 1);
+	waiter_init(&w, &req, BD_REQ_WRITE, 40, &sg, 1);
+	check("bd_cache/pending/submit", bdm_submit(cbd, &req) == 0 && !w.done);
+
+	// The device still has the old data, and a reader can get it
+	check("bd_cache/pending/read during write", cbd->read(cbd, 42, buffer, 1) == 1 && !memcmp(buffer, ad.rd.data + 42 * SECTOR_SIZE, SECTOR_SIZE));
+
+	aramdisk_hold(&ad, 0);
+	waiter_wait(&w);
+	check("bd_cache/pending/complete", req.result == 8);
+	check("bd_cache/pending/read after write", cbd->read(cbd, 42, buffer, 1) == 1 && !memcmp(buffer, data, SECTOR_SIZE));
+
+	bd_cache_destroy(cbd);
+	aramdisk_free(&ad);
+}
+
+/* bd_cache_destroy() waits for the writes in flight, their completion uses the cache */
+struct destroyer
+{
+	struct block_device *cbd;
+	volatile int done;
+};
+
+static void destroyer_thread(void *arg)
+{
+	struct destroyer *d = arg;
+
+	bd_cache_destroy(d->cbd);
+	d->done = 1;
+}
+
+static void check_destroy_pending(void)
+{
+	struct aramdisk ad;
+	struct destroyer d;
+	struct bd_request req;
+	struct bd_sg sg;
+	struct waiter w;
+	u8 data[8 * SECTOR_SIZE];
+	int thid;
+
+	aramdisk_init(&ad, 1024, 2);
+	bd_cache_configure(16, 8);
+	d.cbd = bd_cache_create(&ad.rd.bd);
+	d.done = 0;
+
+	memset(data, 0x5a, sizeof(data));
+	sg.buffer = data;
+	sg.count = 8;
+	aramdisk_hold(&ad, 1);
+	waiter_init(&w, &req, BD_REQ_WRITE, 8, &sg, 1);
+	check("bd_cache/destroy/submit", bdm_submit(d.cbd, &req) == 0);
+
+	thid = iophost_start_thread(destroyer_thread, &d);
+	DelayThread(20000);
+	check("bd_cache/destroy/waits for writes", !d.done && !w.done);
+
+	aramdisk_hold(&ad, 0);
+	waiter_wait(&w);
+	iophost_join_thread(thid);
+	check("bd_cache/destroy/done", d.done && req.result == 8 && !memcmp(ad.rd.data + 8 * SECTOR_SIZE, data, sizeof(data)));
+
+	aramdisk_free(&ad);
+}
+
+/* bdm_transfer() waits on its own, a wakeup sent to the caller meanwhile stays pending */
+static void check_transfer_wakeup(void)
+{
+	struct aramdisk ad;
+	u8 buffer[8 * SECTOR_SIZE];
+	int ok;
+
+	aramdisk_init(&ad, 256, 1);
+
+	WakeupThread(TH_SELF);
+	ok = bdm_read(&ad.rd.bd, 16, buffer, 8) == 8 && !memcmp(buffer, ad.rd.data + 16 * SECTOR_SIZE, sizeof(buffer));
+	check("bdm/transfer/read", ok);
+	check("bdm/transfer/wakeup kept", CancelWakeupThread(TH_SELF) == 1);
+
+	aramdisk_free(&ad);
+}
+
+/* Queue depth benchmark */
+
+#define BENCH_REQUESTS 1024
+#define BENCH_SECTORS 64
+#define BENCH_LATENCY 200
+
+struct bench_slot
+{
+	struct bd_request req;
+	struct bd_sg sg;
+	volatile int busy;
+};
+
+static int bench_thid;
+static volatile int bench_errors;
+
+static void bench_complete(struct bd_request *req)
+{
+	struct bench_slot *slot = req->priv;
+
+	if(req->result != BENCH_SECTORS)
+		__sync_fetch_and_add(&bench_errors, 1);
+	slot->busy = 0;
+	iWakeupThread(bench_thid);
+}
+
+static double bench_time(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void bench_report(const char *name, unsigned int depth, double seconds)
+{
+	printf("  %-22s depth %u: %8.0f requests/s %7.1f MiB/s\n", name, depth,
+		BENCH_REQUESTS / seconds, BENCH_REQUESTS * (double)BENCH_SECTORS * SECTOR_SIZE / (1024 * 1024) / seconds);
+}
+
+/* Keep 'depth' requests in flight until all have completed */
+static double bench_queued(struct block_device *bd, unsigned int op, unsigned int depth, u8 *buffer)
+{
+	struct bench_slot slot[ARAMDISK_MAX_CHANNELS];
+	unsigned int i, issued = 0, done;
+	double start = bench_time();
+
+	bench_thid = GetThreadId();
+	for(i=0;i<depth;i++) {
+		slot[i].busy = 0;
+		slot[i].sg.buffer = buffer + (size_t)i * BENCH_SECTORS * SECTOR_SIZE;
+		slot[i].sg.count = BENCH_SECTORS;
+	}
+
+	for(;;) {
+		done = 1;
+		for(i=0;i<depth;i++) {
+			if(slot[i].busy) {
+				done = 0;
+			} else if(issued < BENCH_REQUESTS) {
+				slot[i].busy = 1;
+				slot[i].req.op = op;
+				slot[i].req.sector = rnd(BENCH_REQUESTS) * BENCH_SECTORS;
+				slot[i].req.sg = &slot[i].sg;
+				slot[i].req.sg_count = 1;
+				slot[i].req.complete = bench_complete;
+				slot[i].req.priv = &slot[i];
+				issued++;
+				done = 0;
+				if(bdm_submit(bd, &slot[i].req) < 0) {
+					bench_errors++;
+					slot[i].busy = 0;
+				}
+			}
+		}
+		if(done)
+			break;
+		SleepThread();
+	}
+	CancelWakeupThread(TH_SELF);
+
+	return bench_time() - start;
+}
+
+static int bench(void)
+{
+	struct aramdisk ad;
+	struct block_device *cbd;
+	u8 *buffer = malloc((size_t)ARAMDISK_MAX_CHANNELS * BENCH_SECTORS * SECTOR_SIZE);
+	unsigned int depth;
+	double start;
+	int i;
+
+	aramdisk_init(&ad, BENCH_REQUESTS * BENCH_SECTORS, ARAMDISK_MAX_CHANNELS);
+	ad.rd.latency = BENCH_LATENCY;
+	bd_cache_configure(32, 8);
+	cbd = bd_cache_create(&ad.rd.bd);
+
+	printf("%d requests of %d sectors, %d us per request, %d device channels\n",
+		BENCH_REQUESTS, BENCH_SECTORS, BENCH_LATENCY, ARAMDISK_MAX_CHANNELS);
+
+	// Before: one synchronous request at a time
+	start = bench_time();
+	for(i=0;i<BENCH_REQUESTS;i++) {
+		if(cbd->read(cbd, rnd(BENCH_REQUESTS) * BENCH_SECTORS, buffer, BENCH_SECTORS) != BENCH_SECTORS)
+			bench_errors++;
+	}
+	bench_report("read()", 1, bench_time() - start);
+
+	for(depth=1;depth<=ARAMDISK_MAX_CHANNELS;depth*=2)
+		bench_report("bdm_submit() read", depth, bench_queued(cbd, BD_REQ_READ, depth, buffer));
+	for(depth=1;depth<=ARAMDISK_MAX_CHANNELS;depth*=2)
+		bench_report("bdm_submit() write", depth, bench_queued(cbd, BD_REQ_WRITE, depth, buffer));
+
+	if(bench_errors != 0)
+		printf("%d errors\n", bench_errors);
+
+	bd_cache_destroy(cbd);
+	aramdisk_free(&ad);
+	free(buffer);
+
+	return bench_errors != 0;
+}
+
+/* Trace replay */
+
+static int replay(const char *path, unsigned int block_count, unsigned int sectors_per_block)
+{
+	struct ramdisk rd;
+	struct block_device *cbd;
+	bd_cache_stats_t stats;
+	char line[256], op;
+	unsigned long sector, count;
+	u32 sectors = 0, ops = 0, errors = 0;
+	u8 *buffer;
+	FILE *f;
+
+	if((f = fopen(path, "r")) == NULL) {
+		printf("Can't open %s\n", path);
+		return 1;
+	}
+
+	// The device is as large as the trace needs
+	while(fgets(line, sizeof(line), f) != NULL) {
+		if(sscanf(line, " %c %lu %lu", &op, &sector, &count) == 3 && (op == 'r' || op == 'w') && sector + count > sectors)
+			sectors = sector + count;
+	}
+
+	ramdisk_init(&rd, sectors);
+	bd_cache_configure(block_count, sectors_per_block);
+	cbd = bd_cache_create(&rd.bd);
+	buffer = malloc(0xffff * SECTOR_SIZE);
+
+	rewind(f);
+	while(fgets(line, sizeof(line), f) != NULL) {
+		if(sscanf(line, " %c %lu %lu", &op, &sector, &count) != 3 || count == 0 || count > 0xffff)
+			continue;
+		if(op == 'r') {
+			if(cbd->read(cbd, sector, buffer, count) != (int)count || memcmp(buffer, rd.data + sector * SECTOR_SIZE, count * SECTOR_SIZE))
+				errors++;
+		} else if(op == 'w') {
+			memset(buffer, ops, count * SECTOR_SIZE);
+			if(cbd->write(cbd, sector, buffer, count) != (int)count)
+				errors++;
+		} else {
+			continue;
+		}
+		ops++;
+	}
+	fclose(f);
+
+	bd_cache_get_stats(cbd, &stats);
+	printf("%u operations, %u errors\n", ops, errors);
+	printf("cache: %u blocks of %u sectors\n", stats.block_count, stats.sectors_per_block);
+	printf("hits %u, misses %u, evictions %u, promotions %u\n", stats.hits, stats.misses, stats.evictions, stats.promotions);
+	printf("direct sectors %u, write updates %u\n", stats.direct_sectors, stats.write_updates);
+	printf("device: %u reads (%u sectors), %u writes\n", rd.reads, rd.read_sectors, rd.writes);
+
+	free(buffer);
+	bd_cache_destroy(cbd);
+	ramdisk_free(&rd);
+
+	return errors != 0;
+}
+
+static void usage(void)
+{
+	printf("Usage: bdmcheck [-b] [-t trace] [-c blocks] [-s sectors]\n");
+	printf("Checks the BDM block cache on a RAM block device.\n");
+	printf("  -b          measure the throughput of queued requests instead\n");
+	printf("  -t trace    replay a trace instead, one \"r|w sector count\" per line\n");
+	printf("  -c blocks   cache blocks for the trace (default 32)\n");
+	printf("  -s sectors  sectors per cache block for the trace (default 8)\n");
+}
+
+int main(int argc, char *argv[])
+{
+	const char *trace = NULL;
+	unsigned int block_count = 32, sectors_per_block = 8;
+	int allocs, i;
+
+	for(i=1;i<argc;i++) {
+		if(!strcmp(argv[i], "-b")) {
+			return bench();
+		} else if(!strcmp(argv[i], "-t") && i + 1 < argc) {
+			trace = argv[++i];
+		} else if(!strcmp(argv[i], "-c") && i + 1 < argc) {
+			block_count = strtoul(argv[++i], NULL, 0);
+		} else if(!strcmp(argv[i], "-s") && i + 1 < argc) {
+			sectors_per_block = strtoul(argv[++i], NULL, 0);
+		} else {
+			usage();
+			return 1;
+		}
+	}
+
+	if(trace != NULL)
+		return replay(trace, block_count, sectors_per_block);
+
+	allocs = iophost_alloc_count();
+
+	check_data(32, 8, 4096);
+	check_data(4, 1, 256);
+	check_data(64, 16, 2000); // Incomplete last block
+	check_data(1024, 4, 65536);
+	check_scan_resistance();
+	check_stats();
+	check_read_error();
+	check_ext();
+	check_large_transfer();
+	check_async_data();
+	check_write_pending();
+	check_destroy_pending();
+	check_transfer_wakeup();
+
+	check("bd_cache/memory", iophost_alloc_count() == allocs);
+
+	printf("%d checks, %d failed\n", checks, failures);
+
+	return failures != 0;
+}
@@ -14,23 +14,98 @@
 #include <fcntl.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include "lz4enc.h"
 
-unsigned char *buffer;
+#define CHUNK_SIZE 0x10000
+
+static const char hex[] = "0123456789abcdef";
+
+/* Output is formatted into a large buffer and written out in one go */
+static char outbuf[CHUNK_SIZE * 8];
+static size_t outlen;
+
+static void flush_output(FILE *dest)
+{
+	fwrite(outbuf, 1, outlen, dest);
+	outlen = 0;
+}
+
+/* Formats the payload bytes; pos is the offset of the first one */
+static void put_bytes(const unsigned char *data, size_t len, size_t pos)
+{
+	char *p = outbuf + outlen;
+	size_t i;
+
+	for(i=0;i<len;i++,pos++) {
+		if((pos % 16) == 0) {
+			*p++ = '\n';
+			*p++ = '\t';
+		}
+		*p++ = '0';
+		*p++ = 'x';
+		*p++ = hex[data[i] >> 4];
+		*p++ = hex[data[i] & 15];
+		*p++ = ',';
+		*p++ = ' ';
+	}
+	outlen = p - outbuf;
+}
+
+static void usage(void)
+{
+	printf("bin2c - from bin2s By Sjeep\n"
+		   "Usage: bin2c [-a XX] [-s XX] [-z] infile outfile label\n"
+		   "  -a XX - align the data to XX bytes (default 16).\n"
+		   "  -s XX - put the data in section XX.\n"
+		   "  -z    - compress the data, to be unpacked with unlz4() from unlz4.h.\n"
+		   "          The array is then called label_lz4 and its size is size_label_lz4.\n\n");
+}
 
 int main(int argc, char *argv[])
 {
-	int fd_size;
+	unsigned char *buffer, *packed = NULL;
+	size_t fd_size, packed_size = 0, pos;
 	FILE *source,*dest;
+	const char *f_source = NULL, *f_dest = NULL, *label = NULL, *section = NULL;
+	int alignment = 16, compress = 0;
 	int i;
 
-	if(argc != 4) {
-		printf("bin2c - from bin2s By Sjeep\n"
-			   "Usage: bin2c infile outfile label\n\n");
+	for(i=1;i<argc;i++) {
+		if(argv[i][0] == '-' && argv[i][1] != '\0') {
+			if(!strcmp(argv[i], "-z")) {
+				compress = 1;
+			} else if(!strcmp(argv[i], "-a") && i + 1 < argc) {
+				alignment = atoi(argv[++i]);
+				if(alignment <= 0 || ((alignment - 1) & alignment)) {
+					printf("Error: alignment must be a power of 2.\n");
+					return 1;
+				}
+			} else if(!strcmp(argv[i], "-s") && i + 1 < argc) {
+				section = argv[++i];
+			} else {
+				usage();
+				return 1;
+			}
+		} else if(f_source == NULL) {
+			f_source = argv[i];
+		} else if(f_dest == NULL) {
+			f_dest = argv[i];
+		} else if(label == NULL) {
+			label = argv[i];
+		} else {
+			usage();
+			return 1;
+		}
+	}
+
+	if(label == NULL) {
+		usage();
 		return 1;
 	}
 
-	if((source=fopen( argv[1], "rb")) == NULL) {
-		printf("Error opening %s for reading.\n",argv[1]);
+	if((source=fopen( f_source, "rb")) == NULL) {
+		printf("Error opening %s for reading.\n",f_source);
 		return 1;
 	}
 
@@ -38,38 +113,77 @@ int main(int argc, char *argv[])
 	fd_size = ftell(source);
 	fseek(source,0,SEEK_SET);
 
-	buffer = malloc(fd_size);
+	/* The input is streamed through in chunks, unless it has to be compressed as a whole */
+	buffer = malloc(compress ? fd_size + 1 : CHUNK_SIZE);
 	if(buffer == NULL) {
 		printf("Failed to allocate memory.\n");
 		fclose(source);
 		return 1;
 	}
 
-	if(fread(buffer,1,fd_size,source) != fd_size) {
-		printf("Failed to read file.\n");
-		fclose(source);
-		return 1;
+	if(compress) {
+		if(fread(buffer,1,fd_size,source) != fd_size) {
+			printf("Failed to read file.\n");
+			fclose(source);
+			return 1;
+		}
+		packed = malloc(LZ4ENC_BOUND(fd_size));
+		if(packed == NULL) {
+			printf("Failed to allocate memory.\n");
+			fclose(source);
+			return 1;
+		}
+		packed_size = lz4enc_compress(buffer, fd_size, packed);
 	}
-	fclose(source);
 
-	if((dest = fopen(argv[2],"w+")) == NULL) {
-		printf("Failed to open/create %s.\n",argv[2]);
+	if((dest = fopen(f_dest,"w+")) == NULL) {
+		printf("Failed to open/create %s.\n",f_dest);
+		fclose(source);
 		return 1;
 	}
 
-	fprintf(dest, "#ifndef __%s__\n", argv[3]);
-	fprintf(dest, "#define __%s__\n\n", argv[3]);
-	fprintf(dest, "unsigned int size_%s = %d;\n", argv[3], fd_size);
-	fprintf(dest, "unsigned char %s[] __attribute__((aligned(16))) = {", argv[3]);
+	fprintf(dest, "#ifndef __%s__\n", label);
+	fprintf(dest, "#define __%s__\n\n", label);
+	fprintf(dest, "unsigned int size_%s = %u;\n", label, (unsigned int)fd_size);
+	if(compress)
+		fprintf(dest, "unsigned int size_%s_lz4 = %u;\n", label, (unsigned int)packed_size);
+	fprintf(dest, "unsigned char %s%s[] __attribute__((aligned(%d)))", label, compress ? "_lz4" : "", alignment);
+	if(section != NULL)
+		fprintf(dest, " __attribute__((section(\"%s\")))", section);
+	fprintf(dest, " = {");
 
-	for(i=0;i<fd_size;i+=1) {
-		if((i % 16) == 0) fprintf(dest, "\n\t");
-		fprintf(dest, "0x%02x, ", buffer[i]);
+	if(compress) {
+		for(pos=0;pos<packed_size;pos+=CHUNK_SIZE) {
+			size_t len = (packed_size - pos < CHUNK_SIZE) ? packed_size - pos : CHUNK_SIZE;
+
+			put_bytes(packed + pos, len, pos);
+			flush_output(dest);
+		}
+	} else {
+		for(pos=0;pos<fd_size;pos+=CHUNK_SIZE) {
+			size_t len = (fd_size - pos < CHUNK_SIZE) ? fd_size - pos : CHUNK_SIZE;
+
+			if(fread(buffer,1,len,source) != len) {
+				printf("Failed to read file.\n");
+				fclose(source);
+				fclose(dest);
+				return 1;
+			}
+			put_bytes(buffer, len, pos);
+			flush_output(dest);
+		}
 	}
+	fclose(source);
 
 	fprintf(dest, "\n};\n\n#endif\n");
 
-	fclose(dest);
+	if(ferror(dest) | fclose(dest)) {
+		printf("Failed to write %s.\n",f_dest);
+		return 1;
+	}
+
+	free(packed);
+	free(buffer);
 
 	return 0;
 }
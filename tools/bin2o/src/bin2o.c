@@ -17,6 +17,9 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include "lz4enc.h"
+
+#define CHUNK_SIZE 0x10000
 
 typedef unsigned char u8;
 typedef unsigned short u16;
@@ -27,6 +30,7 @@ static int have_size = 1;
 static int have_irx = 0;
 static short int put_payload_in_SDATA = 0, put_labels_in_SDATA = 0;
 static int SDATA_size_limit = 0;
+static const char *data_section = ".data";
 
 static u32 LE32(u32 b) {
     u32 t = 0x12345678;
@@ -87,15 +91,20 @@ struct elf_symbol_t {
 
 //                 0 0000000001 11111111 12222222 22233
 //                 0 1234567890 12345678 90123456 78901
-static const char shstrtab[] = "\0.shstrtab\0.symtab\0.strtab\0.data";
-static const char shstrtab_sdata[] = "\0.shstrtab\0.symtab\0.strtab\0.sdata\0.data";
+static const char shstrtab[] = "\0.shstrtab\0.symtab\0.strtab\0";
+static const char shstrtab_sdata[] = "\0.shstrtab\0.symtab\0.strtab\0.sdata\0";
 
-static void create_elf(FILE * dest, const unsigned char * source, u32 size, const char * label) {
-    int i, l_size;
+/*
+ * The payload is either the compressed data in packed, or size bytes
+ * streamed from source. orig_size is stored at label_size.
+ */
+static int create_elf(FILE * dest, FILE * source, const unsigned char * packed, u32 size, u32 orig_size, const char * label) {
+    int l_size;
     struct elf_section_t section;
     struct elf_symbol_t symbol;
     u32 strtab_size;
     char strtab[512];
+    char shstrtab_buf[sizeof(shstrtab_sdata) + 256];
     unsigned int shrtabSectionNameLength, NumSections;
     const char *pshstrtab_ptr;
 
@@ -109,9 +118,7 @@ static void create_elf(FILE * dest, const unsigned char * source, u32 size, cons
     NumSections=(put_payload_in_SDATA || put_labels_in_SDATA)?6:5;
     elf_header[sizeof(elf_header)-4]=NumSections;
 
-    for (i = 0; i < sizeof(elf_header); i++) {
-	fputc(elf_header[i], dest);
-    }
+    fwrite(elf_header, 1, sizeof(elf_header), dest);
 
     l_size = strlen(label);
 
@@ -137,11 +144,16 @@ static void create_elf(FILE * dest, const unsigned char * source, u32 size, cons
     // section 1 (.shstrtab)
     if(put_payload_in_SDATA || put_labels_in_SDATA){
 	pshstrtab_ptr=shstrtab_sdata;
-	shrtabSectionNameLength=sizeof(shstrtab_sdata);
+	shrtabSectionNameLength=sizeof(shstrtab_sdata) - 1;
     }else{
 	pshstrtab_ptr=shstrtab;
-	shrtabSectionNameLength=sizeof(shstrtab);
+	shrtabSectionNameLength=sizeof(shstrtab) - 1;
     }
+    // The name of the data section goes last
+    memcpy(shstrtab_buf, pshstrtab_ptr, shrtabSectionNameLength);
+    strcpy(shstrtab_buf + shrtabSectionNameLength, data_section);
+    shrtabSectionNameLength += strlen(data_section) + 1;
+    pshstrtab_ptr = shstrtab_buf;
     section.sh_name = LE32(1);
     section.sh_type = LE32(3); // STRTAB
     section.sh_flags = 0;
@@ -200,7 +212,7 @@ static void create_elf(FILE * dest, const unsigned char * source, u32 size, cons
     }
 
     // section 4/5 (.data)
-    section.sh_name = LE32((put_payload_in_SDATA||put_labels_in_SDATA)?35:27);
+    section.sh_name = LE32((put_payload_in_SDATA||put_labels_in_SDATA)?34:27);
     section.sh_type = LE32(1); // PROGBITS
     section.sh_flags = LE32(3); // Write + Alloc
     section.sh_addr = 0;
@@ -251,18 +263,37 @@ static void create_elf(FILE * dest, const unsigned char * source, u32 size, cons
     if (have_size) {
         u32 data_size[4];
 
-        data_size[0] = LE32(size);
-        data_size[1] = 0;
+        data_size[0] = LE32(orig_size);
+        data_size[1] = (packed != NULL) ? LE32(size) : 0;
         data_size[2] = 0;
         data_size[3] = 0;
         fwrite(data_size, 4, 4, dest);
     }
-    fwrite(source, 1, size, dest);
+
+    if (packed != NULL) {
+	fwrite(packed, 1, size, dest);
+    } else {
+	unsigned char buffer[CHUNK_SIZE];
+
+	// Stream the payload through, instead of loading it as a whole
+	while (size > 0) {
+	    u32 len = (size < CHUNK_SIZE) ? size : CHUNK_SIZE;
+
+	    if (fread(buffer, 1, len, source) != len) {
+		printf("Failed to read file.\n");
+		return -1;
+	    }
+	    fwrite(buffer, 1, len, dest);
+	    size -= len;
+	}
+    }
+
+    return ferror(dest) ? -1 : 0;
 }
 
 static void usage(void) {
     printf("bin2o - Converts a binary file into a .o file.\n"
-           "Usage: bin2o [-a XX] [-n] [-i] [-b XX] [-e XX] [-s XX] [-GXX] infile outfile label\n"
+           "Usage: bin2o [-a XX] [-n] [-i] [-z] [-b XX] [-e XX] [-s XX] [-S XX] [-GXX] infile outfile label\n"
 	   "  -i    - create an iop-compatible .o file.\n"
 	   "  -n    - don't add label_size symbol.\n"
 	   "  -a XX - set .data section alignment to XX.\n"
@@ -270,6 +301,10 @@ static void usage(void) {
 	   "  -b XX - start reading file at this offset.\n"
 	   "  -e XX - stop reading file at this offset.\n"
 	   "  -s XX - force output data to be of this size.\n"
+	   "  -S XX - put the data in section XX instead of .data.\n"
+	   "  -z    - compress the data, to be unpacked with unlz4() from unlz4.h.\n"
+	   "          label_size holds the uncompressed size and label_size+4\n"
+	   "          the compressed size.\n"
 	   "  -GXX  - Puts data smaller than XX bytes within the sdata section\n"
 	   "          (same as the -G option of GCC).\n"
 	   "\n"
@@ -279,10 +314,12 @@ static void usage(void) {
 int main(int argc, char *argv[])
 {
     u32 fd_size, start = 0, end = 0xffffffff, size = 0xffffffff;
-    unsigned char * buffer;
+    unsigned char * buffer = NULL, * packed = NULL;
+    u32 packed_size;
     FILE * source, * dest;
     char * f_source = 0, * f_dest = 0, * f_label = 0;
-    int i;
+    int compress = 0;
+    int i, result;
 
     for (i = 1; i < argc; i++) {
 	if (argv[i][0] == '-') {
@@ -308,6 +345,18 @@ int main(int argc, char *argv[])
 	    case 'n':
 		have_size = 0;
 		break;
+	    case 'z':
+		compress = 1;
+		break;
+	    case 'S':
+		i++;
+		if (!argv[i] || strlen(argv[i]) > 255) {
+		    usage();
+		    printf("-S requires an argument.\n");
+		    return 1;
+		}
+		data_section = argv[i];
+		break;
 	    case 'i':
 		have_irx = 1;
 		break;
@@ -394,38 +443,60 @@ int main(int argc, char *argv[])
     if (fd_size < end)
 	end = fd_size;
 
+    if (start > end) {
+	printf("Error: start offset is past the end of the data.\n");
+	return 1;
+    }
+
     if (end < (size - start))
 	size = end - start;
 
+    if (compress && !have_size) {
+	printf("Error: -z needs the label_size symbol.\n");
+	return 1;
+    }
+
+    packed_size = size;
+    if (compress) {
+	buffer = malloc(size + 1);
+	packed = malloc(LZ4ENC_BOUND(size));
+	if (buffer == NULL || packed == NULL) {
+	    printf("Failed to allocate memory.\n");
+	    return 1;
+	}
+
+	if (fread(buffer, 1, size, source) != size) {
+	    printf("Failed to read file.\n");
+	    return 1;
+	}
+	packed_size = lz4enc_compress(buffer, size, packed);
+    }
+
     if(SDATA_size_limit>0){
-	put_payload_in_SDATA=(SDATA_size_limit>=size)?1:0;
+	put_payload_in_SDATA=(SDATA_size_limit>=packed_size)?1:0;
 	put_labels_in_SDATA=(have_size && SDATA_size_limit>=16)?1:0;
     }
     else{
 	put_payload_in_SDATA = put_labels_in_SDATA = 0;
     }
 
-    buffer = malloc(size);
-    if (buffer == NULL) {
-	printf("Failed to allocate memory.\n");
-	return 1;
-    }
-
-    if (fread(buffer, 1, size, source) != size) {
-	printf("Failed to read file.\n");
-	return 1;
-    }
-    fclose(source);
-
     if (!(dest = fopen(f_dest, "wb+"))) {
 	printf("Failed to open/create %s.\n", f_dest);
 	return 1;
     }
 
-    create_elf(dest, buffer, size, f_label);
+    result = create_elf(dest, source, packed, packed_size, size, f_label);
 
-    fclose(dest);
+    fclose(source);
+    if (fclose(dest) != 0)
+	result = -1;
+    free(packed);
     free(buffer);
 
+    if (result < 0) {
+	printf("Failed to write %s.\n", f_dest);
+	return 1;
+    }
+
     return 0;
 }
@@ -14,22 +14,97 @@
 #include <fcntl.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include "lz4enc.h"
 
-unsigned char *buffer;
+#define CHUNK_SIZE 0x10000
+
+static const char hex[] = "0123456789abcdef";
+
+/* Output is formatted into a large buffer and written out in one go */
+static char outbuf[CHUNK_SIZE * 8];
+static size_t outlen;
+
+static void flush_output(FILE *dest)
+{
+	fwrite(outbuf, 1, outlen, dest);
+	outlen = 0;
+}
+
+/* Formats the payload bytes; pos is the offset of the first one */
+static void put_bytes(const unsigned char *data, size_t len, size_t pos)
+{
+	static const char line[] = "\n\t.byte 0x";
+	char *p = outbuf + outlen;
+	size_t i;
+
+	for(i=0;i<len;i++,pos++) {
+		if((pos % 16) == 0) {
+			memcpy(p, line, sizeof(line) - 1);
+			p += sizeof(line) - 1;
+		} else {
+			memcpy(p, ", 0x", 4);
+			p += 4;
+		}
+		*p++ = hex[data[i] >> 4];
+		*p++ = hex[data[i] & 15];
+	}
+	outlen = p - outbuf;
+}
+
+static void usage(void)
+{
+	printf("Usage: bin2s [-a XX] [-z] infile outfile label [section]\n"
+		   "  -a XX - align the data to XX bytes (default 16).\n"
+		   "  -z    - compress the data, to be unpacked with unlz4() from unlz4.h.\n"
+		   "          The data is then called label_lz4 and its size is size_label_lz4.\n\n");
+}
 
 int main(int argc, char *argv[])
 {
-	int fd_size;
+	unsigned char *buffer, *packed = NULL;
+	size_t fd_size, data_size, pos;
 	FILE *source,*dest;
+	const char *f_source = NULL, *f_dest = NULL, *label = NULL, *section = NULL;
+	const char *suffix;
+	int alignment = 16, compress = 0;
 	int i;
 
-	if(argc != 4 && argc != 5) {
-		printf("Usage: bin2s infile outfile label [section]\n\n");
+	for(i=1;i<argc;i++) {
+		if(argv[i][0] == '-' && argv[i][1] != '\0' && f_source == NULL) {
+			if(!strcmp(argv[i], "-z")) {
+				compress = 1;
+			} else if(!strcmp(argv[i], "-a") && i + 1 < argc) {
+				alignment = atoi(argv[++i]);
+				if(alignment <= 0 || ((alignment - 1) & alignment)) {
+					printf("Error: alignment must be a power of 2.\n");
+					return 1;
+				}
+			} else {
+				usage();
+				return 1;
+			}
+		} else if(f_source == NULL) {
+			f_source = argv[i];
+		} else if(f_dest == NULL) {
+			f_dest = argv[i];
+		} else if(label == NULL) {
+			label = argv[i];
+		} else if(section == NULL) {
+			section = argv[i];
+		} else {
+			usage();
+			return 1;
+		}
+	}
+
+	if(label == NULL) {
+		usage();
 		return 1;
 	}
 
-	if((source=fopen( argv[1], "rb")) == NULL) {
-		printf("Error opening %s for reading.\n",argv[1]);
+	if((source=fopen( f_source, "rb")) == NULL) {
+		printf("Error opening %s for reading.\n",f_source);
 		return 1;
 	}
 
@@ -37,22 +112,34 @@ int main(int argc, char *argv[])
 	fd_size = ftell(source);
 	fseek(source,0,SEEK_SET);
 
-	buffer = malloc(fd_size);
+	/* The input is streamed through in chunks, unless it has to be compressed as a whole */
+	buffer = malloc(compress ? fd_size + 1 : CHUNK_SIZE);
 	if(buffer == NULL) {
 		printf("Failed to allocate memory.\n");
 		fclose(source);
 		return 1;
 	}
 
-	if(fread(buffer,1,fd_size,source) != fd_size) {
-		printf("Failed to read file.\n");
-		fclose(source);
-		return 1;
+	data_size = fd_size;
+	if(compress) {
+		if(fread(buffer,1,fd_size,source) != fd_size) {
+			printf("Failed to read file.\n");
+			fclose(source);
+			return 1;
+		}
+		packed = malloc(LZ4ENC_BOUND(fd_size));
+		if(packed == NULL) {
+			printf("Failed to allocate memory.\n");
+			fclose(source);
+			return 1;
+		}
+		data_size = lz4enc_compress(buffer, fd_size, packed);
 	}
-	fclose(source);
+	suffix = compress ? "_lz4" : "";
 
-	if((dest = fopen(argv[2],"w+")) == NULL) {
-		printf("Failed to open/create %s.\n",argv[2]);
+	if((dest = fopen(f_dest,"w+")) == NULL) {
+		printf("Failed to open/create %s.\n",f_dest);
+		fclose(source);
 		return 1;
 	}
 
@@ -61,27 +148,53 @@ int main(int argc, char *argv[])
 	fprintf(dest, ".ifdef .gasversion.\n.nan legacy\n.module singlefloat\n.module oddspreg\n.endif\n");
 
 	fprintf(dest, ".sdata\n\n");
-	fprintf(dest, ".align 2\n.type size_%s,@object\n.size size_%s,4\n.globl size_%s\nsize_%s:\t.word %d\n\n", argv[3], argv[3], argv[3], argv[3], fd_size);
+	fprintf(dest, ".align 2\n.type size_%s,@object\n.size size_%s,4\n.globl size_%s\nsize_%s:\t.word %u\n\n", label, label, label, label, (unsigned int)fd_size);
+	if(compress)
+		fprintf(dest, ".align 2\n.type size_%s_lz4,@object\n.size size_%s_lz4,4\n.globl size_%s_lz4\nsize_%s_lz4:\t.word %u\n\n", label, label, label, label, (unsigned int)data_size);
 
-	if( argc == 5 )
-		fprintf(dest, ".SECTION %s\n\n",argv[4]);
+	if( section != NULL )
+		fprintf(dest, ".SECTION %s\n\n",section);
 	else
 		fprintf(dest, ".data\n\n");
 
-	fprintf(dest, ".balign 16\n\n");
-	fprintf(dest, ".globl %s\n",argv[3]);
-	fprintf(dest, ".type %s,@object\n",argv[3]);
-	fprintf(dest, ".size %s,%d\n",argv[3],fd_size);
-	fprintf(dest, "%s:\n\n",argv[3]);
-
-	for(i=0;i<fd_size;i++) {
-		if((i % 16) == 0) fprintf(dest, "\n\t.byte 0x%02x", buffer[i]);
-		else fprintf(dest, ", 0x%02x", buffer[i]);
+	fprintf(dest, ".balign %d\n\n", alignment);
+	fprintf(dest, ".globl %s%s\n",label,suffix);
+	fprintf(dest, ".type %s%s,@object\n",label,suffix);
+	fprintf(dest, ".size %s%s,%u\n",label,suffix,(unsigned int)data_size);
+	fprintf(dest, "%s%s:\n\n",label,suffix);
+
+	if(compress) {
+		for(pos=0;pos<data_size;pos+=CHUNK_SIZE) {
+			size_t len = (data_size - pos < CHUNK_SIZE) ? data_size - pos : CHUNK_SIZE;
+
+			put_bytes(packed + pos, len, pos);
+			flush_output(dest);
+		}
+	} else {
+		for(pos=0;pos<fd_size;pos+=CHUNK_SIZE) {
+			size_t len = (fd_size - pos < CHUNK_SIZE) ? fd_size - pos : CHUNK_SIZE;
+
+			if(fread(buffer,1,len,source) != len) {
+				printf("Failed to read file.\n");
+				fclose(source);
+				fclose(dest);
+				return 1;
+			}
+			put_bytes(buffer, len, pos);
+			flush_output(dest);
+		}
 	}
+	fclose(source);
 
 	fprintf(dest, "\n");
 
-	fclose(dest);
+	if(ferror(dest) | fclose(dest)) {
+		printf("Failed to write %s.\n",f_dest);
+		return 1;
+	}
+
+	free(packed);
+	free(buffer);
 
 	return 0;
 }
@@ -0,0 +1,600 @@
+/*
+# _____     ___ ____     ___ ____
+#  ____|   |    ____|   |        | |____|
+# |     ___|   |____ ___|    ____| |    \    PS2DEV Open Source Project.
+#-----------------------------------------------------------------------
+# Copyright 2001-2004, ps2dev - http://www.ps2dev.org
+# Licenced under Academic Free License version 2.0
+# Review ps2sdk README & LICENSE files for further details.
+*/
+
+/* erl-prelink: appends a prelink index (see erl_prelink.h) to an ERL file.
+ *
+ * The ERL is rewritten with the same sections, in the same order, and the
+ * index as an extra last section. The sections are not touched, so the file
+ * can still be loaded the normal way by older loaders. Running it again on a
+ * prelinked ERL replaces the index.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <erl_prelink.h>
+
+#define ELF_HEADER_SIZE  52
+#define ELF_SECTION_SIZE 40
+#define ELF_SYMBOL_SIZE  16
+#define ELF_REL_SIZE     8
+
+#define SHT_SYMTAB   2
+#define SHT_PROGBITS 1
+#define SHT_NOBITS   8
+#define SHT_REL      9
+
+#define SHN_ABS 0xfff1
+
+#define STB_LOCAL  0
+#define STB_GLOBAL 1
+#define STB_WEAK   2
+
+#define STT_NOTYPE  0
+#define STT_OBJECT  1
+#define STT_FUNC    2
+#define STT_SECTION 3
+
+#define R_MIPS_32   2
+#define R_MIPS_26   4
+#define R_MIPS_HI16 5
+#define R_MIPS_LO16 6
+
+struct section
+{
+	unsigned int name, type, flags, addr, offset, size;
+	unsigned int link, info, addralign, entsize;
+};
+
+static unsigned char *elf;
+static size_t elf_size;
+static struct section *sec;
+static unsigned int shnum;
+
+/* Index being built */
+static struct erl_prelink_symbol_t *imports, *exports;
+static struct erl_prelink_reloc_t *relocs;
+static unsigned int nimports, nexports, nrelocs;
+static char *strings;
+static unsigned int strsize, strcap;
+
+static int verbose;
+
+static unsigned int rd16(const unsigned char *p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+static unsigned int rd32(const unsigned char *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+static void wr16(unsigned char *p, unsigned int v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+}
+
+static void wr32(unsigned char *p, unsigned int v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
+}
+
+static void *xmalloc(size_t size)
+{
+	void *p = calloc(1, size ? size : 1);
+
+	if(p == NULL) {
+		printf("Failed to allocate memory.\n");
+		exit(1);
+	}
+	return p;
+}
+
+static unsigned int add_string(const char *s)
+{
+	unsigned int len = strlen(s) + 1, offset = strsize;
+
+	if(strsize + len > strcap) {
+		strcap = (strsize + len) * 2;
+		strings = realloc(strings, strcap);
+		if(strings == NULL) {
+			printf("Failed to allocate memory.\n");
+			exit(1);
+		}
+	}
+	memcpy(strings + strsize, s, len);
+	strsize += len;
+	return offset;
+}
+
+static int in_file(unsigned int offset, unsigned int size)
+{
+	return offset <= elf_size && size <= elf_size - offset;
+}
+
+static int read_sections(void)
+{
+	unsigned int shoff, i;
+
+	if(elf_size < ELF_HEADER_SIZE || memcmp(elf, "\177ELF", 4) || elf[4] != 1 || elf[5] != 1) {
+		printf("Not a 32-bit little endian ELF file.\n");
+		return -1;
+	}
+	if(rd16(elf + 16) != 1 || rd16(elf + 44) != 0) {
+		printf("Not a relocatable ELF file.\n");
+		return -1;
+	}
+	if(rd16(elf + 46) != ELF_SECTION_SIZE) {
+		printf("Unexpected section header size.\n");
+		return -1;
+	}
+
+	shoff = rd32(elf + 32);
+	shnum = rd16(elf + 48);
+	if(shnum < 2 || !in_file(shoff, shnum * ELF_SECTION_SIZE)) {
+		printf("Invalid section table.\n");
+		return -1;
+	}
+
+	sec = xmalloc(shnum * sizeof(*sec));
+	for(i=0;i<shnum;i++) {
+		const unsigned char *p = elf + shoff + i * ELF_SECTION_SIZE;
+
+		sec[i].name = rd32(p);
+		sec[i].type = rd32(p + 4);
+		sec[i].flags = rd32(p + 8);
+		sec[i].addr = rd32(p + 12);
+		sec[i].offset = rd32(p + 16);
+		sec[i].size = rd32(p + 20);
+		sec[i].link = rd32(p + 24);
+		sec[i].info = rd32(p + 28);
+		sec[i].addralign = rd32(p + 32);
+		sec[i].entsize = rd32(p + 36);
+
+		if(sec[i].type != SHT_NOBITS && !in_file(sec[i].offset, sec[i].size)) {
+			printf("Section %u is out of the file.\n", i);
+			return -1;
+		}
+	}
+
+	/* Drop the index of an earlier run */
+	if(sec[shnum - 1].type == ERL_PRELINK_SHT)
+		shnum--;
+	for(i=1;i<shnum;i++) {
+		if(sec[i].type == ERL_PRELINK_SHT) {
+			printf("The prelink index isn't the last section.\n");
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+
+struct import
+{
+	struct erl_prelink_symbol_t s;
+	unsigned int sym;
+};
+
+struct reloc
+{
+	struct erl_prelink_reloc_t r;
+	/* Order in the file */
+	unsigned int seq;
+};
+
+static int cmp_symbol(const void *a, const void *b)
+{
+	const struct erl_prelink_symbol_t *x = a, *y = b;
+
+	if(x->hash != y->hash)
+		return x->hash < y->hash ? -1 : 1;
+	return strcmp(strings + x->name, strings + y->name);
+}
+
+static int cmp_reloc(const void *a, const void *b)
+{
+	const struct reloc *x = a, *y = b;
+
+	if(x->r.section != y->r.section)
+		return x->r.section < y->r.section ? -1 : 1;
+	if(x->r.offset != y->r.offset)
+		return x->r.offset < y->r.offset ? -1 : 1;
+	/* Keep the file order for relocations of the same word */
+	return x->seq < y->seq ? -1 : (x->seq > y->seq);
+}
+
+static int is_import(const unsigned char *sym)
+{
+	unsigned int type = sym[12] & 15;
+
+	/* Defined global symbols go thru the imports too: the loader uses the
+	 * definition of an already loaded ERL instead, if there is one. */
+	return type == STT_NOTYPE || ((type == STT_OBJECT || type == STT_FUNC) && (sym[12] >> 4) != STB_LOCAL);
+}
+
+static int build_index(void)
+{
+	unsigned int symtab = 0, strtab, nsyms, i, j, total_relocs = 0;
+	const unsigned char *symbols;
+	const char *names;
+	struct import *imp;
+	struct reloc *rel_sorted;
+	int *import_of;
+
+	for(i=1;i<shnum;i++) {
+		if(sec[i].type == SHT_SYMTAB) {
+			symtab = i;
+			break;
+		}
+	}
+	if(!symtab) {
+		printf("No symbol table.\n");
+		return -1;
+	}
+	if(sec[symtab].entsize != ELF_SYMBOL_SIZE || sec[symtab].link == 0 || sec[symtab].link >= shnum) {
+		printf("Invalid symbol table.\n");
+		return -1;
+	}
+
+	strtab = sec[symtab].link;
+	symbols = elf + sec[symtab].offset;
+	nsyms = sec[symtab].size / ELF_SYMBOL_SIZE;
+	names = (const char *)elf + sec[strtab].offset;
+	if(sec[strtab].size == 0 || names[sec[strtab].size - 1] != '\0') {
+		printf("Invalid string table.\n");
+		return -1;
+	}
+	for(i=0;i<nsyms;i++) {
+		if(rd32(symbols + i * ELF_SYMBOL_SIZE) >= sec[strtab].size) {
+			printf("Invalid symbol name.\n");
+			return -1;
+		}
+	}
+
+	for(i=1;i<shnum;i++) {
+		if(sec[i].type != SHT_REL)
+			continue;
+		if(sec[i].entsize != ELF_REL_SIZE || sec[i].info == 0 || sec[i].info >= shnum) {
+			printf("Invalid relocation section %u.\n", i);
+			return -1;
+		}
+		total_relocs += sec[i].size / ELF_REL_SIZE;
+	}
+
+	import_of = xmalloc(nsyms * sizeof(int));
+	imp = xmalloc(nsyms * sizeof(*imp));
+	exports = xmalloc(nsyms * sizeof(*exports));
+	rel_sorted = xmalloc(total_relocs * sizeof(*rel_sorted));
+	add_string("");
+
+	/* First pass: check the relocations and collect the imports */
+	for(i=0;i<nsyms;i++)
+		import_of[i] = -1;
+	for(i=1;i<shnum;i++) {
+		if(sec[i].type != SHT_REL)
+			continue;
+		for(j=0;j<sec[i].size / ELF_REL_SIZE;j++) {
+			const unsigned char *rel = elf + sec[i].offset + j * ELF_REL_SIZE;
+			unsigned int offset = rd32(rel), type = rd32(rel + 4) & 255, sym_n = rd32(rel + 4) >> 8;
+			const unsigned char *sym;
+
+			if(sym_n >= nsyms) {
+				printf("Relocation against an invalid symbol.\n");
+				return -1;
+			}
+			if(type != R_MIPS_32 && type != R_MIPS_26 && type != R_MIPS_HI16 && type != R_MIPS_LO16) {
+				printf("Unsupported relocation type %u.\n", type);
+				return -1;
+			}
+			if(sec[sec[i].info].type != SHT_PROGBITS || sec[sec[i].info].size < 4 || offset > sec[sec[i].info].size - 4) {
+				printf("Relocation outside of a loaded section.\n");
+				return -1;
+			}
+
+			sym = symbols + sym_n * ELF_SYMBOL_SIZE;
+			if(!is_import(sym)) {
+				if((sym[12] & 15) > STT_SECTION) {
+					printf("%s: unsupported symbol type.\n", names + rd32(sym));
+					return -1;
+				}
+				if(rd16(sym + 14) == 0 || rd16(sym + 14) >= shnum) {
+					printf("%s: unsupported symbol section.\n", names + rd32(sym));
+					return -1;
+				}
+			} else if(import_of[sym_n] < 0) {
+				struct erl_prelink_symbol_t *s = &imp[nimports].s;
+
+				s->name = add_string(names + rd32(sym));
+				s->hash = erl_hash(names + rd32(sym));
+				if((sym[12] & 15) != STT_NOTYPE) {
+					if(rd16(sym + 14) == 0 || rd16(sym + 14) >= shnum) {
+						printf("%s: unsupported symbol section.\n", names + rd32(sym));
+						return -1;
+					}
+					s->section = rd16(sym + 14);
+					s->value = rd32(sym + 4);
+				}
+				imp[nimports].sym = sym_n;
+				import_of[sym_n] = nimports++;
+			}
+		}
+	}
+
+	/* Relocations refer to imports by a 16-bit index */
+	if(nimports > UINT16_MAX) {
+		printf("Too many imports (%u), the index holds at most %u.\n", nimports, UINT16_MAX);
+		return -1;
+	}
+
+	qsort(imp, nimports, sizeof(*imp), cmp_symbol);
+	imports = xmalloc(nimports * sizeof(*imports));
+	for(i=0;i<nimports;i++) {
+		imports[i] = imp[i].s;
+		import_of[imp[i].sym] = i;
+	}
+
+	/* Second pass: the relocations themselves */
+	for(i=1;i<shnum;i++) {
+		if(sec[i].type != SHT_REL)
+			continue;
+		for(j=0;j<sec[i].size / ELF_REL_SIZE;j++) {
+			const unsigned char *rel = elf + sec[i].offset + j * ELF_REL_SIZE;
+			unsigned int sym_n = rd32(rel + 4) >> 8;
+			const unsigned char *sym = symbols + sym_n * ELF_SYMBOL_SIZE;
+			struct erl_prelink_reloc_t *r = &rel_sorted[nrelocs].r;
+
+			rel_sorted[nrelocs].seq = nrelocs;
+			nrelocs++;
+			r->offset = rd32(rel);
+			r->section = sec[i].info;
+			r->type = rd32(rel + 4) & 255;
+			if(is_import(sym)) {
+				r->kind = (sym[12] & 15) == STT_NOTYPE ? ERL_PRELINK_IMPORT : ERL_PRELINK_SYMBOL;
+				r->target = import_of[sym_n];
+			} else {
+				r->kind = ERL_PRELINK_SECTION;
+				r->target = rd16(sym + 14);
+				/* Section symbols are relocated against the start of the section */
+				r->value = (sym[12] & 15) == STT_SECTION ? 0 : rd32(sym + 4);
+			}
+		}
+	}
+
+	qsort(rel_sorted, nrelocs, sizeof(*rel_sorted), cmp_reloc);
+	relocs = xmalloc(nrelocs * sizeof(*relocs));
+	for(i=0;i<nrelocs;i++)
+		relocs[i] = rel_sorted[i].r;
+
+	/* Exports: the same symbols the loader exports when reading the symbol table */
+	for(i=0;i<nsyms;i++) {
+		const unsigned char *sym = symbols + i * ELF_SYMBOL_SIZE;
+		unsigned int bind = sym[12] >> 4, shndx = rd16(sym + 14);
+		struct erl_prelink_symbol_t *s;
+
+		if((bind != STB_GLOBAL && bind != STB_WEAK) || (sym[12] & 15) == STT_NOTYPE)
+			continue;
+		if(shndx != SHN_ABS && (shndx == 0 || shndx >= shnum)) {
+			printf("Warning: %s isn't in a section, not exported.\n", names + rd32(sym));
+			continue;
+		}
+
+		s = &exports[nexports++];
+		s->name = add_string(names + rd32(sym));
+		s->hash = erl_hash(names + rd32(sym));
+		s->value = rd32(sym + 4);
+		if(shndx == SHN_ABS)
+			s->flags = ERL_PRELINK_ABS;
+		else
+			s->section = shndx;
+	}
+
+	qsort(exports, nexports, sizeof(*exports), cmp_symbol);
+
+	free(imp);
+	free(rel_sorted);
+	free(import_of);
+	return 0;
+}
+
+static unsigned char *put_symbols(unsigned char *p, const struct erl_prelink_symbol_t *s, unsigned int count)
+{
+	for(;count>0;count--,s++,p+=sizeof(*s)) {
+		wr32(p, s->name);
+		wr32(p + 4, s->hash);
+		wr32(p + 8, s->value);
+		wr16(p + 12, s->section);
+		wr16(p + 14, s->flags);
+	}
+	return p;
+}
+
+static unsigned int align_to(unsigned int x, unsigned int align)
+{
+	if(align <= 1 || (align & (align - 1)))
+		return x;
+	return (x + align - 1) & ~(align - 1);
+}
+
+static int write_output(const char *path)
+{
+	unsigned int index_size, shstrndx, name, out_size, pos, i;
+	unsigned int *offsets, *sizes, shoff, index_off;
+	int reuse_name = 0;
+	unsigned char *out, *p;
+	FILE *dest;
+
+	index_size = sizeof(struct erl_prelink_header_t) + (nimports + nexports) * sizeof(struct erl_prelink_symbol_t) + nrelocs * sizeof(struct erl_prelink_reloc_t) + strsize;
+
+	shstrndx = rd16(elf + 50);
+	if(shstrndx == 0 || shstrndx >= shnum) {
+		printf("Invalid section name table.\n");
+		return -1;
+	}
+
+	/* Running again: the old index section name is still there */
+	if(rd16(elf + 48) > shnum)
+		reuse_name = 1;
+	name = reuse_name ? sec[shnum].name : sec[shstrndx].size;
+
+	/* The sections keep their order and alignment, the index and the section table follow */
+	offsets = xmalloc(shnum * sizeof(unsigned int));
+	sizes = xmalloc(shnum * sizeof(unsigned int));
+	pos = ELF_HEADER_SIZE;
+	for(i=1;i<shnum;i++) {
+		sizes[i] = sec[i].size;
+		if(i == shstrndx && !reuse_name)
+			sizes[i] += sizeof(ERL_PRELINK_NAME);
+		pos = align_to(pos, sec[i].addralign);
+		offsets[i] = pos;
+		if(sec[i].type != SHT_NOBITS)
+			pos += sizes[i];
+	}
+	index_off = align_to(pos, 4);
+	shoff = align_to(index_off + index_size, 4);
+	out_size = shoff + (shnum + 1) * ELF_SECTION_SIZE;
+
+	out = xmalloc(out_size);
+	memcpy(out, elf, ELF_HEADER_SIZE);
+	wr32(out + 32, shoff);
+	wr16(out + 48, shnum + 1);
+
+	for(i=1;i<shnum;i++) {
+		if(sec[i].type == SHT_NOBITS)
+			continue;
+		memcpy(out + offsets[i], elf + sec[i].offset, sec[i].size);
+		if(i == shstrndx && !reuse_name)
+			memcpy(out + offsets[i] + sec[i].size, ERL_PRELINK_NAME, sizeof(ERL_PRELINK_NAME));
+	}
+
+	p = out + index_off;
+	wr32(p, ERL_PRELINK_MAGIC);
+	wr16(p + 4, ERL_PRELINK_VERSION);
+	wr16(p + 6, shnum + 1);
+	wr32(p + 8, nimports);
+	wr32(p + 12, nexports);
+	wr32(p + 16, nrelocs);
+	wr32(p + 20, strsize);
+	p += sizeof(struct erl_prelink_header_t);
+	p = put_symbols(p, imports, nimports);
+	p = put_symbols(p, exports, nexports);
+	for(i=0;i<nrelocs;i++,p+=sizeof(struct erl_prelink_reloc_t)) {
+		wr32(p, relocs[i].offset);
+		wr32(p + 4, relocs[i].value);
+		wr16(p + 8, relocs[i].section);
+		wr16(p + 10, relocs[i].target);
+		p[12] = relocs[i].type;
+		p[13] = relocs[i].kind;
+		wr16(p + 14, 0);
+	}
+	memcpy(p, strings, strsize);
+
+	/* Section table, as read apart from the offsets and the names table size */
+	memcpy(out + shoff, elf + rd32(elf + 32), ELF_SECTION_SIZE);
+	for(i=1;i<shnum;i++) {
+		p = out + shoff + i * ELF_SECTION_SIZE;
+		memcpy(p, elf + rd32(elf + 32) + i * ELF_SECTION_SIZE, ELF_SECTION_SIZE);
+		wr32(p + 16, offsets[i]);
+		wr32(p + 20, sizes[i]);
+	}
+	p = out + shoff + shnum * ELF_SECTION_SIZE;
+	wr32(p, name);
+	wr32(p + 4, ERL_PRELINK_SHT);
+	wr32(p + 16, index_off);
+	wr32(p + 20, index_size);
+	wr32(p + 32, 4);
+
+	if((dest = fopen(path, "wb")) == NULL) {
+		printf("Failed to open/create %s.\n", path);
+		return -1;
+	}
+	if(fwrite(out, 1, out_size, dest) != out_size) {
+		printf("Failed to write %s.\n", path);
+		fclose(dest);
+		return -1;
+	}
+	fclose(dest);
+
+	free(out);
+	free(sizes);
+	free(offsets);
+	return 0;
+}
+
+static void usage(void)
+{
+	printf("erl-prelink - adds a prelink index to ERL files, for faster loading\n"
+		   "Usage: erl-prelink [-v] infile [outfile]\n"
+		   "  -v - print the index statistics.\n"
+		   "  The ERL is rewritten in place if no outfile is given.\n\n");
+}
+
+int main(int argc, char *argv[])
+{
+	const char *f_source = NULL, *f_dest = NULL;
+	FILE *source;
+	int i;
+
+	for(i=1;i<argc;i++) {
+		if(argv[i][0] == '-' && argv[i][1] != '\0') {
+			if(!strcmp(argv[i], "-v")) {
+				verbose = 1;
+			} else {
+				usage();
+				return 1;
+			}
+		} else if(f_source == NULL) {
+			f_source = argv[i];
+		} else if(f_dest == NULL) {
+			f_dest = argv[i];
+		} else {
+			usage();
+			return 1;
+		}
+	}
+
+	if(f_source == NULL) {
+		usage();
+		return 1;
+	}
+	if(f_dest == NULL)
+		f_dest = f_source;
+
+	if((source = fopen(f_source, "rb")) == NULL) {
+		printf("Error opening %s for reading.\n", f_source);
+		return 1;
+	}
+	fseek(source, 0, SEEK_END);
+	elf_size = ftell(source);
+	fseek(source, 0, SEEK_SET);
+	elf = xmalloc(elf_size);
+	if(fread(elf, 1, elf_size, source) != elf_size) {
+		printf("Failed to read file.\n");
+		fclose(source);
+		return 1;
+	}
+	fclose(source);
+
+	if(read_sections() < 0 || build_index() < 0) {
+		printf("%s: can't prelink.\n", f_source);
+		return 1;
+	}
+
+	if(verbose)
+		printf("%s: %u imports, %u exports, %u relocations.\n", f_source, nimports, nexports, nrelocs);
+
+	return write_output(f_dest) < 0 ? 1 : 0;
+}
@@ -0,0 +1,950 @@
+/*
+# _____     ___ ____     ___ ____
+#  ____|   |    ____|   |        | |____|
+# |     ___|   |____ ___|    ____| |    \    PS2DEV Open Source Project.
+#-----------------------------------------------------------------------
+# Copyright 2001-2004, ps2dev - http://www.ps2dev.org
+# Licenced under Academic Free License version 2.0
+# Review ps2sdk README & LICENSE files for further details.
+*/
+
+/* fatfscheck: checks the read-ahead and fast seek of bdmfs_fatfs on the host.
+ *
+ * FatFs, the disk glue, the read-ahead and the file system driver are
+ * built as they are for the IOP, on top of a block device backed by a
+ * temporary FAT16 image file. A fragmented file is written through FatFs,
+ * then read back through the read-ahead in sequential, random and mixed
+ * patterns and compared. The fast seek tables (CLMT) of the driver are
+ * checked through its device operations: on fragmented and contiguous
+ * files, over the memory limit, and after a write to the file.
+ * With -b, prints the device requests and a modelled USB transfer time
+ * for sequential reads, per cluster size, read size and read-ahead size.
+ * FatFs does not read across clusters, so the cluster size bounds the
+ * size of the device requests. Then the same for random seeks, with and
+ * without fast seek, per file size and number of fragments.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <cdvdman.h>
+#include <iomanX.h>
+#include <sysmem.h>
+
+#include <iophost.h>
+#include <bdm.h>
+#include <fs_readahead.h>
+
+#define SECTOR_SIZE 512
+#define DISK_CLUSTERS 8192
+#define FILE_SIZE (2 * 1024 * 1024 + 777)
+
+// Modelled USB mass storage device: time per command and per byte
+#define USB_COMMAND_US 1000
+#define USB_BYTES_PER_US 1
+
+static int checks, failures;
+
+static unsigned int seed = 1;
+
+static unsigned int rnd(unsigned int range)
+{
+	seed = seed * 1103515245 + 12345;
+	return ((seed >> 8) & 0xffffff) % range;
+}
+
+/* Each failing check is only printed once */
+static void check(const char *name, int ok)
+{
+	static const char *failed[64];
+	static int failed_count;
+	int i;
+
+	checks++;
+	if(ok)
+		return;
+
+	failures++;
+	for(i=0;i<failed_count;i++)
+		if(failed[i] == name)
+			return;
+	if(failed_count < 64)
+		failed[failed_count++] = name;
+	printf("FAIL: %s\n", name);
+}
+
+/* File-backed block device */
+
+struct filedisk
+{
+	struct block_device bd;
+	int fd;
+	u32 reads;
+	u32 read_sectors;
+	u32 writes;
+	// Reads of this sector fail
+	u32 fail_sector;
+};
+
+static struct filedisk disk;
+
+static int filedisk_read(struct block_device *bd, u32 sector, void *buffer, u16 count)
+{
+	struct filedisk *fd = bd->priv;
+	size_t size = (size_t)count * SECTOR_SIZE;
+
+	if(sector + count > bd->sectorCount)
+		return -1;
+	if(fd->fail_sector >= sector && fd->fail_sector < sector + count)
+		return -1;
+
+	fd->reads++;
+	fd->read_sectors += count;
+	if(pread(fd->fd, buffer, size, (off_t)sector * SECTOR_SIZE) != (ssize_t)size)
+		return -1;
+
+	return count;
+}
+
+static int filedisk_write(struct block_device *bd, u32 sector, const void *buffer, u16 count)
+{
+	struct filedisk *fd = bd->priv;
+	size_t size = (size_t)count * SECTOR_SIZE;
+
+	if(sector + count > bd->sectorCount)
+		return -1;
+
+	fd->writes++;
+	if(pwrite(fd->fd, buffer, size, (off_t)sector * SECTOR_SIZE) != (ssize_t)size)
+		return -1;
+
+	return count;
+}
+
+static void filedisk_flush(struct block_device *bd)
+{
+	(void)bd;
+}
+
+static int filedisk_stop(struct block_device *bd)
+{
+	(void)bd;
+
+	return 0;
+}
+
+static void put16(u8 *p, u16 v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+}
+
+static void put32(u8 *p, u32 v)
+{
+	put16(p, v);
+	put16(p + 2, v >> 16);
+}
+
+/* An empty FAT16 volume: two FATs, 512 root entries */
+static int filedisk_format(struct filedisk *fd, u32 cluster_sectors)
+{
+	const u32 fat_sectors = ((DISK_CLUSTERS + 2) * 2 + SECTOR_SIZE - 1) / SECTOR_SIZE, root_sectors = 32;
+	u8 sector[SECTOR_SIZE];
+	u32 i;
+
+	memset(sector, 0, sizeof(sector));
+	for(i=0;i<1 + 2 * fat_sectors + root_sectors;i++) {
+		if(pwrite(fd->fd, sector, SECTOR_SIZE, (off_t)i * SECTOR_SIZE) != SECTOR_SIZE)
+			return -1;
+	}
+
+	sector[0] = 0xeb;
+	sector[1] = 0x3c;
+	sector[2] = 0x90;
+	memcpy(&sector[3], "MSDOS5.0", 8);
+	put16(&sector[11], SECTOR_SIZE);
+	sector[13] = cluster_sectors;
+	put16(&sector[14], 1);
+	sector[16] = 2;
+	put16(&sector[17], root_sectors * SECTOR_SIZE / 32);
+	sector[21] = 0xf8;
+	put16(&sector[22], fat_sectors);
+	put16(&sector[24], 63);
+	put16(&sector[26], 255);
+	put32(&sector[32], fd->bd.sectorCount);
+	sector[36] = 0x80;
+	sector[38] = 0x29;
+	put32(&sector[39], 0x12345678);
+	memcpy(&sector[43], "NO NAME    FAT16   ", 19);
+	sector[510] = 0x55;
+	sector[511] = 0xaa;
+	if(pwrite(fd->fd, sector, SECTOR_SIZE, 0) != SECTOR_SIZE)
+		return -1;
+
+	memset(sector, 0, sizeof(sector));
+	put16(&sector[0], 0xfff8);
+	put16(&sector[2], 0xffff);
+	for(i=0;i<2;i++) {
+		if(pwrite(fd->fd, sector, SECTOR_SIZE, (off_t)(1 + i * fat_sectors) * SECTOR_SIZE) != SECTOR_SIZE)
+			return -1;
+	}
+
+	return 0;
+}
+
+static int filedisk_init(struct filedisk *fd, u32 cluster_sectors)
+{
+	char path[] = "/tmp/fatfscheck.XXXXXX";
+
+	memset(fd, 0, sizeof(*fd));
+	fd->fail_sector = 0xffffffff;
+	fd->bd.priv = fd;
+	fd->bd.name = "file";
+	fd->bd.sectorSize = SECTOR_SIZE;
+	fd->bd.sectorOffset = 0;
+	fd->bd.sectorCount = 1024 + DISK_CLUSTERS * cluster_sectors;
+
+	// The image is sparse
+	if((fd->fd = mkstemp(path)) < 0)
+		return -1;
+	unlink(path);
+	if(ftruncate(fd->fd, (off_t)fd->bd.sectorCount * SECTOR_SIZE) != 0 || filedisk_format(fd, cluster_sectors) != 0) {
+		close(fd->fd);
+		return -1;
+	}
+
+	fd->bd.read = filedisk_read;
+	fd->bd.write = filedisk_write;
+	fd->bd.flush = filedisk_flush;
+	fd->bd.stop = filedisk_stop;
+
+	return 0;
+}
+
+/* What the rest of the module and the IOP provide to the driver */
+
+int InitFS(void);
+int connect_bd(struct block_device *bd);
+void disconnect_bd(struct block_device *bd);
+void fatfs_fs_driver_configure_fastseek(unsigned int min_size, unsigned int mem_budget);
+void *fatfs_malloc(int size);
+void fatfs_free(void *ptr);
+
+static iop_device_t *fs_device;
+
+int AddDrv(iop_device_t *device)
+{
+	fs_device = device;
+
+	return device->ops->init(device) >= 0 ? 0 : -1;
+}
+
+int DelDrv(const char *name)
+{
+	(void)name;
+
+	return 0;
+}
+
+int bdm_get_cache_stats(struct block_device *bd, struct bd_cache_stats *stats)
+{
+	(void)bd;
+	(void)stats;
+
+	return -1;
+}
+
+int bdm_reset_cache_stats(struct block_device *bd)
+{
+	(void)bd;
+
+	return -1;
+}
+
+int sceCdReadClock(sceCdCLOCK *clock)
+{
+	(void)clock;
+
+	return 0;
+}
+
+void *fatfs_malloc(int size)
+{
+	return AllocSysMemory(ALLOC_FIRST, size, NULL);
+}
+
+void fatfs_free(void *ptr)
+{
+	FreeSysMemory(ptr);
+}
+
+/* Test files */
+
+static u8 *data;
+
+/* Write the stream file, interleaved with another one so that it is fragmented */
+static int create_files(void)
+{
+	FIL stream, other;
+	UINT bw;
+	u32 pos;
+	u8 chunk[24 * 1024];
+
+	if(f_open(&stream, "0:stream.bin", FA_CREATE_ALWAYS | FA_WRITE) != FR_OK)
+		return -1;
+	if(f_open(&other, "0:other.bin", FA_CREATE_ALWAYS | FA_WRITE) != FR_OK)
+		return -1;
+	memset(chunk, 0x5a, sizeof(chunk));
+
+	for(pos=0;pos<FILE_SIZE;pos+=bw) {
+		UINT n = (FILE_SIZE - pos < 40000) ? FILE_SIZE - pos : 40000;
+
+		if(f_write(&stream, &data[pos], n, &bw) != FR_OK || bw != n)
+			return -1;
+		if(f_write(&other, chunk, 1 + rnd(sizeof(chunk)), &bw) != FR_OK)
+			return -1;
+		bw = n;
+	}
+
+	if(f_close(&stream) != FR_OK || f_close(&other) != FR_OK)
+		return -1;
+
+	return 0;
+}
+
+/* Format a disk image with the given cluster size, and create the files on it */
+static int volume_open(u32 cluster_sectors)
+{
+	if(filedisk_init(&disk, cluster_sectors) != 0) {
+		printf("Can't create the disk image\n");
+		return -1;
+	}
+	if(connect_bd(&disk.bd) != 0 || create_files() != 0) {
+		printf("Can't create the test files\n");
+		disconnect_bd(&disk.bd);
+		close(disk.fd);
+		return -1;
+	}
+
+	return 0;
+}
+
+static void volume_close(void)
+{
+	disconnect_bd(&disk.bd);
+	close(disk.fd);
+}
+
+static int open_stream(FIL *file, fatfs_fs_driver_readahead *ra, int enable)
+{
+	if(f_open(file, "0:stream.bin", FA_READ) != FR_OK)
+		return -1;
+	fs_readahead_open(ra, enable);
+
+	return 0;
+}
+
+static void close_stream(FIL *file, fatfs_fs_driver_readahead *ra)
+{
+	fs_readahead_close(ra);
+	f_close(file);
+}
+
+/* Read the whole file sequentially, returns the number of device reads */
+static int read_sequential(unsigned int readahead, UINT size, int *ok)
+{
+	FIL file;
+	fatfs_fs_driver_readahead ra;
+	u8 *buffer = malloc(size);
+	u32 pos = 0, reads = disk.reads;
+	UINT br;
+
+	*ok = 1;
+	fs_readahead_init(readahead);
+	if(open_stream(&file, &ra, 1) != 0) {
+		*ok = 0;
+		free(buffer);
+		return 0;
+	}
+
+	do {
+		if(fs_readahead_read(&file, &ra, buffer, size, &br) != FR_OK
+			|| br != ((FILE_SIZE - pos < size) ? FILE_SIZE - pos : size) || memcmp(buffer, &data[pos], br)) {
+			*ok = 0;
+			break;
+		}
+		pos += br;
+	} while(br != 0);
+
+	close_stream(&file, &ra);
+	free(buffer);
+
+	return disk.reads - reads;
+}
+
+/* Read-ahead checks */
+
+static void check_sequential(void)
+{
+	static const UINT sizes[] = {512, 2048, 3000, 16384};
+	fs_readahead_stats_t stats;
+	int ok, plain_ok, reads, plain_reads;
+	unsigned int i;
+
+	for(i=0;i<sizeof(sizes) / sizeof(sizes[0]);i++) {
+		plain_reads = read_sequential(0, sizes[i], &plain_ok);
+		fs_readahead_reset_stats();
+		reads = read_sequential(32 * 1024, sizes[i], &ok);
+		fs_readahead_get_stats(&stats);
+
+		check("readahead/sequential/data without read-ahead", plain_ok);
+		check("readahead/sequential/data", ok);
+		// FatFs reads at most a cluster at once, fragments cut reads short too
+		check("readahead/sequential/device reads", (sizes[i] < 4096) ? reads < plain_reads : reads <= plain_reads);
+		check("readahead/sequential/hit rate", stats.hit_bytes >= FILE_SIZE / 10 * 9);
+		check("readahead/sequential/stats", stats.size == 32 * 1024 && stats.hit_bytes + stats.direct_bytes == FILE_SIZE
+			&& stats.fill_bytes >= stats.hit_bytes && stats.fills >= FILE_SIZE / (32 * 1024));
+	}
+}
+
+/* Random seeks and sizes, with sequential runs */
+static void check_random(void)
+{
+	FIL file;
+	fatfs_fs_driver_readahead ra;
+	fs_readahead_stats_t stats;
+	u8 *buffer = malloc(70000);
+	u32 pos = 0;
+	int i, ok = 1, seek_ok = 1;
+
+	fs_readahead_init(16 * 1024);
+	fs_readahead_reset_stats();
+	if(open_stream(&file, &ra, 1) != 0) {
+		check("readahead/random/open", 0);
+		free(buffer);
+		return;
+	}
+
+	for(i=0;i<20000;i++) {
+		UINT size, br, expect;
+
+		switch(rnd(8)) {
+			case 0: // Anywhere, or past the end
+				pos = rnd(FILE_SIZE + 1000);
+				break;
+			case 1: // A little back, likely into the buffer
+				pos = (pos > 3000) ? pos - rnd(3000) : 0;
+				break;
+			case 2: // A little forward
+				pos += rnd(3000);
+				break;
+			default: // Sequential
+				break;
+		}
+		if(rnd(8) != 0 || pos != ra.pos) {
+			if(fs_readahead_lseek(&file, &ra, pos) != FR_OK)
+				seek_ok = 0;
+			// Seeks past the end are clipped
+			if(pos > FILE_SIZE)
+				pos = FILE_SIZE;
+			if(ra.pos != pos)
+				seek_ok = 0;
+		}
+
+		size = (rnd(16) == 0) ? 1 + rnd(70000) : 1 + rnd(4096);
+		expect = (FILE_SIZE - pos < size) ? FILE_SIZE - pos : size;
+		if(fs_readahead_read(&file, &ra, buffer, size, &br) != FR_OK || br != expect || memcmp(buffer, &data[pos], br)) {
+			ok = 0;
+			// Resynchronise
+			fs_readahead_lseek(&file, &ra, pos);
+			continue;
+		}
+		pos += br;
+	}
+
+	fs_readahead_get_stats(&stats);
+	check("readahead/random/data", ok);
+	check("readahead/random/seek", seek_ok);
+	check("readahead/random/used", stats.fills > 0 && stats.hit_bytes > 0 && stats.direct_bytes > 0);
+
+	close_stream(&file, &ra);
+	free(buffer);
+}
+
+/* Seeking back into the buffer does not touch the device */
+static void check_buffer_seek(void)
+{
+	FIL file;
+	fatfs_fs_driver_readahead ra;
+	u8 buffer[1024];
+	UINT br;
+	u32 reads;
+	int i, ok = 1;
+
+	fs_readahead_init(32 * 1024);
+	open_stream(&file, &ra, 1);
+	for(i=0;i<3;i++)
+		fs_readahead_read(&file, &ra, buffer, sizeof(buffer), &br);
+
+	reads = disk.reads;
+	for(i=0;i<20;i++) {
+		u32 pos = ra.buf_pos + rnd(ra.buf_len - sizeof(buffer));
+
+		fs_readahead_lseek(&file, &ra, pos);
+		if(fs_readahead_read(&file, &ra, buffer, sizeof(buffer), &br) != FR_OK || br != sizeof(buffer) || memcmp(buffer, &data[pos], br))
+			ok = 0;
+	}
+	check("readahead/buffer seek/data", ok);
+	check("readahead/buffer seek/no device reads", disk.reads == reads);
+
+	close_stream(&file, &ra);
+}
+
+/* After a write and an invalidation, the new data is read */
+static void check_invalidate(void)
+{
+	FIL file, wfile;
+	fatfs_fs_driver_readahead ra;
+	u8 buffer[1024], patch[100];
+	UINT br, bw;
+	int i;
+
+	fs_readahead_init(32 * 1024);
+	open_stream(&file, &ra, 1);
+	for(i=0;i<3;i++)
+		fs_readahead_read(&file, &ra, buffer, sizeof(buffer), &br);
+	check("readahead/invalidate/buffered", ra.buf_len != 0 && ra.pos < ra.buf_pos + ra.buf_len);
+
+	memset(patch, 0xc3, sizeof(patch));
+	memcpy(&data[ra.pos + 10], patch, sizeof(patch));
+	check("readahead/invalidate/write", f_open(&wfile, "0:stream.bin", FA_WRITE) == FR_OK
+		&& f_lseek(&wfile, ra.pos + 10) == FR_OK && f_write(&wfile, patch, sizeof(patch), &bw) == FR_OK
+		&& bw == sizeof(patch) && f_close(&wfile) == FR_OK);
+
+	fs_readahead_invalidate(&ra);
+	check("readahead/invalidate/read", fs_readahead_read(&file, &ra, buffer, sizeof(buffer), &br) == FR_OK
+		&& br == sizeof(buffer) && !memcmp(buffer, &data[3 * sizeof(buffer)], br));
+
+	close_stream(&file, &ra);
+}
+
+static void check_disabled(void)
+{
+	FIL file;
+	fatfs_fs_driver_readahead ra;
+	fs_readahead_stats_t stats;
+	u8 buffer[512];
+	UINT br;
+	u32 pos = 0;
+	int ok = 1;
+
+	// Read-ahead is off for this file
+	fs_readahead_init(32 * 1024);
+	fs_readahead_reset_stats();
+	open_stream(&file, &ra, 0);
+	check("readahead/disabled/not enabled", !ra.enabled);
+	while(pos < 64 * 1024) {
+		if(f_read(&file, buffer, sizeof(buffer), &br) != FR_OK || br != sizeof(buffer) || memcmp(buffer, &data[pos], br))
+			ok = 0;
+		pos += sizeof(buffer);
+	}
+	close_stream(&file, &ra);
+	check("readahead/disabled/data", ok);
+
+	// Read-ahead is off for all files
+	fs_readahead_init(0);
+	open_stream(&file, &ra, 1);
+	check("readahead/disabled/size 0", !ra.enabled);
+	close_stream(&file, &ra);
+
+	fs_readahead_get_stats(&stats);
+	check("readahead/disabled/stats", stats.fills == 0 && stats.size == 0);
+}
+
+/* A device error is returned, and nothing is left in the buffer */
+static void check_error(void)
+{
+	FIL file;
+	fatfs_fs_driver_readahead ra;
+	u8 buffer[2048];
+	UINT br;
+	u32 pos = 0;
+	FRESULT res;
+	int i, ok = 1;
+
+	fs_readahead_init(32 * 1024);
+	open_stream(&file, &ra, 1);
+	for(i=0;i<3;i++) {
+		fs_readahead_read(&file, &ra, buffer, sizeof(buffer), &br);
+		pos += br;
+	}
+
+	// Fail the next sector the stream needs
+	disk.fail_sector = file.obj.fs->database + (file.clust - 2) * file.obj.fs->csize + (file.obj.fs->csize - 1);
+	for(i=0;i<200;i++) {
+		res = fs_readahead_read(&file, &ra, buffer, sizeof(buffer), &br);
+		if(memcmp(buffer, &data[pos], br))
+			ok = 0;
+		pos += br;
+		if(res != FR_OK)
+			break;
+	}
+	disk.fail_sector = 0xffffffff;
+
+	check("readahead/error/returned", i < 200 && res != FR_OK);
+	check("readahead/error/data", ok);
+	check("readahead/error/buffer dropped", ra.pos < ra.buf_pos || ra.pos >= ra.buf_pos + ra.buf_len);
+
+	close_stream(&file, &ra);
+}
+
+/* Fast seek, through the operations of the driver */
+
+#define FASTSEEK_MIN (1024 * 1024)
+#define FASTSEEK_MEM (32 * 1024)
+// Items of the table the driver probes the chain with
+#define FASTSEEK_PROBE_ITEMS 64
+
+static int drv_open(iop_file_t *fd, const char *name, int flags)
+{
+	memset(fd, 0, sizeof(*fd));
+	fd->unit = 0;
+	fd->device = fs_device;
+
+	return fs_device->ops->open(fd, name, flags, 0);
+}
+
+static DWORD *drv_clmt(iop_file_t *fd)
+{
+	return (fd->privdata != NULL) ? ((FIL *)fd->privdata)->cltbl : NULL;
+}
+
+/* Seek to random places and read there, returns the number of device reads */
+static int drv_read_random(iop_file_t *fd, const u8 *expect, u32 size, int count, int *ok)
+{
+	u8 buffer[SECTOR_SIZE];
+	u32 reads = disk.reads;
+	int i;
+
+	for(i=0;i<count;i++) {
+		u32 pos = rnd(size - sizeof(buffer));
+
+		if(fs_device->ops->lseek(fd, pos, SEEK_SET) != (int)pos
+			|| fs_device->ops->read(fd, buffer, sizeof(buffer)) != sizeof(buffer)
+			|| (expect != NULL && memcmp(buffer, &expect[pos], sizeof(buffer))))
+			*ok = 0;
+	}
+
+	return disk.reads - reads;
+}
+
+/* Write a file in one go, so that it is contiguous */
+static int write_file(const char *name, const u8 *buffer, u32 size)
+{
+	FIL file;
+	UINT bw;
+
+	if(f_open(&file, name, FA_CREATE_ALWAYS | FA_WRITE) != FR_OK)
+		return -1;
+	if(f_write(&file, buffer, size, &bw) != FR_OK || bw != size) {
+		f_close(&file);
+		return -1;
+	}
+
+	return f_close(&file) == FR_OK ? 0 : -1;
+}
+
+static void check_fastseek(void)
+{
+	iop_file_t fd, fd2, fd3;
+	u32 contig_size = FASTSEEK_MIN + FASTSEEK_MIN / 2;
+	unsigned int stream_bytes, contig_bytes;
+	u8 patch[4096], buffer[4096];
+	int ok, plain_ok, reads, plain_reads, allocs;
+	u32 pos;
+
+	// Counted device reads are only those of the seeks and reads
+	fs_readahead_init(0);
+	allocs = iophost_alloc_count();
+
+	if(write_file("0:contig.bin", data, contig_size) != 0 || write_file("0:small.bin", data, 100 * 1024) != 0) {
+		check("fastseek/files", 0);
+		return;
+	}
+
+	// The stream file is fragmented: more items than the probe table holds
+	fatfs_fs_driver_configure_fastseek(0, FASTSEEK_MEM);
+	drv_open(&fd, "stream.bin", O_RDONLY);
+	check("fastseek/disabled/no table", fd.privdata != NULL && drv_clmt(&fd) == NULL);
+	plain_ok = 1;
+	seed = 7;
+	plain_reads = drv_read_random(&fd, data, FILE_SIZE, 500, &plain_ok);
+	fs_device->ops->close(&fd);
+
+	fatfs_fs_driver_configure_fastseek(FASTSEEK_MIN, FASTSEEK_MEM);
+	drv_open(&fd, "stream.bin", O_RDONLY);
+	check("fastseek/fragmented/table", fd.privdata != NULL && drv_clmt(&fd) != NULL && drv_clmt(&fd)[0] > FASTSEEK_PROBE_ITEMS);
+	stream_bytes = (drv_clmt(&fd) != NULL) ? drv_clmt(&fd)[0] * sizeof(DWORD) : 0;
+	ok = 1;
+	seed = 7;
+	reads = drv_read_random(&fd, data, FILE_SIZE, 500, &ok);
+	check("fastseek/fragmented/data without table", plain_ok);
+	check("fastseek/fragmented/data", ok);
+	check("fastseek/fragmented/device reads", reads < plain_reads);
+	fs_device->ops->close(&fd);
+	check("fastseek/fragmented/freed", iophost_alloc_count() == allocs);
+
+	// Few fragments: the probe table is enough, and copied
+	drv_open(&fd, "contig.bin", O_RDONLY);
+	check("fastseek/contiguous/table", fd.privdata != NULL && drv_clmt(&fd) != NULL && drv_clmt(&fd)[0] <= FASTSEEK_PROBE_ITEMS);
+	contig_bytes = (drv_clmt(&fd) != NULL) ? drv_clmt(&fd)[0] * sizeof(DWORD) : 0;
+	ok = 1;
+	drv_read_random(&fd, data, contig_size, 200, &ok);
+	check("fastseek/contiguous/data", ok);
+	fs_device->ops->close(&fd);
+
+	// Files below the minimum size and writable files get none
+	drv_open(&fd, "small.bin", O_RDONLY);
+	check("fastseek/small/no table", fd.privdata != NULL && drv_clmt(&fd) == NULL);
+	fs_device->ops->close(&fd);
+	drv_open(&fd, "contig.bin", O_RDWR);
+	check("fastseek/writable/no table", fd.privdata != NULL && drv_clmt(&fd) == NULL);
+	fs_device->ops->close(&fd);
+
+	// Over the memory limit, the file keeps using normal seeks
+	fatfs_fs_driver_configure_fastseek(FASTSEEK_MIN, stream_bytes + contig_bytes - sizeof(DWORD));
+	drv_open(&fd, "stream.bin", O_RDONLY);
+	drv_open(&fd2, "contig.bin", O_RDONLY);
+	check("fastseek/limit/first table", drv_clmt(&fd) != NULL);
+	check("fastseek/limit/over the limit", fd2.privdata != NULL && drv_clmt(&fd2) == NULL);
+	ok = 1;
+	drv_read_random(&fd2, data, contig_size, 200, &ok);
+	check("fastseek/limit/data", ok);
+	fs_device->ops->close(&fd);
+	fs_device->ops->close(&fd2);
+	drv_open(&fd2, "contig.bin", O_RDONLY);
+	check("fastseek/limit/memory returned", drv_clmt(&fd2) != NULL);
+	fs_device->ops->close(&fd2);
+	fatfs_fs_driver_configure_fastseek(FASTSEEK_MIN, stream_bytes - sizeof(DWORD));
+	drv_open(&fd, "stream.bin", O_RDONLY);
+	check("fastseek/limit/too large", fd.privdata != NULL && drv_clmt(&fd) == NULL);
+	fs_device->ops->close(&fd);
+
+	// A write drops the tables of all handles on the file, not those of others
+	fatfs_fs_driver_configure_fastseek(FASTSEEK_MIN, FASTSEEK_MEM);
+	drv_open(&fd, "stream.bin", O_RDONLY);
+	drv_open(&fd2, "contig.bin", O_RDONLY);
+	drv_open(&fd3, "stream.bin", O_WRONLY);
+	check("fastseek/write/tables", drv_clmt(&fd) != NULL && drv_clmt(&fd2) != NULL && fd3.privdata != NULL);
+	pos = FILE_SIZE / 2 + 123;
+	memset(patch, 0x3c, sizeof(patch));
+	memcpy(&data[pos], patch, sizeof(patch));
+	check("fastseek/write/written", fs_device->ops->lseek(&fd3, pos, SEEK_SET) == (int)pos
+		&& fs_device->ops->write(&fd3, patch, sizeof(patch)) == sizeof(patch));
+	check("fastseek/write/dropped", drv_clmt(&fd) == NULL);
+	check("fastseek/write/other file kept", drv_clmt(&fd2) != NULL);
+	check("fastseek/write/read", fs_device->ops->lseek(&fd, pos - 100, SEEK_SET) == (int)pos - 100
+		&& fs_device->ops->read(&fd, buffer, sizeof(buffer)) == sizeof(buffer) && !memcmp(buffer, &data[pos - 100], sizeof(buffer)));
+	ok = 1;
+	drv_read_random(&fd, data, FILE_SIZE, 200, &ok);
+	check("fastseek/write/data", ok);
+	fs_device->ops->close(&fd3);
+	fs_device->ops->close(&fd);
+	fs_device->ops->close(&fd2);
+
+	drv_open(&fd, "stream.bin", O_RDONLY);
+	check("fastseek/write/rebuilt", drv_clmt(&fd) != NULL);
+	ok = 1;
+	drv_read_random(&fd, data, FILE_SIZE, 200, &ok);
+	check("fastseek/write/data after reopen", ok);
+	fs_device->ops->close(&fd);
+
+	f_unlink("0:contig.bin");
+	f_unlink("0:small.bin");
+	check("fastseek/memory", iophost_alloc_count() == allocs);
+}
+
+/* Benchmarks */
+
+static double now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+/* Write a file of the given size in fragments, each followed by a cluster of another file */
+static int write_fragmented(const char *name, u32 size, u32 fragments, u32 cluster_bytes)
+{
+	FIL file, filler;
+	static u8 chunk[64 * 1024];
+	u32 pos = 0, i;
+	UINT bw;
+
+	if(f_open(&file, name, FA_CREATE_ALWAYS | FA_WRITE) != FR_OK)
+		return -1;
+	if(f_open(&filler, "0:filler.bin", FA_CREATE_ALWAYS | FA_WRITE) != FR_OK)
+		return -1;
+
+	for(i=0;i<fragments;i++) {
+		u32 end = (u32)((u64)size * (i + 1) / fragments);
+
+		while(pos < end) {
+			UINT n = (end - pos < sizeof(chunk)) ? end - pos : sizeof(chunk);
+
+			if(f_write(&file, chunk, n, &bw) != FR_OK || bw != n)
+				return -1;
+			pos += n;
+		}
+		if(i + 1 < fragments && (f_write(&filler, chunk, cluster_bytes, &bw) != FR_OK || bw != cluster_bytes))
+			return -1;
+	}
+
+	if(f_close(&file) != FR_OK || f_close(&filler) != FR_OK)
+		return -1;
+
+	return 0;
+}
+
+/* Random seek benchmark, with and without fast seek */
+static int bench_fastseek(void)
+{
+	static const u32 sizes[] = {1, 4, 16};
+	static const u32 fragments[] = {1, 16, 256};
+	const int seeks = 1000;
+	unsigned int i, j, mode;
+
+	printf("\nRandom seeks and 512 byte reads in a file, 4K clusters, modelled USB device as above\n");
+	printf("%6s %9s %10s %12s %12s %12s\n", "size", "fragments", "fast seek", "reads/seek", "model (us)", "host (us)");
+
+	if(volume_open(8) != 0)
+		return 1;
+	fs_readahead_init(0);
+
+	for(i=0;i<sizeof(sizes) / sizeof(sizes[0]);i++) {
+		for(j=0;j<sizeof(fragments) / sizeof(fragments[0]);j++) {
+			u32 size = sizes[i] * 1024 * 1024;
+
+			if(write_fragmented("0:seek.bin", size, fragments[j], 8 * SECTOR_SIZE) != 0) {
+				printf("Can't create the test file\n");
+				volume_close();
+				return 1;
+			}
+
+			for(mode=0;mode<2;mode++) {
+				iop_file_t fd;
+				u32 sectors = disk.read_sectors;
+				double start, host, model;
+				int reads, ok = 1;
+
+				fatfs_fs_driver_configure_fastseek(mode ? 1 : 0, 1024 * 1024);
+				drv_open(&fd, "seek.bin", O_RDONLY);
+				seed = 1;
+				start = now_us();
+				reads = drv_read_random(&fd, NULL, size, seeks, &ok);
+				host = now_us() - start;
+				sectors = disk.read_sectors - sectors;
+				model = (double)reads * USB_COMMAND_US + (double)sectors * SECTOR_SIZE / USB_BYTES_PER_US;
+				printf("%5uM %9u %10s %12.2f %12.1f %12.2f%s\n", sizes[i], fragments[j],
+					!mode ? "off" : drv_clmt(&fd) != NULL ? "on" : "no table",
+					(double)reads / seeks, model / seeks, host / seeks, ok ? "" : " (error)");
+				fs_device->ops->close(&fd);
+			}
+
+			f_unlink("0:seek.bin");
+			f_unlink("0:filler.bin");
+		}
+	}
+
+	volume_close();
+	fatfs_fs_driver_configure_fastseek(FASTSEEK_MIN, FASTSEEK_MEM);
+
+	return 0;
+}
+
+static int bench(void)
+{
+	static const u32 clusters[] = {8, 64};
+	static const UINT sizes[] = {512, 2048, 8192, 32768};
+	static const unsigned int readahead[] = {0, 16, 32, 64, 128};
+	unsigned int c, i, j;
+
+	printf("Sequential reads of a %u byte file, modelled USB device: %u us per command, %u byte per us\n",
+		FILE_SIZE, USB_COMMAND_US, USB_BYTES_PER_US);
+	printf("%8s %10s %10s %10s %10s %10s\n", "cluster", "read size", "read-ahead", "requests", "KiB/req", "time (ms)");
+
+	for(c=0;c<sizeof(clusters) / sizeof(clusters[0]);c++) {
+		if(volume_open(clusters[c]) != 0)
+			return 1;
+
+		for(i=0;i<sizeof(sizes) / sizeof(sizes[0]);i++) {
+			for(j=0;j<sizeof(readahead) / sizeof(readahead[0]);j++) {
+				u32 sectors = disk.read_sectors;
+				int ok, reads;
+				double us;
+
+				reads = read_sequential(readahead[j] * 1024, sizes[i], &ok);
+				sectors = disk.read_sectors - sectors;
+				us = (double)reads * USB_COMMAND_US + (double)sectors * SECTOR_SIZE / USB_BYTES_PER_US;
+				printf("%7uK %10u %9uK %10d %10.1f %10.1f%s\n", clusters[c] / 2, sizes[i], readahead[j], reads,
+					sectors / 2.0 / reads, us / 1000, ok ? "" : " (data error)");
+			}
+		}
+
+		volume_close();
+	}
+
+	return bench_fastseek();
+}
+
+static void usage(void)
+{
+	printf("Usage: fatfscheck [-b]\n");
+	printf("Checks the bdmfs_fatfs read-ahead and fast seek on a file-backed block device.\n");
+	printf("  -b  print the device requests and time of sequential reads and random seeks instead\n");
+}
+
+int main(int argc, char *argv[])
+{
+	int allocs, i, rv = 0;
+
+	if(argc > 2 || (argc == 2 && strcmp(argv[1], "-b"))) {
+		usage();
+		return 1;
+	}
+
+	data = malloc(FILE_SIZE);
+	for(i=0;i<FILE_SIZE;i++)
+		data[i] = rnd(256);
+
+	InitFS();
+
+	if(argc == 2) {
+		rv = bench();
+	} else if(volume_open(8) != 0) {
+		rv = 1;
+	} else {
+		allocs = iophost_alloc_count();
+
+		check_sequential();
+		check_random();
+		check_buffer_seek();
+		check_invalidate();
+		check_disabled();
+		check_error();
+		check_fastseek();
+
+		check("readahead/memory", iophost_alloc_count() == allocs);
+
+		printf("%d checks, %d failed\n", checks, failures);
+		volume_close();
+		rv = failures != 0;
+	}
+
+	free(data);
+
+	return rv;
+}
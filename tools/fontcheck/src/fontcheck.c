@@ -0,0 +1,832 @@
+/*
+# _____     ___ ____     ___ ____
+#  ____|   |    ____|   |        | |____|
+# |     ___|   |____ ___|    ____| |    \    PS2DEV Open Source Project.
+#-----------------------------------------------------------------------
+# Copyright 2001-2004, ps2dev - http://www.ps2dev.org
+# Licenced under Academic Free License version 2.0
+# Review ps2sdk README & LICENSE files for further details.
+*/
+
+/* fontcheck: checks the FontX2 printing of libfont on the host.
+ *
+ * Strings are printed with points and with the glyph atlas, and the
+ * packets are run through a small GS model: GIF tags, the registers the
+ * font code sets, image transfers into the atlas and its CLUT, points and
+ * textured sprites. Both paths have to draw the same pixels, with packets
+ * of the expected size.
+ *
+ * The character lookups of FontX2 and FontStudio fonts are checked against
+ * the scans they replaced, for every code.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <tamtypes.h>
+#include <gif_tags.h>
+#include <gs_gp.h>
+#include <gs_psm.h>
+#include <draw.h>
+#include <font.h>
+
+#define FB_WIDTH 1024
+#define FB_HEIGHT 1024
+#define PACKET_QWORDS 0x40000
+
+// Where the atlas and its CLUT are in VRAM
+#define ATLAS_TEXTURE 0x80000
+#define ATLAS_CLUT 0xc0000
+
+// Not in font.h, but exported by fontx.c and fsfont.c
+extern unsigned short sjis_table[];
+char *fontx_get_char(fontx_t *fontx, unsigned short c);
+unsigned short get_char(unsigned short c, fsfont_t *font);
+void convert_to_index(unsigned short *in, int num, fsfont_t *font);
+
+// Code tables of the KROM font
+#define SJIS_TABLES 51
+
+static int checks, failures;
+
+static unsigned int seed = 1;
+
+static unsigned int rnd(unsigned int range)
+{
+	seed = seed * 1103515245 + 12345;
+	return ((seed >> 8) & 0xffffff) % range;
+}
+
+/* Each failing check is only printed once */
+static void check(const char *name, int ok)
+{
+	static const char *failed[64];
+	static int failed_count;
+	int i;
+
+	checks++;
+	if(ok)
+		return;
+
+	failures++;
+	for(i=0;i<failed_count;i++)
+		if(failed[i] == name)
+			return;
+	if(failed_count < 64)
+		failed[failed_count++] = name;
+	printf("FAIL: %s\n", name);
+}
+
+/* GS model */
+
+struct gs
+{
+	// Pixels drawn, for the path being checked
+	u8 fb[FB_HEIGHT][FB_WIDTH];
+	// The atlas texture, one 4-bit index per byte, and its CLUT
+	u8 texture[1024][1024];
+	u32 clut[16];
+	u64 prim;
+	u64 uv;
+	u64 tex0[2];
+	u64 bitbltbuf;
+	u64 trxpos;
+	u64 trxreg;
+	// Texels of the running image transfer
+	int image_left;
+	int image_pos;
+	// The texture was written since the last TEXFLUSH
+	int dirty;
+	// First vertex of a sprite
+	int vertex;
+	u64 uv0;
+	u64 xyz0;
+	// Errors in the packet
+	int errors;
+	// Statistics
+	int tags;
+	int points;
+	int sprites;
+	int uploads;
+	int texflushes;
+	int image_qwords;
+	int prims;
+};
+
+static struct gs gs;
+
+static void gs_reset(int keep_vram)
+{
+	static u8 texture[1024][1024];
+	static u32 clut[16];
+
+	if(keep_vram) {
+		memcpy(texture, gs.texture, sizeof(texture));
+		memcpy(clut, gs.clut, sizeof(clut));
+	}
+	memset(&gs, 0, sizeof(gs));
+	if(keep_vram) {
+		memcpy(gs.texture, texture, sizeof(texture));
+		memcpy(gs.clut, clut, sizeof(clut));
+	}
+}
+
+static void gs_error(const char *what)
+{
+	if(gs.errors++ == 0)
+		printf("GS: %s\n", what);
+}
+
+static void gs_pixel(int x, int y)
+{
+	if(x < 0 || y < 0 || x >= FB_WIDTH || y >= FB_HEIGHT) {
+		gs_error("pixel out of the frame buffer");
+		return;
+	}
+	gs.fb[y][x] = 1;
+}
+
+static void gs_sprite(u64 uv0, u64 xyz0, u64 uv1, u64 xyz1)
+{
+	u64 tex0 = gs.tex0[(gs.prim >> 9) & 1];
+	int x0 = ((xyz0 & 0xffff) - 32768) >> 4, y0 = (((xyz0 >> 16) & 0xffff) - 32768) >> 4;
+	int x1 = ((xyz1 & 0xffff) - 32768) >> 4, y1 = (((xyz1 >> 16) & 0xffff) - 32768) >> 4;
+	int u0 = (uv0 & 0x3fff) >> 4, v0 = ((uv0 >> 16) & 0x3fff) >> 4;
+	int u1 = (uv1 & 0x3fff) >> 4, v1 = ((uv1 >> 16) & 0x3fff) >> 4;
+	int tw = 1 << ((tex0 >> 26) & 15), th = 1 << ((tex0 >> 30) & 15);
+	int x, y;
+
+	gs.sprites++;
+
+	if(!((gs.prim >> 4) & 1) || !((gs.prim >> 8) & 1)) {
+		gs_error("sprite not textured with UV");
+		return;
+	}
+	if((tex0 & 0x3fff) != ATLAS_TEXTURE / 64 || ((tex0 >> 20) & 0x3f) != GS_PSM_4 || ((tex0 >> 37) & 0x3fff) != ATLAS_CLUT / 64) {
+		gs_error("sprite not drawn from the atlas");
+		return;
+	}
+	if(gs.dirty) {
+		gs_error("texture sampled without TEXFLUSH after an upload");
+		return;
+	}
+	if(x1 - x0 != u1 - u0 || y1 - y0 != v1 - v0 || u1 > tw || v1 > th) {
+		gs_error("sprite not mapped 1:1 inside the texture");
+		return;
+	}
+
+	for(y=y0;y<y1;y++)
+		for(x=x0;x<x1;x++)
+			if(gs.clut[gs.texture[v0 + y - y0][u0 + x - x0]] >> 24)
+				gs_pixel(x, y);
+}
+
+static void gs_write(int reg, u64 data)
+{
+	switch(reg) {
+		case GS_REG_PRIM:
+			gs.prim = data;
+			gs.vertex = 0;
+			gs.prims++;
+			break;
+		case GS_REG_RGBAQ:
+			break;
+		case GS_REG_UV:
+			gs.uv = data;
+			break;
+		case GS_REG_XYZ2:
+			if((gs.prim & 7) == PRIM_POINT) {
+				gs.points++;
+				gs_pixel(((data & 0xffff) - 32768) >> 4, (((data >> 16) & 0xffff) - 32768) >> 4);
+			} else if((gs.prim & 7) == PRIM_SPRITE) {
+				if(gs.vertex == 0) {
+					gs.uv0 = gs.uv;
+					gs.xyz0 = data;
+					gs.vertex = 1;
+				} else {
+					gs_sprite(gs.uv0, gs.xyz0, gs.uv, data);
+					gs.vertex = 0;
+				}
+			} else {
+				gs_error("unexpected primitive");
+			}
+			break;
+		case GS_REG_TEX0:
+		case GS_REG_TEX0 + 1:
+			gs.tex0[reg - GS_REG_TEX0] = data;
+			break;
+		case GS_REG_TEX1:
+		case GS_REG_TEX1 + 1:
+			break;
+		case GS_REG_TEXFLUSH:
+			gs.dirty = 0;
+			gs.texflushes++;
+			break;
+		case GS_REG_BITBLTBUF:
+			gs.bitbltbuf = data;
+			break;
+		case GS_REG_TRXPOS:
+			gs.trxpos = data;
+			break;
+		case GS_REG_TRXREG:
+			gs.trxreg = data;
+			break;
+		case GS_REG_TRXDIR:
+			if(gs.image_left)
+				gs_error("transfer started before the last one ended");
+			gs.image_left = (gs.trxreg & 0xfff) * ((gs.trxreg >> 32) & 0xfff);
+			gs.image_pos = 0;
+			gs.uploads++;
+			break;
+		default:
+			gs_error("unexpected register");
+			break;
+	}
+}
+
+/* Host to local transfer, into the atlas or its CLUT */
+static void gs_image(const qword_t *q, int qwords)
+{
+	int dbp = ((gs.bitbltbuf >> 32) & 0x3fff) * 64, psm = (gs.bitbltbuf >> 56) & 0x3f;
+	int dx = (gs.trxpos >> 32) & 0x7ff, dy = (gs.trxpos >> 48) & 0x7ff, rrw = gs.trxreg & 0xfff;
+	const u8 *p = (const u8 *)q;
+	int i, texels = qwords * (psm == GS_PSM_4 ? 32 : 4);
+
+	gs.image_qwords += qwords;
+
+	if(texels != gs.image_left) {
+		gs_error("image size doesn't match TRXREG");
+		gs.image_left = 0;
+		return;
+	}
+	gs.image_left = 0;
+
+	if(dbp == ATLAS_TEXTURE && psm == GS_PSM_4) {
+		for(i=0;i<texels;i++) {
+			int x = dx + i % rrw, y = dy + i / rrw;
+
+			if(x >= 1024 || y >= 1024) {
+				gs_error("upload out of the atlas");
+				return;
+			}
+			gs.texture[y][x] = (p[i >> 1] >> ((i & 1) * 4)) & 15;
+		}
+		gs.dirty = 1;
+	} else if(dbp == ATLAS_CLUT && psm == GS_PSM_32 && rrw == 8 && texels == 16) {
+		memcpy(gs.clut, p, sizeof(gs.clut));
+	} else {
+		gs_error("unexpected upload");
+	}
+}
+
+/* Runs a packet, returns 0 if its GIF tags don't add up to its size */
+static int gs_run(const qword_t *q, const qword_t *end)
+{
+	while(q < end) {
+		u64 tag = q->dw[0], regs = q->dw[1];
+		int nloop = tag & 0x7fff, flg = (tag >> 58) & 3, nreg = (tag >> 60) & 15;
+		int i;
+
+		q++;
+		gs.tags++;
+		if(nreg == 0)
+			nreg = 16;
+
+		if(flg == GIF_FLG_PACKED) {
+			if(q + nloop * nreg > end)
+				return 0;
+			for(i=0;i<nloop * nreg;i++,q++) {
+				int reg = (regs >> ((i % nreg) * 4)) & 15;
+
+				if(reg == GIF_REG_AD)
+					gs_write(q->dw[1] & 0xff, q->dw[0]);
+				else
+					gs_write(reg, q->dw[0]);
+			}
+		} else if(flg == GIF_FLG_REGLIST) {
+			const u64 *dw = (const u64 *)q;
+
+			if(q + (nloop * nreg + 1) / 2 > end)
+				return 0;
+			for(i=0;i<nloop * nreg;i++)
+				gs_write((regs >> ((i % nreg) * 4)) & 15, dw[i]);
+			q += (nloop * nreg + 1) / 2;
+		} else if(flg == GIF_FLG_IMAGE) {
+			if(q + nloop > end)
+				return 0;
+			gs_image(q, nloop);
+			q += nloop;
+		} else {
+			return 0;
+		}
+	}
+
+	return q == end && gs.image_left == 0;
+}
+
+/* Fonts, with the header laid out as fontx.c reads it, over the glyph data */
+
+static int make_font(fontx_t *fontx, int type, int width, int height, const unsigned short *tables, int table_num, int bold)
+{
+	char path[] = "/tmp/fontcheckXXXXXX";
+	int rowsize = (width + 7) >> 3, glyphs = 256, offset = 17, size, i, fd;
+	unsigned char *font;
+
+	if(type == DOUBLE_BYTE) {
+		for(i=0,glyphs=0;i<table_num;i++)
+			glyphs += tables[i * 2 + 1] - tables[i * 2] + 1;
+		offset = 18 + table_num * 4;
+	}
+
+	size = offset + glyphs * rowsize * height;
+	font = malloc(size);
+	for(i=0;i<size;i++)
+		font[i] = rnd(256) & rnd(256);
+
+	memcpy(font, "FONTX2\0CHECK\0\0\0\0", 16);
+	font[16] = width;
+	font[17] = height;
+	font[18] = type;
+	if(type == DOUBLE_BYTE) {
+		font[19] = table_num;
+		memcpy(font + 20, tables, table_num * 4);
+	}
+
+	if((fd = mkstemp(path)) < 0 || write(fd, font, size) != size) {
+		printf("Can't write %s.\n", path);
+		exit(1);
+	}
+	close(fd);
+	free(font);
+
+	i = fontx_load(path, fontx, type, 1, 2, bold);
+	unlink(path);
+
+	return i;
+}
+
+// SJIS ranges of the double-byte font
+static const unsigned short kanji_tables[] = {
+	0x8140, 0x817e,
+	0x8180, 0x81ac,
+	0x824f, 0x8258,
+	0x829f, 0x82f1,
+	0x889f, 0x88fc,
+	0x8940, 0x897e,
+};
+
+/* Strings, not ending with a line break: the print functions would draw the terminating NUL */
+
+static void random_ascii(unsigned char *str, int length, int line)
+{
+	int i;
+
+	for(i=0;i<length;i++)
+		str[i] = (i % line == line - 1 && i < length - 1) ? '\n' : 0x20 + rnd(0x5f);
+	str[length] = '\0';
+}
+
+static void random_sjis(unsigned char *str, int length, int line)
+{
+	int i = 0, n = 0;
+
+	while(i < length - 2) {
+		if(++n % line == 0 && i < length - 3) {
+			str[i++] = '\n';
+		} else if(rnd(3) == 0) {
+			str[i++] = 0x20 + rnd(0x5f);
+		} else {
+			int t = rnd(sizeof(kanji_tables) / 4);
+			unsigned short c = kanji_tables[t * 2] + rnd(kanji_tables[t * 2 + 1] - kanji_tables[t * 2] + 1);
+
+			str[i++] = c >> 8;
+			str[i++] = c & 0xff;
+		}
+	}
+	str[i] = '\0';
+}
+
+/* Points a glyph is drawn with, as draw_fontx_row draws them */
+static int glyph_points(const fontx_t *fontx, const char *glyph, int height)
+{
+	int i, j, k, points = 0;
+
+	if(glyph == NULL)
+		return 0;
+
+	for(i=0;i<height;i++) {
+		for(j=0;j<fontx->rowsize;j++) {
+			unsigned char byte = glyph[i * fontx->rowsize + j];
+			int px = 0;
+
+			for(k=7;k>=0;k--) {
+				int bit = (byte >> k) & 1;
+
+				points += bit || (fontx->bold && px);
+				px = bit;
+			}
+			points += fontx->bold && px;
+		}
+	}
+
+	return points;
+}
+
+/* Packet size of the point path: the primitive and its reglist tag, then the points of each glyph, in whole qwords */
+static int point_qwords(fontx_t *ascii, fontx_t *kanji, const unsigned char *str)
+{
+	int qwords = 4;
+
+	while(*str) {
+		fontx_t *fontx = ascii;
+		unsigned short c = *str++;
+
+		if(c == '\n' || c == '\t')
+			continue;
+		if(kanji != NULL && ((c >= 0x81 && c <= 0x9f) || (c >= 0xe0 && c <= 0xef))) {
+			fontx = kanji;
+			c = (c << 8) | *str++;
+		}
+		qwords += (glyph_points(fontx, fontx_get_char(fontx, c), fontx->font[17]) + 1) / 2;
+	}
+
+	return qwords;
+}
+
+/* Packet size of the atlas path: the CLUT once; per upload its tags and texels; per batch the texture,
+ * a TEXFLUSH if the batch uploaded glyphs, the primitive and two qwords per sprite
+ */
+static int atlas_qwords(int clut, int uploads, int upload_qwords, int batches, int flushes, int sprites)
+{
+	return (clut ? 10 : 0) + uploads * 6 + upload_qwords + batches * 7 + flushes + sprites * 2;
+}
+
+struct print
+{
+	// Packet size
+	int qwords;
+	// Pixels drawn
+	int pixels;
+	int ok;
+};
+
+static qword_t *packet;
+
+/* Prints a string with the fonts as they are set up, and runs the packet */
+static struct print print(fontx_t *ascii, fontx_t *kanji, const unsigned char *str, int alignment, int keep_vram)
+{
+	vertex_t v0;
+	color_t c0;
+	qword_t *end;
+	struct print p;
+	int x, y;
+
+	v0.x = (alignment == LEFT_ALIGN) ? 16 : 512;
+	v0.y = 16;
+	v0.z = 0;
+	c0.rgbaq = 0x3f80000080808080ULL;
+
+	if(kanji == NULL)
+		end = fontx_print_ascii(packet, 0, str, alignment, &v0, &c0, ascii);
+	else
+		end = fontx_print_sjis(packet, 0, str, alignment, &v0, &c0, ascii, kanji);
+
+	gs_reset(keep_vram);
+	p.qwords = end - packet;
+	p.ok = gs_run(packet, end) && gs.errors == 0;
+	for(y=0,p.pixels=0;y<FB_HEIGHT;y++)
+		for(x=0;x<FB_WIDTH;x++)
+			p.pixels += gs.fb[y][x];
+
+	return p;
+}
+
+static u8 point_fb[FB_HEIGHT][FB_WIDTH];
+
+/* Prints with points, then with the atlas twice: cold, and with the glyphs in it */
+static void check_string(const char *name, fontx_t *ascii, fontx_t *kanji, const unsigned char *str, int alignment, fontx_atlas_t *atlas)
+{
+	struct print points, cold, warm;
+	int glyphs, batches, misses, prims;
+
+	ascii->atlas = NULL;
+	if(kanji != NULL)
+		kanji->atlas = NULL;
+	points = print(ascii, kanji, str, alignment, 0);
+	memcpy(point_fb, gs.fb, sizeof(point_fb));
+	glyphs = 0;
+	check("points/packet", points.ok);
+	check("points/qwords", points.qwords == point_qwords(ascii, kanji, str));
+	check("points/one primitive", gs.prims == 1);
+	check(name, points.pixels > 0);
+
+	fontx_atlas_reset(atlas);
+	atlas->hits = atlas->misses = 0;
+	fontx_set_atlas(ascii, atlas);
+	if(kanji != NULL)
+		fontx_set_atlas(kanji, atlas);
+	cold = print(ascii, kanji, str, alignment, 0);
+	glyphs = gs.sprites;
+	prims = gs.prims;
+	check("atlas/packet", cold.ok);
+	check("atlas/same pixels", memcmp(gs.fb, point_fb, sizeof(point_fb)) == 0);
+	check("atlas/uploads", gs.uploads == (int)atlas->misses + 1);
+	check("atlas/lookups", (int)(atlas->hits + atlas->misses) == glyphs);
+	// Batches are flushed when full, or when every slot is taken by the batch
+	batches = prims;
+	check("atlas/batches", batches >= (glyphs + 63) / 64 && (atlas->misses <= (unsigned int)atlas->slot_count ? batches == (glyphs + 63) / 64 : 1));
+	check("atlas/flushes", gs.texflushes <= batches && gs.texflushes > 0);
+	// The glyphs are 16 high, a slot row is slot_width / 2 bytes
+	check("atlas/slot qwords", gs.image_qwords - 4 == (gs.uploads - 1) * atlas->slot_width / 2);
+	check("atlas/qwords", cold.qwords == atlas_qwords(1, gs.uploads - 1, gs.image_qwords - 4, batches, gs.texflushes, glyphs));
+	misses = atlas->misses;
+
+	// Again, with the glyphs still in the atlas if they fit
+	warm = print(ascii, kanji, str, alignment, 1);
+	check("atlas/warm packet", warm.ok);
+	check("atlas/warm same pixels", memcmp(gs.fb, point_fb, sizeof(point_fb)) == 0);
+	if(misses <= atlas->slot_count) {
+		check("atlas/warm no uploads", gs.uploads == 0 && (int)atlas->misses == misses);
+		check("atlas/warm qwords", warm.qwords == atlas_qwords(0, 0, 0, batches, 0, glyphs));
+		check("atlas/warm smaller", warm.qwords < points.qwords);
+	}
+
+	ascii->atlas = NULL;
+	if(kanji != NULL)
+		kanji->atlas = NULL;
+}
+
+static fontx_t ascii_font, ascii_bold, kanji_font, kanji_bold, krom_font;
+
+static void load_fonts(void)
+{
+	if(make_font(&ascii_font, SINGLE_BYTE, 8, 16, NULL, 0, 0) < 0 || make_font(&ascii_bold, SINGLE_BYTE, 8, 16, NULL, 0, 1) < 0 ||
+		make_font(&kanji_font, DOUBLE_BYTE, 16, 16, kanji_tables, sizeof(kanji_tables) / 4, 0) < 0 ||
+		make_font(&kanji_bold, DOUBLE_BYTE, 16, 16, kanji_tables, sizeof(kanji_tables) / 4, 1) < 0 ||
+		make_font(&krom_font, DOUBLE_BYTE, 16, 15, sjis_table, SJIS_TABLES, 0) < 0) {
+		printf("Can't load the fonts.\n");
+		exit(1);
+	}
+}
+
+static void check_ascii(void)
+{
+	static unsigned char str[1024];
+	fontx_atlas_t *big = fontx_atlas_init(ATLAS_TEXTURE, ATLAS_CLUT, 512, 512, 17, 16);
+	fontx_atlas_t *small = fontx_atlas_init(ATLAS_TEXTURE, ATLAS_CLUT, 128, 32, 17, 16);
+	int i;
+
+	check_string("ascii/hello", &ascii_font, NULL, (const unsigned char *)"Hello, World!", LEFT_ALIGN, big);
+	check_string("ascii/lines", &ascii_bold, NULL, (const unsigned char *)"The quick brown fox\n\tjumps over\nthe lazy dog", LEFT_ALIGN, big);
+	check_string("ascii/center", &ascii_font, NULL, (const unsigned char *)"centered\ntext", CENTER_ALIGN, big);
+
+	for(i=0;i<8;i++) {
+		random_ascii(str, 40 + rnd(500), 60);
+		check_string("ascii/random", (i & 1) ? &ascii_bold : &ascii_font, NULL, str, LEFT_ALIGN, big);
+		// More glyphs than slots: replaced while printing
+		check_string("ascii/small atlas", (i & 1) ? &ascii_bold : &ascii_font, NULL, str, LEFT_ALIGN, small);
+	}
+
+	fontx_atlas_free(big);
+	fontx_atlas_free(small);
+}
+
+static void check_sjis(void)
+{
+	static unsigned char str[1024];
+	fontx_atlas_t *big = fontx_atlas_init(ATLAS_TEXTURE, ATLAS_CLUT, 1024, 512, 17, 16);
+	fontx_atlas_t *small = fontx_atlas_init(ATLAS_TEXTURE, ATLAS_CLUT, 128, 64, 17, 16);
+	fontx_atlas_t *narrow = fontx_atlas_init(ATLAS_TEXTURE, ATLAS_CLUT, 128, 64, 16, 16);
+	int i;
+
+	for(i=0;i<8;i++) {
+		random_sjis(str, 40 + rnd(500), 40);
+		check_string("sjis/random", (i & 1) ? &ascii_bold : &ascii_font, (i & 1) ? &kanji_bold : &kanji_font, str, LEFT_ALIGN, big);
+		check_string("sjis/small atlas", (i & 1) ? &ascii_bold : &ascii_font, (i & 1) ? &kanji_bold : &kanji_font, str, LEFT_ALIGN, small);
+	}
+
+	// Glyphs that don't fit the slots
+	check("sjis/slot too small", fontx_set_atlas(&kanji_bold, narrow) < 0 && kanji_bold.atlas == NULL);
+
+	fontx_atlas_free(big);
+	fontx_atlas_free(small);
+	fontx_atlas_free(narrow);
+}
+
+/* Character lookups */
+
+/* A FontStudio font: Latin, then CJK ideographs in random order, with some codes twice */
+static fsfont_t *make_fsfont(int cjk)
+{
+	fsfont_t *font = fontstudio_init(16);
+	int total = 0x160 + cjk, i, len = 0;
+	char *ini = malloc(total * 100 + 100);
+
+	len += sprintf(ini + len, "NumChar=%d\nSpaceWidth=4\n", total);
+	for(i=0;i<total;i++) {
+		int c = (i < 0x160) ? 0x20 + i : 0x4e00 + rnd(0x5200);
+
+		len += sprintf(ini + len, "Char=%d\nA=0\nB=8\nC=0\nox=0\noy=0\nWid=8\nHgt=16\nX1=0.0\nY1=0.0\nX2=0.03125\nY2=0.0625\n", c);
+	}
+
+	if(fontstudio_parse_ini(font, ini, 256, 256) < 0) {
+		printf("Can't parse the FontStudio font.\n");
+		exit(1);
+	}
+	free(ini);
+
+	return font;
+}
+
+static void check_lookup(void)
+{
+	static const unsigned short unsorted[] = {0x889f, 0x88fc, 0x8140, 0x817e};
+	static unsigned short text[200], indices[200];
+	fsfont_t *fsfont = make_fsfont(2500);
+	unsigned short **lookup = fsfont->lookup;
+	int *table_index = krom_font.table_index;
+	fontx_t font;
+	int c, i, ok;
+
+	// Every code, with the table and with the scan
+	check("fsfont/table", lookup != NULL);
+	for(c=0,ok=1;c<0x10000;c++) {
+		unsigned short index = get_char(c, fsfont);
+
+		fsfont->lookup = NULL;
+		ok &= get_char(c, fsfont) == index;
+		fsfont->lookup = lookup;
+	}
+	check("fsfont/every code", ok);
+
+	for(i=0,ok=1;i<100;i++) {
+		int j;
+
+		for(j=0;j<200;j++)
+			text[j] = (j == 199 || rnd(8)) ? fsfont->charmap[rnd(fsfont->totalchars)] : (rnd(2) ? ' ' : 0x3000 + rnd(0x100));
+		memcpy(indices, text, sizeof(text));
+		convert_to_index(indices, 200, fsfont);
+		for(j=0;j<200;j++)
+			ok &= indices[j] == ((text[j] == ' ') ? ' ' : get_char(text[j], fsfont));
+	}
+	check("fsfont/strings", ok);
+	fontstudio_free(fsfont);
+
+	check("fontx/table index", table_index != NULL);
+	for(c=0,ok=1;c<0x10000;c++) {
+		char *glyph = fontx_get_char(&krom_font, c);
+
+		krom_font.table_index = NULL;
+		ok &= fontx_get_char(&krom_font, c) == glyph;
+		krom_font.table_index = table_index;
+	}
+	check("fontx/every code", ok);
+
+	// Tables out of order are scanned
+	if(make_font(&font, DOUBLE_BYTE, 16, 16, unsorted, 2, 0) < 0) {
+		check("fontx/unsorted", 0);
+		return;
+	}
+	check("fontx/unsorted no index", font.table_index == NULL);
+	check("fontx/unsorted lookup", fontx_get_char(&font, 0x889f) == font.font + 26 && fontx_get_char(&font, 0x8140) == font.font + 26 + 94 * 32);
+	fontx_unload(&font);
+}
+
+static double seconds(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Lookup time of 200-character strings, with the table and with the scan */
+static void bench_lookup(void)
+{
+	static unsigned short text[200], indices[200];
+	fsfont_t *fsfont = make_fsfont(2500);
+	unsigned short **lookup = fsfont->lookup;
+	int *table_index = krom_font.table_index;
+	const int rounds = 2000;
+	volatile unsigned long sink = 0;
+	double start, scan, table;
+	int i, j;
+
+	printf("\nLookup of 200-character strings, in microseconds\n");
+	printf("%-34s %10s %10s\n", "font", "scan", "table");
+
+	for(j=0;j<200;j++)
+		text[j] = fsfont->charmap[rnd(fsfont->totalchars)];
+
+	for(i=0,start=seconds();i<rounds;i++) {
+		memcpy(indices, text, sizeof(text));
+		fsfont->lookup = NULL;
+		convert_to_index(indices, 200, fsfont);
+		sink += indices[i % 200];
+	}
+	scan = seconds() - start;
+	fsfont->lookup = lookup;
+	for(i=0,start=seconds();i<rounds;i++) {
+		memcpy(indices, text, sizeof(text));
+		convert_to_index(indices, 200, fsfont);
+		sink += indices[i % 200];
+	}
+	table = seconds() - start;
+	printf("FontStudio, %4d characters        %10.2f %10.2f\n", fsfont->totalchars, scan * 1e6 / rounds, table * 1e6 / rounds);
+	fontstudio_free(fsfont);
+
+	for(j=0;j<200;j++) {
+		int t = rnd(SJIS_TABLES);
+
+		text[j] = sjis_table[t * 2] + rnd(sjis_table[t * 2 + 1] - sjis_table[t * 2] + 1);
+	}
+
+	for(i=0,start=seconds();i<rounds;i++) {
+		krom_font.table_index = NULL;
+		for(j=0;j<200;j++)
+			sink += (unsigned long)fontx_get_char(&krom_font, text[j]);
+	}
+	scan = seconds() - start;
+	krom_font.table_index = table_index;
+	for(i=0,start=seconds();i<rounds;i++)
+		for(j=0;j<200;j++)
+			sink += (unsigned long)fontx_get_char(&krom_font, text[j]);
+	table = seconds() - start;
+	printf("FontX2, %2d SJIS tables             %10.2f %10.2f\n", SJIS_TABLES, scan * 1e6 / rounds, table * 1e6 / rounds);
+}
+
+/* Packet sizes and lookup times */
+
+static int bench(void)
+{
+	static unsigned char ascii[1024], sjis[1024];
+	fontx_atlas_t *atlas = fontx_atlas_init(ATLAS_TEXTURE, ATLAS_CLUT, 1024, 512, 17, 16);
+	struct print points, cold, warm;
+	int i;
+
+	random_ascii(ascii, 400, 50);
+	random_sjis(sjis, 400, 30);
+
+	printf("Packet size in qwords of 400-byte strings, random glyphs\n");
+	printf("%-12s %10s %10s %10s\n", "string", "points", "atlas", "cached");
+
+	for(i=0;i<4;i++) {
+		fontx_t *a = (i & 1) ? &ascii_bold : &ascii_font;
+		fontx_t *k = (i >= 2) ? ((i & 1) ? &kanji_bold : &kanji_font) : NULL;
+
+		a->atlas = NULL;
+		if(k != NULL)
+			k->atlas = NULL;
+		points = print(a, k, k ? sjis : ascii, LEFT_ALIGN, 0);
+
+		fontx_atlas_reset(atlas);
+		fontx_set_atlas(a, atlas);
+		if(k != NULL)
+			fontx_set_atlas(k, atlas);
+		cold = print(a, k, k ? sjis : ascii, LEFT_ALIGN, 0);
+		warm = print(a, k, k ? sjis : ascii, LEFT_ALIGN, 1);
+		a->atlas = NULL;
+		if(k != NULL)
+			k->atlas = NULL;
+
+		printf("%-12s %10d %10d %10d\n", (i == 0) ? "ascii" : (i == 1) ? "ascii bold" : (i == 2) ? "sjis" : "sjis bold", points.qwords, cold.qwords, warm.qwords);
+	}
+
+	fontx_atlas_free(atlas);
+
+	bench_lookup();
+
+	return 0;
+}
+
+static void usage(void)
+{
+	printf("Usage: fontcheck [-b]\n");
+	printf("Checks the FontX2 printing of libfont, with points and with the glyph atlas.\n");
+	printf("  -b  print the packet sizes of both, and the lookup times, instead\n");
+}
+
+int main(int argc, char *argv[])
+{
+	if(argc > 2 || (argc == 2 && strcmp(argv[1], "-b"))) {
+		usage();
+		return 1;
+	}
+
+	packet = aligned_alloc(16, PACKET_QWORDS * sizeof(qword_t));
+	load_fonts();
+
+	if(argc == 2)
+		return bench();
+
+	check_ascii();
+	check_sjis();
+	check_lookup();
+
+	printf("%d checks, %d failed\n", checks, failures);
+
+	return failures != 0;
+}
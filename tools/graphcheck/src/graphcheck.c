@@ -0,0 +1,394 @@
+/*
+# _____     ___ ____     ___ ____
+#  ____|   |    ____|   |        | |____|
+# |     ___|   |____ ___|    ____| |    \    PS2DEV Open Source Project.
+#-----------------------------------------------------------------------
+# Copyright ps2dev - http://www.ps2dev.org
+# Licenced under Academic Free License version 2.0
+# Review ps2sdk README & LICENSE files for further details.
+*/
+
+/* graphcheck: checks the vram allocator of libgraph on the host.
+ *
+ * Random allocations and frees of mixed sizes, psm and alignment are
+ * checked against a bitmap of the vram blocks: every allocation must be
+ * aligned, must not overlap another one, and must be the one best fit
+ * picks from the free space of the bitmap, the lowest address among
+ * equals. An allocation may only fail if nothing fits. The statistics
+ * are checked against the same model, and once everything is freed vram
+ * must be a single free region again.
+ * With -b, prints the time per allocation and free.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <gs_psm.h>
+#include <graph_vram.h>
+
+// Every address and size is a multiple of the block alignment
+#define BLOCK_WORDS GRAPH_ALIGN_BLOCK
+#define BLOCKS (GRAPH_VRAM_MAX_WORDS / BLOCK_WORDS)
+#define MAX_LIVE 256
+#define RANDOM_OPS 50000
+
+static int checks, failures;
+
+/* Each failing check is only printed once */
+static void check(const char *name, int ok)
+{
+	static const char *failed[64];
+	static int failed_count;
+	int i;
+
+	checks++;
+	if(ok)
+		return;
+
+	failures++;
+	for(i=0;i<failed_count;i++)
+		if(failed[i] == name)
+			return;
+	if(failed_count < 64)
+		failed[failed_count++] = name;
+	printf("FAIL: %s\n", name);
+}
+
+static unsigned int seed = 1;
+
+static unsigned int rnd(unsigned int range)
+{
+	seed = seed * 1103515245 + 12345;
+	return (seed >> 8) % range;
+}
+
+/* Model of vram */
+
+struct allocation
+{
+	int address;
+	int size;
+};
+
+static unsigned char used_blocks[BLOCKS];
+static struct allocation live[MAX_LIVE];
+static int live_count;
+static int model_used, model_peak, model_high, model_failures;
+
+static void model_reset(void)
+{
+	memset(used_blocks, 0, sizeof(used_blocks));
+	live_count = 0;
+	model_used = 0;
+	model_peak = 0;
+	model_high = 0;
+	model_failures = 0;
+}
+
+/* Where best fit has to put size words: the smallest free run that fits, or -1 */
+static int model_best_fit(int size, int alignment)
+{
+	int best = -1, best_run = 0;
+	int start = 0, end;
+
+	while(start < BLOCKS) {
+		int aligned;
+
+		if(used_blocks[start]) {
+			start++;
+			continue;
+		}
+		for(end=start;end<BLOCKS && !used_blocks[end];end++)
+			;
+
+		aligned = -alignment & (start * BLOCK_WORDS + (alignment - 1));
+		if(aligned + size <= end * BLOCK_WORDS && (best < 0 || end - start < best_run)) {
+			best = aligned;
+			best_run = end - start;
+		}
+		start = end;
+	}
+
+	return best;
+}
+
+/* Start of the free space at the end of vram, or -1 */
+static int model_tail(int alignment)
+{
+	int start = BLOCKS, aligned;
+
+	while(start > 0 && !used_blocks[start - 1])
+		start--;
+	if(start == BLOCKS)
+		return -1;
+
+	aligned = -alignment & (start * BLOCK_WORDS + (alignment - 1));
+
+	return (aligned < GRAPH_VRAM_MAX_WORDS) ? aligned : -1;
+}
+
+static void model_mark(int address, int size, int used)
+{
+	memset(&used_blocks[address / BLOCK_WORDS], used, size / BLOCK_WORDS);
+}
+
+static int model_free_regions(void)
+{
+	int i, regions = 0;
+
+	for(i=0;i<BLOCKS;i++)
+		if(!used_blocks[i] && (i == 0 || used_blocks[i - 1]))
+			regions++;
+
+	return regions;
+}
+
+/* Allocation and free, checked against the model */
+
+static const int psms[] = {GS_PSM_32, GS_PSM_24, GS_PSM_16, GS_PSM_16S, GS_PSM_8, GS_PSM_4, GS_PSM_8H, GS_PSMZ_32, GS_PSMZ_24, GS_PSMZ_16};
+
+static int allocate(int width, int height, int psm, int alignment)
+{
+	int min_alignment = (alignment < GRAPH_ALIGN_BLOCK) ? GRAPH_ALIGN_BLOCK : alignment;
+	int size = graph_vram_size(width, height, psm, min_alignment);
+	int expect = model_best_fit(size, min_alignment);
+	int address = graph_vram_allocate(width, height, psm, alignment);
+
+	check("allocate/best fit", address == expect);
+	if(address < 0) {
+		model_failures++;
+		return -1;
+	}
+
+	check("allocate/aligned", (address % min_alignment) == 0);
+	check("allocate/in vram", address + size <= GRAPH_VRAM_MAX_WORDS);
+	check("allocate/no overlap", memchr(&used_blocks[address / BLOCK_WORDS], 1, size / BLOCK_WORDS) == NULL);
+
+	model_mark(address, size, 1);
+	live[live_count].address = address;
+	live[live_count].size = size;
+	live_count++;
+
+	model_used += size;
+	if(model_used > model_peak)
+		model_peak = model_used;
+	if(address + size > model_high)
+		model_high = address + size;
+
+	return address;
+}
+
+static void release(int index)
+{
+	graph_vram_free(live[index].address);
+	model_mark(live[index].address, live[index].size, 0);
+	model_used -= live[index].size;
+	live[index] = live[--live_count];
+}
+
+static int check_stats(void)
+{
+	graph_vram_stats_t stats;
+	int largest = 0, start, end;
+
+	for(start=0;start<BLOCKS;start=end+1) {
+		for(end=start;end<BLOCKS && !used_blocks[end];end++)
+			;
+		if((end - start) * BLOCK_WORDS > largest)
+			largest = (end - start) * BLOCK_WORDS;
+	}
+
+	graph_vram_get_stats(&stats);
+
+	return stats.used == model_used
+		&& stats.free == GRAPH_VRAM_MAX_WORDS - model_used
+		&& stats.largest_free == largest
+		&& stats.free_regions == model_free_regions()
+		&& stats.allocations == live_count
+		&& stats.peak_used == model_peak
+		&& stats.high_water == model_high
+		&& stats.failures == model_failures
+		&& stats.fragmentation == (stats.free > 0 ? 100 - (int)(((long long)largest * 100) / stats.free) : 0);
+}
+
+/* Checks */
+
+static void random_allocation(int *width, int *height, int *psm, int *alignment)
+{
+	*psm = psms[rnd(sizeof(psms) / sizeof(psms[0]))];
+
+	if(rnd(8) == 0) {
+		// A frame or z buffer
+		*width = 256 + rnd(385);
+		*height = 224 + rnd(289);
+		*alignment = GRAPH_ALIGN_PAGE;
+	} else {
+		// A texture or CLUT, high enough for 4-bit storage not to round down to nothing
+		*width = 1 << rnd(9);
+		*height = 8 << rnd(6);
+		*alignment = rnd(4) ? GRAPH_ALIGN_BLOCK : rnd(2) ? GRAPH_ALIGN_PAGE : 0;
+	}
+}
+
+static void check_random(void)
+{
+	int i, ok = 1;
+
+	graph_vram_clear();
+	model_reset();
+	seed = 1;
+
+	for(i=0;i<RANDOM_OPS;i++) {
+		if(live_count == MAX_LIVE || (live_count > 0 && rnd(100) < 45)) {
+			release(rnd(live_count));
+		} else {
+			int width, height, psm, alignment;
+
+			random_allocation(&width, &height, &psm, &alignment);
+			allocate(width, height, psm, alignment);
+		}
+
+		if((i % 97) == 0 && !check_stats())
+			ok = 0;
+	}
+	check("random/stats", ok && check_stats());
+	check("random/failures", model_failures > 0);
+
+	// Out of order, down to nothing
+	while(live_count > 0)
+		release(rnd(live_count));
+	check("random/stats after free", check_stats());
+	check("random/one region", model_free_regions() == 1 && model_used == 0);
+	check("random/reuse", allocate(1024, 1024, GS_PSM_32, GRAPH_ALIGN_PAGE) == 0);
+	release(0);
+}
+
+static void check_free(void)
+{
+	int frame, z, texture;
+
+	graph_vram_clear();
+	model_reset();
+
+	// Like the graph sample: each buffer is freed on its own
+	frame = allocate(512, 512, GS_PSM_32, GRAPH_ALIGN_PAGE);
+	z = allocate(512, 512, GS_PSMZ_24, GRAPH_ALIGN_PAGE);
+	texture = allocate(256, 256, GS_PSM_24, GRAPH_ALIGN_BLOCK);
+	check("free/addresses", frame == 0 && z == 512 * 512 && texture == 2 * 512 * 512);
+
+	release(0);
+	check("free/only that one", check_stats() && model_free_regions() == 2);
+
+	// Unknown addresses and double frees change nothing
+	graph_vram_free(frame);
+	graph_vram_free(z + BLOCK_WORDS);
+	graph_vram_free(-1);
+	graph_vram_free(GRAPH_VRAM_MAX_WORDS);
+	check("free/unknown", check_stats());
+
+	// The hole is reused by a buffer that fits
+	check("free/hole reused", allocate(512, 256, GS_PSM_32, GRAPH_ALIGN_PAGE) == 0);
+
+	while(live_count > 0)
+		release(live_count - 1);
+	check("free/all", check_stats() && model_free_regions() == 1);
+}
+
+static void check_tail(void)
+{
+	int i;
+
+	graph_vram_clear();
+	model_reset();
+
+	check("tail/empty", graph_vram_allocate(0, 0, GS_PSM_32, GRAPH_ALIGN_BLOCK) == 0);
+	for(i=0;i<3;i++)
+		allocate(100 + i * 50, 64, GS_PSM_16, GRAPH_ALIGN_BLOCK);
+	release(1);
+	check("tail/after holes", graph_vram_allocate(0, 0, GS_PSM_32, GRAPH_ALIGN_PAGE) == model_tail(GRAPH_ALIGN_PAGE));
+	check("tail/not allocated", check_stats());
+
+	// All of vram in use: there is no tail
+	graph_vram_clear();
+	model_reset();
+	allocate(1024, 1024, GS_PSM_32, GRAPH_ALIGN_PAGE);
+	check("tail/full", graph_vram_allocate(0, 0, GS_PSM_32, GRAPH_ALIGN_BLOCK) == -1);
+	check("tail/full fails", allocate(8, 8, GS_PSM_32, GRAPH_ALIGN_BLOCK) == -1 && check_stats());
+
+	graph_vram_clear();
+	model_reset();
+	check("clear", check_stats());
+}
+
+/* Allocation speed */
+
+static double now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int bench(void)
+{
+	static const int sizes[] = {16, 64, 256};
+	static int addresses[256];
+	unsigned int i;
+	int j, n;
+
+	printf("Random texture allocations and frees, with a number of allocations live\n");
+	printf("%6s %14s %8s\n", "live", "us/op", "regions");
+
+	for(i=0;i<sizeof(sizes) / sizeof(sizes[0]);i++) {
+		graph_vram_stats_t stats;
+		const int ops = 200000;
+		double start;
+
+		graph_vram_clear();
+		seed = 1;
+		for(n=0;n<sizes[i];n++)
+			addresses[n] = graph_vram_allocate(8 << rnd(5), 8 << rnd(5), GS_PSM_32, GRAPH_ALIGN_BLOCK);
+
+		start = now_us();
+		for(j=0;j<ops;j++) {
+			n = rnd(sizes[i]);
+			graph_vram_free(addresses[n]);
+			addresses[n] = graph_vram_allocate(8 << rnd(5), 8 << rnd(5), GS_PSM_32, GRAPH_ALIGN_BLOCK);
+		}
+		graph_vram_get_stats(&stats);
+		printf("%6d %14.3f %8d\n", sizes[i], (now_us() - start) / (2 * ops), stats.allocations + stats.free_regions);
+	}
+
+	graph_vram_clear();
+
+	return 0;
+}
+
+static void usage(void)
+{
+	printf("Usage: graphcheck [-b]\n");
+	printf("Checks the libgraph vram allocator against a model of vram.\n");
+	printf("  -b  print the time per allocation and free instead\n");
+}
+
+int main(int argc, char *argv[])
+{
+	if(argc > 2 || (argc == 2 && strcmp(argv[1], "-b"))) {
+		usage();
+		return 1;
+	}
+
+	if(argc == 2)
+		return bench();
+
+	check_random();
+	check_free();
+	check_tail();
+
+	printf("%d checks, %d failed\n", checks, failures);
+
+	return failures != 0;
+}
@@ -0,0 +1,95 @@
+/*
+# _____     ___ ____     ___ ____
+#  ____|   |    ____|   |        | |____|
+# |     ___|   |____ ___|    ____| |    \    PS2DEV Open Source Project.
+#-----------------------------------------------------------------------
+# Copyright ps2dev - http://www.ps2dev.org
+# Licenced under Academic Free License version 2.0
+# Review ps2sdk README & LICENSE files for further details.
+*/
+
+/**
+ * @file
+ * SPU2 ADPCM encoder shared by the adpenc and ps2adpcm host tools.
+ */
+
+#ifndef __LIBADPCM_H__
+#define __LIBADPCM_H__
+
+#include <stdint.h>
+
+/** PCM samples encoded into one ADPCM block. */
+#define ADPCM_BLOCK_SAMPLES 28
+/** Size of one encoded ADPCM block, in bytes. */
+#define ADPCM_BLOCK_SIZE    16
+
+/** Encoder state of one channel, carried from one block to the next. */
+typedef struct
+{
+	/** Last two (clamped) input samples, used by the predictor search. */
+	double s_1, s_2;
+	/** Last two quantisation errors, fed back by the packer. */
+	double ps_1, ps_2;
+	/** Last two samples of the decoder, used by the quality search. */
+	int d_1, d_2;
+	/** Beam width of the quality search, 0 for the standard encoder. */
+	int quality;
+} AdpcmState;
+
+/** Decoder state of one channel. */
+typedef struct
+{
+	int h_1, h_2;
+} AdpcmDecoder;
+
+/** Signal and noise energy, accumulated by AdpcmMeasure(). */
+typedef struct
+{
+	double signal;
+	double noise;
+	double peak;   /* Largest absolute error */
+} AdpcmStats;
+
+/** One channel for AdpcmEncodeStreams(). */
+typedef struct
+{
+	AdpcmState *state;
+	const double *pcm;
+	int blocks;
+	uint8_t *out;
+} AdpcmStream;
+
+/** Largest beam width of the quality search. */
+#define ADPCM_MAX_QUALITY 32
+
+void AdpcmStateInit(AdpcmState *state);
+
+/** Encodes blocks*28 PCM samples into blocks*16 bytes of ADPCM.
+ * The flags byte (offset 1) of each block is left zero for the caller to fill in.
+ * The predictor/shift search of independent blocks is spread over up to
+ * threads threads; the result does not depend on the thread count.
+ * If state->quality is set, a beam search over the predictor and shift of
+ * every block minimises the error of the decoded signal instead. It is
+ * much slower and runs in the calling thread only.
+ * Returns 0 on success, -1 if out of memory.
+ */
+int AdpcmEncodeBlocks(AdpcmState *state, const double *pcm, int blocks, uint8_t *out, int threads);
+
+/** Encodes several independent channels at once, one thread per channel.
+ * Returns 0 on success, -1 if out of memory.
+ */
+int AdpcmEncodeStreams(AdpcmStream *streams, int count, int threads);
+
+/** Decodes one 16-byte block into 28 samples, like the SPU2 does. */
+void AdpcmDecodeBlock(AdpcmDecoder *dec, const uint8_t *in, short *out);
+
+/** Decodes blocks of ADPCM and accumulates its error against the source PCM. */
+void AdpcmMeasure(AdpcmStats *stats, AdpcmDecoder *dec, const double *pcm, const uint8_t *adpcm, int blocks);
+
+/** Returns the signal-to-noise ratio of the accumulated statistics, in dB. */
+double AdpcmSnr(const AdpcmStats *stats);
+
+/** Returns the number of online CPUs, a sensible default thread count. */
+int AdpcmThreadCount(void);
+
+#endif /* __LIBADPCM_H__ */
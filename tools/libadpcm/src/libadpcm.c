@@ -0,0 +1,584 @@
+/*
+# _____     ___ ____     ___ ____
+#  ____|   |    ____|   |        | |____|
+# |     ___|   |____ ___|    ____| |    \    PS2DEV Open Source Project.
+#-----------------------------------------------------------------------
+# Copyright ps2dev - http://www.ps2dev.org
+# Licenced under Academic Free License version 2.0
+# Review ps2sdk README & LICENSE files for further details.
+*/
+
+/*
+	Based on:
+	PSX VAG-Packer, hacked by bITmASTER@bigfoot.com
+
+	The encoder works in two passes. The predictor/shift search of a block
+	only depends on the input samples, so it is done for many blocks at once,
+	in parallel. The packer feeds the quantisation error of each block into
+	the next one and therefore runs sequentially afterwards; it is cheap.
+	Both passes perform exactly the same floating point operations as the
+	original encoder, so the output is bit-identical to it.
+
+	The optional quality search instead runs the SPU2 decoder for every
+	predictor/shift candidate and keeps the best few partial encodings
+	(a beam) by their total reconstruction error, so the choice for a block
+	takes the error it leaves to the following blocks into account.
+*/
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "libadpcm.h"
+
+/* Don't bother starting threads for less blocks than this, per thread */
+#define ADPCM_MT_MIN_BLOCKS 256
+#define ADPCM_MAX_THREADS   64
+
+static const double f[5][2] =
+{
+	{           0.0, 0.0},
+	{  -60.0 / 64.0, 0.0},
+	{ -115.0 / 64.0, 52.0 / 64.0},
+	{  -98.0 / 64.0, 55.0 / 64.0},
+	{ -122.0 / 64.0, 60.0 / 64.0}
+};
+
+/* Prediction filter as used by the SPU2 decoder, in 1/64 units */
+static const int coef[5][2] =
+{
+	{   0,   0},
+	{  60,   0},
+	{ 115, -52},
+	{  98, -55},
+	{ 122, -60}
+};
+
+typedef struct
+{
+	const double *pcm;
+	double *residual;
+	uint8_t *out;
+	int first, last;
+	double s_1, s_2;
+} SearchJob;
+
+/* A candidate encoding of the stream up to the current block */
+typedef struct
+{
+	double err;
+	int h_1, h_2;
+	int parent;
+	uint8_t data[ADPCM_BLOCK_SIZE];
+} BeamEntry;
+
+typedef struct
+{
+	uint8_t data[ADPCM_BLOCK_SIZE];
+	int parent;
+} BeamNode;
+
+typedef struct
+{
+	AdpcmStream *stream;
+	int threads;
+	int result;
+} StreamJob;
+
+// This is a portable implementation of arithmetic right shift.
+static int asr(int v, int n)
+{
+	int tmp = -((unsigned int)v >> 31);
+
+	return (tmp ^ v) >> n ^ tmp;
+}
+
+static int clamp16(int v)
+{
+	if (v > 32767)
+		return 32767;
+	if (v < -32768)
+		return -32768;
+	return v;
+}
+
+static int pcm_to_int(double s)
+{
+	if (s > 32767.0)
+		return 32767;
+	if (s < -32768.0)
+		return -32768;
+	return (int)floor(s + 0.5);
+}
+
+static double clamp_sample(double s)
+{
+	if (s > 30719.0)
+		s = 30719.0;
+	if (s < -30720.0)
+		s = -30720.0;
+	return s;
+}
+
+static void find_predict(const double *pcm, double s_1, double s_2, double *residual, uint8_t *out)
+{
+	double x[ADPCM_BLOCK_SAMPLES + 2];
+	double buffer[5][ADPCM_BLOCK_SAMPLES];
+	double min = 1e10;
+	int predict = 0, shift, min2, shift_mask;
+
+	/* x[j + 2] is s[t], x[j + 1] is s[t-1] and x[j] is s[t-2]. */
+	x[0] = s_2;
+	x[1] = s_1;
+	for (int j = 0; j < ADPCM_BLOCK_SAMPLES; j++)
+		x[j + 2] = clamp_sample(pcm[j]);
+
+	for (int i = 0; i < 5; i++)
+	{
+		const double f0 = f[i][0], f1 = f[i][1];
+		double max = 0.0;
+
+		/* No loop-carried dependency, so this vectorises. */
+		for (int j = 0; j < ADPCM_BLOCK_SAMPLES; j++)
+		{
+			double ds = x[j + 2] + x[j + 1] * f0 + x[j] * f1;
+			double a = fabs(ds);
+
+			buffer[i][j] = ds;
+			max = (a > max) ? a : max;
+		}
+
+		if (max < min)
+		{
+			min = max;
+			predict = i;
+		}
+		if (min <= 7)
+		{
+			predict = 0;
+			break;
+		}
+	}
+
+	memcpy(residual, buffer[predict], sizeof(buffer[predict]));
+
+	min2 = (int)min;
+	shift_mask = 0x4000;
+	shift = 0;
+	while (shift < 12)
+	{
+		if (shift_mask & (min2 + (shift_mask >> 3)))
+			break;
+		shift++;
+		shift_mask >>= 1;
+	}
+
+	out[0] = (predict << 4) | shift;
+}
+
+static void *search_blocks(void *arg)
+{
+	SearchJob *job = arg;
+	double s_1 = job->s_1, s_2 = job->s_2;
+
+	for (int b = job->first; b < job->last; b++)
+	{
+		const double *pcm = job->pcm + b * ADPCM_BLOCK_SAMPLES;
+
+		find_predict(pcm, s_1, s_2, job->residual + b * ADPCM_BLOCK_SAMPLES, job->out + b * ADPCM_BLOCK_SIZE);
+		s_1 = clamp_sample(pcm[ADPCM_BLOCK_SAMPLES - 1]);
+		s_2 = clamp_sample(pcm[ADPCM_BLOCK_SAMPLES - 2]);
+	}
+
+	return NULL;
+}
+
+static void pack(AdpcmState *state, const double *residual, uint8_t *out)
+{
+	int predict = out[0] >> 4, shift = out[0] & 0xf;
+	double s_1 = state->ps_1, s_2 = state->ps_2;
+	short four_bit[ADPCM_BLOCK_SAMPLES];
+
+	for (int i = 0; i < ADPCM_BLOCK_SAMPLES; i++)
+	{
+		double ds, s_0;
+		int di, di_shift_tmp;
+
+		s_0 = residual[i] + s_1 * f[predict][0] + s_2 * f[predict][1];
+		ds = s_0 * (double)(1 << shift);
+
+		di = ((int)ds + 0x800) & 0xfffff000;
+		if (di > 32767)
+			di = 32767;
+		if (di < -32768)
+			di = -32768;
+
+		four_bit[i] = (short)di;
+
+		// This is a portable implementation of arithmetic right shift.
+		di_shift_tmp = -((unsigned int)di >> 31);
+		di = (di_shift_tmp ^ di) >> shift ^ di_shift_tmp;
+		s_2 = s_1;
+		s_1 = (double)di - s_0;
+	}
+
+	for (int i = 0; i < 14; i++)
+		out[2 + i] = ((four_bit[(i * 2) + 1] >> 8) & 0xf0) | ((four_bit[i * 2] >> 12) & 0xf);
+
+	state->ps_1 = s_1;
+	state->ps_2 = s_2;
+}
+
+/* Encodes one block with the given predictor and shift, starting from the
+   decoder history h_1/h_2. Gives up as soon as the error reaches limit. */
+static double try_block(const int *x, int h_1, int h_2, int predict, int shift, double limit, uint8_t *data, int *out_h_1, int *out_h_2)
+{
+	const int c0 = coef[predict][0], c1 = coef[predict][1];
+	const double scale = (double)(1 << shift) / 4096.0;
+	double err = 0.0;
+
+	data[0] = (predict << 4) | shift;
+	data[1] = 0;
+
+	for (int j = 0; j < ADPCM_BLOCK_SAMPLES; j++)
+	{
+		int pred = asr(h_1 * c0 + h_2 * c1 + 32, 6);
+		int n = (int)floor((x[j] - pred) * scale + 0.5);
+		int y, e;
+
+		if (n > 7)
+			n = 7;
+		if (n < -8)
+			n = -8;
+
+		y = clamp16(asr(n * 4096, shift) + pred);
+		e = x[j] - y;
+		err += (double)e * e;
+		if (err >= limit)
+			return err;
+
+		if (j & 1)
+			data[2 + j / 2] |= (n & 0xf) << 4;
+		else
+			data[2 + j / 2] = n & 0xf;
+
+		h_2 = h_1;
+		h_1 = y;
+	}
+
+	*out_h_1 = h_1;
+	*out_h_2 = h_2;
+
+	return err;
+}
+
+/* Adds a candidate to the beam, which is sorted by error. Candidates that
+   leave the decoder in the same state have the same future, so only the
+   better one of them is kept. */
+static void beam_insert(BeamEntry *beam, int *count, int width, const BeamEntry *cand)
+{
+	int i;
+
+	for (i = 0; i < *count; i++)
+	{
+		if (beam[i].h_1 == cand->h_1 && beam[i].h_2 == cand->h_2)
+		{
+			if (beam[i].err <= cand->err)
+				return;
+			/* Drop the worse duplicate */
+			memmove(&beam[i], &beam[i + 1], (*count - i - 1) * sizeof(BeamEntry));
+			(*count)--;
+			break;
+		}
+	}
+
+	if (*count == width)
+	{
+		if (beam[width - 1].err <= cand->err)
+			return;
+		(*count)--;
+	}
+
+	for (i = *count; i > 0 && beam[i - 1].err > cand->err; i--)
+		beam[i] = beam[i - 1];
+	beam[i] = *cand;
+	(*count)++;
+}
+
+static int encode_quality(AdpcmState *state, const double *pcm, int blocks, uint8_t *out)
+{
+	BeamEntry beam[2][ADPCM_MAX_QUALITY];
+	BeamEntry cand;
+	BeamNode *nodes;
+	int width, count, next, cur = 0;
+	int x[ADPCM_BLOCK_SAMPLES];
+
+	width = state->quality;
+	if (width > ADPCM_MAX_QUALITY)
+		width = ADPCM_MAX_QUALITY;
+
+	nodes = malloc((size_t)blocks * width * sizeof(BeamNode));
+	if (nodes == NULL)
+		return -1;
+
+	beam[cur][0].err = 0.0;
+	beam[cur][0].h_1 = state->d_1;
+	beam[cur][0].h_2 = state->d_2;
+	beam[cur][0].parent = 0;
+	count = 1;
+
+	for (int b = 0; b < blocks; b++)
+	{
+		for (int j = 0; j < ADPCM_BLOCK_SAMPLES; j++)
+			x[j] = pcm_to_int(pcm[b * ADPCM_BLOCK_SAMPLES + j]);
+
+		next = 0;
+		for (int i = 0; i < count; i++)
+		{
+			const BeamEntry *e = &beam[cur][i];
+
+			for (int predict = 0; predict < 5; predict++)
+			{
+				for (int shift = 0; shift <= 12; shift++)
+				{
+					double limit = (next == width) ? beam[cur ^ 1][width - 1].err - e->err : 1e300;
+					double err = try_block(x, e->h_1, e->h_2, predict, shift, limit, cand.data, &cand.h_1, &cand.h_2);
+
+					if (err >= limit)
+						continue;
+					cand.err = e->err + err;
+					cand.parent = i;
+					beam_insert(beam[cur ^ 1], &next, width, &cand);
+				}
+			}
+		}
+
+		cur ^= 1;
+		count = next;
+		for (int i = 0; i < count; i++)
+		{
+			memcpy(nodes[b * width + i].data, beam[cur][i].data, ADPCM_BLOCK_SIZE);
+			nodes[b * width + i].parent = beam[cur][i].parent;
+		}
+	}
+
+	/* Follow the best path back to the start */
+	state->d_1 = beam[cur][0].h_1;
+	state->d_2 = beam[cur][0].h_2;
+	for (int b = blocks - 1, i = 0; b >= 0; b--)
+	{
+		memcpy(out + b * ADPCM_BLOCK_SIZE, nodes[b * width + i].data, ADPCM_BLOCK_SIZE);
+		i = nodes[b * width + i].parent;
+	}
+
+	free(nodes);
+
+	return 0;
+}
+
+static void *encode_stream(void *arg)
+{
+	StreamJob *job = arg;
+	AdpcmStream *stream = job->stream;
+
+	job->result = AdpcmEncodeBlocks(stream->state, stream->pcm, stream->blocks, stream->out, job->threads);
+
+	return NULL;
+}
+
+void AdpcmStateInit(AdpcmState *state)
+{
+	state->s_1 = state->s_2 = 0.0;
+	state->ps_1 = state->ps_2 = 0.0;
+	state->d_1 = state->d_2 = 0;
+	state->quality = 0;
+}
+
+int AdpcmEncodeBlocks(AdpcmState *state, const double *pcm, int blocks, uint8_t *out, int threads)
+{
+	SearchJob job[ADPCM_MAX_THREADS];
+	pthread_t thread[ADPCM_MAX_THREADS];
+	int started[ADPCM_MAX_THREADS];
+	double *residual;
+	int i;
+
+	if (blocks <= 0)
+		return 0;
+
+	if (state->quality > 0)
+		return encode_quality(state, pcm, blocks, out);
+
+	residual = malloc(blocks * ADPCM_BLOCK_SAMPLES * sizeof(double));
+	if (residual == NULL)
+		return -1;
+
+	memset(out, 0, blocks * ADPCM_BLOCK_SIZE);
+
+	if (threads > blocks / ADPCM_MT_MIN_BLOCKS)
+		threads = blocks / ADPCM_MT_MIN_BLOCKS;
+	if (threads > ADPCM_MAX_THREADS)
+		threads = ADPCM_MAX_THREADS;
+	if (threads < 1)
+		threads = 1;
+
+	for (i = 0; i < threads; i++)
+	{
+		job[i].pcm = pcm;
+		job[i].residual = residual;
+		job[i].out = out;
+		job[i].first = (int)((long long)blocks * i / threads);
+		job[i].last = (int)((long long)blocks * (i + 1) / threads);
+		if (i == 0)
+		{
+			job[i].s_1 = state->s_1;
+			job[i].s_2 = state->s_2;
+		}
+		else
+		{
+			/* The search state of a block is simply the preceding two samples */
+			job[i].s_1 = clamp_sample(pcm[job[i].first * ADPCM_BLOCK_SAMPLES - 1]);
+			job[i].s_2 = clamp_sample(pcm[job[i].first * ADPCM_BLOCK_SAMPLES - 2]);
+		}
+	}
+
+	/* The calling thread does the first share; fall back to it if a thread can't be started */
+	for (i = 1; i < threads; i++)
+		started[i] = (pthread_create(&thread[i], NULL, search_blocks, &job[i]) == 0);
+	search_blocks(&job[0]);
+	for (i = 1; i < threads; i++)
+	{
+		if (started[i])
+			pthread_join(thread[i], NULL);
+		else
+			search_blocks(&job[i]);
+	}
+
+	state->s_1 = clamp_sample(pcm[blocks * ADPCM_BLOCK_SAMPLES - 1]);
+	state->s_2 = clamp_sample(pcm[blocks * ADPCM_BLOCK_SAMPLES - 2]);
+
+	for (i = 0; i < blocks; i++)
+		pack(state, residual + i * ADPCM_BLOCK_SAMPLES, out + i * ADPCM_BLOCK_SIZE);
+
+	free(residual);
+
+	return 0;
+}
+
+int AdpcmEncodeStreams(AdpcmStream *streams, int count, int threads)
+{
+	StreamJob *job;
+	pthread_t *thread;
+	int *started;
+	int i, result = 0;
+
+	job = malloc(count * sizeof(StreamJob));
+	thread = malloc(count * sizeof(pthread_t));
+	started = malloc(count * sizeof(int));
+	if (job == NULL || thread == NULL || started == NULL)
+	{
+		free(started);
+		free(thread);
+		free(job);
+		return -1;
+	}
+
+	/* Share the threads out between the streams */
+	for (i = 0; i < count; i++)
+	{
+		job[i].stream = &streams[i];
+		job[i].threads = (threads + count - 1 - i) / count;
+		if (job[i].threads < 1)
+			job[i].threads = 1;
+		job[i].result = 0;
+	}
+
+	for (i = 1; i < count; i++)
+		started[i] = (threads > i) && (pthread_create(&thread[i], NULL, encode_stream, &job[i]) == 0);
+	encode_stream(&job[0]);
+	for (i = 1; i < count; i++)
+	{
+		if (started[i])
+			pthread_join(thread[i], NULL);
+		else
+			encode_stream(&job[i]);
+		if (job[i].result < 0)
+			result = -1;
+	}
+	if (job[0].result < 0)
+		result = -1;
+
+	free(started);
+	free(thread);
+	free(job);
+
+	return result;
+}
+
+void AdpcmDecodeBlock(AdpcmDecoder *dec, const uint8_t *in, short *out)
+{
+	int predict = in[0] >> 4, shift = in[0] & 0xf;
+	int h_1 = dec->h_1, h_2 = dec->h_2;
+
+	/* The SPU2 treats the reserved values like this */
+	if (predict > 4)
+		predict = 0;
+	if (shift > 12)
+		shift = 9;
+
+	for (int j = 0; j < ADPCM_BLOCK_SAMPLES; j++)
+	{
+		int n = (in[2 + j / 2] >> ((j & 1) * 4)) & 0xf;
+		int y;
+
+		n = (n ^ 8) - 8;
+		y = clamp16(asr(n * 4096, shift) + asr(h_1 * coef[predict][0] + h_2 * coef[predict][1] + 32, 6));
+		out[j] = y;
+		h_2 = h_1;
+		h_1 = y;
+	}
+
+	dec->h_1 = h_1;
+	dec->h_2 = h_2;
+}
+
+void AdpcmMeasure(AdpcmStats *stats, AdpcmDecoder *dec, const double *pcm, const uint8_t *adpcm, int blocks)
+{
+	short y[ADPCM_BLOCK_SAMPLES];
+
+	for (int b = 0; b < blocks; b++)
+	{
+		AdpcmDecodeBlock(dec, adpcm + b * ADPCM_BLOCK_SIZE, y);
+		for (int j = 0; j < ADPCM_BLOCK_SAMPLES; j++)
+		{
+			double x = pcm_to_int(pcm[b * ADPCM_BLOCK_SAMPLES + j]);
+			double e = fabs(x - y[j]);
+
+			stats->signal += x * x;
+			stats->noise += e * e;
+			if (e > stats->peak)
+				stats->peak = e;
+		}
+	}
+}
+
+double AdpcmSnr(const AdpcmStats *stats)
+{
+	if (stats->noise <= 0.0)
+		return INFINITY;
+
+	return 10.0 * log10(stats->signal / stats->noise);
+}
+
+int AdpcmThreadCount(void)
+{
+#ifdef _SC_NPROCESSORS_ONLN
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+	if (n > 0)
+		return (n > ADPCM_MAX_THREADS) ? ADPCM_MAX_THREADS : (int)n;
+#endif
+	return 1;
+}
@@ -0,0 +1,100 @@
+/*
+# _____     ___ ____     ___ ____
+#  ____|   |    ____|   |        | |____|
+# |     ___|   |____ ___|    ____| |    \    PS2DEV Open Source Project.
+#-----------------------------------------------------------------------
+# Copyright 2001-2004, ps2dev - http://www.ps2dev.org
+# Licenced under Academic Free License version 2.0
+# Review ps2sdk README & LICENSE files for further details.
+*/
+
+/**
+ * @file
+ * I/O manager, for IOP code built on the host.
+ *
+ * Takes the place of iop/kernel/include/iomanX.h, whose declarations of
+ * open, read, write and friends collide with the host C library. Only the
+ * file mode and flag definitions, with the IOP's values, the device driver
+ * structures, and ioctl2(), AddDrv() and DelDrv(), which the host does not
+ * have, are here. A check tool that uses ioctl2() provides it, standing in
+ * for the device behind the file descriptor, and one that builds a file
+ * system driver provides AddDrv() and DelDrv() to get at its operations.
+ */
+
+#ifndef __IOMANX_H__
+#define __IOMANX_H__
+
+#include <tamtypes.h>
+#include <iox_stat.h>
+
+#define O_RDONLY  0x0001
+#define O_WRONLY  0x0002
+#define O_RDWR    0x0003
+#define O_DIROPEN 0x0008
+#define O_NBLOCK  0x0010
+#define O_APPEND  0x0100
+#define O_CREAT   0x0200
+#define O_TRUNC   0x0400
+#define O_EXCL    0x0800
+#define O_NOWAIT  0x8000
+
+#define FIO_MT_RDWR   0x00
+#define FIO_MT_RDONLY 0x01
+
+#define IOP_DT_CHAR  0x01
+#define IOP_DT_CONS  0x02
+#define IOP_DT_BLOCK 0x04
+#define IOP_DT_RAW   0x08
+#define IOP_DT_FS    0x10
+#define IOP_DT_FSEXT 0x10000000
+
+typedef struct _iop_file {
+	int mode;
+	int unit;
+	struct _iop_device *device;
+	void *privdata;
+} iop_file_t;
+
+typedef struct _iop_device {
+	const char *name;
+	unsigned int type;
+	unsigned int version;
+	const char *desc;
+	struct _iop_device_ops *ops;
+} iop_device_t;
+
+typedef struct _iop_device_ops {
+	int (*init)(iop_device_t *);
+	int (*deinit)(iop_device_t *);
+	int (*format)(iop_file_t *, const char *, const char *, void *, int);
+	int (*open)(iop_file_t *, const char *, int, int);
+	int (*close)(iop_file_t *);
+	int (*read)(iop_file_t *, void *, int);
+	int (*write)(iop_file_t *, void *, int);
+	int (*lseek)(iop_file_t *, int, int);
+	int (*ioctl)(iop_file_t *, int, void *);
+	int (*remove)(iop_file_t *, const char *);
+	int (*mkdir)(iop_file_t *, const char *, int);
+	int (*rmdir)(iop_file_t *, const char *);
+	int (*dopen)(iop_file_t *, const char *);
+	int (*dclose)(iop_file_t *);
+	int (*dread)(iop_file_t *, iox_dirent_t *);
+	int (*getstat)(iop_file_t *, const char *, iox_stat_t *);
+	int (*chstat)(iop_file_t *, const char *, iox_stat_t *, unsigned int);
+	int (*rename)(iop_file_t *, const char *, const char *);
+	int (*chdir)(iop_file_t *, const char *);
+	int (*sync)(iop_file_t *, const char *, int);
+	int (*mount)(iop_file_t *, const char *, const char *, int, void *, int);
+	int (*umount)(iop_file_t *, const char *);
+	s64 (*lseek64)(iop_file_t *, s64, int);
+	int (*devctl)(iop_file_t *, const char *, int, void *, unsigned int, void *, unsigned int);
+	int (*symlink)(iop_file_t *, const char *, const char *);
+	int (*readlink)(iop_file_t *, const char *, char *, unsigned int);
+	int (*ioctl2)(iop_file_t *, int, void *, unsigned int, void *, unsigned int);
+} iop_device_ops_t;
+
+int ioctl2(int fd, int cmd, void *arg, unsigned int arglen, void *buf, unsigned int buflen);
+int AddDrv(iop_device_t *device);
+int DelDrv(const char *name);
+
+#endif /* __IOMANX_H__ */
@@ -0,0 +1,37 @@
+/*
+# _____     ___ ____     ___ ____
+#  ____|   |    ____|   |        | |____|
+# |     ___|   |____ ___|    ____| |    \    PS2DEV Open Source Project.
+#-----------------------------------------------------------------------
+# Copyright ps2dev - http://www.ps2dev.org
+# Licenced under Academic Free License version 2.0
+# Review ps2sdk README & LICENSE files for further details.
+*/
+
+/**
+ * @file
+ * Host versions of the IOP kernel services, for running IOP code in host
+ * check tools.
+ *
+ * IOP threads are host threads. Interrupts are not emulated: disabling them
+ * takes one global lock, and a thread can declare itself an interrupt
+ * handler so that QueryIntrContext() and the i* functions behave as they
+ * would in one.
+ */
+
+#ifndef __IOPHOST_H__
+#define __IOPHOST_H__
+
+/** Mark the calling thread as running in interrupt context, or not. */
+void iophost_set_intr_context(int intr);
+
+/** Number of AllocSysMemory() blocks that have not been freed. */
+int iophost_alloc_count(void);
+
+/** Start a host thread running an IOP thread function. Returns its thread ID. */
+int iophost_start_thread(void (*func)(void *arg), void *arg);
+
+/** Wait for a thread started with iophost_start_thread() to return. */
+void iophost_join_thread(int thid);
+
+#endif /* __IOPHOST_H__ */
@@ -0,0 +1,30 @@
+/*
+# _____     ___ ____     ___ ____
+#  ____|   |    ____|   |        | |____|
+# |     ___|   |____ ___|    ____| |    \    PS2DEV Open Source Project.
+#-----------------------------------------------------------------------
+# Copyright 2001-2004, ps2dev - http://www.ps2dev.org
+# Licenced under Academic Free License version 2.0
+# Review ps2sdk README & LICENSE files for further details.
+*/
+
+/**
+ * @file
+ * System C library, for IOP code built on the host.
+ *
+ * Takes the place of iop/kernel/include/sysclib.h, whose declarations of
+ * the non-standard IOP functions collide with the host C library. The
+ * standard functions come from the host.
+ */
+
+#ifndef __SYSCLIB_H__
+#define __SYSCLIB_H__
+
+#include <tamtypes.h>
+#include <stdarg.h>
+#include <setjmp.h>
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+
+#endif /* __SYSCLIB_H__ */
@@ -0,0 +1,353 @@
+/*
+# _____     ___ ____     ___ ____
+#  ____|   |    ____|   |        | |____|
+# |     ___|   |____ ___|    ____| |    \    PS2DEV Open Source Project.
+#-----------------------------------------------------------------------
+# Copyright ps2dev - http://www.ps2dev.org
+# Licenced under Academic Free License version 2.0
+# Review ps2sdk README & LICENSE files for further details.
+*/
+
+/*
+	Host versions of the IOP kernel services used by the modules that the
+	check tools build. Only what those modules need is here, with the
+	IOP's semantics: wakeups are counted, and CancelWakeupThread() returns
+	and clears the count. Semaphores are counted up to their maximum.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <sysmem.h>
+#include <thbase.h>
+#include <thsemap.h>
+#include <intrman.h>
+#include <kerr.h>
+
+#include "iophost.h"
+
+#define IOPHOST_MAX_THREADS 64
+#define IOPHOST_MAX_SEMAS 64
+
+struct iophost_thread
+{
+	int used;
+	int wakeups;
+	pthread_t thread;
+	pthread_cond_t cond;
+	void (*func)(void *arg);
+	void *arg;
+};
+
+struct iophost_sema
+{
+	int used;
+	int count;
+	int max;
+	pthread_cond_t cond;
+};
+
+static struct iophost_thread threads[IOPHOST_MAX_THREADS];
+static struct iophost_sema semas[IOPHOST_MAX_SEMAS];
+static pthread_mutex_t thread_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t intr_lock;
+static pthread_once_t intr_once = PTHREAD_ONCE_INIT;
+static __thread int current_thid;
+static __thread int intr_context;
+static int alloc_count;
+
+static int thread_alloc(void)
+{
+	int i;
+
+	pthread_mutex_lock(&thread_lock);
+	for(i = 0; i < IOPHOST_MAX_THREADS; i++) {
+		if(!threads[i].used) {
+			threads[i].used = 1;
+			threads[i].wakeups = 0;
+			pthread_cond_init(&threads[i].cond, NULL);
+			break;
+		}
+	}
+	pthread_mutex_unlock(&thread_lock);
+
+	if(i == IOPHOST_MAX_THREADS) {
+		fprintf(stderr, "iophost: out of threads\n");
+		abort();
+	}
+
+	return i + 1;
+}
+
+static struct iophost_thread *thread_get(int thid)
+{
+	if(thid == TH_SELF)
+		thid = GetThreadId();
+
+	return &threads[thid - 1];
+}
+
+/* Threads */
+
+int GetThreadId(void)
+{
+	if(current_thid == 0)
+		current_thid = thread_alloc();
+
+	return current_thid;
+}
+
+int SleepThread(void)
+{
+	struct iophost_thread *t = thread_get(TH_SELF);
+
+	pthread_mutex_lock(&thread_lock);
+	while(t->wakeups == 0)
+		pthread_cond_wait(&t->cond, &thread_lock);
+	t->wakeups--;
+	pthread_mutex_unlock(&thread_lock);
+
+	return 0;
+}
+
+int WakeupThread(int thid)
+{
+	struct iophost_thread *t = thread_get(thid);
+
+	pthread_mutex_lock(&thread_lock);
+	t->wakeups++;
+	pthread_cond_signal(&t->cond);
+	pthread_mutex_unlock(&thread_lock);
+
+	return 0;
+}
+
+int iWakeupThread(int thid)
+{
+	return WakeupThread(thid);
+}
+
+int CancelWakeupThread(int thid)
+{
+	struct iophost_thread *t = thread_get(thid);
+	int wakeups;
+
+	pthread_mutex_lock(&thread_lock);
+	wakeups = t->wakeups;
+	t->wakeups = 0;
+	pthread_mutex_unlock(&thread_lock);
+
+	return wakeups;
+}
+
+int iCancelWakeupThread(int thid)
+{
+	return CancelWakeupThread(thid);
+}
+
+int DelayThread(int usec)
+{
+	struct timespec ts;
+
+	ts.tv_sec = usec / 1000000;
+	ts.tv_nsec = (usec % 1000000) * 1000;
+	nanosleep(&ts, NULL);
+
+	return 0;
+}
+
+static void *thread_main(void *arg)
+{
+	struct iophost_thread *t = arg;
+
+	current_thid = (int)(t - threads) + 1;
+	t->func(t->arg);
+
+	return NULL;
+}
+
+int iophost_start_thread(void (*func)(void *arg), void *arg)
+{
+	int thid = thread_alloc();
+	struct iophost_thread *t = &threads[thid - 1];
+
+	t->func = func;
+	t->arg = arg;
+	if(pthread_create(&t->thread, NULL, thread_main, t) != 0) {
+		fprintf(stderr, "iophost: can't create thread\n");
+		abort();
+	}
+
+	return thid;
+}
+
+void iophost_join_thread(int thid)
+{
+	struct iophost_thread *t = &threads[thid - 1];
+
+	pthread_join(t->thread, NULL);
+	pthread_mutex_lock(&thread_lock);
+	pthread_cond_destroy(&t->cond);
+	t->used = 0;
+	pthread_mutex_unlock(&thread_lock);
+}
+
+/* Semaphores */
+
+int CreateSema(iop_sema_t *sema)
+{
+	int i;
+
+	pthread_mutex_lock(&thread_lock);
+	for(i = 0; i < IOPHOST_MAX_SEMAS; i++) {
+		if(!semas[i].used) {
+			semas[i].used = 1;
+			semas[i].count = sema->initial;
+			semas[i].max = sema->max;
+			pthread_cond_init(&semas[i].cond, NULL);
+			break;
+		}
+	}
+	pthread_mutex_unlock(&thread_lock);
+
+	return (i < IOPHOST_MAX_SEMAS) ? i + 1 : KE_NO_MEMORY;
+}
+
+int DeleteSema(int semid)
+{
+	struct iophost_sema *s = &semas[semid - 1];
+
+	pthread_mutex_lock(&thread_lock);
+	pthread_cond_destroy(&s->cond);
+	s->used = 0;
+	pthread_mutex_unlock(&thread_lock);
+
+	return 0;
+}
+
+int SignalSema(int semid)
+{
+	struct iophost_sema *s = &semas[semid - 1];
+	int rv = 0;
+
+	pthread_mutex_lock(&thread_lock);
+	if(s->count < s->max) {
+		s->count++;
+		pthread_cond_signal(&s->cond);
+	} else {
+		rv = KE_SEMA_OVF;
+	}
+	pthread_mutex_unlock(&thread_lock);
+
+	return rv;
+}
+
+int iSignalSema(int semid)
+{
+	return SignalSema(semid);
+}
+
+int WaitSema(int semid)
+{
+	struct iophost_sema *s = &semas[semid - 1];
+
+	pthread_mutex_lock(&thread_lock);
+	while(s->count == 0)
+		pthread_cond_wait(&s->cond, &thread_lock);
+	s->count--;
+	pthread_mutex_unlock(&thread_lock);
+
+	return 0;
+}
+
+int PollSema(int semid)
+{
+	struct iophost_sema *s = &semas[semid - 1];
+	int rv = KE_SEMA_ZERO;
+
+	pthread_mutex_lock(&thread_lock);
+	if(s->count > 0) {
+		s->count--;
+		rv = 0;
+	}
+	pthread_mutex_unlock(&thread_lock);
+
+	return rv;
+}
+
+/* Interrupts */
+
+static void intr_init(void)
+{
+	pthread_mutexattr_t attr;
+
+	// Interrupts can be disabled again while they are
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&intr_lock, &attr);
+	pthread_mutexattr_destroy(&attr);
+}
+
+int CpuSuspendIntr(int *state)
+{
+	pthread_once(&intr_once, intr_init);
+	pthread_mutex_lock(&intr_lock);
+	*state = 0;
+
+	return 0;
+}
+
+int CpuResumeIntr(int state)
+{
+	(void)state;
+
+	pthread_mutex_unlock(&intr_lock);
+
+	return 0;
+}
+
+int QueryIntrContext(void)
+{
+	return intr_context;
+}
+
+void iophost_set_intr_context(int intr)
+{
+	intr_context = intr;
+}
+
+/* Memory */
+
+void *AllocSysMemory(int mode, int size, void *ptr)
+{
+	void *p;
+
+	(void)mode;
+	(void)ptr;
+
+	// Blocks of the IOP allocator are 256-byte aligned
+	if(posix_memalign(&p, 256, size > 0 ? size : 1) != 0)
+		return NULL;
+	__sync_fetch_and_add(&alloc_count, 1);
+
+	return p;
+}
+
+int FreeSysMemory(void *ptr)
+{
+	if(ptr == NULL)
+		return -1;
+
+	free(ptr);
+	__sync_fetch_and_sub(&alloc_count, 1);
+
+	return 0;
+}
+
+int iophost_alloc_count(void)
+{
+	return alloc_count;
+}
@@ -0,0 +1,30 @@
+/*
+# _____     ___ ____     ___ ____
+#  ____|   |    ____|   |        | |____|
+# |     ___|   |____ ___|    ____| |    \    PS2DEV Open Source Project.
+#-----------------------------------------------------------------------
+# Copyright ps2dev - http://www.ps2dev.org
+# Licenced under Academic Free License version 2.0
+# Review ps2sdk README & LICENSE files for further details.
+*/
+
+/**
+ * @file
+ * LZ4 block compressor shared by the bin2c, bin2o and bin2s host tools.
+ * The data is decompressed on the PS2 with unlz4() from unlz4.h.
+ */
+
+#ifndef __LZ4ENC_H__
+#define __LZ4ENC_H__
+
+#include <stddef.h>
+
+/** Worst case size of the compressed data. */
+#define LZ4ENC_BOUND(size) ((size) + (size) / 255 + 16)
+
+/** Compresses size bytes from src into dst, which must hold LZ4ENC_BOUND(size) bytes.
+ * Returns the size of the compressed data.
+ */
+size_t lz4enc_compress(const unsigned char *src, size_t size, unsigned char *dst);
+
+#endif /* __LZ4ENC_H__ */
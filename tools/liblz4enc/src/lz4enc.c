@@ -0,0 +1,145 @@
+/*
+# _____     ___ ____     ___ ____
+#  ____|   |    ____|   |        | |____|
+# |     ___|   |____ ___|    ____| |    \    PS2DEV Open Source Project.
+#-----------------------------------------------------------------------
+# Copyright ps2dev - http://www.ps2dev.org
+# Licenced under Academic Free License version 2.0
+# Review ps2sdk README & LICENSE files for further details.
+*/
+
+/*
+	Produces the LZ4 block format: a sequence of
+	  token (literal length << 4 | match length - 4),
+	  optional literal length bytes, literals,
+	  16-bit little endian match offset, optional match length bytes.
+	The last sequence only has literals. Like the reference encoder, the
+	last 5 bytes are always literals and no match starts in the last 12
+	bytes, so that fast decoders may copy in words.
+
+	Compression only happens at build time, so matches are searched with
+	hash chains rather than a single hash probe, for a better ratio.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "lz4enc.h"
+
+#define MIN_MATCH    4
+#define LAST_LITERALS 5
+#define MF_LIMIT     12
+#define MAX_OFFSET   65535
+#define HASH_BITS    16
+#define CHAIN_DEPTH  256
+
+static unsigned int hash4(const unsigned char *p)
+{
+	unsigned int v = p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+
+	return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+
+static unsigned char *put_length(unsigned char *op, size_t len)
+{
+	while (len >= 255)
+	{
+		*op++ = 255;
+		len -= 255;
+	}
+	*op++ = (unsigned char)len;
+
+	return op;
+}
+
+static unsigned char *put_sequence(unsigned char *op, const unsigned char *lit, size_t lit_len, size_t offset, size_t match_len)
+{
+	unsigned char *token = op++;
+
+	*token = (unsigned char)(((lit_len >= 15) ? 15 : lit_len) << 4);
+	if (lit_len >= 15)
+		op = put_length(op, lit_len - 15);
+	memcpy(op, lit, lit_len);
+	op += lit_len;
+
+	if (match_len == 0)
+		return op;
+
+	*op++ = offset & 0xff;
+	*op++ = offset >> 8;
+	match_len -= MIN_MATCH;
+	*token |= (match_len >= 15) ? 15 : match_len;
+	if (match_len >= 15)
+		op = put_length(op, match_len - 15);
+
+	return op;
+}
+
+size_t lz4enc_compress(const unsigned char *src, size_t size, unsigned char *dst)
+{
+	long *head, *chain;
+	const unsigned char *anchor = src;
+	unsigned char *op = dst;
+	size_t pos = 0;
+
+	head = malloc((1 << HASH_BITS) * sizeof(long));
+	chain = malloc((MAX_OFFSET + 1) * sizeof(long));
+
+	if (head != NULL && chain != NULL && size > MF_LIMIT)
+	{
+		const size_t match_limit = size - MF_LIMIT;
+		const size_t end_limit = size - LAST_LITERALS;
+
+		for (size_t i = 0; i < (1 << HASH_BITS); i++)
+			head[i] = -1;
+
+		while (pos < match_limit)
+		{
+			unsigned int h = hash4(&src[pos]);
+			size_t best_len = 0, best_off = 0;
+			long cand = head[h];
+
+			for (int depth = 0; depth < CHAIN_DEPTH && cand >= 0 && pos - cand <= MAX_OFFSET; depth++)
+			{
+				size_t len = 0;
+
+				while (pos + len < end_limit && src[cand + len] == src[pos + len])
+					len++;
+				if (len > best_len)
+				{
+					best_len = len;
+					best_off = pos - cand;
+				}
+				cand = chain[cand & MAX_OFFSET];
+			}
+
+			chain[pos & MAX_OFFSET] = head[h];
+			head[h] = pos;
+
+			if (best_len < MIN_MATCH)
+			{
+				pos++;
+				continue;
+			}
+
+			op = put_sequence(op, anchor, &src[pos] - anchor, best_off, best_len);
+
+			/* Index the positions covered by the match */
+			for (size_t end = pos + best_len, p = pos + 1; p < end; p++)
+			{
+				if (p < match_limit)
+				{
+					h = hash4(&src[p]);
+					chain[p & MAX_OFFSET] = head[h];
+					head[h] = p;
+				}
+			}
+			pos += best_len;
+			anchor = &src[pos];
+		}
+	}
+
+	free(chain);
+	free(head);
+
+	return put_sequence(op, anchor, &src[size] - anchor, 0, 0) - dst;
+}
@@ -0,0 +1,855 @@
+/*
+# _____     ___ ____     ___ ____
+#  ____|   |    ____|   |        | |____|
+# |     ___|   |____ ___|    ____| |    \    PS2DEV Open Source Project.
+#-----------------------------------------------------------------------
+# Copyright 2001-2004, ps2dev - http://www.ps2dev.org
+# Licenced under Academic Free License version 2.0
+# Review ps2sdk README & LICENSE files for further details.
+*/
+
+/* mx4siocheck: checks the SPI SD card protocol of mx4sio_bd on the host.
+ *
+ * The spi_sdcard driver talks, through its spisd_interface_t, to a
+ * simulated SD card in SPI mode. The card decodes every byte clocked in:
+ * commands with their CRC7, start and stop tokens, data blocks, and
+ * answers with R1/R3/R7 responses, data blocks with their CRC16, data
+ * responses and busy signalling. Faults can be injected: rejected data
+ * blocks and a card that stays busy.
+ *
+ * It also checks the receive path of mx4sio.c: the fused bit-reversal and
+ * CRC16 over the bytes as the SIO2 receives them, against the bit-reversal
+ * followed by the nibble-wise CRC16 that it replaced.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "bitreverse.h"
+#include "crc16.h"
+#include "spi_sdcard_driver.h"
+
+#define CARD_SECTORS 4096
+#define SECTOR_SIZE 512
+// Bytes a card stays busy after programming a block
+#define CARD_BUSY 12
+// A card that never gets ready
+#define CARD_STUCK 0x7fffffff
+
+static int checks, failures;
+
+static unsigned int seed = 1;
+
+static unsigned int rnd(unsigned int range)
+{
+	seed = seed * 1103515245 + 12345;
+	return ((seed >> 8) & 0xffffff) % range;
+}
+
+/* Each failing check is only printed once */
+static void check(const char *name, int ok)
+{
+	static const char *failed[64];
+	static int failed_count;
+	int i;
+
+	checks++;
+	if(ok)
+		return;
+
+	failures++;
+	for(i=0;i<failed_count;i++)
+		if(failed[i] == name)
+			return;
+	if(failed_count < 64)
+		failed[failed_count++] = name;
+	printf("FAIL: %s\n", name);
+}
+
+/* SD card in SPI mode */
+
+enum card_state
+{
+	// Waiting for a command
+	CARD_CMD,
+	// CMD18: sending blocks until CMD12
+	CARD_READ,
+	// CMD24: waiting for the start token, then the block
+	CARD_WRITE_TOKEN,
+	CARD_WRITE_DATA,
+	// CMD25: waiting for start or stop tokens, then blocks
+	CARD_MULTI_TOKEN,
+	CARD_MULTI_DATA,
+};
+
+struct card
+{
+	u8 data[CARD_SECTORS * SECTOR_SIZE];
+	// Block addressed (SDHC) or byte addressed (SDSC)
+	int sdhc;
+	int present;
+	enum card_state state;
+	// Still initializing, until ACMD41 answers 0
+	int idle;
+	// The last command was CMD55
+	int app_cmd;
+	int acmd41_polls;
+	// Command being received
+	u8 cmd[6];
+	int cmd_len;
+	// Bytes to send, ahead of anything else
+	u8 out[SECTOR_SIZE + 16];
+	int out_len;
+	int out_pos;
+	// Bytes the data line stays low for
+	int busy;
+	// Block being received or sent
+	u32 sector;
+	u8 block[SECTOR_SIZE + 2];
+	int block_len;
+	int selected;
+	u32 speed;
+	// Faults: data response for the block with that index in a CMD25, and busy time after it
+	int fault_block;
+	u8 fault_response;
+	int fault_busy;
+	int multi_blocks;
+	// Statistics
+	int commands;
+	int crc_errors;
+	int illegal;
+	int acmd23_count;
+	int stop_tokens;
+	int blocks_written;
+};
+
+static struct card card;
+
+static void card_insert(int sdhc)
+{
+	int i;
+
+	memset(&card, 0, sizeof(card));
+	card.sdhc = sdhc;
+	card.present = 1;
+	card.idle = 1;
+	card.fault_block = -1;
+	for(i=0;i<CARD_SECTORS * SECTOR_SIZE;i++)
+		card.data[i] = (u8)(i * 7 + (i >> 9));
+}
+
+/* CRC7 of a command, as in the SD specification, bit by bit */
+static u8 card_crc7(const u8 *p, int len)
+{
+	u8 crc = 0;
+	int i, j;
+
+	for(i=0;i<len;i++) {
+		for(j=7;j>=0;j--) {
+			int bit = ((p[i] >> j) & 1) ^ ((crc >> 6) & 1);
+
+			crc = (crc << 1) & 0x7f;
+			if(bit)
+				crc ^= 0x09;
+		}
+	}
+
+	return crc;
+}
+
+/* CRC16 of a data block, as in the SD specification, bit by bit */
+static u16 card_crc16(const u8 *p, int len)
+{
+	u16 crc = 0;
+	int i, j;
+
+	for(i=0;i<len;i++) {
+		crc ^= p[i] << 8;
+		for(j=0;j<8;j++)
+			crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : (crc << 1);
+	}
+
+	return crc;
+}
+
+static void card_send(const u8 *p, int len)
+{
+	if(card.out_pos == card.out_len)
+		card.out_pos = card.out_len = 0;
+	memcpy(&card.out[card.out_len], p, len);
+	card.out_len += len;
+}
+
+static void card_send_byte(u8 b)
+{
+	card_send(&b, 1);
+}
+
+/* Queues a data block: access time, start token, data, CRC16 */
+static void card_send_block(const u8 *p, int len)
+{
+	u16 crc = card_crc16(p, len);
+
+	card_send_byte(0xff);
+	card_send_byte(0xfe);
+	card_send(p, len);
+	card_send_byte(crc >> 8);
+	card_send_byte(crc & 0xff);
+}
+
+/* Sector of a data command, -1 if out of range */
+static int card_sector(u32 arg)
+{
+	if(!card.sdhc) {
+		if(arg % SECTOR_SIZE)
+			return -1;
+		arg /= SECTOR_SIZE;
+	}
+
+	return (arg < CARD_SECTORS) ? (int)arg : -1;
+}
+
+static void card_command(void)
+{
+	static const u8 csd[16] = {0x40, 0x0e, 0x00, 0x32, 0x5b, 0x59, 0x00, 0x00, 0x00, 0x07, 0x7f, 0x80, 0x0a, 0x40, 0x00, 0x01};
+	static const u8 cid[16] = {0x03, 'S', 'D', 'S', 'I', 'M', '0', '1', 0x10, 0x12, 0x34, 0x56, 0x78, 0x01, 0x4a, 0x01};
+	u8 index = card.cmd[0] & 0x3f;
+	u32 arg = (card.cmd[1] << 24) | (card.cmd[2] << 16) | (card.cmd[3] << 8) | card.cmd[4];
+	int app = card.app_cmd, sector;
+	u8 r1;
+
+	card.commands++;
+	card.app_cmd = 0;
+
+	// Response time: one byte
+	card_send_byte(0xff);
+
+	if((card.cmd[5] >> 1) != card_crc7(card.cmd, 5) || !(card.cmd[5] & 1)) {
+		card.crc_errors++;
+		card_send_byte(0x08 | card.idle);
+		return;
+	}
+
+	r1 = card.idle;
+	switch(index) {
+		case 0:
+			card.idle = 1;
+			card.state = CARD_CMD;
+			card_send_byte(0x01);
+			break;
+		case 8:
+			card_send_byte(r1);
+			card_send_byte(0x00);
+			card_send_byte(0x00);
+			card_send_byte((arg >> 8) & 0x0f);
+			card_send_byte(arg & 0xff);
+			break;
+		case 9:
+		case 10:
+			card_send_byte(r1);
+			card_send_block(index == 9 ? csd : cid, 16);
+			break;
+		case 12:
+			// The byte after the command is a stuff byte, then the card is busy for a while
+			card.out_pos = card.out_len = 0;
+			card.state = CARD_CMD;
+			card_send_byte(0xff);
+			card_send_byte(r1);
+			card.busy = 4;
+			break;
+		case 17:
+		case 18:
+			if((sector = card_sector(arg)) < 0) {
+				card_send_byte(r1 | 0x40);
+				break;
+			}
+			card.sector = sector;
+			card_send_byte(r1);
+			card_send_block(&card.data[card.sector * SECTOR_SIZE], SECTOR_SIZE);
+			if(index == 18) {
+				card.sector++;
+				card.state = CARD_READ;
+			}
+			break;
+		case 23:
+			if(app) {
+				card.acmd23_count = arg;
+				card_send_byte(r1);
+			} else {
+				card.illegal++;
+				card_send_byte(r1 | 0x04);
+			}
+			break;
+		case 24:
+		case 25:
+			if((sector = card_sector(arg)) < 0) {
+				card_send_byte(r1 | 0x40);
+				break;
+			}
+			card.sector = sector;
+			card.multi_blocks = 0;
+			card.state = (index == 24) ? CARD_WRITE_TOKEN : CARD_MULTI_TOKEN;
+			card_send_byte(r1);
+			break;
+		case 41:
+			if(app && ++card.acmd41_polls >= 3)
+				card.idle = 0;
+			card_send_byte(card.idle);
+			break;
+		case 55:
+			card.app_cmd = 1;
+			card_send_byte(r1);
+			break;
+		case 58:
+			card_send_byte(r1);
+			card_send_byte(card.sdhc ? 0xc0 : 0x80);
+			card_send_byte(0xff);
+			card_send_byte(0x80);
+			card_send_byte(0x00);
+			break;
+		default:
+			card.illegal++;
+			card_send_byte(r1 | 0x04);
+			break;
+	}
+}
+
+/* A block was received: answer with a data response, then program it */
+static void card_block_done(int multi)
+{
+	u8 response = 0xe5;
+	int busy = CARD_BUSY;
+
+	if(multi && card.multi_blocks == card.fault_block) {
+		response = card.fault_response;
+		busy = card.fault_busy;
+	}
+	card.multi_blocks++;
+
+	card_send_byte(response);
+	card.busy = busy;
+	if((response & 0x1f) == 0x05) {
+		memcpy(&card.data[card.sector * SECTOR_SIZE], card.block, SECTOR_SIZE);
+		card.blocks_written++;
+		card.sector++;
+	}
+
+	card.state = multi ? CARD_MULTI_TOKEN : CARD_CMD;
+}
+
+/* One byte in each direction */
+static u8 card_xfer(u8 in)
+{
+	u8 out;
+
+	if(card.out_pos < card.out_len) {
+		out = card.out[card.out_pos++];
+	} else if(card.busy > 0) {
+		if(card.busy != CARD_STUCK)
+			card.busy--;
+		out = 0x00;
+	} else if(card.state == CARD_READ && card.sector < CARD_SECTORS) {
+		card_send_block(&card.data[card.sector * SECTOR_SIZE], SECTOR_SIZE);
+		card.sector++;
+		out = card.out[card.out_pos++];
+	} else {
+		out = 0xff;
+	}
+
+	switch(card.state) {
+		case CARD_CMD:
+		case CARD_READ:
+			// Commands start with 01
+			if(card.cmd_len > 0 || (in & 0xc0) == 0x40) {
+				card.cmd[card.cmd_len++] = in;
+				if(card.cmd_len == 6) {
+					card.cmd_len = 0;
+					// Only CMD12 stops a multiple block read
+					if(card.state == CARD_CMD || (card.cmd[0] & 0x3f) == 12)
+						card_command();
+				}
+			}
+			break;
+		case CARD_WRITE_TOKEN:
+			if(in == 0xfe) {
+				card.block_len = 0;
+				card.state = CARD_WRITE_DATA;
+			}
+			break;
+		case CARD_MULTI_TOKEN:
+			if(in == 0xfc) {
+				card.block_len = 0;
+				card.state = CARD_MULTI_DATA;
+			} else if(in == 0xfd) {
+				// Stop token: a stuff byte, then busy
+				card.stop_tokens++;
+				card.state = CARD_CMD;
+				card_send_byte(0xff);
+				if(card.busy < CARD_BUSY)
+					card.busy = CARD_BUSY;
+			}
+			break;
+		case CARD_WRITE_DATA:
+		case CARD_MULTI_DATA:
+			card.block[card.block_len++] = in;
+			if(card.block_len == SECTOR_SIZE + 2)
+				card_block_done(card.state == CARD_MULTI_DATA);
+			break;
+	}
+
+	return out;
+}
+
+/* spisd_interface_t, as mx4sio.c implements it: no clocks while not selected */
+
+static void spi_set_speed(uint32_t freq)
+{
+	card.speed = freq;
+}
+
+static void spi_select(void)
+{
+	card.selected = 1;
+}
+
+static void spi_release(void)
+{
+	card.selected = 0;
+}
+
+static bool spi_is_present(void)
+{
+	return card.present;
+}
+
+static uint8_t spi_wr_rd_byte(uint8_t byte)
+{
+	return card.selected ? card_xfer(byte) : 0;
+}
+
+static void spi_write(uint8_t const *buffer, uint32_t size)
+{
+	while(card.selected && size--)
+		card_xfer(*buffer++);
+}
+
+static void spi_read(uint8_t *buffer, uint32_t size)
+{
+	while(card.selected && size--)
+		*buffer++ = card_xfer(0xff);
+}
+
+static spisd_interface_t spi = {
+	spi_set_speed,
+	spi_select,
+	spi_release,
+	spi_is_present,
+	spi_wr_rd_byte,
+	spi_write,
+	spi_read};
+
+/* The card takes commands again */
+static int card_ready(void)
+{
+	return card.state == CARD_CMD && card.cmd_len == 0 && !card.selected;
+}
+
+static int card_init(int sdhc)
+{
+	card_insert(sdhc);
+
+	return spisd_init(&spi);
+}
+
+static void fill(u8 *buffer, int sectors)
+{
+	int i;
+
+	for(i=0;i<sectors * SECTOR_SIZE;i++)
+		buffer[i] = (u8)rnd(256);
+}
+
+/* Protocol checks */
+
+static void check_init(void)
+{
+	spisd_info_t info;
+	int sdhc;
+
+	for(sdhc=0;sdhc<2;sdhc++) {
+		check("init/result", card_init(sdhc) == SPISD_RESULT_OK);
+		check("init/initialized", card.idle == 0);
+		check("init/fast clock", card.speed > 400000);
+		check("init/ready", card_ready());
+
+		check("init/card info", spisd_get_card_info(&info) == 0);
+		check("init/csd", info.csd[0] == 0x40);
+		check("init/cid", info.cid.ManufacturerID == 0x03 && info.cid.OEM_AppliID == (('S' << 8) | 'D'));
+		check("init/no crc errors", card.crc_errors == 0 && card.illegal == 0);
+	}
+
+	card_insert(1);
+	card.present = 0;
+	check("init/no card", spisd_init(&spi) == SPISD_RESULT_NO_CARD);
+}
+
+static void check_single(void)
+{
+	u8 buffer[SECTOR_SIZE], readback[SECTOR_SIZE];
+	int sdhc, i;
+
+	for(sdhc=0;sdhc<2;sdhc++) {
+		card_init(sdhc);
+		for(i=0;i<20;i++) {
+			u32 sector = rnd(CARD_SECTORS);
+
+			fill(buffer, 1);
+			check("single/write", spisd_write_block(sector, buffer) == SPISD_RESULT_OK);
+			check("single/stored", memcmp(&card.data[sector * SECTOR_SIZE], buffer, SECTOR_SIZE) == 0);
+			check("single/read", spisd_read_block(sector, readback) == SPISD_RESULT_OK);
+			check("single/read data", memcmp(readback, buffer, SECTOR_SIZE) == 0);
+			check("single/ready", card_ready());
+		}
+		check("single/no crc errors", card.crc_errors == 0 && card.illegal == 0);
+	}
+}
+
+static void check_multi_write(void)
+{
+	static const int counts[] = {1, 2, 7, 32, 64};
+	static u8 buffer[64 * SECTOR_SIZE];
+	unsigned int c;
+	int sdhc;
+
+	for(sdhc=0;sdhc<2;sdhc++) {
+		card_init(sdhc);
+		for(c=0;c<sizeof(counts) / sizeof(counts[0]);c++) {
+			u32 sector = rnd(CARD_SECTORS - 64);
+			int written = card.blocks_written, stops = card.stop_tokens;
+
+			fill(buffer, counts[c]);
+			check("multi write/result", spisd_write_multi_block(sector, buffer, counts[c]) == SPISD_RESULT_OK);
+			check("multi write/stored", memcmp(&card.data[sector * SECTOR_SIZE], buffer, counts[c] * SECTOR_SIZE) == 0);
+			check("multi write/blocks", card.blocks_written - written == counts[c]);
+			check("multi write/pre-erase", card.acmd23_count == counts[c]);
+			check("multi write/stop token", card.stop_tokens == stops + 1);
+			// The driver waits for the card to finish the last block
+			check("multi write/not busy", card.busy == 0);
+			check("multi write/ready", card_ready());
+		}
+		check("multi write/no crc errors", card.crc_errors == 0 && card.illegal == 0);
+	}
+}
+
+/* A rejected block ends the transfer, and leaves the card ready for the next command */
+static void check_multi_write_error(void)
+{
+	static const u8 responses[] = {0xeb, 0xed};
+	static u8 buffer[16 * SECTOR_SIZE], before[16 * SECTOR_SIZE];
+	const int count = 16;
+	unsigned int r;
+	int k;
+
+	for(r=0;r<sizeof(responses);r++) {
+		for(k=0;k<count;k+=5) {
+			u32 sector = rnd(CARD_SECTORS - count);
+			u8 one[SECTOR_SIZE];
+
+			card_init(1);
+			memcpy(before, &card.data[sector * SECTOR_SIZE], sizeof(before));
+			card.fault_block = k;
+			card.fault_response = responses[r];
+			card.fault_busy = 0;
+
+			fill(buffer, count);
+			check("write error/result", spisd_write_multi_block(sector, buffer, count) == SPISD_RESULT_ERROR);
+			check("write error/blocks before", memcmp(&card.data[sector * SECTOR_SIZE], buffer, k * SECTOR_SIZE) == 0);
+			check("write error/blocks after", memcmp(&card.data[(sector + k) * SECTOR_SIZE], &before[k * SECTOR_SIZE], (count - k) * SECTOR_SIZE) == 0);
+			check("write error/stop token", card.stop_tokens == 1);
+			check("write error/ready", card_ready());
+
+			// No reinitialization needed
+			fill(one, 1);
+			check("write error/next write", spisd_write_block(sector + k, one) == SPISD_RESULT_OK);
+			check("write error/next stored", memcmp(&card.data[(sector + k) * SECTOR_SIZE], one, SECTOR_SIZE) == 0);
+		}
+	}
+}
+
+/* A card that stays busy times out, instead of hanging the driver */
+static void check_busy(void)
+{
+	static u8 buffer[8 * SECTOR_SIZE];
+	u8 one[SECTOR_SIZE];
+
+	card_init(1);
+	card.fault_block = 3;
+	card.fault_response = 0xe5;
+	card.fault_busy = CARD_STUCK;
+
+	fill(buffer, 8);
+	check("busy/result", spisd_write_multi_block(100, buffer, 8) == SPISD_RESULT_TIMEOUT);
+	check("busy/blocks", card.blocks_written == 4);
+	check("busy/stop token", card.stop_tokens == 1);
+	check("busy/released", !card.selected);
+
+	// Once the card is done, it takes commands again
+	card.busy = 0;
+	card.out_pos = card.out_len = 0;
+	fill(one, 1);
+	check("busy/next write", spisd_write_block(200, one) == SPISD_RESULT_OK);
+	check("busy/next stored", memcmp(&card.data[200 * SECTOR_SIZE], one, SECTOR_SIZE) == 0);
+
+	// Slow, but not stuck
+	card_init(1);
+	card.fault_block = 0;
+	card.fault_response = 0xe5;
+	card.fault_busy = 0x20000;
+	check("busy/slow card", spisd_write_multi_block(300, buffer, 8) == SPISD_RESULT_OK);
+	check("busy/slow card stored", memcmp(&card.data[300 * SECTOR_SIZE], buffer, 8 * SECTOR_SIZE) == 0);
+}
+
+static void check_multi_read(void)
+{
+	static u8 buffer[64 * SECTOR_SIZE];
+	int sdhc, i;
+
+	for(sdhc=0;sdhc<2;sdhc++) {
+		card_init(sdhc);
+		for(i=0;i<20;i++) {
+			u32 count = 1 + rnd(64), sector = rnd(CARD_SECTORS - count);
+
+			check("multi read/begin", spisd_read_multi_block_begin(sector) == SPISD_RESULT_OK);
+			check("multi read/read", spisd_read_multi_block_read(buffer, count) == SPISD_RESULT_OK);
+			check("multi read/end", spisd_read_multi_block_end() == SPISD_RESULT_OK);
+			check("multi read/data", memcmp(buffer, &card.data[sector * SECTOR_SIZE], count * SECTOR_SIZE) == 0);
+			check("multi read/ready", card_ready());
+		}
+		check("multi read/no crc errors", card.crc_errors == 0 && card.illegal == 0);
+	}
+
+	// Out of range
+	card_init(1);
+	check("multi read/range", spisd_read_multi_block_begin(CARD_SECTORS) == SPISD_RESULT_ERROR);
+}
+
+/* Receive path */
+
+/* The CRC16 of mx4sio.c before the fused kernel, over the reversed data */
+static u16 crc16_nibble(const void *buf, int len)
+{
+	const u16 *bf = buf;
+	u32 poly = 0;
+	int i;
+
+	len /= 2; // to u16
+	for(i=0;i<len;i++) {
+		u32 polyIn, di;
+
+		di = (((bf[i]) << 8) & 0xFF00) | (((bf[i]) >> 8) & 0xFF);
+		polyIn = poly;
+		polyIn ^= ((polyIn ^ di) >> 4) & 0x0F00;
+		polyIn ^= ((polyIn ^ di) >> 4) & 0x00F0;
+		polyIn ^= ((polyIn ^ di) >> 11) & 0x001F;
+		polyIn ^= ((polyIn ^ di) >> 4) & 0x000F;
+		polyIn ^= di;
+		poly = polyIn ^ (polyIn << 5) ^ (polyIn << 12);
+	}
+
+	return poly;
+}
+
+static u8 rev8(u8 n)
+{
+	u8 r = 0;
+	int i;
+
+	for(i=0;i<8;i++)
+		r |= ((n >> i) & 1) << (7 - i);
+
+	return r;
+}
+
+/* The two CRC bytes of a block as the SIO2 receives them, first | second << 8 */
+static u16 crc16_received(u16 crc)
+{
+	return rev8(crc >> 8) | (rev8(crc & 0xff) << 8);
+}
+
+// One word more, reverseBuffer32() loads one past the end
+static u32 sector_raw[SECTOR_SIZE / 4 + 1], sector_old[SECTOR_SIZE / 4 + 1], sector_new[SECTOR_SIZE / 4 + 1];
+
+/* A sector as received, through the old and the fused receive path. Returns the received CRC */
+static u16 check_sector(void)
+{
+	const u8 *raw = (const u8 *)sector_raw;
+	u16 old, fused;
+	int i, ok;
+
+	memcpy(sector_old, sector_raw, SECTOR_SIZE);
+	reverseBuffer32(sector_old, SECTOR_SIZE / 4);
+	old = crc16_nibble(sector_old, SECTOR_SIZE);
+
+	memcpy(sector_new, sector_raw, SECTOR_SIZE);
+	fused = reverseBuffer32_crc16(sector_new, SECTOR_SIZE / 4);
+
+	check("crc/fused equals nibble-wise", fused == crc16_received(old));
+	check("crc/crc16() equals fused", crc16(sector_raw, SECTOR_SIZE) == fused);
+	check("crc/reversed data", memcmp(sector_new, sector_old, SECTOR_SIZE) == 0);
+	check("crc/card crc", card_crc16((const u8 *)sector_old, SECTOR_SIZE) == old);
+
+	for(i=0,ok=1;i<SECTOR_SIZE;i++)
+		ok &= ((const u8 *)sector_new)[i] == rev8(raw[i]);
+	check("crc/reversed bytes", ok);
+
+	return fused;
+}
+
+static void check_crc(void)
+{
+	static u8 seen[0x10000];
+	u8 *raw = (u8 *)sector_raw;
+	int i, v, count;
+
+	crc16_generate_table();
+
+	// Every byte value at every offset
+	for(i=0;i<SECTOR_SIZE;i++) {
+		for(v=0;v<256;v++) {
+			memset(raw, 0, SECTOR_SIZE);
+			raw[i] = v;
+			check_sector();
+		}
+	}
+
+	// Every CRC: the last two bytes of a sector map one to one onto its CRC
+	for(i=0;i<SECTOR_SIZE;i++)
+		raw[i] = rnd(256);
+	for(v=0;v<0x10000;v++) {
+		raw[SECTOR_SIZE - 2] = v & 0xff;
+		raw[SECTOR_SIZE - 1] = v >> 8;
+		seen[check_sector()] = 1;
+	}
+	for(v=0,count=0;v<0x10000;v++)
+		count += seen[v];
+	check("crc/every value", count == 0x10000);
+
+	for(v=0;v<20000;v++) {
+		for(i=0;i<SECTOR_SIZE;i++)
+			raw[i] = rnd(256);
+		check_sector();
+	}
+
+	// The words are reversed in place, each of them once
+	for(i=0;i<SECTOR_SIZE;i++)
+		raw[i] = rnd(256);
+	sector_raw[SECTOR_SIZE / 4] = 0x12345678;
+	check_sector();
+	check("crc/in bounds", sector_new[SECTOR_SIZE / 4] == 0 && sector_old[SECTOR_SIZE / 4] == 0);
+	for(i=0,v=1;i<SECTOR_SIZE / 4;i++)
+		v &= reverseByteInWord(sector_raw[i]) == sector_old[i];
+	check("crc/reversed words", v);
+}
+
+/* Receive path measurements */
+
+static double seconds(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+enum
+{
+	BENCH_NIBBLE,
+	BENCH_FUSED,
+	BENCH_REVERSE,
+	BENCH_CRC16,
+	BENCH_COUNT,
+};
+
+static const char *bench_names[BENCH_COUNT] = {
+	"reverse + nibble-wise crc",
+	"fused reverse + crc",
+	"reverse only",
+	"crc16() only",
+};
+
+static int bench(void)
+{
+	const int sectors = 0x10000;
+	volatile u32 sink = 0;
+	int b, i, j;
+
+	crc16_generate_table();
+	for(i=0;i<SECTOR_SIZE;i++)
+		((u8 *)sector_raw)[i] = rnd(256);
+
+	printf("Receive path of 512-byte sectors, %d MB each\n", sectors * SECTOR_SIZE >> 20);
+	printf("%-26s %10s\n", "path", "MB/s");
+
+	for(b=0;b<BENCH_COUNT;b++) {
+		double start = seconds(), elapsed;
+
+		for(i=0;i<sectors;i++) {
+			// The old path always reversed the data that it checked
+			sector_new[i & (SECTOR_SIZE / 4 - 1)] ^= i;
+			switch(b) {
+				case BENCH_NIBBLE:
+					reverseBuffer32(sector_new, SECTOR_SIZE / 4);
+					sink += crc16_nibble(sector_new, SECTOR_SIZE);
+					break;
+				case BENCH_FUSED:
+					sink += reverseBuffer32_crc16(sector_new, SECTOR_SIZE / 4);
+					break;
+				case BENCH_REVERSE:
+					reverseBuffer32(sector_new, SECTOR_SIZE / 4);
+					break;
+				case BENCH_CRC16:
+					sink += crc16(sector_new, SECTOR_SIZE);
+					break;
+			}
+		}
+		elapsed = seconds() - start;
+
+		printf("%-26s %10.1f\n", bench_names[b], sectors * (SECTOR_SIZE / 1048576.0) / elapsed);
+		for(j=0;j<SECTOR_SIZE / 4;j++)
+			sink += sector_new[j];
+	}
+
+	return sink == 0x5a5a5a5a;
+}
+
+static void usage(void)
+{
+	printf("Usage: mx4siocheck [-b]\n");
+	printf("Checks the SPI SD card protocol and the receive path of mx4sio_bd.\n");
+	printf("  -b  print the throughput of the receive path instead\n");
+}
+
+int main(int argc, char *argv[])
+{
+	if(argc > 2 || (argc == 2 && strcmp(argv[1], "-b"))) {
+		usage();
+		return 1;
+	}
+
+	if(argc == 2)
+		return bench();
+
+	check_crc();
+	check_init();
+	check_single();
+	check_multi_write();
+	check_multi_write_error();
+	check_busy();
+	check_multi_read();
+
+	printf("%d checks, %d failed\n", checks, failures);
+
+	return failures != 0;
+}
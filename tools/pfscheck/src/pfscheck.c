@@ -0,0 +1,639 @@
+/*
+# _____     ___ ____     ___ ____
+#  ____|   |    ____|   |        | |____|
+# |     ___|   |____ ___|    ____| |    \    PS2DEV Open Source Project.
+#-----------------------------------------------------------------------
+# Copyright 2001-2004, ps2dev - http://www.ps2dev.org
+# Licenced under Academic Free License version 2.0
+# Review ps2sdk README & LICENSE files for further details.
+*/
+
+/* pfscheck: checks the PFS metadata cache (libpfs) on the host.
+ *
+ * libpfs is built as it is for the IOP. Its hdd block device functions
+ * talk to an APA partition stand-in through ioctl2(), which serves them
+ * from a temporary disk image: a main partition and one sub-partition.
+ * Directory trees are created and looked up the way pfs.irx does it, and
+ * the cache is checked for duplicate buffers, lost buffers, write-back
+ * order (journal first, then the blocks sorted) and persistence. Power
+ * is cut at random points during write-backs, and the journal must bring
+ * back everything that was synced.
+ * With -b, measures path lookups for several cache sizes.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <cdvdman.h>
+#include <hdd-ioctl.h>
+
+#include <iomanX.h>
+#include <libpfs.h>
+
+#define SECTOR_SIZE 512
+#define MAIN_SECTORS (128 * 1024 * 2)
+#define SUB_SECTORS (64 * 1024 * 2)
+#define ZONE_SIZE 8192
+
+#define WRITE_LOG_SIZE 4096
+
+extern pfs_cache_t *pfsCacheBuf;
+extern u32 pfsCacheNumBuffers;
+
+static int checks, failures;
+
+static unsigned int seed = 1;
+
+static unsigned int rnd(unsigned int range)
+{
+	seed = seed * 1103515245 + 12345;
+	return ((seed >> 8) & 0xffffff) % range;
+}
+
+/* Each failing check is only printed once */
+static void check(const char *name, int ok)
+{
+	static const char *failed[64];
+	static int failed_count;
+	int i;
+
+	checks++;
+	if(ok)
+		return;
+
+	failures++;
+	for(i=0;i<failed_count;i++)
+		if(failed[i] == name)
+			return;
+	if(failed_count < 64)
+		failed[failed_count++] = name;
+	printf("FAIL: %s\n", name);
+}
+
+/* libpfs reports its progress with printf, keep it out of the results */
+static void quiet(int on)
+{
+	static int saved = -1;
+	FILE *null;
+
+	fflush(stdout);
+	if(on) {
+		saved = dup(1);
+		if((null = fopen("/dev/null", "w")) != NULL) {
+			dup2(fileno(null), 1);
+			fclose(null);
+		}
+	} else if(saved >= 0) {
+		dup2(saved, 1);
+		close(saved);
+		saved = -1;
+	}
+}
+
+/* APA partition stand-in: a main partition and one sub-partition in an image file */
+
+struct hdd_write
+{
+	u32 sub;
+	u32 sector;
+	u32 size;
+};
+
+struct hdd
+{
+	int fd;
+	u32 reads;
+	u32 writes;
+	u32 flushes;
+	u32 errors;
+	// Writes after this many more are lost, like at a power loss. -1: no loss.
+	int power;
+	struct hdd_write log[WRITE_LOG_SIZE];
+	u32 log_count;
+};
+
+// Partition file descriptors are 1 and 2
+static struct hdd hdds[2];
+
+static struct hdd *hdd_get(int fd)
+{
+	return (fd == 1 || fd == 2) ? &hdds[fd - 1] : NULL;
+}
+
+static int hdd_transfer(struct hdd *hdd, hddIoctl2Transfer_t *t)
+{
+	size_t size = (size_t)t->size * SECTOR_SIZE;
+	off_t offset = ((off_t)(t->sub ? MAIN_SECTORS : 0) + t->sector) * SECTOR_SIZE;
+
+	if(t->sub > 1 || t->sector + t->size > (t->sub ? SUB_SECTORS : MAIN_SECTORS))
+		return -EINVAL;
+
+	if(t->mode == PFS_IO_MODE_WRITE) {
+		hdd->writes++;
+		if(hdd->log_count < WRITE_LOG_SIZE) {
+			hdd->log[hdd->log_count].sub = t->sub;
+			hdd->log[hdd->log_count].sector = t->sector;
+			hdd->log[hdd->log_count].size = t->size;
+			hdd->log_count++;
+		}
+		if(hdd->power == 0)
+			return 0;
+		if(hdd->power > 0)
+			hdd->power--;
+		return (pwrite(hdd->fd, t->buffer, size, offset) == (ssize_t)size) ? 0 : -EIO;
+	}
+
+	hdd->reads++;
+	return (pread(hdd->fd, t->buffer, size, offset) == (ssize_t)size) ? 0 : -EIO;
+}
+
+int ioctl2(int fd, int cmd, void *arg, unsigned int arglen, void *buf, unsigned int buflen)
+{
+	struct hdd *hdd = hdd_get(fd);
+
+	(void)arglen;
+	(void)buf;
+	(void)buflen;
+
+	if(hdd == NULL)
+		return -EBADF;
+
+	switch(cmd) {
+		case HIOCTRANSFER:
+			return hdd_transfer(hdd, arg);
+		case HIOCNSUB:
+			return 1;
+		case HIOCGETSIZE:
+			return (*(u32 *)arg == 0) ? MAIN_SECTORS : SUB_SECTORS;
+		case HIOCSETPARTERROR:
+			hdd->errors++;
+			return 0;
+		case HIOCFLUSH:
+			hdd->flushes++;
+			return 0;
+		default:
+			return -EINVAL;
+	}
+}
+
+static int hdd_open(struct hdd *hdd)
+{
+	char path[] = "/tmp/pfscheck.XXXXXX";
+
+	memset(hdd, 0, sizeof(*hdd));
+	hdd->power = -1;
+	if((hdd->fd = mkstemp(path)) < 0)
+		return -1;
+	unlink(path);
+	if(ftruncate(hdd->fd, (off_t)(MAIN_SECTORS + SUB_SECTORS) * SECTOR_SIZE) != 0) {
+		close(hdd->fd);
+		return -1;
+	}
+
+	return 0;
+}
+
+static void hdd_close(struct hdd *hdd)
+{
+	close(hdd->fd);
+}
+
+/* What the rest of the IOP provides */
+
+int sceCdReadClock(sceCdCLOCK *clock)
+{
+	memset(clock, 0, sizeof(*clock));
+
+	return 0;
+}
+
+/* Filesystem operations, as pfs.irx does them */
+
+static pfs_block_device_t *block_dev;
+
+static int pfs_format(int fd)
+{
+	int rv;
+
+	quiet(1);
+	rv = pfsFormat(block_dev, fd, ZONE_SIZE, 0);
+	quiet(0);
+
+	return rv;
+}
+
+static int pfs_mount(pfs_mount_t *mount, int fd)
+{
+	int rv;
+
+	memset(mount, 0, sizeof(*mount));
+	mount->blockDev = block_dev;
+	mount->fd = fd;
+	mount->flags = FIO_MT_RDWR;
+
+	quiet(1);
+	rv = pfsMountSuperBlock(mount);
+	quiet(0);
+
+	return rv;
+}
+
+static void pfs_umount(pfs_mount_t *mount)
+{
+	quiet(1);
+	pfsCacheClose(mount);
+	quiet(0);
+}
+
+/* Create a file or directory, like open(O_CREAT) and mkdir() */
+static int pfs_create(pfs_mount_t *mount, const char *path, u16 mode)
+{
+	char name[256];
+	pfs_cache_t *parent, *inode, *c;
+	int result = 0, result2 = 0;
+
+	if((parent = pfsInodeGetParent(mount, NULL, path, name, &result)) == NULL)
+		return result;
+
+	if((inode = pfsInodeGetFileInDir(parent, name, &result)) != NULL) {
+		pfsCacheFree(inode);
+		pfsCacheFree(parent);
+		return -EEXIST;
+	}
+	if(result != -ENOENT) {
+		pfsCacheFree(parent);
+		return result;
+	}
+
+	result = 0;
+	if((inode = pfsInodeCreate(parent, mode, PFS_UID, PFS_GID, &result)) != NULL) {
+		if((mode & FIO_S_IFMT) == FIO_S_IFDIR) {
+			c = pfsCacheGetData(mount, inode->u.inode->data[1].subpart, inode->u.inode->data[1].number << mount->inode_scale,
+				PFS_CACHE_FLAG_NOLOAD | PFS_CACHE_FLAG_NOTHING, &result2);
+			if(c != NULL) {
+				pfsFillSelfAndParentDentries(c, &inode->u.inode->inode_block, &parent->u.inode->inode_block);
+				c->flags |= PFS_CACHE_FLAG_DIRTY;
+				pfsCacheFree(c);
+			}
+		} else {
+			c = pfsCacheGetData(mount, inode->sub, inode->block + 1, PFS_CACHE_FLAG_NOLOAD | PFS_CACHE_FLAG_NOTHING, &result2);
+			if(c != NULL) {
+				memset(c->u.aentry, 0, sizeof(pfs_inode_t));
+				c->u.aentry->aLen = sizeof(pfs_inode_t);
+				c->flags |= PFS_CACHE_FLAG_DIRTY;
+				pfsCacheFree(c);
+			}
+		}
+		result = result2;
+
+		if(result == 0 && (c = pfsDirAddEntry(parent, name, &inode->u.inode->inode_block, mode, &result)) != NULL) {
+			pfsInodeSetTimeParent(parent, c);
+			pfsCacheFree(c);
+		}
+		pfsCacheFree(inode);
+	}
+	pfsCacheFree(parent);
+
+	return result;
+}
+
+/* Look a path up, returns its mode or a negative error */
+static int pfs_lookup(pfs_mount_t *mount, const char *path)
+{
+	char name[256];
+	pfs_cache_t *parent, *inode;
+	int result = 0;
+
+	if((parent = pfsInodeGetParent(mount, NULL, path, name, &result)) == NULL)
+		return result;
+	if((inode = pfsInodeGetFileInDir(parent, name, &result)) != NULL) {
+		result = inode->u.inode->mode;
+		pfsCacheFree(inode);
+	}
+	pfsCacheFree(parent);
+
+	return result;
+}
+
+static void tree_path(char *path, int dir, int file)
+{
+	if(file < 0)
+		sprintf(path, "/d%02d", dir);
+	else
+		sprintf(path, "/d%02d/f%03d", dir, file);
+}
+
+/* Create dirs directories of files files each, returns the number of failures */
+static int tree_create(pfs_mount_t *mount, int dirs, int files, int sync)
+{
+	char path[32];
+	int d, f, errors = 0;
+
+	for(d=0;d<dirs;d++) {
+		tree_path(path, d, -1);
+		if(pfs_create(mount, path, FIO_S_IFDIR | 0777) != 0)
+			errors++;
+		for(f=0;f<files;f++) {
+			tree_path(path, d, f);
+			if(pfs_create(mount, path, FIO_S_IFREG | 0666) != 0)
+				errors++;
+			if(sync && (f % sync) == sync - 1)
+				pfsCacheFlushAllDirty(mount);
+		}
+	}
+
+	return errors;
+}
+
+/* Look the tree up, returns the number of paths not found with the right type */
+static int tree_lookup(pfs_mount_t *mount, int dirs, int files)
+{
+	char path[32];
+	int d, f, errors = 0;
+
+	for(d=0;d<dirs;d++) {
+		tree_path(path, d, -1);
+		if((pfs_lookup(mount, path) & FIO_S_IFMT) != FIO_S_IFDIR)
+			errors++;
+		for(f=0;f<files;f++) {
+			tree_path(path, d, f);
+			if((pfs_lookup(mount, path) & FIO_S_IFMT) != FIO_S_IFREG)
+				errors++;
+		}
+	}
+
+	return errors;
+}
+
+/* Cache invariants */
+
+/* No two buffers hold the same block */
+static int cache_duplicates(void)
+{
+	u32 i, j;
+	int duplicates = 0;
+
+	for(i=1;i<pfsCacheNumBuffers+1;i++) {
+		if(pfsCacheBuf[i].pfsMount == NULL)
+			continue;
+		for(j=i+1;j<pfsCacheNumBuffers+1;j++) {
+			if(pfsCacheBuf[j].pfsMount == pfsCacheBuf[i].pfsMount && pfsCacheBuf[j].sub == pfsCacheBuf[i].sub
+				&& pfsCacheBuf[j].block == pfsCacheBuf[i].block)
+				duplicates++;
+		}
+	}
+
+	return duplicates;
+}
+
+/* When nothing is in use, every buffer is on the free list */
+static int cache_all_free(void)
+{
+	pfs_cache_t *clink;
+	u32 i, count = 0;
+
+	for(clink=pfsCacheBuf->next;clink!=pfsCacheBuf && count<=pfsCacheNumBuffers;clink=clink->next)
+		count++;
+	for(i=1;i<pfsCacheNumBuffers+1;i++)
+		if(pfsCacheBuf[i].nused != 0)
+			return 0;
+
+	return count == pfsCacheNumBuffers;
+}
+
+/* Every write-back starts with the journal, and writes the blocks in sub/sector order */
+static int write_order(const struct hdd *hdd, const pfs_mount_t *mount, u32 start)
+{
+	u32 log_start = mount->log.number << mount->sector_scale;
+	u32 log_end = log_start + 2 + pfsCacheNumBuffers * 2;
+	int journalled = 0;
+	u32 i;
+
+	for(i=start;i<hdd->log_count;i++) {
+		const struct hdd_write *w = &hdd->log[i];
+
+		if(w->sub == 0 && w->sector >= log_start && w->sector < log_end) {
+			// The journal header is written last
+			journalled = (w->sector == log_start);
+			continue;
+		}
+		if(!journalled)
+			return 0;
+		if(i > start && !(w->sub == 0 && hdd->log[i - 1].sector == log_start)) {
+			const struct hdd_write *p = &hdd->log[i - 1];
+
+			if(p->sub > w->sub || (p->sub == w->sub && p->sector >= w->sector))
+				return 0;
+		}
+	}
+
+	return 1;
+}
+
+/* Cache checks */
+
+static void check_tree(void)
+{
+	pfs_mount_t mount;
+	pfs_cache_stats_t stats;
+	u32 writes;
+
+	check("pfs/tree/format", pfs_format(1) == 0);
+	check("pfs/tree/mount", pfs_mount(&mount, 1) == 0);
+
+	// Without syncs, dirty buffers are only written back when they are evicted
+	writes = hdds[0].log_count;
+	pfsCacheClearStats();
+	check("pfs/tree/create", tree_create(&mount, 8, 40, 0) == 0);
+	pfsCacheGetStats(&stats);
+	check("pfs/tree/evictions", stats.cleanEvictions > 0 && stats.dirtyEvictions > 0);
+	check("pfs/tree/write-back", stats.flushes > 0 && stats.blocksWritten >= stats.flushes);
+	check("pfs/tree/write order", write_order(&hdds[0], &mount, writes));
+	check("pfs/tree/no duplicates", cache_duplicates() == 0);
+	check("pfs/tree/all free", cache_all_free());
+
+	pfsCacheClearStats();
+	check("pfs/tree/lookup", tree_lookup(&mount, 8, 40) == 0);
+	check("pfs/tree/exists", pfs_create(&mount, "/d03/f007", FIO_S_IFREG | 0666) == -EEXIST);
+	check("pfs/tree/missing", pfs_lookup(&mount, "/d03/nothing") == -ENOENT);
+	pfsCacheGetStats(&stats);
+	check("pfs/tree/hits", stats.hits > 0 && stats.hits < stats.lookups);
+	check("pfs/tree/no duplicates after lookups", cache_duplicates() == 0);
+
+	// Everything reaches the disk
+	pfs_umount(&mount);
+	check("pfs/tree/remount", pfs_mount(&mount, 1) == 0);
+	check("pfs/tree/lookup after remount", tree_lookup(&mount, 8, 40) == 0);
+	check("pfs/tree/all free after remount", cache_all_free());
+	check("pfs/tree/no disk errors", hdds[0].errors == 0);
+	pfs_umount(&mount);
+}
+
+/* Two mounts share the cache, but not their blocks */
+static void check_two_mounts(void)
+{
+	pfs_mount_t a, b;
+
+	check("pfs/mounts/format", pfs_format(1) == 0 && pfs_format(2) == 0);
+	check("pfs/mounts/mount", pfs_mount(&a, 1) == 0 && pfs_mount(&b, 2) == 0);
+
+	check("pfs/mounts/create", tree_create(&a, 2, 30, 0) == 0 && tree_create(&b, 1, 10, 0) == 0);
+	check("pfs/mounts/a", tree_lookup(&a, 2, 30) == 0);
+	check("pfs/mounts/b", tree_lookup(&b, 1, 10) == 0 && pfs_lookup(&b, "/d01") == -ENOENT && pfs_lookup(&b, "/d00/f020") == -ENOENT);
+	check("pfs/mounts/no duplicates", cache_duplicates() == 0);
+
+	pfs_umount(&a);
+	check("pfs/mounts/b after a", tree_lookup(&b, 1, 10) == 0 && pfs_lookup(&b, "/d01") == -ENOENT);
+	pfs_umount(&b);
+	check("pfs/mounts/all free", cache_all_free());
+}
+
+/* Power is lost during a write-back: what was synced before must survive */
+static void check_power_loss(void)
+{
+	const int trials = 24, sync = 5;
+	pfs_mount_t mount;
+	char path[32];
+	int t, f, synced_ok = 1, mount_ok = 1;
+
+	for(t=0;t<trials;t++) {
+		int files = 10 + rnd(40), synced;
+
+		pfs_format(1);
+		pfs_mount(&mount, 1);
+		pfs_create(&mount, "/d00", FIO_S_IFDIR | 0777);
+		pfsCacheFlushAllDirty(&mount);
+
+		// Files created before the last sync are synced
+		synced = 0;
+		hdds[0].power = 1 + rnd(60);
+		for(f=0;f<files;f++) {
+			tree_path(path, 0, f);
+			pfs_create(&mount, path, FIO_S_IFREG | 0666);
+			if((f % sync) == sync - 1) {
+				pfsCacheFlushAllDirty(&mount);
+				if(hdds[0].power != 0)
+					synced = f + 1;
+			}
+		}
+		hdds[0].power = 0;
+		pfs_umount(&mount);
+		hdds[0].power = -1;
+
+		// Reboot: the mount replays the journal
+		if(pfs_mount(&mount, 1) != 0) {
+			mount_ok = 0;
+			continue;
+		}
+		for(f=0;f<synced;f++) {
+			tree_path(path, 0, f);
+			if(pfs_lookup(&mount, path) != (FIO_S_IFREG | 0666))
+				synced_ok = 0;
+		}
+		pfs_umount(&mount);
+	}
+
+	check("pfs/power loss/mount", mount_ok);
+	check("pfs/power loss/synced files", synced_ok);
+	check("pfs/power loss/all free", cache_all_free());
+}
+
+/* Lookup benchmark */
+
+static double bench_time(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int bench(void)
+{
+	static const u32 buffers[] = {8, 16, 32, 64, 127};
+	const int dirs = 16, files = 64, lookups = 100000;
+	pfs_mount_t mount;
+	pfs_cache_stats_t stats;
+	char path[32];
+	unsigned int i;
+	int l;
+
+	printf("%d random path lookups in %d directories of %d files\n", lookups, dirs, files);
+	printf("%8s %12s %10s %12s %12s\n", "buffers", "lookups/s", "hit rate", "disk reads", "evictions");
+
+	for(i=0;i<sizeof(buffers) / sizeof(buffers[0]);i++) {
+		u32 reads;
+		double start, seconds;
+
+		// The cache can not be freed, the previous one is left behind
+		if(pfsCacheInit(buffers[i], 1024) != 0)
+			return 1;
+		if(pfs_format(1) != 0 || pfs_mount(&mount, 1) != 0 || tree_create(&mount, dirs, files, 16) != 0) {
+			printf("Can't create the tree\n");
+			return 1;
+		}
+		pfsCacheFlushAllDirty(&mount);
+
+		pfsCacheClearStats();
+		reads = hdds[0].reads;
+		start = bench_time();
+		for(l=0;l<lookups;l++) {
+			// Most lookups are in a few directories
+			tree_path(path, rnd(4) ? rnd(2) : rnd(dirs), rnd(files));
+			pfs_lookup(&mount, path);
+		}
+		seconds = bench_time() - start;
+		pfsCacheGetStats(&stats);
+
+		printf("%8u %12.0f %9.1f%% %12.2f %12u\n", buffers[i], lookups / seconds, 100.0 * stats.hits / stats.lookups,
+			(double)(hdds[0].reads - reads) / lookups, stats.cleanEvictions + stats.dirtyEvictions);
+		pfs_umount(&mount);
+	}
+
+	return 0;
+}
+
+static void usage(void)
+{
+	printf("Usage: pfscheck [-b]\n");
+	printf("Checks the PFS metadata cache on a disk image.\n");
+	printf("  -b  measure path lookups for several cache sizes instead\n");
+}
+
+int main(int argc, char *argv[])
+{
+	int rv;
+
+	if(argc > 2 || (argc == 2 && strcmp(argv[1], "-b"))) {
+		usage();
+		return 1;
+	}
+
+	if(hdd_open(&hdds[0]) != 0 || hdd_open(&hdds[1]) != 0) {
+		printf("Can't create the disk images\n");
+		return 1;
+	}
+	block_dev = pfsGetBlockDeviceTable("hdd0:");
+
+	if(argc == 2) {
+		rv = bench();
+	} else {
+		// As few buffers as pfs.irx allows, so that they are reused all the time
+		pfsCacheInit(8, 1024);
+
+		check_tree();
+		check_two_mounts();
+		check_power_loss();
+
+		printf("%d checks, %d failed\n", checks, failures);
+		rv = failures != 0;
+	}
+
+	hdd_close(&hdds[0]);
+	hdd_close(&hdds[1]);
+
+	return rv;
+}
@@ -20,26 +20,13 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 #include "adpcm.h"
 
 #define ADPCM_LOOP_START    4  /* Set on first block of looped data */
 #define ADPCM_LOOP          2  /* Set on all blocks (?that are inside the loop?) */
 #define ADPCM_LOOP_END      1  /* Set on last block to loop */
 
-#define PACKED __attribute__((packed))
-
-typedef struct
-{
-	unsigned shift:      4  PACKED;
-	unsigned predict:    4  PACKED;
-	uint8_t  flags;
-	uint8_t  sample[14]; /* 4bits each */
-} AdpcmBlock;
-
-static void find_predict(AdpcmSetup *set, AdpcmBlock *adpcm, double *samples);
-static void pack(AdpcmSetup *set, AdpcmBlock *adpcm, const double *samples);
-
-
 AdpcmSetup *AdpcmCreate(AdpcmGetPCMfunc get, void *getpriv, AdpcmPutADPCMfunc put, void *putpriv, int loopstart)
 {
 	AdpcmSetup *set;
@@ -48,8 +35,10 @@ AdpcmSetup *AdpcmCreate(AdpcmGetPCMfunc get, void *getpriv, AdpcmPutADPCMfunc pu
 	if (set==NULL)
 		return(NULL);
 
-	set->s_1 = set->s_2 = 0.0;
-	set->ps_1 = set->ps_2 = 0.0;
+	AdpcmStateInit(&set->state);
+	set->dec.h_1 = set->dec.h_2 = 0;
+	memset(&set->stats, 0, sizeof(set->stats));
+	set->report = 0;
 
 	set->curblock = 0;
 
@@ -64,6 +53,7 @@ AdpcmSetup *AdpcmCreate(AdpcmGetPCMfunc get, void *getpriv, AdpcmPutADPCMfunc pu
 	set->PutADPCM = put;
 	set->putpriv = putpriv;
 	set->pad = 0;
+	set->threads = AdpcmThreadCount();
 	return(set);
 }
 
@@ -73,62 +63,64 @@ int AdpcmDestroy(AdpcmSetup *set)
 	return(0);
 }
 
-int AdpcmEncode(AdpcmSetup *set, int blocks)
+/* Reads the PCM data of a chunk, returns the number of complete blocks */
+static int GatherPCM(AdpcmSetup *set, double *samples, int blocks)
 {
-	AdpcmBlock adpcm;
-	double samples[28];
 	int procblocks;
 
 	for (procblocks=0;procblocks<blocks;procblocks++)
 	{
 		int ret;
-		adpcm.flags = 0;
 
-		for (int j=0;j<28;j++)
-			samples[j] = 0.0;
-
-		ret = set->GetPCM(set->getpriv, samples, 28);
+		ret = set->GetPCM(set->getpriv, &samples[procblocks*28], 28);
 		if (ret<0)
 			return(-1);
 		if (ret<28)
+			break;
+	}
+
+	return(procblocks);
+}
+
+/* Sets the flags, adds the end and padding blocks and writes the chunk */
+static int EmitADPCM(AdpcmSetup *set, uint8_t *out, int procblocks, int blocks)
+{
+	uint8_t *adpcm;
+	int encblocks, outblocks;
+
+	encblocks = (procblocks<blocks) ? procblocks+1 : blocks;
+
+	for (int i=0;i<encblocks;i++)
+	{
+		adpcm = &out[i*16];
+
+		if (i==procblocks)
 		{
 			printf("loop end!\n");
-			adpcm.flags = ADPCM_LOOP_END;
+			adpcm[1] = ADPCM_LOOP_END;
 		}
 
 		if (set->loopstart>=0)
 		{
-			adpcm.flags |= ADPCM_LOOP;
+			adpcm[1] |= ADPCM_LOOP;
 			if (set->curblock == set->loopstart)
 			{
 				printf("loop start!\n");
-				adpcm.flags |= ADPCM_LOOP_START;
+				adpcm[1] |= ADPCM_LOOP_START;
 			}
 		}
 
-
-		find_predict(set, &adpcm, samples);
-		pack(set, &adpcm, samples);
-
-		if (set->PutADPCM(set->putpriv, &adpcm, 16)<0)
-			return(-1);
-
 		set->curblock++;
-		if (ret<28)
-			break;
 	}
+	outblocks = encblocks;
 
 	if (set->loopstart<0 && procblocks<blocks)
 	{
 		/* this block essentialy loops to itself and contains no data */
-		adpcm.predict = 0;
-		adpcm.shift = 0;
-		adpcm.flags = ADPCM_LOOP_START | ADPCM_LOOP | ADPCM_LOOP_END;
-
-		for (int i=0;i<14;i++)
-			adpcm.sample[i] = 0;
-		if (set->PutADPCM(set->putpriv, &adpcm, 16)<0)
-			return(-1);
+		adpcm = &out[outblocks*16];
+		memset(adpcm, 0, 16);
+		adpcm[1] = ADPCM_LOOP_START | ADPCM_LOOP | ADPCM_LOOP_END;
+		outblocks++;
 		set->curblock++;
 	}
 
@@ -136,126 +128,100 @@ int AdpcmEncode(AdpcmSetup *set, int blocks)
 	{
 		int padblocks = blocks-(set->curblock%blocks);
 
-		adpcm.predict = 0;
-		adpcm.shift = 0;
-		adpcm.flags = ADPCM_LOOP_START | ADPCM_LOOP | ADPCM_LOOP_END;
-		for (int i=0;i<14;i++)
-			adpcm.sample[i] = 0;
-
-
 		for (int i=0;i<padblocks;i++)
 		{
-			if (set->PutADPCM(set->putpriv, &adpcm, 16)<0)
-			return(-1);
+			adpcm = &out[outblocks*16];
+			memset(adpcm, 0, 16);
+			adpcm[1] = ADPCM_LOOP_START | ADPCM_LOOP | ADPCM_LOOP_END;
+			outblocks++;
 			set->curblock++;
 		}
 	}
 
-	return(procblocks);
+	/* Hand the whole chunk over at once */
+	if (set->PutADPCM(set->putpriv, out, outblocks*16)<0)
+		return(-1);
+
+	return(0);
 }
 
-static double f[5][2] =
-{
-	{           0.0, 0.0},
-   	{  -60.0 / 64.0, 0.0},
-   	{ -115.0 / 64.0, 52.0 / 64.0},
-   	{  -98.0 / 64.0, 55.0 / 64.0},
-   	{ -122.0 / 64.0, 60.0 / 64.0}
-};
-#define MAX(_a,_b)   ((_a)>(_b) ? (_a):(_b))
-#define MIN(_a,_b)   ((_a)<(_b) ? (_a):(_b))
-#define CLAMP(_v,_min,_max) MIN(MAX(_v,_min),_max);
-
-static void find_predict(AdpcmSetup *set, AdpcmBlock *adpcm, double *samples)
+int AdpcmEncodeChannels(AdpcmSetup **set, int count, int blocks)
 {
-	double buffer[28][5];
-	double min = 1e10;
-	double max[5];
-	double ds;
-	int min2;
-	int shift_mask;
-	double s_0, s_1, s_2;
-
-	for (int i=0;i<5;i++)
-	{
-		max[i] = 0.0;
-		s_1 = set->s_1;
-		s_2 = set->s_2;
-
-		for (int j=0;j<28;j++)
-		{
-			s_0 = CLAMP(samples[j],-30720.0,30719.0);
+	AdpcmStream stream[ADPCM_MAX_CHANNELS];
+	double *samples[ADPCM_MAX_CHANNELS];
+	uint8_t *out[ADPCM_MAX_CHANNELS];
+	int procblocks[ADPCM_MAX_CHANNELS];
+	int i, result = blocks;
 
-			ds = s_0 + s_1 * f[i][0] + s_2 * f[i][1];
-			buffer[j][i] = ds;
-			if (fabs(ds) > max[i])
-				max[i] = fabs(ds);
+	if (count<1 || count>ADPCM_MAX_CHANNELS)
+		return(-1);
 
-			s_2 = s_1;
-			s_1 = s_0;
-		}
+	for (i=0;i<count;i++)
+	{
+		samples[i] = calloc(blocks*28, sizeof(double));
+		/* Room for the data, the end block and the padding */
+		out[i] = malloc((2*blocks+1)*16);
+	}
 
-		if ( max[i] < min )
+	/* Gather the PCM data of the whole chunk first, so it can be encoded in one go */
+	for (i=0;i<count;i++)
+	{
+		if (samples[i]==NULL || out[i]==NULL)
 		{
-			min = max[i];
-			adpcm->predict = i;
+			result = -1;
+			goto end;
 		}
-		if (min <= 7)
+
+		procblocks[i] = GatherPCM(set[i], samples[i], blocks);
+		if (procblocks[i]<0)
 		{
-			adpcm->predict = 0;
-			break;
+			result = -1;
+			goto end;
 		}
-	}
 
-	set->s_1 = s_1;
-	set->s_2 = s_2;
-
-	for (int  i=0;i<28;i++ )
-		samples[i] = buffer[i][adpcm->predict];
-
-	min2 = (int)min;
-	shift_mask = 0x4000;
-	adpcm->shift = 0;
+		stream[i].state = &set[i]->state;
+		stream[i].pcm = samples[i];
+		stream[i].blocks = (procblocks[i]<blocks) ? procblocks[i]+1 : blocks;
+		stream[i].out = out[i];
+	}
 
-	while(adpcm->shift < 12)
+	/* The channels are independent, so they are encoded at the same time */
+	if (AdpcmEncodeStreams(stream, count, set[0]->threads)<0)
 	{
-		if (shift_mask & ( min2 + (shift_mask>>3) ))
-			break;
-		adpcm->shift++;
-		shift_mask = shift_mask >> 1;
+		result = -1;
+		goto end;
 	}
-}
-
-static void pack(AdpcmSetup *set, AdpcmBlock *adpcm, const double *samples)
-{
-	double s_1, s_2;
-	short four_bit[28];
-
-	s_1 = set->ps_1;
-	s_2 = set->ps_2;
 
-	for (int i=0;i<28;i++)
+	for (i=0;i<count;i++)
 	{
-		double ds;
-		int di;
-		double s_0;
+		if (set[i]->report)
+			AdpcmMeasure(&set[i]->stats, &set[i]->dec, samples[i], out[i], stream[i].blocks);
 
-		s_0 = samples[i] + s_1 * f[adpcm->predict][0] + s_2 * f[adpcm->predict][1];
-		ds = s_0 * (double) (1<<adpcm->shift);
-
-		di = ((int)ds+0x800) & 0xfffff000;
-		di = CLAMP(di,-32768,32767);
+		if (EmitADPCM(set[i], out[i], procblocks[i], blocks)<0)
+		{
+			result = -1;
+			goto end;
+		}
 
-		four_bit[i] = (short)di;
+		/* Like encoding the channels one by one, stop at the first one that ended */
+		if (procblocks[i]<blocks)
+		{
+			result = procblocks[i];
+			break;
+		}
+	}
 
-		di = di >> adpcm->shift;
-		s_2 = s_1;
-		s_1 = (double) di - s_0;
+end:
+	for (i=0;i<count;i++)
+	{
+		free(out[i]);
+		free(samples[i]);
 	}
 
-	for (int i=0;i<14;i++)
-		adpcm->sample[i] = ( ( four_bit[(i*2)+1] >> 8 ) & 0xf0 ) | ( ( four_bit[i*2] >> 12 ) & 0xf );
+	return(result);
+}
 
-	set->ps_1 = s_1;
-	set->ps_2 = s_2;
+int AdpcmEncode(AdpcmSetup *set, int blocks)
+{
+	return(AdpcmEncodeChannels(&set, 1, blocks));
 }
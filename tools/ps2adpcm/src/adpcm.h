@@ -11,6 +11,8 @@
 #ifndef _ADPCM_H_
 #define _ADPCM_H_
 
+#include "libadpcm.h"
+
 typedef int (*AdpcmGetPCMfunc)  (void *priv, double *pcm, int len); /* Length in samples */
 typedef int (*AdpcmPutADPCMfunc)(void *priv, void  *data, int len); /* Length in bytes */
 
@@ -18,18 +20,24 @@ typedef struct
 {
 	AdpcmGetPCMfunc   GetPCM;
 	AdpcmPutADPCMfunc PutADPCM;
-	double s_1, s_2;
-	double ps_1, ps_2;
+	AdpcmState state;
 	int curblock;  /* Current block */
 	int loopstart; /* Loop start position, in ADPCM blocks (28 PCM samples) */
 	void *getpriv;
 	void *putpriv;
 	int pad;
+	int threads;   /* Encoder threads */
+	int report;    /* Measure the error of the encoded data */
+	AdpcmDecoder dec;
+	AdpcmStats stats;
 } AdpcmSetup;
 
+#define ADPCM_MAX_CHANNELS 2
+
 AdpcmSetup *AdpcmCreate(AdpcmGetPCMfunc get, void *getpriv, AdpcmPutADPCMfunc put, void *putpriv, int loopstart);
 int AdpcmDestroy(AdpcmSetup *set);
 int AdpcmEncode(AdpcmSetup *set, int blocks);
+int AdpcmEncodeChannels(AdpcmSetup **set, int count, int blocks);
 
 
 #endif
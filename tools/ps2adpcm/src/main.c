@@ -65,14 +65,16 @@ int main(int argc, char *argv[])
 	FILE *fi, *fo;
 	int bpc = 1024; /* ADPCM (16byte, 28sample) blocks per chunk */
 	int loopstart = -1;
-	AdpcmSetup *set[2];
-	PcmBuffer pcm;
-
-	pcm.ChannelCount = 1;
+	int threads = 0; /* Default: one per CPU */
+	int quality = 0;
+	int report = 0;
+	AdpcmSetup *set[ADPCM_MAX_CHANNELS];
+	PcmBuffer pcm[ADPCM_MAX_CHANNELS];
+	int channels = 1;
 
 	if (argc<3)
 	{
-		dprintf("usage:   %s <PCM Input> <ADPCM Output> -s(tereo) -c[chunksize] -l[loopstart]\n", argv[0]);
+		dprintf("usage:   %s <PCM Input> <ADPCM Output> -s(tereo) -c[chunksize] -l[loopstart] -j[threads] -q[width] -r\n", argv[0]);
 		dprintf("example: %s - output.adpcm -s -c1024 -s1000\n", argv[0]);
 
 		return(1);
@@ -92,7 +94,7 @@ int main(int argc, char *argv[])
 		num = strtol(&argv[i][2], NULL, 0);
 		switch(argv[i][1])
 		{
-		case 's': pcm.ChannelCount = 2; break;
+		case 's': channels = 2; break;
 		case 'c':
 			if (num<=0 || num >= 65536)
 			{
@@ -109,6 +111,26 @@ int main(int argc, char *argv[])
 			}
 			loopstart = num;
 			break;
+		case 'j':
+			if (num<=0)
+			{
+				dprintf("%s: invalid thread count (%ld, '%s')\n", argv[0], num, &argv[i][2]);
+				return(1);
+			}
+			threads = num;
+			break;
+		case 'q':
+			/* Beam width of the high quality search */
+			if (argv[i][2] == '\0')
+				num = 4;
+			if (num<1 || num>ADPCM_MAX_QUALITY)
+			{
+				dprintf("%s: invalid quality (%ld, '%s')\n", argv[0], num, &argv[i][2]);
+				return(1);
+			}
+			quality = num;
+			break;
+		case 'r': report = 1; break;
 		default:
 			dprintf("%s: unkown option '%s'\n", argv[0], argv[i]);
 			return(1);
@@ -136,42 +158,52 @@ int main(int argc, char *argv[])
 		return(1);
 	}
 
-	for (int i=0;i<pcm.ChannelCount;i++)
+	for (int i=0;i<channels;i++)
 	{
-		set[i] = AdpcmCreate(GetPCM, &pcm, PutADPCM, fo, loopstart);
+		pcm[i].Channel = i;
+		pcm[i].ChannelCount = channels;
+		set[i] = AdpcmCreate(GetPCM, &pcm[i], PutADPCM, fo, loopstart);
 		if (set[i]==NULL)
 		{
 			dprintf("Failed to create ADPCM setup\n");
 			return(1);
 		}
+		if (threads>0)
+			set[i]->threads = threads;
+		set[i]->state.quality = quality;
+		set[i]->report = report;
 	}
 
-	if (pcm.ChannelCount>1)
+	if (channels>1)
 	{
 		set[0]->pad = 1;
 		set[1]->pad = 1;
 	}
 
-	pcm.Sample = malloc((bpc*28)*pcm.ChannelCount*2);
+	pcm[0].Sample = malloc((bpc*28)*channels*2);
 	do
 	{
 		int i, r;
-		r = fread(pcm.Sample, 2*pcm.ChannelCount, (bpc*28), fi);
+		r = fread(pcm[0].Sample, 2*channels, (bpc*28), fi);
 		if (r<0)
 			break;
-		pcm.SampleCount = r;
 
-		for (i=0;i<pcm.ChannelCount;i++)
+		for (i=0;i<channels;i++)
 		{
-			pcm.Position = 0;
-			pcm.Channel = i;
-			if (AdpcmEncode(set[i], bpc)!=bpc)
-				break;
+			pcm[i].Sample = pcm[0].Sample;
+			pcm[i].SampleCount = r;
+			pcm[i].Position = 0;
 		}
-		if (i!=pcm.ChannelCount)
+		if (AdpcmEncodeChannels(set, channels, bpc)!=bpc)
 			break;
 	} while(1);
-	free(pcm.Sample);
+	free(pcm[0].Sample);
+
+	if (report)
+	{
+		for (int i=0;i<channels;i++)
+			printf("channel %d: SNR %.2f dB, peak error %.0f\n", i, AdpcmSnr(&set[i]->stats), set[i]->stats.peak);
+	}
 
 	return(0);
 }
@@ -0,0 +1,769 @@
+/*
+# _____     ___ ____     ___ ____
+#  ____|   |    ____|   |        | |____|
+# |     ___|   |____ ___|    ____| |    \    PS2DEV Open Source Project.
+#-----------------------------------------------------------------------
+# Copyright 2001-2004, ps2dev - http://www.ps2dev.org
+# Licenced under Academic Free License version 2.0
+# Review ps2sdk README & LICENSE files for further details.
+*/
+
+/* vu0check: checks math3d and libvux, built with their plain C reference
+ * code (VU0_REFERENCE), on the host.
+ *
+ * Every function of math3d.h and libvux.h is checked against another way of
+ * getting the same result: the VU0 functions against their references, the
+ * two libraries against each other, or the math they are meant to do.
+ * With -b, also times the functions that have VU0 versions, for comparing
+ * with the numbers of the VU0 code on the console.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include <math3d.h>
+#include <libvux.h>
+
+#define TRIALS   200
+#define COUNT    1024
+
+static int checks, failures;
+
+static unsigned int seed = 1;
+
+static float rnd(float range)
+{
+	seed = seed * 1103515245 + 12345;
+	return ((float)((seed >> 8) & 0xffff) / 32768.0f - 1.0f) * range;
+}
+
+static void rnd_vector(VECTOR v, float range, float w)
+{
+	v[0] = rnd(range);
+	v[1] = rnd(range);
+	v[2] = rnd(range);
+	v[3] = w;
+}
+
+static void rnd_matrix(MATRIX m, float range)
+{
+	int i;
+
+	for(i=0;i<16;i++)
+		m[i] = rnd(range);
+}
+
+/* A rotation and a translation. */
+static void rnd_rigid(MATRIX m)
+{
+	VECTOR rotation, translation;
+
+	rnd_vector(rotation, 3.0f, 1.0f);
+	rnd_vector(translation, 10.0f, 1.0f);
+	create_local_world(m, translation, rotation);
+}
+
+static int close_to(float a, float b)
+{
+	float scale = 1.0f;
+
+	if(fabsf(a) > scale)
+		scale = fabsf(a);
+	if(fabsf(b) > scale)
+		scale = fabsf(b);
+
+	return fabsf(a - b) <= 1e-4f * scale;
+}
+
+/* Each failing check is only printed once */
+static void check(const char *name, int ok)
+{
+	static const char *failed[64];
+	static int failed_count;
+	int i;
+
+	checks++;
+	if(ok)
+		return;
+
+	failures++;
+	for(i=0;i<failed_count;i++)
+		if(failed[i] == name)
+			return;
+	if(failed_count < 64)
+		failed[failed_count++] = name;
+	printf("FAIL: %s\n", name);
+}
+
+static void check_floats(const char *name, const float *a, const float *b, int count)
+{
+	int i, ok = 1;
+
+	for(i=0;i<count;i++)
+		if(!close_to(a[i], b[i]))
+			ok = 0;
+
+	check(name, ok);
+}
+
+static void check_identity(const char *name, const float *m)
+{
+	MATRIX unit;
+
+	matrix_unit(unit);
+	check_floats(name, m, unit, 16);
+}
+
+static float length3(const float *v)
+{
+	return sqrtf(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+}
+
+/* math3d */
+
+static void check_vector_functions(void)
+{
+	VECTOR a, b, c, out, ref, work;
+	MATRIX m;
+	VU_VECTOR va, vb, vout;
+	VU_MATRIX vm;
+	float f, g;
+	int i, t;
+
+	for(t=0;t<TRIALS;t++) {
+		rnd_vector(a, 10.0f, 1.0f + fabsf(rnd(1.0f)));
+		rnd_vector(b, 10.0f, 1.0f + fabsf(rnd(1.0f)));
+		rnd_vector(c, 10.0f, 1.0f);
+		rnd_matrix(m, 2.0f);
+
+		vector_apply(out, a, m);
+		vector_apply_ref(ref, a, m);
+		check_floats("vector_apply", out, ref, 4);
+		memcpy(&vm, m, sizeof(vm));
+		memcpy(&va, a, sizeof(va));
+		va.w = 1.0f;
+		VuxApplyMatrix(&vm, &va, &vout);
+		check_floats("vector_apply/VuxApplyMatrix", out, &vout.x, 4);
+
+		vector_clamp(out, a, -2.0f, 3.0f);
+		for(i=0;i<4;i++) {
+			f = a[i] < -2.0f ? -2.0f : a[i] > 3.0f ? 3.0f : a[i];
+			check("vector_clamp", out[i] == f);
+		}
+
+		vector_copy(out, a);
+		check("vector_copy", !memcmp(out, a, sizeof(VECTOR)));
+
+		f = vector_innerproduct(a, b);
+		g = (a[0] / a[3]) * (b[0] / b[3]) + (a[1] / a[3]) * (b[1] / b[3]) + (a[2] / a[3]) * (b[2] / b[3]);
+		check("vector_innerproduct", close_to(f, g));
+
+		vector_multiply(out, a, b);
+		for(i=0;i<4;i++)
+			check("vector_multiply", out[i] == a[i] * b[i]);
+
+		vector_normalize(out, a);
+		vector_normalize_ref(ref, a);
+		check_floats("vector_normalize", out, ref, 4);
+		check("vector_normalize/length", close_to(length3(out), 1.0f) && out[3] == 0.0f);
+
+		vector_outerproduct(out, a, b);
+		vector_outerproduct_ref(ref, a, b);
+		check_floats("vector_outerproduct", out, ref, 4);
+		memcpy(&va, a, sizeof(va));
+		memcpy(&vb, b, sizeof(vb));
+		vout = VuxCrossProduct(&va, &vb);
+		check_floats("vector_outerproduct/VuxCrossProduct", out, &vout.x, 3);
+		check("vector_outerproduct/w", out[3] == 0.0f);
+
+		vector_add(out, a, b);
+		for(i=0;i<4;i++)
+			check("vector_add", out[i] == a[i] + b[i]);
+
+		vector_cross_product(out, a, b);
+		check_floats("vector_cross_product", out, &vout.x, 3);
+		check("vector_cross_product/w", out[3] == 1.0f);
+
+		/* The normal of a+c, b+c, as it's calculated */
+		vector_triangle_normal(out, a, b, c);
+		vector_add(work, a, c);
+		vector_add(ref, b, c);
+		check("vector_triangle_normal", close_to(length3(out), 1.0f)
+			&& fabsf(out[0] * work[0] + out[1] * work[1] + out[2] * work[2]) < 1e-3f * length3(work)
+			&& fabsf(out[0] * ref[0] + out[1] * ref[1] + out[2] * ref[2]) < 1e-3f * length3(ref));
+	}
+}
+
+static void check_matrix_functions(void)
+{
+	MATRIX a, b, out, ref, work;
+	VECTOR v, rotation;
+	VU_MATRIX va, vb, vout;
+	VU_VECTOR vv;
+	int i, j, t;
+
+	for(t=0;t<TRIALS;t++) {
+		rnd_matrix(a, 2.0f);
+		rnd_matrix(b, 2.0f);
+		rnd_vector(v, 5.0f, 1.0f);
+
+		matrix_copy(out, a);
+		check("matrix_copy", !memcmp(out, a, sizeof(MATRIX)));
+
+		rnd_rigid(work);
+		matrix_inverse(out, work);
+		matrix_multiply_ref(ref, work, out);
+		check_identity("matrix_inverse", ref);
+
+		matrix_multiply(out, a, b);
+		matrix_multiply_ref(ref, a, b);
+		check_floats("matrix_multiply", out, ref, 16);
+		memcpy(&va, a, sizeof(va));
+		memcpy(&vb, b, sizeof(vb));
+		VuxMulMatrix(&va, &vb, &vout);
+		check_floats("matrix_multiply/VuxMulMatrix", out, &vout.m[0][0], 16);
+
+		/* In place, as matrix_rotate() does */
+		matrix_copy(work, a);
+		matrix_multiply(work, work, b);
+		check_floats("matrix_multiply/in place", work, ref, 16);
+
+		/* One axis at a time, the same as libvux */
+		for(i=0;i<3;i++) {
+			memset(rotation, 0, sizeof(rotation));
+			rotation[i] = rnd(3.0f);
+			matrix_unit(work);
+			matrix_rotate(out, work, rotation);
+			memcpy(&vv, rotation, sizeof(vv));
+			VuxRotMatrix(&vout, &vv);
+			check_floats("matrix_rotate/VuxRotMatrix", out, &vout.m[0][0], 16);
+		}
+		rnd_vector(rotation, 3.0f, 1.0f);
+		matrix_unit(work);
+		matrix_rotate(out, work, rotation);
+		matrix_transpose(ref, out);
+		matrix_multiply_ref(work, out, ref);
+		check_identity("matrix_rotate/orthonormal", work);
+
+		matrix_scale(out, a, v);
+		matrix_unit(work);
+		work[0x00] = v[0];
+		work[0x05] = v[1];
+		work[0x0A] = v[2];
+		matrix_multiply_ref(ref, a, work);
+		check_floats("matrix_scale", out, ref, 16);
+		memcpy(&vout, a, sizeof(vout));
+		memcpy(&vv, v, sizeof(vv));
+		VuxScaleMatrix(&vout, &vv);
+		check_floats("matrix_scale/VuxScaleMatrix", out, &vout.m[0][0], 16);
+
+		matrix_unit(work);
+		matrix_translate(out, work, v);
+		VuxIdMatrix(&vout);
+		VuxTransMatrix(&vout, &vv);
+		check_floats("matrix_translate/VuxTransMatrix", out, &vout.m[0][0], 16);
+
+		matrix_transpose(out, a);
+		for(i=0;i<4;i++)
+			for(j=0;j<4;j++)
+				check("matrix_transpose", out[i * 4 + j] == a[j * 4 + i]);
+
+		matrix_unit(out);
+		VuxIdMatrix(&vout);
+		check("matrix_unit", !memcmp(out, &vout, sizeof(MATRIX)));
+	}
+}
+
+static void check_create_functions(void)
+{
+	MATRIX local_world, local_light, world_view, view_screen, local_screen, ref;
+	VECTOR translation, rotation, origin = { 0.0f, 0.0f, 0.0f, 1.0f }, out;
+	int t;
+
+	for(t=0;t<TRIALS;t++) {
+		rnd_vector(translation, 10.0f, 1.0f);
+		rnd_vector(rotation, 3.0f, 1.0f);
+
+		create_local_world(local_world, translation, rotation);
+		vector_apply(out, origin, local_world);
+		check_floats("create_local_world", out, translation, 4);
+
+		create_local_light(local_light, rotation);
+		check_floats("create_local_light", local_light, local_world, 12);
+
+		/* The camera's position is at the origin of its view */
+		create_world_view(world_view, translation, rotation);
+		vector_apply(out, translation, world_view);
+		check_floats("create_world_view", out, origin, 4);
+
+		create_view_screen(view_screen, 1.5f, -3.0f, 3.0f, -2.0f, 2.0f, 1.0f, 100.0f);
+		check("create_view_screen", close_to(view_screen[0x00], 2.0f / 9.0f) && close_to(view_screen[0x05], 0.5f)
+			&& close_to(view_screen[0x0A], 101.0f / 99.0f) && view_screen[0x0B] == -1.0f
+			&& close_to(view_screen[0x0E], 200.0f / 99.0f) && view_screen[0x0F] == 0.0f);
+
+		create_local_screen(local_screen, local_world, world_view, view_screen);
+		matrix_multiply_ref(ref, local_world, world_view);
+		matrix_multiply_ref(ref, ref, view_screen);
+		check_floats("create_local_screen", local_screen, ref, 16);
+	}
+}
+
+static VECTOR vertices[COUNT], normals[COUNT], colours[COUNT];
+static VECTOR out0[COUNT], out1[COUNT], out2[COUNT], out3[COUNT];
+
+static VECTOR light_directions[5];
+static VECTOR light_colours[5];
+static int light_types[5] = { LIGHT_AMBIENT, LIGHT_DIRECTIONAL, LIGHT_DIRECTIONAL, 7, LIGHT_DIRECTIONAL };
+
+static void create_mesh(MATRIX local_screen, MATRIX local_light)
+{
+	MATRIX local_world, world_view, view_screen;
+	VECTOR position = { 0.0f, 0.0f, 0.0f, 1.0f }, rotation, camera = { 0.0f, 0.0f, 40.0f, 1.0f }, camera_rotation = { 0.0f, 0.0f, 0.0f, 1.0f };
+	int i;
+
+	/* Most vertices in view, some out of it */
+	for(i=0;i<COUNT;i++) {
+		rnd_vector(vertices[i], 20.0f, 1.0f);
+		rnd_vector(normals[i], 1.0f, 1.0f);
+		rnd_vector(colours[i], 1.0f, 1.0f);
+		colours[i][0] = fabsf(colours[i][0]);
+		colours[i][1] = fabsf(colours[i][1]);
+		colours[i][2] = fabsf(colours[i][2]);
+		colours[i][3] = rnd(2.5f);
+	}
+	for(i=0;i<5;i++) {
+		rnd_vector(light_directions[i], 1.0f, 1.0f);
+		rnd_vector(light_colours[i], 1.0f, 1.0f);
+		light_colours[i][0] = fabsf(light_colours[i][0]);
+		light_colours[i][1] = fabsf(light_colours[i][1]);
+		light_colours[i][2] = fabsf(light_colours[i][2]);
+	}
+
+	rnd_vector(rotation, 3.0f, 1.0f);
+	create_local_world(local_world, position, rotation);
+	create_local_light(local_light, rotation);
+	create_world_view(world_view, camera, camera_rotation);
+	create_view_screen(view_screen, 1.33f, -3.0f, 3.0f, -3.0f, 3.0f, 1.0f, 2000.0f);
+	create_local_screen(local_screen, local_world, world_view, view_screen);
+}
+
+static void check_calculate_functions(void)
+{
+	MATRIX local_screen, local_light;
+	math3d_batch_t batch;
+	int i, t, count;
+
+	for(t=0;t<TRIALS / 10;t++) {
+		create_mesh(local_screen, local_light);
+		count = COUNT - (t & 1);
+
+		calculate_normals(out0, count, normals, local_light);
+		calculate_normals_ref(out1, count, normals, local_light);
+		check_floats("calculate_normals", out0[0], out1[0], count * 4);
+		calculate_normals_batch(out2, count, normals, local_light);
+		check_floats("calculate_normals_batch", out2[0], out1[0], count * 4);
+
+		calculate_vertices(out0, count, vertices, local_screen);
+		calculate_vertices_ref(out1, count, vertices, local_screen);
+		check_floats("calculate_vertices", out0[0], out1[0], count * 4);
+		calculate_vertices_batch(out2, count, vertices, local_screen);
+		check_floats("calculate_vertices_batch", out2[0], out1[0], count * 4);
+
+		/* The separate functions against the single pass, and the single pass
+		 * against its reference. The light with the unknown type is skipped by both. */
+		check("create_batch", create_batch(&batch, local_screen, local_light, light_directions, light_colours, light_types, 5) == 0);
+		calculate_normals(out0, count, normals, local_light);
+		calculate_lights(out1, count, out0, light_directions, light_colours, light_types, 5);
+		for(i=0;i<count;i++)
+			out2[i][3] = colours[i][3];
+		calculate_colours(out2, count, colours, out1);
+		calculate_vertices(out1, count, vertices, local_screen);
+
+		calculate_batch(out0, out3, count, vertices, normals, colours, &batch);
+		check_floats("calculate_batch/vertices", out0[0], out1[0], count * 4);
+		check_floats("calculate_batch/colours", out3[0], out2[0], count * 4);
+		calculate_batch_ref(out1, out2, count, vertices, normals, colours, &batch);
+		check_floats("calculate_batch_ref/vertices", out1[0], out0[0], count * 4);
+		check_floats("calculate_batch_ref/colours", out2[0], out3[0], count * 4);
+	}
+
+	for(i=0;i<5;i++)
+		light_types[i] = LIGHT_DIRECTIONAL;
+	check("create_batch/too many lights", create_batch(&batch, local_screen, local_light, light_directions, light_colours, light_types, 5) < 0);
+	light_types[0] = LIGHT_AMBIENT;
+	light_types[3] = 7;
+}
+
+/* libvux */
+
+static void rnd_vu_matrix(VU_MATRIX *m, float range)
+{
+	int i, j;
+
+	for(i=0;i<4;i++)
+		for(j=0;j<4;j++)
+			m->m[i][j] = rnd(range);
+}
+
+static void rnd_vu_vector(VU_VECTOR *v, float range, float w)
+{
+	v->x = rnd(range);
+	v->y = rnd(range);
+	v->z = rnd(range);
+	v->w = w;
+}
+
+static void check_vu0_functions(void)
+{
+	VU_MATRIX a, b, out, ref;
+	VU_VECTOR v, w, vout, vref;
+	int t;
+
+	for(t=0;t<TRIALS;t++) {
+		rnd_vu_matrix(&a, 2.0f);
+		rnd_vu_matrix(&b, 2.0f);
+		rnd_vu_vector(&v, 5.0f, 1.0f);
+		rnd_vu_vector(&w, 5.0f, rnd(2.0f));
+
+		VuxIdMatrix(&ref);
+		Vu0IdMatrix(&out);
+		check("Vu0IdMatrix", !memcmp(&out, &ref, sizeof(out)));
+		out = a;
+		Vu0ResetMatrix(&out);
+		check("Vu0ResetMatrix", !memcmp(&out, &ref, sizeof(out)));
+
+		out = ref = a;
+		Vu0TransMatrix(&out, &v);
+		VuxTransMatrix(&ref, &v);
+		check_floats("Vu0TransMatrix", &out.m[0][0], &ref.m[0][0], 16);
+		out = ref = a;
+		Vu0TransMatrixXYZ(&out, v.x, v.y, v.z);
+		VuxTransMatrixXYZ(&ref, v.x, v.y, v.z);
+		check_floats("Vu0TransMatrixXYZ", &out.m[0][0], &ref.m[0][0], 16);
+
+		/* Vu0ScaleMatrix() only scales the diagonal, which is the same on scaling matrices */
+		VuxIdMatrix(&out);
+		VuxScaleMatrix(&out, &w);
+		ref = out;
+		Vu0ScaleMatrix(&out, &v);
+		VuxScaleMatrix(&ref, &v);
+		check_floats("Vu0ScaleMatrix", &out.m[0][0], &ref.m[0][0], 16);
+		VuxIdMatrix(&out);
+		VuxScaleMatrix(&out, &w);
+		ref = out;
+		Vu0ScaleMatrixXYZ(&out, v.x, v.y, v.z);
+		VuxScaleMatrixXYZ(&ref, v.x, v.y, v.z);
+		check_floats("Vu0ScaleMatrixXYZ", &out.m[0][0], &ref.m[0][0], 16);
+
+		Vu0MulMatrix(&a, &b, &out);
+		VuxMulMatrix(&a, &b, &ref);
+		check_floats("Vu0MulMatrix", &out.m[0][0], &ref.m[0][0], 16);
+
+		Vu0ApplyMatrix(&a, &w, &vout);
+		VuxApplyMatrix(&a, &w, &vref);
+		check_floats("Vu0ApplyMatrix", &vout.x, &vref.x, 4);
+		vout = w;
+		Vu0ApplyMatrix(&a, &vout, &vout);
+		check_floats("Vu0ApplyMatrix/in place", &vout.x, &vref.x, 4);
+
+		Vu0ApplyRotMatrix(&a, &w, &vout);
+		VuxApplyRotMatrix(&a, &w, &vref);
+		check_floats("Vu0ApplyRotMatrix", &vout.x, &vref.x, 4);
+
+		Vu0CopyMatrix(&out, &a);
+		VuxCopyMatrix(&ref, &a);
+		check("Vu0CopyMatrix", !memcmp(&out, &a, sizeof(out)) && !memcmp(&ref, &a, sizeof(ref)));
+
+		check("Vu0DotProduct", close_to(Vu0DotProduct(&v, &w), VuxDotProduct(&v, &w)));
+	}
+}
+
+static void check_vux_functions(void)
+{
+	VU_MATRIX a, out, ref, work;
+	VU_VECTOR v, w, vout, vref, up = { 0.0f, 1.0f, 0.0f, 1.0f };
+	float f;
+	int t;
+
+	for(t=0;t<TRIALS;t++) {
+		rnd_vu_matrix(&a, 2.0f);
+		rnd_vu_vector(&v, 3.0f, 1.0f);
+		rnd_vu_vector(&w, 5.0f, 1.0f);
+
+		VuxRotMatrix(&out, &v);
+		VuxRotMatrixXYZ(&ref, v.x, v.y, v.z);
+		check_floats("VuxRotMatrixXYZ", &out.m[0][0], &ref.m[0][0], 16);
+		VuxIdMatrix(&ref);
+		VuxRotMatrixX(&ref, v.x);
+		VuxIdMatrix(&work);
+		VuxRotMatrixZ(&work, v.z);
+		VuxMulMatrix(&work, &ref, &ref);
+		VuxIdMatrix(&work);
+		VuxRotMatrixY(&work, v.y);
+		VuxMulMatrix(&work, &ref, &ref);
+		check_floats("VuxRotMatrixX/Y/Z", &out.m[0][0], &ref.m[0][0], 16);
+
+		/* Only well conditioned matrices give an exact enough identity, so
+		 * those whose inverse inverts back to them */
+		VuxInverseMatrix(&a, &out);
+		VuxMulMatrix(&a, &out, &ref);
+		VuxInverseMatrix(&out, &work);
+		if(fabsf(work.m[0][0] - a.m[0][0]) < 1e-2f)
+			check_identity("VuxInverseMatrix", &ref.m[0][0]);
+
+		vout = VuxCrossProduct(&v, &w);
+		VuxCrossProduct0(&v, &w, &vref);
+		check_floats("VuxCrossProduct0", &vout.x, &vref.x, 3);
+		check("VuxCrossProduct", fabsf(VuxDotProduct(&vout, &v)) < 1e-3f * length3(&vout.x) * length3(&v.x));
+
+		vout = w;
+		VuxVectorNormal(&vout);
+		VuxVectorNormal0(&w, &vref);
+		check_floats("VuxVectorNormal0", &vout.x, &vref.x, 4);
+		f = sqrtf(vout.x * vout.x + vout.y * vout.y + vout.z * vout.z + vout.w * vout.w);
+		check("VuxVectorNormal", close_to(f, 1.0f));
+
+		VuSetLocalScreenMatrix(&a);
+		VuxApplyMatrixLS(&w, &vout);
+		VuxApplyMatrix(&a, &w, &vref);
+		check_floats("VuxApplyMatrixLS", &vout.x, &vref.x, 4);
+		VuxApplyRotMatrixLS(&w, &vout);
+		VuxApplyRotMatrix(&a, &w, &vref);
+		check_floats("VuxApplyRotMatrixLS", &vout.x, &vref.x, 4);
+
+		VuxRotMatrix(&work, &v);
+		VuxMakeLocalScreenMatrix(&out, &a, &work);
+		VuxMulMatrix(&a, &work, &ref);
+		check_floats("VuxMakeLocalScreenMatrix", &out.m[0][0], &ref.m[0][0], 16);
+		VuxMakeLocalScreenMatrix2(&out, &a, &work, &a);
+		VuxMulMatrix(&ref, &a, &ref);
+		check_floats("VuxMakeLocalScreenMatrix2", &out.m[0][0], &ref.m[0][0], 16);
+
+		/* The view matrix undoes the camera's own */
+		{
+			VU_VECTOR scale = { 1.0f + fabsf(rnd(1.0f)), 1.0f + fabsf(rnd(1.0f)), 1.0f + fabsf(rnd(1.0f)), 1.0f };
+
+			VuxMakeViewMatrix(&out, &v, &w, &scale);
+			VuxResetMatrix(&work);
+			VuxRotMatrix(&work, &v);
+			VuxTransMatrix(&work, &w);
+			VuxScaleMatrix(&work, &scale);
+			VuxMulMatrix(&work, &out, &ref);
+			check_identity("VuxMakeViewMatrix", &ref.m[0][0]);
+		}
+
+		/* The eye is at the origin, looking down z */
+		rnd_vu_vector(&vref, 5.0f, 1.0f);
+		VuxMakeLookAtViewMatrix(&out, &w, &vref, &up);
+		VuxApplyMatrix(&out, &w, &vout);
+		check("VuxMakeLookAtViewMatrix/eye", close_to(vout.x + 1.0f, 1.0f) && close_to(vout.y + 1.0f, 1.0f) && close_to(vout.z + 1.0f, 1.0f));
+		VuxApplyMatrix(&out, &vref, &vout);
+		check("VuxMakeLookAtViewMatrix/target", close_to(vout.x + 1.0f, 1.0f) && close_to(vout.y + 1.0f, 1.0f) && vout.z > 0.0f);
+
+		VuxMakeProjectionMatrix(&out, 320.0f, 240.0f, 10.0f, 1000.0f);
+		check("VuxMakeProjectionMatrix", close_to(out.m[0][0], 10.0f / 320.0f) && close_to(out.m[1][1], 10.0f / 240.0f)
+			&& close_to(out.m[2][2], 1000.0f / 990.0f) && out.m[2][3] == 1.0f && close_to(out.m[3][2], -10000.0f / 990.0f)
+			&& out.m[3][3] == 1.0f);
+	}
+}
+
+static void check_vux_pipeline(void)
+{
+	VU_MATRIX world, view, projection, ref;
+	VU_VECTOR v[3], tv[3], tref[3], pos = { 0.0f, 0.0f, -50.0f, 1.0f }, rot = { 0.0f, 0.0f, 0.0f, 1.0f }, scale = { 1.0f, 1.0f, 1.0f, 1.0f };
+	VU_SXYZ s[3], sref[3];
+	VU_FLAT_LIGHT light;
+	VU_CVECTOR colour = { 100, 50, 25, 0x80, 1.0f }, out;
+	float f;
+	int i, t, type, area;
+
+	VuInit();
+	VuSetGeometryXYOffset(2048, 2048);
+	VuSetProjectionNearPlaneWH(320, 240);
+	VuSetAmbientLight(0.2f, 0.3f, 0.4f);
+
+	for(type=0;type<2;type++) {
+		for(t=0;t<TRIALS;t++) {
+			VuxRotMatrixXYZ(&world, rnd(3.0f), rnd(3.0f), rnd(3.0f));
+			VuxMakeViewMatrix(&view, &rot, &pos, &scale);
+			VuxMakeProjectionMatrix(&projection, 320.0f, 240.0f, 1.0f, 1000.0f);
+			VuSetWorldMatrix(&world);
+			VuSetViewMatrix(&view);
+			if(type == 0) {
+				VuSetProjection(500.0f);
+			} else {
+				VuSetProjectionMatrix(&projection);
+				VuSetProjectionType(1);
+			}
+
+			VuxUpdateLocalScreenMatrix();
+			VuxMulMatrix(&world, &view, &ref);
+			if(type == 1)
+				VuxMulMatrix(&ref, &projection, &ref);
+			check("VuxUpdateLocalScreenMatrix", !memcmp(&ref, &VuLocalScreenMatrix, sizeof(ref)));
+			check("VuSetWorldMatrix", !memcmp(&world, &VuWorldMatrix, sizeof(world)));
+			check("VuSetViewMatrix", !memcmp(&view, &VuViewMatrix, sizeof(view)));
+
+			for(i=0;i<3;i++)
+				rnd_vu_vector(&v[i], 10.0f, 1.0f);
+
+			for(i=0;i<3;i++)
+				VuxApplyMatrixLS(&v[i], &tref[i]);
+			VuxRotTrans(&v[0], &tv[0]);
+			check_floats("VuxRotTrans", &tv[0].x, &tref[0].x, 4);
+			VuxRotTrans3(&v[0], &v[1], &v[2], &tv[0], &tv[1], &tv[2]);
+			check_floats("VuxRotTrans3", &tv[0].x, &tref[0].x, 12);
+			memset(tv, 0, sizeof(tv));
+			VuxRotTransN(v, tv, 3);
+			check_floats("VuxRotTransN", &tv[0].x, &tref[0].x, 12);
+
+			for(i=0;i<3;i++)
+				VuxPers(&tv[i], &sref[i]);
+			VuxPers3(&tv[0], &tv[1], &tv[2], &s[0], &s[1], &s[2]);
+			check("VuxPers3", !memcmp(s, sref, sizeof(s)));
+			memset(s, 0, sizeof(s));
+			VuxPersN(tv, s, 3);
+			check("VuxPersN", !memcmp(s, sref, sizeof(s)));
+			memset(s, 0, sizeof(s));
+			area = VuxPersClip3(&tv[0], &tv[1], &tv[2], &s[0], &s[1], &s[2]);
+			check("VuxPersClip3", !memcmp(s, sref, sizeof(s)) && area == VuxClipSxyz(&sref[0], &sref[1], &sref[2]));
+			check("VuxClipSxyz", area == (sref[1].x - sref[0].x) * (sref[2].y - sref[0].y) - (sref[2].x - sref[0].x) * (sref[1].y - sref[0].y));
+
+			/* The screen position of the projected center of the view */
+			if(type == 0) {
+				VU_VECTOR center = { 0.0f, 0.0f, 30.0f, 1.0f };
+
+				VuxPers(&center, &s[0]);
+				check("VuxPers", s[0].x == 2048 * 16 && s[0].y == 2048 * 16);
+			}
+
+			memset(s, 0, sizeof(s));
+			f = VuxRotTransPers(&v[0], &s[0]);
+			check("VuxRotTransPers", !memcmp(&s[0], &sref[0], sizeof(s[0])) && f == tref[0].z);
+			memset(s, 0, sizeof(s));
+			f = VuxRotTransPers3(&v[0], &v[1], &v[2], &s[0], &s[1], &s[2]);
+			check("VuxRotTransPers3", !memcmp(s, sref, sizeof(s)) && f == tref[0].z);
+			memset(s, 0, sizeof(s));
+			VuxRotTransPersN(v, s, 3);
+			check("VuxRotTransPersN", !memcmp(s, sref, sizeof(s)));
+			memset(s, 0, sizeof(s));
+			area = VuxRotTransPersClip3(&v[0], &v[1], &v[2], &s[0], &s[1], &s[2]);
+			check("VuxRotTransPersClip3", !memcmp(s, sref, sizeof(s)) && area == VuxClipSxyz(&sref[0], &sref[1], &sref[2]));
+		}
+	}
+
+	rnd_vu_vector(&v[0], 1.0f, 1.0f);
+	VuxVectorNormal(&v[0]);
+	rnd_vu_vector(&light.direction, 1.0f, 1.0f);
+	light.color.r = 0.5f;
+	light.color.g = 0.6f;
+	light.color.b = 0.7f;
+	light.color.a = 1.0f;
+
+	VuxLightNormal(&v[0], &colour, &light, VU_LIGHT_TYPE_FLAT, &out);
+	f = -VuxDotProduct(&v[0], &light.direction);
+	if(f < 0.0f)
+		f = 0.0f;
+	check("VuxLightNormal/flat", out.r == (unsigned char)((0.2f + 100 * 0.0078125f * f * 0.5f) * 128.0f)
+		&& out.g == (unsigned char)((0.3f + 50 * 0.0078125f * f * 0.6f) * 128.0f)
+		&& out.b == (unsigned char)((0.4f + 25 * 0.0078125f * f * 0.7f) * 128.0f)
+		&& out.a == 0x80 && out.q == 1.0f);
+	VuxLightNormal(&v[0], &colour, NULL, 0, &out);
+	check("VuxLightNormal", out.r == (unsigned char)((0.2f + 100 * 0.0078125f) * 128.0f)
+		&& out.g == (unsigned char)((0.3f + 50 * 0.0078125f) * 128.0f)
+		&& out.b == (unsigned char)((0.4f + 25 * 0.0078125f) * 128.0f));
+}
+
+/* Benchmarks */
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+#define RUNS 64
+
+/* Best time of RUNS runs of count items, in ns per item */
+#define BENCH(name, count, call) do { \
+	double start, best = 1e30, elapsed; \
+	int run; \
+	for(run=0;run<RUNS;run++) { \
+		start = now(); \
+		call; \
+		elapsed = now() - start; \
+		if(elapsed < best) \
+			best = elapsed; \
+	} \
+	printf("%-28s %8.2f ns\n", name, best / (count)); \
+} while(0)
+
+static void bench(void)
+{
+	MATRIX local_screen, local_light, m[COUNT / 16];
+	VU_MATRIX vm;
+	VU_SXYZ sxyz[COUNT];
+	math3d_batch_t batch;
+	int i;
+
+	create_mesh(local_screen, local_light);
+	create_batch(&batch, local_screen, local_light, light_directions, light_colours, light_types, 5);
+	memcpy(&vm, local_screen, sizeof(vm));
+	VuSetLocalScreenMatrix(&vm);
+	VuSetProjection(500.0f);
+
+	printf("%d items, best of %d runs, per item:\n", COUNT, RUNS);
+
+	BENCH("vector_apply", COUNT, for(i=0;i<COUNT;i++) vector_apply(out0[i], vertices[i], local_screen));
+	BENCH("vector_normalize", COUNT, for(i=0;i<COUNT;i++) vector_normalize(out0[i], normals[i]));
+	BENCH("matrix_multiply", COUNT / 16, for(i=0;i<COUNT/16;i++) matrix_multiply(m[i], local_screen, local_light));
+	BENCH("calculate_normals", COUNT, calculate_normals(out0, COUNT, normals, local_light));
+	BENCH("calculate_normals_batch", COUNT, calculate_normals_batch(out0, COUNT, normals, local_light));
+	BENCH("calculate_vertices", COUNT, calculate_vertices(out0, COUNT, vertices, local_screen));
+	BENCH("calculate_vertices_batch", COUNT, calculate_vertices_batch(out0, COUNT, vertices, local_screen));
+	BENCH("calculate_batch", COUNT, calculate_batch(out0, out1, COUNT, vertices, normals, colours, &batch));
+	BENCH("Vu0ApplyMatrix", COUNT, for(i=0;i<COUNT;i++) Vu0ApplyMatrix(&vm, (VU_VECTOR *)vertices[i], (VU_VECTOR *)out0[i]));
+	BENCH("Vu0MulMatrix", COUNT / 16, for(i=0;i<COUNT/16;i++) Vu0MulMatrix(&vm, &vm, (VU_MATRIX *)m[i]));
+	BENCH("VuxRotTransPersN", COUNT, VuxRotTransPersN((VU_VECTOR *)vertices, sxyz, COUNT));
+}
+
+static void usage(void)
+{
+	printf("Usage: vu0check [-b]\n");
+	printf("Checks math3d and libvux built with their reference code.\n");
+	printf("  -b  also time the functions that have VU0 versions\n");
+}
+
+int main(int argc, char *argv[])
+{
+	int benchmark = 0, i;
+
+	for(i=1;i<argc;i++) {
+		if(!strcmp(argv[i], "-b")) {
+			benchmark = 1;
+		} else {
+			usage();
+			return 1;
+		}
+	}
+
+	check_vector_functions();
+	check_matrix_functions();
+	check_create_functions();
+	check_calculate_functions();
+	check_vu0_functions();
+	check_vux_functions();
+	check_vux_pipeline();
+
+	printf("%d checks, %d failed\n", checks, failures);
+
+	if(benchmark)
+		bench();
+
+	return failures != 0;
+}